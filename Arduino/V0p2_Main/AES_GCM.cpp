@@ -0,0 +1,221 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): agent 2026
+*/
+
+/*
+ Compact AES-128-GCM authenticated encryption.
+
+ Portable: builds for AVR (S-box kept in Flash) and for a host.
+ */
+
+#include <string.h>
+
+#include "AES_GCM.h"
+
+#if defined(ARDUINO)
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(p) (*(p))
+#endif
+
+
+// AES forward S-box.
+static const uint8_t sbox[256] PROGMEM =
+  {
+  0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+  0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+  0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+  0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+  0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+  0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+  0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+  0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+  0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+  0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+  0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+  0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+  0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+  0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+  0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+  0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+  };
+static inline uint8_t sub(const uint8_t b) { return(pgm_read_byte(sbox + b)); }
+
+// Multiply by x (ie 2) in GF(2^8) with the AES polynomial.
+static inline uint8_t xtime(const uint8_t b) { return((uint8_t)((b << 1) ^ ((b & 0x80) ? 0x1b : 0))); }
+
+// Steps the round key rk in place to the next one, using and then updating round constant rcon.
+static void nextRoundKey(uint8_t *const rk, uint8_t &rcon)
+  {
+  rk[0] ^= sub(rk[13]) ^ rcon;
+  rk[1] ^= sub(rk[14]);
+  rk[2] ^= sub(rk[15]);
+  rk[3] ^= sub(rk[12]);
+  for(uint8_t i = 4; i < 16; ++i) { rk[i] ^= rk[i-4]; }
+  rcon = xtime(rcon);
+  }
+
+// Encrypts one 16-byte block in place with a 16-byte AES-128 key.
+// Round keys are derived on the fly so the key itself is not modified.
+void aes128EncryptBlock(const uint8_t *const key, uint8_t *const block)
+  {
+  uint8_t rk[16];
+  memcpy(rk, key, 16);
+  uint8_t rcon = 1;
+  for(uint8_t i = 0; i < 16; ++i) { block[i] ^= rk[i]; }
+  for(uint8_t round = 1; ; ++round)
+    {
+    // SubBytes and ShiftRows together; state is column-major, ie byte 4c+r is row r of column c.
+    uint8_t t;
+    block[0] = sub(block[0]); block[4] = sub(block[4]); block[8] = sub(block[8]); block[12] = sub(block[12]);
+    t = block[1]; block[1] = sub(block[5]); block[5] = sub(block[9]); block[9] = sub(block[13]); block[13] = sub(t);
+    t = block[2]; block[2] = sub(block[10]); block[10] = sub(t); t = block[6]; block[6] = sub(block[14]); block[14] = sub(t);
+    t = block[15]; block[15] = sub(block[11]); block[11] = sub(block[7]); block[7] = sub(block[3]); block[3] = sub(t);
+    nextRoundKey(rk, rcon);
+    if(10 == round) { break; } // Final round has no MixColumns.
+    // MixColumns.
+    for(uint8_t c = 0; c < 16; c += 4)
+      {
+      uint8_t *const s = block + c;
+      const uint8_t a0 = s[0], all = s[0] ^ s[1] ^ s[2] ^ s[3];
+      s[0] ^= all ^ xtime(s[0] ^ s[1]);
+      s[1] ^= all ^ xtime(s[1] ^ s[2]);
+      s[2] ^= all ^ xtime(s[2] ^ s[3]);
+      s[3] ^= all ^ xtime(s[3] ^ a0);
+      }
+    for(uint8_t i = 0; i < 16; ++i) { block[i] ^= rk[i]; }
+    }
+  for(uint8_t i = 0; i < 16; ++i) { block[i] ^= rk[i]; }
+  memset(rk, 0, sizeof(rk)); // Don't leave key material lying around on the stack.
+  }
+
+// Multiplies x in place by h in GF(2^128) as defined for GHASH (bit-reflected, polynomial x^128 + x^7 + x^2 + x + 1).
+// Bitwise: small and constant-time, but ~128 times the work of one 16-byte XOR.
+static void gfMul(uint8_t *const x, const uint8_t *const h)
+  {
+  uint8_t z[16], v[16];
+  memset(z, 0, 16);
+  memcpy(v, h, 16);
+  for(uint8_t i = 0; i < 16; ++i)
+    {
+    const uint8_t xi = x[i];
+    for(uint8_t m = 0x80; 0 != m; m >>= 1)
+      {
+      const uint8_t mask = (0 != (xi & m)) ? 0xff : 0;
+      for(uint8_t j = 0; j < 16; ++j) { z[j] ^= v[j] & mask; }
+      const uint8_t reduce = (0 != (v[15] & 1)) ? 0xe1 : 0;
+      for(uint8_t j = 15; j > 0; --j) { v[j] = (uint8_t)((v[j] >> 1) | (v[j-1] << 7)); }
+      v[0] = (uint8_t)((v[0] >> 1) ^ reduce);
+      }
+    }
+  memcpy(x, z, 16);
+  }
+
+// Absorbs len bytes of data (zero-padded to a whole number of blocks) into GHASH accumulator y with hash key h.
+static void ghash(uint8_t *const y, const uint8_t *const h, const uint8_t *data, uint8_t len)
+  {
+  while(len > 0)
+    {
+    const uint8_t n = (len > 16) ? 16 : len;
+    for(uint8_t i = 0; i < n; ++i) { y[i] ^= data[i]; }
+    gfMul(y, h);
+    data += n;
+    len -= n;
+    }
+  }
+
+// Working state shared by encryption and decryption.
+typedef struct
+  {
+  uint8_t h[16]; // Hash key E(K, 0^128).
+  uint8_t y[16]; // GHASH accumulator.
+  uint8_t cb[16]; // Counter block, initially J0 = nonce || 0^31 || 1.
+  } gcmState_t;
+
+// Sets up hash key and counter block, and absorbs the AAD.
+static void gcmStart(gcmState_t *const s, const uint8_t *const key, const uint8_t *const nonce, const uint8_t *const aad, const uint8_t aadLen)
+  {
+  memset(s, 0, sizeof(gcmState_t));
+  aes128EncryptBlock(key, s->h);
+  memcpy(s->cb, nonce, AES_GCM_NONCE_BYTES);
+  s->cb[15] = 1;
+  ghash(s->y, s->h, aad, aadLen);
+  }
+
+// Absorbs the lengths block and computes the full 16-byte tag into s->y; aadLen and len are in bytes.
+static void gcmFinish(gcmState_t *const s, const uint8_t *const key, const uint8_t aadLen, const uint8_t len)
+  {
+  uint8_t lengths[16];
+  memset(lengths, 0, 16);
+  lengths[6] = aadLen >> 5; lengths[7] = aadLen << 3; // Lengths in bits, big-endian 64-bit.
+  lengths[14] = len >> 5; lengths[15] = len << 3;
+  ghash(s->y, s->h, lengths, 16);
+  memcpy(lengths, s->cb, 16); // Reuse as E(K, J0) tag mask, leaving the counter block free for CTR.
+  lengths[15] = 1;
+  aes128EncryptBlock(key, lengths);
+  for(uint8_t i = 0; i < 16; ++i) { s->y[i] ^= lengths[i]; }
+  }
+
+// CTR-mode en/decryption of len bytes from in to out starting at counter block inc32(J0); up to 255 bytes so one counter byte suffices.
+static void gcmCTR(gcmState_t *const s, const uint8_t *const key, const uint8_t *in, uint8_t len, uint8_t *out)
+  {
+  uint8_t ks[16];
+  while(len > 0)
+    {
+    ++(s->cb[15]);
+    memcpy(ks, s->cb, 16);
+    aes128EncryptBlock(key, ks);
+    const uint8_t n = (len > 16) ? 16 : len;
+    for(uint8_t i = 0; i < n; ++i) { *out++ = *in++ ^ ks[i]; }
+    len -= n;
+    }
+  }
+
+// AES-128-GCM authenticated encryption (NIST SP 800-38D) with a 96-bit nonce.
+void aes128GCMEncrypt(const uint8_t *const key, const uint8_t *const nonce,
+    const uint8_t *const aad, const uint8_t aadLen,
+    const uint8_t *const in, const uint8_t len, uint8_t *const out,
+    uint8_t *const tag, const uint8_t tagLen)
+  {
+  gcmState_t s;
+  gcmStart(&s, key, nonce, aad, aadLen);
+  gcmCTR(&s, key, in, len, out);
+  ghash(s.y, s.h, out, len);
+  gcmFinish(&s, key, aadLen, len);
+  memcpy(tag, s.y, (tagLen > AES_GCM_MAX_TAG_BYTES) ? AES_GCM_MAX_TAG_BYTES : tagLen);
+  memset(&s, 0, sizeof(s));
+  }
+
+// AES-128-GCM authenticated decryption (NIST SP 800-38D) with a 96-bit nonce.
+bool aes128GCMDecrypt(const uint8_t *const key, const uint8_t *const nonce,
+    const uint8_t *const aad, const uint8_t aadLen,
+    const uint8_t *const in, const uint8_t len, uint8_t *const out,
+    const uint8_t *const tag, const uint8_t tagLen)
+  {
+  if((0 == tagLen) || (tagLen > AES_GCM_MAX_TAG_BYTES)) { return(false); }
+  gcmState_t s;
+  gcmStart(&s, key, nonce, aad, aadLen);
+  ghash(s.y, s.h, in, len);
+  gcmFinish(&s, key, aadLen, len);
+  // Compare without early exit so as not to leak how much of the tag matched.
+  uint8_t diff = 0;
+  for(uint8_t i = 0; i < tagLen; ++i) { diff |= s.y[i] ^ tag[i]; }
+  if(0 == diff) { gcmCTR(&s, key, in, len, out); }
+  memset(&s, 0, sizeof(s));
+  return(0 == diff);
+  }
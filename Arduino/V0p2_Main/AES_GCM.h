@@ -0,0 +1,83 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): agent 2026
+*/
+
+/*
+ Compact AES-128-GCM authenticated encryption for secure leaf frames.
+
+ Deliberately free of Arduino/V0p2 dependencies (only <stdint.h> and <string.h>)
+ so that the same code can be built into host-side tools and checked against
+ the Java implementation (javasrc/uk/org/opentrv/test/leafauthenc/AESGCMTest.java).
+
+ Sized for the ATmega328P rather than for raw speed:
+   * the 256-byte S-box lives in Flash and nothing is table-driven beyond that;
+   * the AES key schedule is computed on the fly one round key at a time,
+     so no 176-byte expanded key is ever held in RAM;
+   * GHASH is a plain bitwise GF(2^128) multiply with no per-key tables.
+ All working state is on the stack and is about 130 bytes at the deepest point
+ (AES_GCM_STACK_BYTES, excluding call overhead); there is no static RAM use at all.
+
+ Estimated cost at 1MHz CPU clock (ie 8MHz crystal/RC prescaled by 8) on ATmega328P, avr-gcc -Os,
+ by instruction counting of the inner loops (not yet timed on hardware):
+   * one AES-128 block with on-the-fly key schedule: ~7k cycles (~7ms);
+   * one GHASH block (128 constant-time conditional 16-byte XORs and 1-bit shifts): ~45k cycles (~45ms).
+ A secure full stats frame (<= 16 bytes of body, 4 bytes of AAD, 16-byte tag)
+ needs 3 AES blocks (hash key, one counter block, tag mask) and 3 GHASH blocks (AAD, body, lengths),
+ so ~155k cycles (~0.16s at 1MHz) to encrypt, or to verify and decrypt;
+ GHASH dominates, and could be traded for 256 bytes of RAM with a 4-bit table if ever needed.
+ */
+
+#ifndef AES_GCM_H
+#define AES_GCM_H
+
+#include <stdint.h>
+
+
+// AES block and key sizes in bytes (AES-128 only).
+#define AES128_BLOCK_BYTES 16
+#define AES128_KEY_BYTES 16
+// GCM nonce (IV) size in bytes; only the recommended 96-bit nonce is supported.
+#define AES_GCM_NONCE_BYTES 12
+// Largest tag in bytes; shorter (truncated) tags may be used at reduced authentication strength.
+#define AES_GCM_MAX_TAG_BYTES 16
+// Approximate worst-case stack usage in bytes of aes128GCMEncrypt()/aes128GCMDecrypt(), excluding call overhead.
+#define AES_GCM_STACK_BYTES 130
+
+// Encrypts one 16-byte block in place with a 16-byte AES-128 key.
+// Round keys are derived on the fly so the key itself is not modified.
+void aes128EncryptBlock(const uint8_t *key, uint8_t *block);
+
+// AES-128-GCM authenticated encryption (NIST SP 800-38D) with a 96-bit nonce.
+// Encrypts len bytes from in to out (which may be the same buffer),
+// authenticating them along with aadLen bytes of additional (unencrypted) data aad,
+// and writes a tag of tagLen bytes [1,AES_GCM_MAX_TAG_BYTES].
+// A nonce must never be reused with the same key.
+void aes128GCMEncrypt(const uint8_t *key, const uint8_t *nonce,
+    const uint8_t *aad, uint8_t aadLen,
+    const uint8_t *in, uint8_t len, uint8_t *out,
+    uint8_t *tag, uint8_t tagLen);
+
+// AES-128-GCM authenticated decryption (NIST SP 800-38D) with a 96-bit nonce.
+// Checks the tagLen-byte tag over the aadLen bytes of aad and the len bytes of ciphertext in,
+// and only if it matches decrypts in to out (which may be the same buffer) and returns true.
+// Returns false, with out untouched, if authentication fails.
+bool aes128GCMDecrypt(const uint8_t *key, const uint8_t *nonce,
+    const uint8_t *aad, uint8_t aadLen,
+    const uint8_t *in, uint8_t len, uint8_t *out,
+    const uint8_t *tag, uint8_t tagLen);
+
+#endif
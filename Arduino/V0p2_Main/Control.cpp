@@ -313,9 +313,62 @@ OccupancyTracker Occupancy;
 #define OCCCP_SHIFT 0
 #endif
 
+// Update the Bayesian occupancy estimate by one minute.
+// Probabilities are fixed point in [0,0xffff] for [0,1].
+void OccupancyTracker::updateEstimate()
+  {
+  // Take the strongest evidence heard since the last update, if any.
+  uint8_t lrX16;
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE) { lrX16 = pendingEvidenceLRX16; pendingEvidenceLRX16 = 0; }
+
+  // Prior probability of occupancy for this hour from the smoothed stats, else even odds,
+  // kept away from certainty, with the odds raised 4x while a WARM schedule is on.
+  const uint8_t occpc = getByHourStat(getHoursLT(), EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED);
+  uint8_t priorPC = (STATS_UNSET_BYTE == occpc) ? 50 : constrain(occpc, 2, 98);
+  if(isAnyScheduleOnWARMNow()) { priorPC = (uint8_t)((400U * priorPC) / (100U + 3U * priorPC)); }
+  const uint16_t prior = (uint16_t)((((uint32_t)priorPC) << 16) / 100U);
+
+  // Transition: occupants leave at a rate of 1/dwellM and arrive at whatever rate holds the prior steady,
+  // so with no other information the estimate relaxes towards the prior with time constant dwellM * (1 - prior).
+  const uint16_t tau = fnmax((uint16_t)1, (uint16_t)((dwellM * (uint16_t)(100U - priorPC)) / 100U));
+  pOccupied = (uint16_t)(pOccupied + ((((int32_t)prior) - (int32_t)pOccupied) / tau));
+
+  if(0 != lrX16)
+    {
+    // Evidence: posterior odds = prior odds * likelihood ratio, computed at 8-bit precision.
+    const uint16_t p8 = fnmax((uint16_t)1, (uint16_t)(pOccupied >> 8));
+    const uint32_t num = p8 * (uint32_t)lrX16;
+    const uint32_t den = num + (((uint32_t)(255U - p8)) << 4);
+    pOccupied = (uint16_t)fnmin((num << 16) / den, (uint32_t)0xffffU);
+
+    // Learn the typical gap between evidence while occupied, and how long occupancy typically lasts,
+    // taking a gap of more than twice the occupation timeout as the end of one occupancy and the start of another.
+    const uint8_t gapM = (uint8_t)fnmin(quietM + 1U, 255U);
+    if(gapM <= 2*OCCUPATION_TIMEOUT_M)
+      {
+      evidenceGapM = fnmax((uint8_t)1, smoothStatsValue(evidenceGapM, gapM));
+      sessionM = (uint8_t)fnmin((uint16_t)(sessionM + gapM), (uint16_t)255U);
+      }
+    else
+      {
+      if(0 != sessionM) { dwellM = fnmax((uint8_t)(OCCUPATION_TIMEOUT_M/2), smoothStatsValue(dwellM, (uint8_t)fnmin((uint16_t)(sessionM + evidenceGapM), (uint16_t)255U))); }
+      sessionM = 0;
+      }
+    quietM = 0;
+    }
+  else
+    {
+    // Silence: a quiet minute is less likely (by about 1/evidenceGapM) when occupied than when vacant,
+    // so lower the odds a little: p -= p(1-p)/evidenceGapM.
+    pOccupied -= (uint16_t)(((((uint32_t)pOccupied) * (0xffffU - pOccupied)) >> 16) / evidenceGapM);
+    if(quietM < 0xff) { ++quietM; }
+    }
+  }
+
 // Update notion of occupancy confidence.
 uint8_t OccupancyTracker::read()
   {
+  updateEstimate();
   ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
     {
     // Compute as percentage.
@@ -337,14 +390,16 @@ uint8_t OccupancyTracker::read()
 // If the hardware allows this may immediately turn on the main GUI LED until normal GUI reverts it,
 // at least periodically.
 // Probably do not call on manual control operation to avoid interfering with UI operation.
-// Thread-safe.
-void OccupancyTracker::markAsPossiblyOccupied()
+// The evidence is weighted by its likelihood ratio (x16) in the Bayesian estimate.
+// Thread-safe and ISR-safe.
+void OccupancyTracker::markAsPossiblyOccupied(const uint8_t evidenceLRX16)
   {
 //  if(0 == activityCountdownM) // Only flash the UI at start of external activity to limit flashing.
     { LED_HEATCALL_ON_ISR_SAFE(); }
   ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
     {
     occupationCountdownM = fnmax((uint8_t)occupationCountdownM, (uint8_t)(OCCUPATION_TIMEOUT_1_M));
+    if(evidenceLRX16 > pendingEvidenceLRX16) { pendingEvidenceLRX16 = evidenceLRX16; }
     }
   activityCountdownM = 2;
   }
@@ -357,37 +412,81 @@ void OccupancyTracker::markAsPossiblyOccupied()
 // Always returns false if all samples are the same.
 //   * s is start of (24) sample set in EEPROM
 //   * sample to be tested for being in lower quartile
-bool inBottomQuartile(const uint8_t *sE, const uint8_t sample)
+static bool inBottomQuartile(const uint8_t *sE, const uint8_t sample)
   {
   uint8_t valuesHigher = 0;
   for(int8_t hh = 24; --hh >= 0; ++sE)
     {
     const uint8_t v = eeprom_read_byte(sE); 
-    if(STATS_UNSET_INT == v) { return(false); } // Abort if not a full set of stats (eg at least one full day's worth). 
-    if(v > sample) { if(++valuesHigher >= 18) { return(true); } } // Stop as soon as known to be in lower quartile.
+    if(STATS_UNSET_BYTE == v) { return(false); } // Abort if not a full set of stats (eg at least one full day's worth). 
+    if(v > sample) { ++valuesHigher; } // Check the whole set, ie for unset values, before answering.
     }
-  return(false); // Not in lower quartile.
+  return(valuesHigher >= 18);
   }
 
 // Returns true iff there is a full set of stats (none unset) and this 3/4s of the values are lower than the supplied sample.
 // Always returns false if all samples are the same.
 //   * s is start of (24) sample set in EEPROM
 //   * sample to be tested for being in lower quartile
-bool inTopQuartile(const uint8_t *sE, const uint8_t sample)
+static bool inTopQuartile(const uint8_t *sE, const uint8_t sample)
   {
   uint8_t valuesLower = 0;
   for(int8_t hh = 24; --hh >= 0; ++sE)
     {
     const uint8_t v = eeprom_read_byte(sE); 
-    if(STATS_UNSET_INT == v) { return(false); } // Abort if not a full set of stats (eg at least one full day's worth). 
-    if(v < sample) { if(++valuesLower >= 18) { return(true); } } // Stop as soon as known to be in upper quartile.
+    if(STATS_UNSET_BYTE == v) { return(false); } // Abort if not a full set of stats (eg at least one full day's worth). 
+    if(v < sample) { ++valuesLower; } // Check the whole set, ie for unset values, before answering.
+    }
+  return(valuesLower >= 18);
+  }
+
+// Stats sets whose quartile membership is held in RAM, being those queried by the control logic every few minutes.
+// Other sets (eg for CLI display) are scanned in EEPROM on each query.
+static const uint8_t quartileIndexedSets[] = { EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED, EE_STATS_SET_AMBLIGHT_BY_HOUR_SMOOTHED };
+#define QUARTILE_INDEXED_SETS (sizeof(quartileIndexedSets)/sizeof(quartileIndexedSets[0]))
+// Bottom and top quartile membership by hour (bit hh set if hour hh is in the quartile), 16 bytes in all.
+static uint32_t quartileBottomMask[QUARTILE_INDEXED_SETS], quartileTopMask[QUARTILE_INDEXED_SETS];
+// Bit i set iff the masks for quartileIndexedSets[i] are up to date with EEPROM; cleared whenever the stats are written.
+static uint8_t quartileIndexValid;
+
+// Marks all quartile indexes stale, to be rebuilt from EEPROM on next use.
+// Call whenever by-hour stats in EEPROM are written or erased.
+static inline void invalidateQuartileIndex() { quartileIndexValid = 0; }
+
+// Rebuilds the quartile membership masks for index slot i with one 24-byte EEPROM read.
+// Gives the same result as inBottomQuartile()/inTopQuartile() for each hour's sample:
+// nothing is in either quartile unless the set is full (none unset).
+static void rebuildQuartileIndex(const uint8_t i)
+  {
+  uint8_t v[24];
+  const uint8_t *ss = (uint8_t *)(EE_STATS_START_ADDR(quartileIndexedSets[i]));
+  uint32_t bottom = 0, top = 0;
+  bool full = true;
+  for(uint8_t hh = 0; hh < 24; ++hh)
+    { if(STATS_UNSET_BYTE == (v[hh] = eeprom_read_byte(ss + hh))) { full = false; } }
+  if(full)
+    {
+    for(uint8_t hh = 0; hh < 24; ++hh)
+      {
+      uint8_t valuesHigher = 0, valuesLower = 0;
+      for(uint8_t j = 0; j < 24; ++j)
+        {
+        if(v[j] > v[hh]) { ++valuesHigher; }
+        else if(v[j] < v[hh]) { ++valuesLower; }
+        }
+      if(valuesHigher >= 18) { bottom |= ((uint32_t)1) << hh; }
+      if(valuesLower >= 18) { top |= ((uint32_t)1) << hh; }
+      }
     }
-  return(false); // Not in upper quartile.
+  quartileBottomMask[i] = bottom;
+  quartileTopMask[i] = top;
+  quartileIndexValid |= (uint8_t)(1U << i);
   }
 
 // Returns true if specified hour is (conservatively) in the specifed outlier quartile for the specified stats set.
 // Returns false if a full set of stats not available, eg including the specified hour.
 // Always returns false if all samples are the same.
+// For the indexed sets this is constant-time with no EEPROM reads except once per set after each hourly stats update.
 //   * inTop  test for membership of the top quartile if true, bottom quartile if false
 //   * statsSet  stats set number to use.
 //   * hour  hour of day to use or ~0 for current hour.
@@ -395,9 +494,16 @@ bool inOutlierQuartile(const uint8_t inTop, const uint8_t statsSet, const uint8_
   {
   if(statsSet >= EE_STATS_SETS) { return(false); } // Bad stats set number, ie unsafe.
   const uint8_t hh = (hour > 23) ? getHoursLT() : hour;
+  for(uint8_t i = 0; i < QUARTILE_INDEXED_SETS; ++i)
+    {
+    if(statsSet != quartileIndexedSets[i]) { continue; }
+    if(!(quartileIndexValid & (1U << i))) { rebuildQuartileIndex(i); }
+    const uint32_t mask = inTop ? quartileTopMask[i] : quartileBottomMask[i];
+    return(0 != (mask & (((uint32_t)1) << hh)));
+    }
   const uint8_t *ss = (uint8_t *)(EE_STATS_START_ADDR(statsSet));
   const uint8_t sample = eeprom_read_byte(ss + hh);
-  if(STATS_UNSET_INT == sample) { return(false); }
+  if(STATS_UNSET_BYTE == sample) { return(false); }
   if(inTop) { return(inTopQuartile(ss, sample)); }
   return(inBottomQuartile(ss, sample));
   }
@@ -405,10 +511,21 @@ bool inOutlierQuartile(const uint8_t inTop, const uint8_t statsSet, const uint8_
 #ifdef ENABLE_ANTICIPATION
 // Returns true iff room likely to be occupied and need warming at the specified hour's sample point based on collected stats.
 // Used for predictively warming a room in smart mode and for choosing setback depths.
-// Returns false if no good evidence to warm the room at the given time based on past history over about one week.
+// Returns false if no good evidence to warm the room at the given time based on past history over recent weeks.
 //   * hh hour to check for predictive warming [0,23]
 bool shouldBeWarmedAtHour(const uint_least8_t hh)
   {
+  // Find the hour of the week for hh: today, or tomorrow if that hour has already passed today.
+  const uint8_t nowHourOfWeek = getHourOfWeekLT();
+  const uint8_t nowHH = nowHourOfWeek % 24;
+  uint8_t hourOfWeek = nowHourOfWeek - nowHH + hh;
+  if(hh < nowHH) { hourOfWeek += 24; }
+  if(hourOfWeek >= EE_WEEK_PROFILE_SIZE) { hourOfWeek -= EE_WEEK_PROFILE_SIZE; }
+
+  // Return false immediately if the weekly profile shows this hour of the week as usually vacant,
+  // eg for an office at the weekend, whatever the by-hour-of-day stats suggest.
+  if(isWeeklyProfileVacant(hourOfWeek)) { return(false); }
+
 #ifndef OMIT_MODULE_LDROCCUPANCYDETECTION
   // Return false immediately if the sample hour's historic ambient light level falls in the bottom quartile (or is zero).
   // Thus aim to shave off 'smart' warming for at least 25% of the daily cycle.
@@ -421,14 +538,11 @@ bool shouldBeWarmedAtHour(const uint_least8_t hh)
   if(inOutlierQuartile(false, EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED, hh)) { return(false); }
 #endif
 
-  const uint8_t warmHistory = eeprom_read_byte((uint8_t *)(EE_STATS_START_ADDR(EE_STATS_SET_WARMMODE_BY_HOUR_OF_WK) + hh));
-  if(0 == (0x80 & warmHistory)) // This hour has a history.
+  const uint8_t warmHistory = getWeeklyWARMHistory(hourOfWeek);
+  if(STATS_UNSET_BYTE != warmHistory) // This hour of the week has a history.
     {
-//    // Return false immediately if no WARM mode this hour for the last week (ie the unit needs reminding at least once per week).
-//    if(0 == warmHistory) // No explicit WARM for a week at this hour, prevents 'smart' warming.
-//      { return(false); }
-    // Return true immediately if this hour was in WARM mode yesterday or a week ago, and at least one other day.
-    if((0 != (0x41 & warmHistory)) && (0 != (0x3e & warmHistory)))
+    // Return true immediately if this hour of the week was in WARM mode last week and in at least one of the two before.
+    if((0 != (4 & warmHistory)) && (0 != (3 & warmHistory)))
       { return(true); }
     }
 
@@ -562,7 +676,11 @@ uint8_t ModelledRadValve::computeTargetTemp()
     // Don't do this if the room has been vacant for a long time (eg so as to avoid pre-warm being higher than WARM ever).
     // Don't do this if there has been recent manual intervention, eg to allow manual 'cancellation' of pre-heat (TODO-464).
     // Only do this if the target WARM temperature is NOT an 'eco' temperature (ie very near the bottom of the scale).
-    if(!Occupancy.longVacant() && isAnyScheduleOnWARMSoon() && !recentUIControlUse())
+    // Don't do this if the weekly profile shows the hour that the WARM period starts as usually vacant, eg an office at the weekend;
+    // that may be several hours ahead given a long learned pre-warm for a slow room.
+    const uint_least16_t untilWARMM = getMinsUntilScheduleOnWARMSoon();
+    if(!Occupancy.longVacant() && ((uint_least16_t)~0 != untilWARMM) && !recentUIControlUse() &&
+       !isWeeklyProfileVacant(getHourOfWeekAheadLT(untilWARMM)))
       {
       const uint8_t warmTarget = getWARMTargetC();
       // Compute putative pre-warm temperature...
@@ -588,8 +706,12 @@ uint8_t ModelledRadValve::computeTargetTemp()
 
     // Set back target the temperature a little if the room seems to have been vacant for a long time (TODO-107)
     // or it is too dark for anyone to be active or the room is not likely occupied at this time
+    // (from the Bayesian occupancy estimate or the occupancy stats)
     //   AND no WARM schedule is active now (TODO-111)
     //   AND no recent manual interaction with the unit's local UI (TODO-464) indicating local settings override.
+    // Also set back, even within a WARM schedule, if the room seems vacant at an hour of the week
+    // when the weekly profile shows it usually is, eg an office at the weekend with a daily schedule,
+    // unless there has been recent manual interaction.
     // Note that this mainly has to work in domestic settings in winter (with ~8h of daylight)
     // but should also work in artificially-lit offices (maybe ~12h continuous lighting).
     // No 'lights-on' signal for a whole day is a fairly strong indication that the heat can be turned down.
@@ -597,8 +719,11 @@ uint8_t ModelledRadValve::computeTargetTemp()
     // TODO: consider bottom quartile of amblient light as alternative setback trigger for near-continuously-lit spaces (aiming to spot daylight signature).
     const bool longLongVacant = Occupancy.longLongVacant();
     const bool longVacant = longLongVacant || Occupancy.longVacant();
-    const bool notLikelyOccupiedSoon = longLongVacant || (Occupancy.isLikelyUnoccupied() && inOutlierQuartile(false, EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED));
+    const bool weeklyVacant = Occupancy.isLikelyUnoccupied() && isWeeklyProfileVacant(getHourOfWeekLT());
+    const bool notLikelyOccupiedSoon = longLongVacant || Occupancy.isConfidentlyVacant() || weeklyVacant ||
+        (Occupancy.isLikelyUnoccupied() && inOutlierQuartile(false, EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED));
     if(longVacant ||
+       (weeklyVacant && !recentUIControlUse()) ||
        ((notLikelyOccupiedSoon || (AmbLight.getDarkMinutes() > 10)) && !isAnyScheduleOnWARMNow() && !recentUIControlUse()))
       {
       // Use a default minimal non-annoying setback if in comfort mode
@@ -606,14 +731,15 @@ uint8_t ModelledRadValve::computeTargetTemp()
       //   or if the room is lit and hasn't been vacant for a very long time (TODO-107)
       //   or if the room is commonly occupied at this time and hasn't been vacant for a very long time
       //   or if a scheduled WARM period is due soon and the room hasn't been vacant for a moderately long time,
+      //   (each of the last three only if not at an hour of the week that is usually vacant)
       // else a bigger 'eco' setback
       // unless an even bigger 'full' setback if the room has been vacant for a very long time
       //   or is unlikely to be unoccupied at this time of day and the target WARM temperature is at the 'eco' end.
       const uint8_t setback = (!hasEcoBias() ||
                                Occupancy.isLikelyOccupied() ||
-                               (!longLongVacant && AmbLight.isRoomLit()) ||
-                               (!longLongVacant && inOutlierQuartile(true, EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED)) ||
-                               (!longVacant && isAnyScheduleOnWARMSoon())) ?
+                               (!longLongVacant && !weeklyVacant && AmbLight.isRoomLit()) ||
+                               (!longLongVacant && !weeklyVacant && inOutlierQuartile(true, EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED)) ||
+                               (!longVacant && !weeklyVacant && isAnyScheduleOnWARMSoon())) ?
               SETBACK_DEFAULT :
           ((longLongVacant || (notLikelyOccupiedSoon && isEcoTemperature(wt))) ?
               SETBACK_FULL : SETBACK_ECO);
@@ -857,14 +983,68 @@ DEBUG_SERIAL_PRINTLN();
   return(valvePCOpen);
   }
 
+// Slack in the daily valve movement budget (%) before pro-rata limiting applies,
+// enough for (say) a full open and close during a morning warm-up.
+#define DAILY_VALVE_MOVEMENT_SLACK_PC (DEFAULT_MAX_CUMULATIVE_PC_DAILY_VALVE_MOVEMENT/2)
+
+// Get valve movement so far today as a percentage of DEFAULT_MAX_CUMULATIVE_PC_DAILY_VALVE_MOVEMENT, capped at 255.
+uint8_t ModelledRadValve::getDailyMovementBudgetUsedPC() const
+  {
+  const uint16_t usedPC = (retainedState.cumulativeMovementPC - dayStartMovementPC) & 0xfff; // Allow for 12-bit rollover.
+  return((uint8_t)fnmin((uint16_t)((usedPC * 100UL) / DEFAULT_MAX_CUMULATIVE_PC_DAILY_VALVE_MOVEMENT), (uint16_t)255));
+  }
+
+// Get how far the valve is running ahead of its pro-rata daily movement budget [0,3], 0 being within budget.
+// The budget is spread evenly across the local day, plus some slack,
+// so that battery life is predictable and bursts of movement early in the day cannot starve the rest of it.
+// Starts a new day's budget after local midnight.
+uint8_t ModelledRadValve::computeMovementBudgetPressure()
+  {
+  const uint16_t today = getDaysSince1999LT();
+  if(today != budgetDay) { budgetDay = today; dayStartMovementPC = retainedState.cumulativeMovementPC; }
+  const uint16_t budgetPC = DEFAULT_MAX_CUMULATIVE_PC_DAILY_VALVE_MOVEMENT;
+  const uint16_t usedPC = (retainedState.cumulativeMovementPC - dayStartMovementPC) & 0xfff; // Allow for 12-bit rollover.
+  if(usedPC >= budgetPC) { return(3); } // Whole day's budget used.
+  const uint16_t allowedPC = (uint16_t)(((uint32_t)budgetPC * (getMinutesSinceMidnightLT() + 1)) / MINS_PER_DAY) + DAILY_VALVE_MOVEMENT_SLACK_PC;
+  if(usedPC <= allowedPC) { return(0); }
+  // One more level for each further 1/8th of the daily budget used ahead of pro-rata.
+  return((uint8_t)fnmin((uint16_t)(1 + (usedPC - allowedPC) / (budgetPC/8)), (uint16_t)3));
+  }
+
 // Compute/update target temperature and set up state for tick()/computeRequiredTRVPercentOpen().
 void ModelledRadValve::computeTargetTemperature()
   {
-  // Compute basic target temperature.
-  const uint8_t newTarget = computeTargetTemp();
+  // Compute basic target temperature, but only if any of its inputs have changed since it was last computed,
+  // avoiding needless EEPROM stats reads (eg the weekly profile) and setback logic most minutes.
+  // The schedule terms depend on the time of day so are always re-evaluated (from a RAM copy of the schedules).
+  const uint16_t flags =
+      (inWarmMode() ? 1 : 0) |
+      (inBakeMode() ? 2 : 0) |
+      (Occupancy.longVacant() ? 4 : 0) |
+      (Occupancy.longLongVacant() ? 8 : 0) |
+      (Occupancy.isLikelyOccupied() ? 0x10 : 0) |
+      (Occupancy.isConfidentlyVacant() ? 0x20 : 0) |
+      ((AmbLight.getDarkMinutes() > 10) ? 0x40 : 0) |
+      (AmbLight.isRoomLit() ? 0x80 : 0) |
+      (recentUIControlUse() ? 0x100 : 0) |
+      (isAnyScheduleOnWARMNow() ? 0x200 : 0) |
+      (isAnyScheduleOnWARMSoon() ? 0x400 : 0);
+  const uint8_t warmC = getWARMTargetC();
+  const uint8_t frostC = getFROSTTargetC();
+  const uint8_t hh = getHoursLT();
+  if(!inputState.targetInputsValid || (flags != inputState.targetInputFlags) ||
+     (warmC != inputState.targetInputWARMC) || (frostC != inputState.targetInputFROSTC) || (hh != inputState.targetInputHour))
+    {
+    inputState.targetTempC = computeTargetTemp();
+    inputState.targetInputsValid = true;
+    inputState.targetInputFlags = flags;
+    inputState.targetInputWARMC = warmC;
+    inputState.targetInputFROSTC = frostC;
+    inputState.targetInputHour = hh;
+    }
+  const uint8_t newTarget = inputState.targetTempC;
 
-  // Set up state for computeRequiredTRVPercentOpen().
-  inputState.targetTempC = newTarget;
+  // Set up remaining state for computeRequiredTRVPercentOpen().
   inputState.minPCOpen = getMinPercentOpen();
   inputState.maxPCOpen = getMaxPercentageOpenAllowed();
   inputState.glacial = glacial;
@@ -875,23 +1055,22 @@ void ModelledRadValve::computeTargetTemperature()
   // to attempt to reduce the total number and size of adjustments and thus reduce noise/disturbance (and battery drain).
   // The wider deadband (less good temperature regulation) might be noticeable/annoying to sensitive occupants.
   // FIXME: With a wider deadband may also simply suppress any movement/noise on some/most minutes while close to target temperature.
-  inputState.widenDeadband = AmbLight.isRoomDark() || Occupancy.longVacant() || (!inWarmMode()) || retainedState.isFiltering;
+  // Also widen it, and then lengthen the anti-seek delays, progressively when valve movement runs ahead of the daily budget.
+  const uint8_t budgetPressure = computeMovementBudgetPressure();
+  inputState.widenDeadband = AmbLight.isRoomDark() || Occupancy.longVacant() || (!inWarmMode()) || retainedState.isFiltering || (0 != budgetPressure);
+  inputState.antiSeekDelayShift = (budgetPressure > 1) ? (budgetPressure - 1) : 0;
   // Capture adjusted reference/room temperatures
   // and set callingForHeat flag also using same outline logic as computeRequiredTRVPercentOpen() will use.
   inputState.setReferenceTemperatures(TemperatureC16.get());
   callingForHeat = (newTarget >= (inputState.refTempC16 >> 4));
   }
 
-// Get smoothed raw/unadjusted temperature from the most recent samples.
-int ModelledRadValveState::getSmoothedRecent()
-  { return(smallIntMean<filterLength>(prevRawTempC16)); }
-
 //// Compute an estimate of rate/velocity of temperature change in C/16 per minute/tick.
 //// A positive value indicates that temperature is rising.
 //// Based on comparing the most recent smoothed value with an older smoothed value.
 //int ModelledRadValveState::getVelocityC16PerTick()
 //  {
-//  const int oldSmoothed = smallIntMean<filterLength/2>(prevRawTempC16 + (filterLength/2));
+//  const int oldSmoothed = ...mean of getPrevRawTempC16(filterLength/2 .. filterLength-1)...;
 //  const int newSmoothed = getSmoothedRecent();
 //  const int velocity = (newSmoothed - oldSmoothed + (int)(filterLength/4)) / (int)(filterLength/2); // Avoid going unsigned by accident.
 ////DEBUG_SERIAL_PRINT_FLASHSTRING("old&new sm, velocity: ");
@@ -911,6 +1090,15 @@ int ModelledRadValveState::getSmoothedRecent()
 // Typical values range from 2 (for 1/8C precision temperature sensor) up to 4.
 static const int MAX_TEMP_JUMP_C16 = 3; // 3/16C.
 
+// Fold one window's rise in temperature (C/16 over filterLength-1 minutes) into a learned rate in C/16 per hour.
+// A fall is treated as zero; the first sample is taken as-is and later ones smoothed in.
+static void learnRateC16PerH(uint8_t &rateC16PerH, const int riseC16)
+  {
+  const long perH = (riseC16 <= 0) ? 0 : ((long)riseC16 * 60) / (long)(ModelledRadValveState::filterLength - 1);
+  const uint8_t sample = (uint8_t)fnmin(perH, 254L); // Never 0xff, which means not yet learned.
+  rateC16PerH = (0xff == rateC16PerH) ? sample : smoothStatsValue(rateC16PerH, sample);
+  }
+
 // Perform per-minute tasks such as counter and filter updates then recompute valve position.
 // The input state must be complete including target and reference temperatures
 // before calling this including the first time whereupon some further lazy initialisation is done.
@@ -922,12 +1110,21 @@ void ModelledRadValveState::tick(volatile uint8_t &valvePCOpenRef, const Modelle
     {
     // Fill the filter memory with the current room temperature.
     for(int i = filterLength; --i >= 0; ) { prevRawTempC16[i] = rawTempC16; }
+    prevRawTempHead = 0;
+    prevRawTempJumps = 0;
+    prevRawTempSum = (int32_t)rawTempC16 * (int32_t)filterLength;
     initialised = true;
     }
 
-  // Shift in the latest (raw) temperature.
-  for(int i = filterLength; --i > 0; ) { prevRawTempC16[i] = prevRawTempC16[i-1]; }
-  prevRawTempC16[0] = rawTempC16;
+  // Shift in the latest (raw) temperature in O(1) by overwriting the oldest entry,
+  // updating the running sum and the count of big adjacent jumps as the oldest pair leaves and the newest arrives.
+  const uint8_t oldest = (uint8_t)(prevRawTempHead + 1) % filterLength;
+  const int oldestC16 = prevRawTempC16[oldest];
+  if(abs(prevRawTempC16[(uint8_t)(oldest + 1) % filterLength] - oldestC16) > MAX_TEMP_JUMP_C16) { --prevRawTempJumps; }
+  if(abs(rawTempC16 - prevRawTempC16[prevRawTempHead]) > MAX_TEMP_JUMP_C16) { ++prevRawTempJumps; }
+  prevRawTempSum += rawTempC16 - oldestC16;
+  prevRawTempC16[oldest] = rawTempC16;
+  prevRawTempHead = oldest;
 
   // Disable/enable filtering.
   // Allow possible exit from filtering for next time
@@ -940,8 +1137,24 @@ void ModelledRadValveState::tick(volatile uint8_t &valvePCOpenRef, const Modelle
   // Force filtering (back) on if any adjacent past readings are wildly different.
   if(!isFiltering)
     {
-    for(int i = 1; i < filterLength; ++i) { if(abs(prevRawTempC16[i] - prevRawTempC16[i-1]) > MAX_TEMP_JUMP_C16) { isFiltering = true; break; } }
+    if(0 != prevRawTempJumps) { isFiltering = true; }
+    }
+
+  // Learn room heating/cooling rates from the filter history once the valve
+  // has been held fully open/shut over the whole window and for one window before it
+  // (to let the radiator and room settle), then take non-overlapping windows after that.
+  // A fully-open window in which the room did not warm (eg the boiler was off) says nothing about the heating rate so is skipped,
+  // else it would drag the rate towards zero and the pre-warm as early as possible.
+  const uint8_t learnWindowM = filterLength - 1;
+  const int windowRiseC16 = getPrevRawTempC16(0) - getPrevRawTempC16(learnWindowM);
+  if(valvePCOpenRef < inputState.maxPCOpen) { valveFullyOpenM = 0; }
+  else if(++valveFullyOpenM >= 2*learnWindowM)
+    {
+    if(windowRiseC16 > 0) { learnRateC16PerH(heatRateC16PerH, windowRiseC16); }
+    valveFullyOpenM = learnWindowM;
     }
+  if(0 != valvePCOpenRef) { valveShutM = 0; }
+  else if(++valveShutM >= 2*learnWindowM) { learnRateC16PerH(coolRateC16PerH, -windowRiseC16); valveShutM = learnWindowM; }
 
   // Tick count down timers.
   if(valveTurndownCountdownM > 0) { --valveTurndownCountdownM; }
@@ -955,13 +1168,13 @@ void ModelledRadValveState::tick(volatile uint8_t &valvePCOpenRef, const Modelle
     if(newValvePC > valvePCOpenRef)
       {
       // Defer reclosing valve to avoid excessive hunting.
-      valveTurnup();
+      valveTurnup(inputState.antiSeekDelayShift);
       cumulativeMovementPC += (newValvePC - valvePCOpenRef);
       }
     else
       {
       // Defer opening valve to avoid excessive hunting.
-      valveTurndown();
+      valveTurndown(inputState.antiSeekDelayShift);
       cumulativeMovementPC += (valvePCOpenRef - newValvePC);
       }
     valvePCOpenRef = newValvePC;
@@ -991,9 +1204,35 @@ void ModelledRadValve::computeCallForHeat()
 
   // Compute target and ensure that required input state is set for computeRequiredTRVPercentOpen().
   computeTargetTemperature();
+  // Before the first tick pick up any room heating/cooling rates learned before the last restart.
+  if(!retainedState.initialised)
+    {
+    retainedState.heatRateC16PerH = eeprom_read_byte((uint8_t *)EE_START_LEARNED_HEAT_RATE);
+    retainedState.coolRateC16PerH = eeprom_read_byte((uint8_t *)EE_START_LEARNED_COOL_RATE);
+    }
   retainedState.tick(value, inputState);
   }
 
+// Estimated minutes to bring the room from its current temperature up to the WARM target at the learned heating rate.
+// Returns 0 if already at/above the target, at most 254, or 0xff if no heating rate has been learned yet.
+// A zero rate (eg persisted by older firmware) is treated as not learned.
+uint8_t ModelledRadValve::getEstimatedMinsToWARMTarget() const
+  {
+  const uint8_t rate = retainedState.heatRateC16PerH;
+  if((0xff == rate) || (0 == rate)) { return(0xff); }
+  const int gapC16 = (((int)getWARMTargetC()) << 4) - TemperatureC16.get();
+  if(gapC16 <= 0) { return(0); }
+  const uint16_t mins = (((uint16_t)fnmin(gapC16, 1000)) * 60U + (rate - 1)) / rate; // Rounded up.
+  return((uint8_t)fnmin(mins, (uint16_t)254));
+  }
+
+// Save learned heating/cooling rates to EEPROM with minimal wear; unlearned values are left alone.
+void ModelledRadValve::persistLearnedRates() const
+  {
+  if(0xff != retainedState.heatRateC16PerH) { eeprom_smart_update_byte((uint8_t *)EE_START_LEARNED_HEAT_RATE, retainedState.heatRateC16PerH); }
+  if(0xff != retainedState.coolRateC16PerH) { eeprom_smart_update_byte((uint8_t *)EE_START_LEARNED_COOL_RATE, retainedState.coolRateC16PerH); }
+  }
+
 
 
 
@@ -1052,6 +1291,7 @@ static void simpleUpdateStatsPair_(uint8_t * const lastEEPtr, const uint8_t valu
   if((((int)lastEEPtr) < EE_START_STATS) || (((int)lastEEPtr)+24 > EE_END_STATS)) { panic(); }
   if(0xff == value) { panic(); }
 #endif
+  invalidateQuartileIndex(); // Rebuild lazily from the new values.
   // Update the last-sample slot using the mean samples value.
   eeprom_smart_update_byte(lastEEPtr, value);
   // If existing smoothed value unset or invalid, use new one as is, else fold in.
@@ -1078,6 +1318,12 @@ static inline void simpleUpdateStatsPair(const uint8_t lastSetN, const uint8_t h
   simpleUpdateStatsPair_((uint8_t *)(EE_STATS_START_ADDR(lastSetN) + (hh)), (value));
   }
 
+#if defined(UNIT_TESTS)
+// Update the last and (following) smoothed stats values for hour hh [0,23] as sampleStats() does, for unit tests.
+void _TEST_simpleUpdateStatsPair(const uint8_t lastSetN, const uint8_t hh, const uint8_t value)
+  { simpleUpdateStatsPair(lastSetN, hh, value); }
+#endif
+
 // Sample statistics once per hour as background to simple monitoring and adaptive behaviour.
 // Call this once per hour with fullSample==true, as near the end of the hour as possible;
 // this will update the non-volatile stats record for the current hour.
@@ -1095,11 +1341,9 @@ void sampleStats(const bool fullSample)
   if(!fullSample && (sampleCount_ != 0)) { return; }
 #endif
   const bool firstSample = (0 == sampleCount_++);
-#if defined(EE_STATS_SET_WARMMODE_BY_HOUR_OF_WK)
   // WARM mode count.
   static int8_t warmCount; // Sub-sample WARM count; initially zero, and zeroed after each full sample.
   if(inWarmMode()) { ++warmCount; } else { --warmCount; }
-#endif
   // Ambient light.
   const uint16_t ambLight = fnmin(AmbLight.get(), (uint8_t)MAX_STATS_AMBLIGHT); // Constrain value at top end to avoid 'not set' value.
   static uint16_t ambLightTotal;
@@ -1125,6 +1369,11 @@ void sampleStats(const bool fullSample)
   // Reset generic sub-sample count to initial state after fill sample.
   sampleCount_ = 0;
 
+#if defined(LOCAL_TRV)
+  // Persist any learned room heating/cooling rates hourly to bound EEPROM wear.
+  NominalRadValve.persistLearnedRates();
+#endif
+
   // Get the current local-time hour...
   const uint_least8_t hh = getHoursLT(); 
 
@@ -1155,7 +1404,10 @@ void sampleStats(const bool fullSample)
 
 #ifdef OCCUPANCY_SUPPORT
   // Occupancy confidence percent, if supported; last and smoothed data sets,
-  simpleUpdateStatsPair(EE_STATS_SET_OCCPC_BY_HOUR, hh, smartDivToU8(occpcTotal, sc));
+  const uint8_t occpcMean = smartDivToU8(occpcTotal, sc);
+  simpleUpdateStatsPair(EE_STATS_SET_OCCPC_BY_HOUR, hh, occpcMean);
+#else
+  const uint8_t occpcMean = STATS_UNSET_BYTE;
 #endif 
 
 #if defined(HUMIDITY_SENSOR_SUPPORT)
@@ -1163,27 +1415,12 @@ void sampleStats(const bool fullSample)
   simpleUpdateStatsPair(EE_STATS_SET_RHPC_BY_HOUR, hh, smartDivToU8(rhpcTotal, sc));
 #endif
 
-#if defined(EE_STATS_SET_WARMMODE_BY_HOUR_OF_WK)
-  // Update sampled WARM-mode value.
-  // 0xff when unset/erased; first use will set all history bits to the initial sample value.
-  // When in use, bit 7 (msb) is always 0 (to distinguish from unset).
-  // Bit 6 is 1 if most recent day's sample was in WARM (or BAKE) mode, 0 if in FROST mode.
-  // At each new sampling, bits 6--1 are shifted down and the new bit 6 set as above.
-  // Designed to enable low-wear no-write or selective erase/write use much of the time;
-  // periods which are always the same mode will achieve a steady-state value (eliminating most EEPROM wear)
-  // while even some of the rest (while switching over from all-WARM to all-FROST) will only need pure writes (no erase).
-  uint8_t *const phW = (uint8_t *)(EE_STATS_START_ADDR(EE_STATS_SET_WARMMODE_BY_HOUR_OF_WK) + hh);
-  const uint8_t warmHistory = eeprom_read_byte(phW);
-  if(warmHistory & 0x80) { eeprom_smart_clear_bits(phW, inWarmMode() ? 0x7f : 0); } // First use sets all history bits to current sample value.
-  else // Shift in today's sample bit value for this hour at bit 6...
-    {
-    uint8_t newWarmHistory = (warmHistory >> 1) & 0x3f;
-    if(warmCount > 0) { newWarmHistory |= 0x40; } // Treat as warm iff more WARM than FROST (sub-)samples.
-    eeprom_smart_update_byte(phW, newWarmHistory);
-    }
+  // Update this hour of the week in the weekly profile with the occupancy and WARM mode (iff more WARM than FROST (sub-)samples).
+  // Each byte is only touched once per week, and periods that are always the same reach a steady state with no writes at all.
+  uint8_t *const phW = (uint8_t *)(EE_START_WEEK_PROFILE + getHourOfWeekLT());
+  eeprom_smart_update_byte(phW, updateWeeklyProfileByte(eeprom_read_byte(phW), occpcMean, (warmCount > 0)));
   // Reset WARM sub-sample count after full sample.
   warmCount = 0;
-#endif
 
   // TODO: other stats measures...
   }
@@ -1198,14 +1435,58 @@ uint8_t getByHourStat(uint8_t hh, uint8_t statsSet)
   return(eeprom_read_byte((uint8_t *)(EE_START_STATS + (statsSet * (int)EE_STATS_SET_SIZE) + (int)hh)));
   }
 
+// Get the smoothed occupancy level [0,EE_WEEK_PROFILE_OCC_MAX] for the given hour of the week, or STATS_UNSET_BYTE if not known.
+uint8_t getWeeklyOccupancyLevel(const uint8_t hourOfWeek)
+  {
+  if(hourOfWeek >= EE_WEEK_PROFILE_SIZE) { return(STATS_UNSET_BYTE); } // Invalid hour.
+  const uint8_t level = eeprom_read_byte((uint8_t *)(EE_START_WEEK_PROFILE + hourOfWeek)) >> 4;
+  return((level > EE_WEEK_PROFILE_OCC_MAX) ? STATS_UNSET_BYTE : level);
+  }
+
+// Get the WARM mode history for the given hour of the week, bits 2--0 for the last three weeks (bit 2 most recent),
+// or STATS_UNSET_BYTE if not known.
+uint8_t getWeeklyWARMHistory(const uint8_t hourOfWeek)
+  {
+  if(hourOfWeek >= EE_WEEK_PROFILE_SIZE) { return(STATS_UNSET_BYTE); } // Invalid hour.
+  const uint8_t history = eeprom_read_byte((uint8_t *)(EE_START_WEEK_PROFILE + hourOfWeek)) & 0xf;
+  return((0 != (history & 8)) ? STATS_UNSET_BYTE : history);
+  }
+
+// True if the weekly profile shows the given hour of the week as usually vacant; false if not known.
+// A level of 1 (~7%) or less allows for the odd brief visit.
+bool isWeeklyProfileVacant(const uint8_t hourOfWeek)
+  { return(getWeeklyOccupancyLevel(hourOfWeek) <= 1); }
+
+// Compute the new weekly profile byte from the old one (0xff if unset),
+// the hour's mean occupancy percentage [0,100] (or STATS_UNSET_BYTE if not available) and whether it was mainly in WARM mode.
+uint8_t updateWeeklyProfileByte(const uint8_t old, const uint8_t occPC, const bool warm)
+  {
+  // Occupancy level: halfway towards each new level, starting from the middle level when unset
+  // so that one vacant sample alone cannot mark the hour usually vacant,
+  // rounding towards the new level so that it can be reached, eg 14, 7, 3, 1, 0 over successive vacant weeks.
+  uint8_t occ = old >> 4;
+  if(occPC <= 100)
+    {
+    const uint8_t level = (uint8_t)((occPC * (uint16_t)EE_WEEK_PROFILE_OCC_MAX + 50) / 100);
+    if(occ > EE_WEEK_PROFILE_OCC_MAX) { occ = EE_WEEK_PROFILE_OCC_MAX / 2; }
+    occ = (occ + level + ((level > occ) ? 1 : 0)) >> 1;
+    }
+  // WARM history: set for all three weeks at first, then shifted down with this week's at bit 2.
+  const uint8_t history = old & 0xf;
+  const uint8_t newHistory = (0 != (history & 8)) ? (warm ? 7 : 0) : (((history >> 1) & 3) | (warm ? 4 : 0));
+  return((uint8_t)((occ << 4) | newHistory));
+  }
+
 
 // Clear all collected statistics, eg when moving device to a new room or at a major time change.
+// Includes the weekly profile, which follows the by-hour stats.
 // Requires 1.8ms per byte for each byte that actually needs erasing.
 //   * maxBytesToErase limit the number of bytes erased to this; strictly positive, else 0 to allow 65536
 // Returns true if finished with all bytes erased.
 bool zapStats(uint16_t maxBytesToErase)
   {
-  for(uint8_t *p = (uint8_t *)EE_START_STATS; p <= (uint8_t *)EE_END_STATS; ++p)
+  invalidateQuartileIndex();
+  for(uint8_t *p = (uint8_t *)EE_START_STATS; p <= (uint8_t *)EE_END_WEEK_PROFILE; ++p)
     { if(eeprom_smart_erase_byte(p)) { if(--maxBytesToErase == 0) { return(false); } } } // Stop if out of time...
   return(true); // All done.
   }
@@ -1292,6 +1573,13 @@ void populateCoreStats(FullStatsMessageCore_t *const content)
   content->containsTempAndPower = true;
   content->ambL = fnmax((uint8_t)1, fnmin((uint8_t)254, AmbLight.get())); // Coerce to allowed value in range [1,254]. Bug-fix (twice! TODO-510) c/o Gary Gladman!
   content->containsAmbL = true;
+#if defined(HUMIDITY_SENSOR_SUPPORT)
+  if(RelHumidity.isAvailable())
+    {
+    content->rhp = fnmin(RelHumidity.get(), (uint8_t)100); // Fail safe.
+    content->containsRHP = true;
+    }
+#endif
   // OC1/OC2 = Occupancy: 00 not disclosed, 01 not occupied, 10 possibly occupied, 11 probably occupied.
   // The encodeFullStatsMessageCore() route should omit data not appopriate for security reasons.
   content->occ = Occupancy.twoBitOccupancyValue();
@@ -1330,9 +1618,239 @@ bool pollIO(const bool force)
   }
 
 
+#if defined(ENABLE_BOILER_HUB)
+// Maximum chars for one hub stats output line, including trailing CRLF and '\0' while formatting.
+#define HUB_STATS_LINE_MAX (MSG_JSON_MAX_EXPANDED_LENGTH + 3)
+// Hub stats output batch buffer size.
+// Two full-length lines is ~0.25s of output at 4800 baud, which fits easily in the slack at the end of a typical cycle,
+// and the inbound stats queue provides further buffering behind this.
+#define HUB_STATS_OUT_BUF_SIZE (2 * HUB_STATS_LINE_MAX)
+// Batched text lines awaiting output, and length used.
+static char hubStatsOut[HUB_STATS_OUT_BUF_SIZE];
+static uint8_t hubStatsOutLen;
+
+// Move queued inbound stats into the hub output batch as text lines, while whole lines are sure to fit.
+// Fast, and does no serial I/O, so can be called at any point in the cycle.
+// Anything not moved stays in the inbound stats queue for later.
+static void batchInboundStatsForOutput()
+  {
+  while(hubStatsOutLen + HUB_STATS_LINE_MAX <= sizeof(hubStatsOut))
+    {
+    FullStatsMessageCore_t stats;
+    char buf[MSG_JSON_MAX_EXPANDED_LENGTH+1];
+    const uint8_t type = getNextInboundStats(&stats, buf);
+    if(INBOUND_STATS_NONE == type) { break; }
+    BufPrint bp(hubStatsOut + hubStatsOutLen, sizeof(hubStatsOut) - hubStatsOutLen);
+    if(INBOUND_STATS_CORE == type)
+      {
+      // Dump (remote) stats field '@<hexnodeID>;TnnCh[P;]'
+      // where the T field shows temperature in C with a hex digit after the binary point indicated by C
+      // and the optional P field indicates low power,
+      // followed by optional L ambient light, O occupancy, H RH%, F call-for-heat seconds and (last) A ASCII payload fields.
+      bp.print(LINE_START_CHAR_RSTATS);
+      bp.print((((uint16_t)stats.id0) << 8) | stats.id1, HEX);
+      if(stats.containsTempAndPower)
+        {
+        bp.print(F(";T"));
+        bp.print(stats.tempAndPower.tempC16 >> 4, DEC);
+        bp.print('C');
+        bp.print(stats.tempAndPower.tempC16 & 0xf, HEX);
+        if(stats.tempAndPower.powerLow) { bp.print(F(";P")); } // Insert power-low field if needed.
+        }
+      if(stats.containsAmbL)
+        {
+        bp.print(F(";L"));
+        bp.print(stats.ambL);
+        }
+      if(0 != stats.occ)
+        {
+        bp.print(F(";O"));
+        bp.print(stats.occ);
+        }
+      if(stats.containsRHP)
+        {
+        bp.print(F(";H"));
+        bp.print(stats.rhp);
+        }
+      if(stats.containsCFH)
+        {
+        bp.print(F(";F"));
+        bp.print(stats.cfhSecs);
+        }
+      if(stats.containsAPL)
+        {
+        bp.print(F(";A"));
+        bp.write((const uint8_t *)stats.apl, stats.aplLen);
+        }
+      }
+    else
+      {
+      // Dump contained JSON message as-is at start of line.
+      bp.print(buf);
+      }
+    bp.println();
+    hubStatsOutLen += bp.getSize();
+    }
+  }
+
+// Send as many whole batched lines as can go out at BAUD before the given sub-cycle time, in one burst.
+// Lines that do not fit in the time are kept for the next call.
+static void flushHubStatsOutput(const uint8_t maxSCT)
+  {
+  if(0 == hubStatsOutLen) { return; }
+  const uint8_t sct = getSubCycleTime();
+  if(sct >= maxSCT) { return; }
+  // Chars that can be sent in the time available (~10 bits per char).
+  const uint16_t charsAvail = (uint16_t)min(255UL, (((unsigned long)(maxSCT - sct)) * (BAUD/10)) / SUB_CYCLE_TICKS_PER_S);
+  // Find the end of the last whole line that fits.
+  uint8_t n = 0;
+  for(uint8_t i = 0; (i < hubStatsOutLen) && (i < charsAvail); ++i)
+    { if('\n' == hubStatsOut[i]) { n = i + 1; } }
+  if(0 == n) { return; }
+  const bool neededWaking = powerUpSerialIfDisabled();
+  Serial.write((const uint8_t *)hubStatsOut, n);
+  // Lines were sized to go out before maxSCT, so let them drain under interrupts rather than waiting here.
+  if(neededWaking) { powerDownSerialWhenDrained(); }
+  hubStatsOutLen -= n;
+  memmove(hubStatsOut, hubStatsOut + n, hubStatsOutLen);
+  }
+#endif
+
 #if defined(ALLOW_JSON_OUTPUT)
 // Managed JSON stats.
-static SimpleStatsRotation<8> ss1; // Configured for maximum different stats.
+// Configured for maximum different stats: a TRV with occupancy and humidity sensing, eg CONFIG_DORM1, puts 9
+// (T, H, O, vac, B|mV, v|%, tT|C, vC|%, vB|%), at ~13 bytes of RAM each.
+static SimpleStatsRotation<9> ss1;
+
+// Changes in key stats since last sent that are significant enough to trigger an early stats TX.
+// Temperature (C/16): 0.5C, eg as when a window is opened.
+#define STATS_SIGNIFICANT_DELTA_TEMP_C16 8
+// Occupancy: any change.
+#define STATS_SIGNIFICANT_DELTA_OCC 1
+// Valve position (%).
+#define STATS_SIGNIFICANT_DELTA_VALVE_PC 10
+
+// Update the managed stats with current values (without sending them); fast.
+// Sets up the per-stat properties when first called.
+static void updateManagedStats()
+  {
+  if(ss1.isEmpty())
+    {
+#ifdef DEBUG
+    ss1.enableCount(true); // For diagnostic purposes, eg while TX is lossy.
+#endif
+    // Stats whose significant changes should be sent promptly.
+    ss1.putDescriptor(GenericStatsDescriptor(TemperatureC16.tag(), 1, false, STATS_SIGNIFICANT_DELTA_TEMP_C16));
+#if defined(OCCUPANCY_SUPPORT)
+    ss1.putDescriptor(GenericStatsDescriptor(Occupancy.twoBitTag(), 1, false, STATS_SIGNIFICANT_DELTA_OCC));
+#endif
+#if defined(LOCAL_TRV)
+    ss1.putDescriptor(GenericStatsDescriptor(NominalRadValve.tag(), 1, false, STATS_SIGNIFICANT_DELTA_VALVE_PC));
+#endif
+    }
+  ss1.put(TemperatureC16);
+#if defined(HUMIDITY_SENSOR_SUPPORT)
+  ss1.put(RelHumidity);
+#endif
+#if defined(OCCUPANCY_SUPPORT)
+  ss1.put(Occupancy.twoBitTag(), Occupancy.twoBitOccupancyValue()); // Reduce spurious TX cf percentage.
+  ss1.put(Occupancy.vacHTag(), Occupancy.getVacancyH()); // EXPERIMENTAL
+#endif
+  // OPTIONAL items
+  // Only TX supply voltage for units apparently not mains powered.
+  if(!Supply_mV.isMains()) { ss1.put(Supply_mV); } else { ss1.remove(Supply_mV.tag()); }
+#if !defined(LOCAL_TRV) // Deploying as sensor unit, not TRV controller, so show all sensors and no TRV stuff.
+  // Only show ambient light levels for non-TRV pure-sensor units.
+  ss1.put(AmbLight);
+#else
+  ss1.put(NominalRadValve);
+  ss1.put(NominalRadValve.tagTTC(), NominalRadValve.getTargetTempC());
+#if 1
+  ss1.put(NominalRadValve.tagCMPC(), NominalRadValve.getCumulativeMovementPC()); // EXPERIMENTAL
+  ss1.put(NominalRadValve.tagMBPC(), NominalRadValve.getDailyMovementBudgetUsedPC()); // EXPERIMENTAL
+#endif
+#endif
+  }
+
+// True if the managed stats sent by this unit include the given key, after updating them; eg to test that all fit.
+bool managedStatsContainsKey(const char *const key)
+  {
+  updateManagedStats();
+  return(ss1.containsKey(key));
+  }
+#endif
+
+#if defined(ALLOW_STATS_ACK)
+// Maximum number of retries of an important stats frame not ACKed by the hub.
+#define STATS_ACK_MAX_RETRIES 2
+// Time to listen for an ACK after each TX (ms).
+// Covers the hub's RX poll interval (~32ms) and turnaround plus the ~20ms ACK itself.
+#define STATS_ACK_LISTEN_MS 100
+// Backoff before the first retry (ms), doubled for each further retry, plus up to as much again of random jitter.
+// Must be a power of two.
+#define STATS_ACK_BACKOFF_MS 32
+
+// Send a TLV stats frame that asks for an ACK (already in buf as for RFM22RawStatsTX()),
+// listening briefly after each TX for the hub's ACK,
+// and retrying (single TX) with randomised exponential backoff if none is heard.
+// An ACK reporting link margin to spare counts towards turning TX power down;
+// the caller deals with a frame never ACKed (see statsAckMisses).
+// The ACK's pre-warm stagger slot is adopted for the schedule.
+// Leaves the radio in standby.
+// Returns true if ACKed.
+static bool statsTXWithAck(uint8_t * const buf)
+  {
+  const uint8_t *const frame = buf + STATS_MSG_START_OFFSET;
+  const uint8_t seq = statsTLVFrameSeq(frame);
+  const uint8_t id0 = statsTLVFrameID0(frame);
+  const uint8_t id1 = statsTLVFrameID1(frame);
+  for(uint8_t attempt = 0; ; ++attempt)
+    {
+    // Resending rewrites only the preamble area, so the frame itself is unchanged and repeats are recognised as such.
+    RFM22RawStatsTX(true, buf, false);
+    uint8_t rx[STATS_TLV_ACK_BYTES + 2]; // Allow for sync bytes left in front of the ACK.
+    const uint8_t n = RFM22RXFrameWithin(rx, sizeof(rx), STATS_ACK_LISTEN_MS);
+    uint8_t pos = 0;
+    while((pos < n) && (RFM22_SYNC_BYTE == rx[pos])) { ++pos; }
+    const uint8_t *const ack = rx + pos;
+    if((0 != statsTLVCheckAck(ack, n - pos)) &&
+       (seq == statsTLVFrameSeq(ack)) && (id0 == statsTLVFrameID0(ack)) && (id1 == statsTLVFrameID1(ack)))
+      {
+      if(statsTLVAckHasMargin(ack)) { RFM22AdaptTXPower(true); }
+      setPreWarmStaggerSlot(statsTLVAckStaggerSlot(ack));
+      return(true);
+      }
+    if(attempt >= STATS_ACK_MAX_RETRIES) { break; }
+    // Back off so as not to collide again with whatever may have caused the loss.
+    sleepLowPowerLessThanMs((STATS_ACK_BACKOFF_MS << attempt) + (randRNG8() & ((STATS_ACK_BACKOFF_MS << attempt) - 1)));
+    }
+  return(false);
+  }
+
+// True if bareStatsTX() would currently send an ACK-able (TLV) frame when not asked for binary.
+// Not so if only secure stats may be sent, as those go in the (unACKed) secure binary form.
+static bool statsAckPossible()
+  {
+#if defined(ALLOW_JSON_OUTPUT)
+  return(enableTrailingStatsPayload() || !enableSecureStatsPayload());
+#else
+  return(false);
+#endif
+  }
+#endif
+
+#if defined(ENABLE_STATS_RELAY)
+#if (RELAY_STATS_MAX_FRAME_BYTES > STATS_MSG_MAX_LEN)
+#error RELAY_STATS_MAX_FRAME_BYTES too big
+#endif
+// Send all neighbours' frames awaiting relay as one multi-record frame, then resume listening.
+static void relayStatsTX()
+  {
+  uint8_t buf[STATS_MSG_START_OFFSET + RELAY_STATS_MAX_FRAME_BYTES + 1];
+  if(0 == writeRelayStatsFrame(buf + STATS_MSG_START_OFFSET, sizeof(buf) - STATS_MSG_START_OFFSET)) { return; }
+  RFM22RawStatsTX(true, buf, false);
+  SetupToEavesdropOnFHT8V(true); // Revert to listening.
+  }
 #endif
 
 // Do bare stats transmission.
@@ -1343,36 +1861,45 @@ static SimpleStatsRotation<8> ss1; // Configured for maximum different stats.
 //       the unit will resume RX after sending the stats
 //   * allowDoubleTX  allow double TX to increase chance of successful reception
 //   * doBinary  send binary form, else JSON form if supported
-static void bareStatsTX(const bool resumeRX, const bool allowDoubleTX, const bool doBinary)
+//   * ackWanted  if true and supported, ask the hub to ACK the (TLV) frame and retry until it does or retries run out
+// Returns true iff an ACK was wanted and received.
+static bool bareStatsTX(const bool resumeRX, const bool allowDoubleTX, const bool doBinary, const bool ackWanted = false)
   {
+  bool acked = false;
 #if (FullStatsMessageCore_MAX_BYTES_ON_WIRE > STATS_MSG_MAX_LEN)
 #error FullStatsMessageCore_MAX_BYTES_ON_WIRE too big
 #endif
+#if defined(ALLOW_SECURE_STATS) && (FullStatsMessageCore_MAX_BYTES_ON_WIRE_SECURE > STATS_MSG_MAX_LEN)
+#error FullStatsMessageCore_MAX_BYTES_ON_WIRE_SECURE too big
+#endif
 #if (MSG_JSON_MAX_LENGTH+1 > STATS_MSG_MAX_LEN) // Allow 1 for trailing CRC.
 #error MSG_JSON_MAX_LENGTH too big
 #endif
   
   // Allow space in buffer for:
   //   * buffer offset/preamble
-  //   * max binary length, or max JSON length + 1 for CRC + 1 to allow detection of oversize message
+  //   * max binary length, or max JSON length (before any compression) + 1 for CRC + 1 to allow detection of oversize message
   //   * terminating 0xff
-  uint8_t buf[STATS_MSG_START_OFFSET + max(FullStatsMessageCore_MAX_BYTES_ON_WIRE,  MSG_JSON_MAX_LENGTH+1) + 1];
+  uint8_t buf[STATS_MSG_START_OFFSET + max(FullStatsMessageCore_MAX_BYTES_ON_WIRE_SECURE,  MSG_JSON_MAX_EXPANDED_LENGTH+1) + 1];
+
+  // Encrypt binary stats whenever possible, and send only those when plaintext stats are not allowed.
+  const bool secure = enableSecureStatsPayload();
 
 #if defined(ALLOW_JSON_OUTPUT)
-  if(doBinary)
+  if(doBinary || (secure && !enableTrailingStatsPayload()))
 #endif
     {
     // Send binary message first.
     // Gather core stats.
     FullStatsMessageCore_t content;
     populateCoreStats(&content);
-    const uint8_t *msg1 = encodeFullStatsMessageCore(buf + STATS_MSG_START_OFFSET, sizeof(buf) - STATS_MSG_START_OFFSET, getStatsTXLevel(), false, &content);
+    const uint8_t *msg1 = encodeFullStatsMessageCore(buf + STATS_MSG_START_OFFSET, sizeof(buf) - STATS_MSG_START_OFFSET, getStatsTXLevel(), secure, &content);
     if(NULL == msg1)
       {
 #if 0
 DEBUG_SERIAL_PRINTLN_FLASHSTRING("Bin gen err!");
 #endif
-      return;
+      return(false);
       }
     // Record stats as if remote, and treat channel as secure.
     recordCoreStats(true, &content);
@@ -1397,44 +1924,37 @@ DEBUG_SERIAL_PRINTLN_FLASHSTRING("Bin gen err!");
     int8_t wrote;
 
     // Managed JSON stats.
-//    static SimpleStatsRotation<8> ss1; // Configured for maximum different stats.
     const bool maximise = true; // Make best use of available bandwidth...
-    if(ss1.isEmpty())
-      {
-#ifdef DEBUG
-      ss1.enableCount(true); // For diagnostic purposes, eg while TX is lossy.
+    updateManagedStats();
+#if defined(ALLOW_STATS_TLV)
+    // Send the compact binary TLV form in place of JSON for several times fewer bytes on air.
+#if defined(ALLOW_STATS_ACK)
+    wrote = ss1.writeTLV(bptr, sizeof(buf) - (bptr-buf) - 1, getStatsTXLevel(), ackWanted); // Leave space for terminating 0xff.
+#else
+    wrote = ss1.writeTLV(bptr, sizeof(buf) - (bptr-buf) - 1, getStatsTXLevel()); // Leave space for terminating 0xff.
 #endif
-//      // Try and get as much out on the first TX as possible.
-//      maximise = true;
+    if(0 == wrote)
+      {
+DEBUG_SERIAL_PRINTLN_FLASHSTRING("TLV gen err!");
+      return(false);
       }
-    ss1.put(TemperatureC16);
-#if defined(HUMIDITY_SENSOR_SUPPORT)
-    ss1.put(RelHumidity);
-#endif
-#if defined(OCCUPANCY_SUPPORT)
-    ss1.put(Occupancy.twoBitTag(), Occupancy.twoBitOccupancyValue()); // Reduce spurious TX cf percentage.
-    ss1.put(Occupancy.vacHTag(), Occupancy.getVacancyH()); // EXPERIMENTAL
+    // Record stats as if local (decoded to JSON as the hub would for a remote frame), and treat channel as secure.
+    recordStatsTLV(true, bptr, wrote);
+    bptr[wrote] = 0xff; // Terminate message for TX.
+    // Send it!
+#if defined(ALLOW_STATS_ACK)
+    if(ackWanted) { acked = statsTXWithAck(buf); }
+    else
 #endif
-    // OPTIONAL items
-    // Only TX supply voltage for units apparently not mains powered.
-    if(!Supply_mV.isMains()) { ss1.put(Supply_mV); } else { ss1.remove(Supply_mV.tag()); }
-#if !defined(LOCAL_TRV) // Deploying as sensor unit, not TRV controller, so show all sensors and no TRV stuff.
-    // Only show ambient light levels for non-TRV pure-sensor units.
-    ss1.put(AmbLight);
+      { RFM22RawStatsTX(true, buf, allowDoubleTX); }
 #else
-    ss1.put(NominalRadValve);
-    ss1.put(NominalRadValve.tagTTC(), NominalRadValve.getTargetTempC());
-#if 1
-    ss1.put(NominalRadValve.tagCMPC(), NominalRadValve.getCumulativeMovementPC()); // EXPERIMENTAL
-#endif
-#endif
     // If not doing a doubleTX then consider sometimes suppressing the change-flag clearing for this send
     // to reduce the chance of important changes being missed by the receiver.
     wrote = ss1.writeJSON(bptr, sizeof(buf) - (bptr-buf), getStatsTXLevel(), maximise); // , !allowDoubleTX && randRNG8NextBoolean());
     if(0 == wrote)
       {
 DEBUG_SERIAL_PRINTLN_FLASHSTRING("JSON gen err!");
-      return;
+      return(false);
       }
 
     // Record stats as if local, and treat channel as secure.
@@ -1449,8 +1969,11 @@ DEBUG_SERIAL_PRINTLN_FLASHSTRING("JSON gen err!");
     if(0xff == crc)
       {
   //DEBUG_SERIAL_PRINTLN_FLASHSTRING("JSON msg bad!");
-      return;
+      return(false);
       }
+#if defined(ALLOW_JSON_DICT_COMPRESSION)
+    wrote = strlen((const char *)bptr); // Now compressed.
+#endif
     bptr += wrote;
     *bptr++ = crc; // Add 7-bit CRC for on-the-wire check.
     *bptr = 0xff; // Terminate message for TX.
@@ -1460,12 +1983,13 @@ DEBUG_SERIAL_PRINTLN_FLASHSTRING("JSON gen err!");
       DEBUG_SERIAL_PRINT_FLASHSTRING("Too long for RFM2x: ");
       DEBUG_SERIAL_PRINT((int)(bptr - buf));
       DEBUG_SERIAL_PRINTLN();
-      return;
+      return(false);
       }
 #endif
     // TODO: put in listen before TX to reduce collisions (CSMA).
     // Send it!
     RFM22RawStatsTX(false, buf, allowDoubleTX);
+#endif
     // Resume appropriate behaviour after TX.
 #if defined(ENABLE_BOILER_HUB)
     if(resumeRX)
@@ -1478,6 +2002,7 @@ DEBUG_SERIAL_PRINTLN_FLASHSTRING("JSON gen err!");
 #endif // defined(ALLOW_JSON_OUTPUT)
 
 //DEBUG_SERIAL_PRINTLN_FLASHSTRING("Stats TX");
+  return(acked);
   }
 
 
@@ -1493,6 +2018,36 @@ DEBUG_SERIAL_PRINTLN_FLASHSTRING("JSON gen err!");
 // 'Elapsed minutes' count of minute/major cycles; cheaper than accessing RTC and not tied to real time.
 static uint8_t minuteCount;
 
+// Stats TX token bucket, to bound airtime however often early (change-triggered) TXes are wanted.
+// One token is needed per stats TX, refilled every STATS_TX_TOKEN_REFILL_M minutes up to STATS_TX_TOKENS_MAX.
+// At most one stats frame (~0.1s--0.2s on air with double TX) every 2 minutes on average
+// is ~0.2% duty cycle, well inside the 1% band limit with room for valve commands and other nodes.
+#define STATS_TX_TOKENS_MAX 3
+#define STATS_TX_TOKEN_REFILL_M 2
+#if defined(ALLOW_STATS_RX) && ((60 * STATS_TX_TOKEN_REFILL_M) < RX_DEDUP_RELAY_WINDOW_S)
+#error RX_DEDUP_FRAMES_PER_SENDER assumes at most one stats TX per sender within RX_DEDUP_RELAY_WINDOW_S
+#endif
+static uint8_t statsTXTokens = STATS_TX_TOKENS_MAX;
+// Scheduled (heartbeat) stats TX interval in 4-minute slots, [1,STATS_TX_MAX_HEARTBEAT_SLOTS].
+// Doubles after each heartbeat TX while conserving energy with nothing significant happening, else reset to 1.
+#define STATS_TX_MAX_HEARTBEAT_SLOTS 4
+static uint8_t statsHeartbeatSlots = 1;
+// 4-minute slots since the last stats TX (saturating).
+static uint8_t statsSlotsSinceTX;
+#if defined(ALLOW_STATS_ACK)
+// Important state (call for heat, battery low) as last confirmed by an ACK from the hub.
+// Stats frames are important, ie sent promptly asking for an ACK, until the hub has confirmed the current state.
+static bool statsAckedValid, statsAckedCFH, statsAckedBatteryLow;
+// Consecutive important frames not ACKed (saturating).
+// After STATS_ACK_MAX_MISSES (eg no hub able to ACK is in range) frames are no longer treated as important,
+// other than for one attempt every STATS_ACK_HOLDOFF_SLOTS 4-minute slots, until an ACK is next heard.
+static uint8_t statsAckMisses;
+#define STATS_ACK_MAX_MISSES 3
+// 4-minute slots left before the next attempt at an ACK after giving up; about an hour.
+static uint8_t statsAckHoldoffSlots;
+#define STATS_ACK_HOLDOFF_SLOTS 15
+#endif
+
 #if !defined(DONT_RANDOMISE_MINUTE_CYCLE)
 // Local count for seconds-within-minute; not tied to RTC and helps prevent collisions between (eg) TX of different units.
 static uint8_t localTicks;
@@ -1669,58 +2224,9 @@ void loopOpenTRV()
 
 #if defined(ENABLE_BOILER_HUB)
   // Check (early) for any remote stats arriving to dump.
-  // This is designed to be easy to pick up by reading the serial output.
-  // The output is terse to avoid taking too long and possibly delaying other stuff too far.
-  // Avoid doing this at all if too near the end of the cycle and risking overrun,
-  // leaving any message queued, hoping it does not get overwritten.
-  // TODO: safely process more than one pending message if present.
-  // TODO: move to process in a batch periodically, eg when CLI is due.
-  if(getSubCycleTime() >= nearOverrunThreshold) { tooNearOverrun = true; }
-  else
-    {
-    // Look for binary-format message.
-    FullStatsMessageCore_t stats;
-    getLastCoreStats(&stats);
-    if(stats.containsID)
-      {
-      // Dump (remote) stats field '@<hexnodeID>;TnnCh[P;]'
-      // where the T field shows temperature in C with a hex digit after the binary point indicated by C
-      // and the optional P field indicates low power.
-      serialPrintAndFlush(LINE_START_CHAR_RSTATS);
-      serialPrintAndFlush((((uint16_t)stats.id0) << 8) | stats.id1, HEX);
-      if(stats.containsTempAndPower)
-        {
-        serialPrintAndFlush(F(";T"));
-        serialPrintAndFlush(stats.tempAndPower.tempC16 >> 4, DEC);
-        serialPrintAndFlush('C');
-        serialPrintAndFlush(stats.tempAndPower.tempC16 & 0xf, HEX);
-        if(stats.tempAndPower.powerLow) { serialPrintAndFlush(F(";P")); } // Insert power-low field if needed.
-        }
-      if(stats.containsAmbL)
-        {
-        serialPrintAndFlush(F(";L"));
-        serialPrintAndFlush(stats.ambL);
-        }
-      if(0 != stats.occ)
-        {
-        serialPrintAndFlush(F(";O"));
-        serialPrintAndFlush(stats.occ);
-        }
-      serialPrintlnAndFlush();
-      }
-    // Check for JSON/text-format message if no binary message waiting.
-    else
-      {
-      char buf[MSG_JSON_MAX_LENGTH+1];
-      getLastJSONStats(buf);
-      if('\0' != *buf)
-        {
-        // Dump contained JSON message as-is at start of line.
-        serialPrintAndFlush(buf);
-        serialPrintlnAndFlush();
-        }
-      }
-    }
+  // They are formatted into the hub output batch now (which is fast and does no serial I/O)
+  // and sent in one burst later in the cycle by flushHubStatsOutput().
+  batchInboundStatsForOutput();
 #endif
 
 #if defined(ENABLE_BOILER_HUB)
@@ -1772,6 +2278,49 @@ void loopOpenTRV()
         }
       }
 
+#if defined(ENABLE_BOILER_DRIVER_LOGIC)
+    // The boiler is driven by BoilerControl, weighing all radiators' recent signals (fed to it as they are heard)
+    // against individual and aggregate thresholds with a minimum time in each state to avoid short-cycling,
+    // or with BOILER_TPI_CYCLES_PER_HOUR for a fraction of each cycle in proportion to aggregate demand;
+    // boilerCountdownTicks then only tracks recent calls for heat to schedule listening.
+    if(second0)
+      {
+      const uint8_t minTotalPC = eeprom_read_byte((uint8_t *)EE_START_MIN_TOTAL_VALVE_PC_OPEN);
+      const uint8_t minPC = NominalRadValve.getMinValvePcReallyOpen();
+      BoilerControl.setThresholds(minPC, ((minTotalPC >= 1) && (minTotalPC <= 100)) ? minTotalPC : fnmax(minPC, (uint8_t)DEFAULT_VALVE_PC_MODERATELY_OPEN));
+      BoilerControl.setMinTicksInEitherState((uint8_t)fnmin(getMinBoilerOnMinutes() * 30U, 255U));
+#if defined(BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY)
+      BoilerControl.loadAuthorisedIDs();
+#endif
+#if defined(BOILER_TPI_CYCLES_PER_HOUR)
+      BoilerControl.setTPIMode(1800U / BOILER_TPI_CYCLES_PER_HOUR); // 2s ticks per TPI period.
+#endif
+#if defined(ENABLE_ZONE_COORDINATOR)
+      Zones.tickMinute();
+#endif
+      }
+    const bool wasBoilerOn = BoilerControl.isCallingForHeat();
+#if 1 == MAIN_TICK_S
+    if(0 == (TIME_LSD & 1)) // Tick the logic every 2s.
+#endif
+      { BoilerControl.read(); }
+    if(wasBoilerOn != BoilerControl.isCallingForHeat())
+      {
+      if(getSubCycleTime() >= nearOverrunThreshold) { tooNearOverrun = true; }
+      else if(wasBoilerOn) { serialPrintlnAndFlush(F("RCfH0")); } // Remote call for heat off
+      else { serialPrintlnAndFlush(F("RCfH1")); } // Remote call for heat on.
+      }
+    if(heardIt)
+      {
+      boilerCountdownTicks = getMinBoilerOnMinutes() * (60/MAIN_TICK_S);
+      boilerNoCallM = 0; // No time has passed since the last call.
+      }
+    else if(boilerCountdownTicks > 0) { --boilerCountdownTicks; }
+    else if(second0 && (boilerNoCallM < (uint8_t)~0)) { ++boilerNoCallM; }
+
+    // Turn boiler output on or off in response to calls for heat.
+    hubModeBoilerOn = BoilerControl.isCallingForHeat();
+#else
     // Record call for heat, both to start boiler-on cycle and to defer need to listen again. 
     // Optimisation: may be able to stop RX if boiler is on for local demand (can measure local temp better: less self-heating).
     if(heardIt)
@@ -1798,6 +2347,7 @@ void loopOpenTRV()
 
     // Turn boiler output on or off in response to calls for heat.
     hubModeBoilerOn = (boilerCountdownTicks > 0);
+#endif
 
     // If in stats hub mode then always listen; don't attempt to save power.
     if(inStatsHubMode())
@@ -1851,9 +2401,22 @@ void loopOpenTRV()
       {
       DEBUG_SERIAL_PRINT_FLASHSTRING("?DROPPED stats: ");
       DEBUG_SERIAL_PRINT(dropped);
+      DEBUG_SERIAL_PRINT_FLASHSTRING(" queue HWM ");
+      DEBUG_SERIAL_PRINT(getInboundStatsQueueHighWaterMark());
       DEBUG_SERIAL_PRINTLN();
       oldDropped = dropped;
       }
+#if defined(ENABLE_BOILER_DRIVER_LOGIC)
+    const uint8_t droppedSignals = BoilerControl.getSignalOverruns();
+    static uint8_t oldDroppedSignals;
+    if(droppedSignals != oldDroppedSignals)
+      {
+      DEBUG_SERIAL_PRINT_FLASHSTRING("?DROPPED boiler signals: ");
+      DEBUG_SERIAL_PRINT(droppedSignals);
+      DEBUG_SERIAL_PRINTLN();
+      oldDroppedSignals = droppedSignals;
+      }
+#endif
 #endif
 #if 0 && defined(DEBUG)
     DEBUG_SERIAL_PRINT_FLASHSTRING("hub listen, on/cd ");
@@ -1874,6 +2437,14 @@ void loopOpenTRV()
 #endif
 
 
+#if defined(ENABLE_STATS_RELAY)
+  // Forward neighbours' stats frames to the hub several per TX:
+  // as soon as another record might not fit, else at least once a minute.
+  if(hubMode && (0 != getRelayStatsPendingCount()) && (second0 || isRelayStatsFrameFull()))
+    { relayStatsTX(); }
+#endif
+
+
   // Set BOILER_OUT as appropriate for local and/or remote calls for heat.
   // FIXME: local valve-driven boiler on does not obey normal on/off run-time rules.
 #if defined(ENABLE_BOILER_HUB)
@@ -1889,8 +2460,8 @@ void loopOpenTRV()
 #if 0 && defined(DEBUG)
   DEBUG_SERIAL_PRINTLN_FLASHSTRING("*E"); // End-of-cycle sleep.
 #endif
-  // Ensure that serial I/O is off.
-  powerDownSerial();
+  // Ensure that serial I/O is off once any pending output has drained (sleeping in IDLE mode until then).
+  powerDownSerialWhenDrained();
   // Power down most stuff (except radio for hub RX).
   minimisePowerWithoutSleep();
   uint_fast8_t newTLSD;
@@ -1942,7 +2513,7 @@ void loopOpenTRV()
 
 
   // Warn if too near overrun before.
-  if(tooNearOverrun) { serialPrintlnAndFlush(F("?near overrun")); }
+  if(tooNearOverrun) { serialPrintlnAsync(F("?near overrun")); }
 
 
   // Get current power supply voltage.
@@ -2038,6 +2609,8 @@ void loopOpenTRV()
       {
       // Tasks that must be run every minute.
       ++minuteCount;
+      // Refill the stats TX token bucket.
+      if((0 == (minuteCount % STATS_TX_TOKEN_REFILL_M)) && (statsTXTokens < STATS_TX_TOKENS_MAX)) { ++statsTXTokens; }
       checkUserSchedule(); // Force to user's programmed settings, if any, at the correct time.
       // Ensure that the RTC has been persisted promptly when necessary.
       persistRTC();
@@ -2052,31 +2625,86 @@ void loopOpenTRV()
     // Regular transmission of stats if NOT driving a local valve (else stats can be piggybacked onto that).
     case 10:
       {
-      if(!enableTrailingStatsPayload()) { break; } // Not allowed to send stuff like this.
+      if(!enableTrailingStatsPayload() && !enableSecureStatsPayload()) { break; } // Not allowed to send stuff like this.
 #if defined(USE_MODULE_FHT8VSIMPLE)
       // Avoid transmit conflict with FS20; just drop the slot.
       // We should possibly choose between this and piggybacking stats to avoid busting duty-cycle rules.
       if(localFHT8VTRVEnabled() && useExtraFHT8VTXSlots) { break; }
 #endif
 
-      // Generally only attempt stats TX in the minute after all sensors should have been polled (so that readings are fresh).
-      if(minute1From4AfterSensors ||
-        (!batteryLow && (0 == (0x24 & randRNG8())))) // Occasional additional TX when not conserving power.
+      // Scheduled (heartbeat) stats TX is in the minute after all sensors should have been polled (so that readings are fresh),
+      // every statsHeartbeatSlots 4-minute slots.
+      bool doTX = false;
+      if(minute1From4AfterSensors)
         {
+        if(statsSlotsSinceTX < 255) { ++statsSlotsSinceTX; }
+        doTX = (statsSlotsSinceTX >= statsHeartbeatSlots);
+#if defined(ALLOW_STATS_ACK)
+        if(0 != statsAckHoldoffSlots) { --statsAckHoldoffSlots; }
+#endif
+        }
+      // Send early in any minute if a key value has changed significantly since last sent, eg a window opened.
+      // Sensors are read late in every minute so values are fresh.
+      updateManagedStats();
+      const bool significantChange = ss1.significantChange();
+      if(significantChange) { doTX = true; }
+#if defined(ALLOW_STATS_ACK)
+      // Any change in important state not yet confirmed by the hub is sent promptly and must be ACKed.
+#if defined(LOCAL_TRV)
+      const bool callingForHeat = NominalRadValve.isCallingForHeat();
+#else
+      const bool callingForHeat = false;
+#endif
+      // Only while an ACK can actually be asked for, and not while holding off after repeated misses.
+      const bool important = !hubMode && (0 == statsAckHoldoffSlots) && statsAckPossible() &&
+        (!statsAckedValid || (callingForHeat != statsAckedCFH) || (batteryLow != statsAckedBatteryLow));
+      if(important) { doTX = true; }
+#else
+      const bool important = false;
+#endif
+      // Everything is subject to the token bucket to bound airtime.
+      if(doTX && (0 != statsTXTokens))
+        {
+        --statsTXTokens;
+        statsSlotsSinceTX = 0;
+        // Back off heartbeats in quiet rooms when conserving energy; stay brisk while anything is happening.
+        if(significantChange || !conserveBattery) { statsHeartbeatSlots = 1; }
+        else if(statsHeartbeatSlots < STATS_TX_MAX_HEARTBEAT_SLOTS) { statsHeartbeatSlots <<= 1; }
         pollIO(); // Deal with any pending I/O.
         // Sleep randomly up to 128ms to spread transmissions and thus help avoid collisions.
         sleepLowPowerLessThanMs(1 + (randRNG8() & 0x7f));
         pollIO(); // Deal with any pending I/O.
         // Send it!
         // Try for double TX for extra robustness unless:
-        //   * this is a speculative 'extra' TX
         //   * battery is low
         //   * this node is a hub so needs to listen as much as possible
+        //   * nothing has changed
         // This doesn't generally/always need to send binary/both formats
         // if this is controlling a local FHT8V on which the binary stats can be piggybacked.
         // Ie, if doesn't have a local TRV then it must send binary some of the time.
-        const bool doBinary = !localFHT8VTRVEnabled() && randRNG8NextBoolean();
-        bareStatsTX(hubMode, minute1From4AfterSensors && !batteryLow && !hubMode && ss1.changedValue(), doBinary);
+        // A significant change is always sent in the managed (JSON) form which tracks what has been sent.
+        // Important frames are sent in the TLV form which can be ACKed, and retried rather than double TXed.
+        const bool doBinary = !significantChange && !important && !localFHT8VTRVEnabled() && randRNG8NextBoolean();
+#if defined(ALLOW_STATS_ACK)
+        if(bareStatsTX(hubMode, !batteryLow && !hubMode && ss1.changedValue(), doBinary, important))
+          {
+          statsAckedValid = true;
+          statsAckedCFH = callingForHeat;
+          statsAckedBatteryLow = batteryLow;
+          statsAckMisses = 0;
+          }
+        else if(important)
+          {
+          // Step TX power back up on the first miss only, rather than pinning it at maximum with no hub to hear.
+          if(0 == statsAckMisses) { RFM22AdaptTXPower(false); }
+          // The hub missed at least this frame so cannot apply deltas until it has fresh absolute values.
+          ss1.resetTLVBaselines();
+          if(statsAckMisses < 255) { ++statsAckMisses; }
+          if(statsAckMisses >= STATS_ACK_MAX_MISSES) { statsAckHoldoffSlots = STATS_ACK_HOLDOFF_SLOTS; }
+          }
+#else
+        bareStatsTX(hubMode, !batteryLow && !hubMode && ss1.changedValue(), doBinary);
+#endif
         }
       break;
       }
@@ -2205,6 +2833,13 @@ void loopOpenTRV()
     }
 #endif
 
+#if defined(ENABLE_BOILER_HUB)
+  // Send any batched remote stats in one burst now that the time-critical work (eg FHT8V RX/TX) is done for this cycle,
+  // picking up anything that arrived during the cycle first.
+  batchInboundStatsForOutput();
+  flushHubStatsOutput(nearOverrunThreshold);
+#endif
+
   // Command-Line Interface (CLI) polling.
   // If a reasonable chunk of the minor cycle remains after all other work is done
   // AND the CLI is / should be active OR a status line has just been output
@@ -238,7 +238,9 @@ struct ModelledRadValveInputState
   ModelledRadValveInputState(const int realTempC16) :
     targetTempC(FROST), 
     minPCOpen(DEFAULT_MIN_VALVE_PC_REALLY_OPEN), maxPCOpen(100),
-    widenDeadband(false), glacial(false), hasEcoBias(false), inBakeMode(false)
+    widenDeadband(false), glacial(false), hasEcoBias(false), inBakeMode(false),
+    antiSeekDelayShift(0),
+    targetInputsValid(false), targetInputFlags(0), targetInputWARMC(0), targetInputFROSTC(0), targetInputHour(0)
     { setReferenceTemperatures(realTempC16); }
 
   // Calculate reference temperature from real temperature.
@@ -260,6 +262,17 @@ struct ModelledRadValveInputState
   bool hasEcoBias;
   // True if in BAKE mode.
   bool inBakeMode;
+  // Lengthens the anti-seek (reopen/reclose) delays by this left shift [0,2], eg to save valve movement.
+  uint8_t antiSeekDelayShift;
+
+  // Dirty tracking for targetTempC: the inputs it was last computed from by ModelledRadValve::computeTargetTemperature(),
+  // which only recomputes it when one of them differs; targetInputsValid is false until the first computation.
+  // The hour of day stands in for the by-hour stats, which change at most once per hour.
+  bool targetInputsValid;
+  uint16_t targetInputFlags;
+  uint8_t targetInputWARMC;
+  uint8_t targetInputFROSTC;
+  uint8_t targetInputHour;
 
   // Reference (room) temperature in C/16; must be set before each valve position recalc.
   // Proportional control is in the region where (refTempC16>>4) == targetTempC.
@@ -276,7 +289,9 @@ struct ModelledRadValveState
     isFiltering(false),
     valveMoved(false),
     cumulativeMovementPC(0),
-    valveTurndownCountdownM(0), valveTurnupCountdownM(0)
+    valveTurndownCountdownM(0), valveTurnupCountdownM(0),
+    heatRateC16PerH(0xff), coolRateC16PerH(0xff),
+    valveFullyOpenM(0), valveShutM(0)
     { }
 
   // Perform per-minute tasks such as counter and filter updates then recompute valve position.
@@ -319,8 +334,8 @@ struct ModelledRadValveState
   // This attempts to reduce excessive valve noise and energy use
   // and help to avoid boiler short-cycling.
   uint8_t valveTurndownCountdownM;
-  // Mark flow as having been reduced.
-  void valveTurndown() { valveTurndownCountdownM = ANTISEEK_VALVE_REOPEN_DELAY_M; }
+  // Mark flow as having been reduced, optionally lengthening the delay by a left shift [0,2].
+  void valveTurndown(const uint8_t shift = 0) { valveTurndownCountdownM = ANTISEEK_VALVE_REOPEN_DELAY_M << shift; }
   // If true then avoid turning up the heat yet.
   bool dontTurnup() { return(0 != valveTurndownCountdownM); }
 
@@ -332,26 +347,52 @@ struct ModelledRadValveState
   // This attempts to reduce excessive valve noise and energy use
   // and help to avoid boiler short-cycling.
   uint8_t valveTurnupCountdownM;
-  // Mark flow as having been increased.
-  void valveTurnup() { valveTurnupCountdownM = ANTISEEK_VALVE_RECLOSE_DELAY_M; }
+  // Mark flow as having been increased, optionally lengthening the delay by a left shift [0,2].
+  void valveTurnup(const uint8_t shift = 0) { valveTurnupCountdownM = ANTISEEK_VALVE_RECLOSE_DELAY_M << shift; }
   // If true then avoid turning down the heat yet.
   bool dontTurndown() { return(0 != valveTurnupCountdownM); }
 
   // Length of filter memory in ticks; strictly positive.
-  // Must be at least 4, and may be more efficient at a power of 2.
+  // Must be at least 4 and no more than 128, and is more efficient at a power of 2.
+  // Each tick() costs the same whatever the length, so only RAM (2 bytes/entry) limits it.
   static const size_t filterLength = 16;
 
-  // Previous unadjusted temperatures, 0 being the newest, and following ones successively older.
+  // Previous unadjusted temperatures held as a circular buffer, newest at prevRawTempHead.
+  // Access in time order with getPrevRawTempC16(i), 0 being the newest, and following ones successively older.
   // These values have any target bias removed.
   // Half the filter size times the tick() interval gives an approximate time constant.
   // Note that full response time of a typical mechanical wax-based TRV is ~20mins.
   int prevRawTempC16[filterLength];
+  // Index in prevRawTempC16[] of the newest entry; valid once initialised.
+  uint8_t prevRawTempHead;
+  // Count of adjacent pairs in prevRawTempC16[] further apart than MAX_TEMP_JUMP_C16; valid once initialised.
+  uint8_t prevRawTempJumps;
+  // Running sum of all of prevRawTempC16[]; valid once initialised.
+  // Wider than int so that long filters of high temperatures cannot overflow it.
+  int32_t prevRawTempSum;
+
+  // Get the i-th most recent unadjusted temperature, 0 being the newest; i in [0,filterLength-1].
+  int getPrevRawTempC16(const uint8_t i) const
+    { return(prevRawTempC16[(uint8_t)(prevRawTempHead + (filterLength - i)) % filterLength]); }
 
   // Get smoothed raw/unadjusted temperature from the most recent samples.
-  int getSmoothedRecent();
+  int getSmoothedRecent() const
+    { return((int)((prevRawTempSum + (int32_t)(filterLength/2)) / (int32_t)filterLength)); } // Rounded as smallIntMean().
 
   // get last change in temperature, +ve means rising.
-  int getRawDelta() { return(prevRawTempC16[0] - prevRawTempC16[1]); }
+  int getRawDelta() const { return(getPrevRawTempC16(0) - getPrevRawTempC16(1)); }
+
+  // Learned rates of room temperature change in C/16 per hour [0,254]; 0xff if not yet learned.
+  // The heating rate is with the valve held fully open (at maxPCOpen) while the room is actually warming,
+  // the cooling rate (positive for a falling temperature) with the valve held shut.
+  // Learned by tick() from whole non-overlapping windows of the filter history,
+  // each smoothed in as for the hourly stats;
+  // the owner may preload these at start-up and persist them (eg to EEPROM) from time to time.
+  uint8_t heatRateC16PerH;
+  uint8_t coolRateC16PerH;
+  // Minutes that the valve has been continuously fully open/shut, used to pick windows to learn from.
+  uint8_t valveFullyOpenM;
+  uint8_t valveShutM;
 
 //  // Compute an estimate of rate/velocity of temperature change in C/16 per minute/tick.
 //  // A positive value indicates that temperature is rising.
@@ -381,6 +422,15 @@ class ModelledRadValve : public AbstractRadValve
     // A value of 0 means not yet loaded from EEPROM.
     static uint8_t mVPRO_cache;
 
+    // Value of retainedState.cumulativeMovementPC at the start of the local day budgetDay,
+    // to track movement against the daily budget; budgetDay is initially invalid (~0).
+    uint16_t dayStartMovementPC;
+    uint16_t budgetDay;
+
+    // Get how far the valve is running ahead of its pro-rata daily movement budget [0,3], 0 being within budget.
+    // Starts a new day's budget after local midnight.
+    uint8_t computeMovementBudgetPressure();
+
     // Compute target temperature and set heat demand for TRV and boiler; update state.
     // CALL REGULARLY APPROXIMATELY ONCE PER MINUTE TO ALLOW SIMPLE TIME-BASED CONTROLS.
     // Inputs are inWarmMode(), isRoomLit().
@@ -396,10 +446,11 @@ class ModelledRadValve : public AbstractRadValve
       : inputState(0),
         callingForHeat(false),
 #if defined(TRV_SLEW_GLACIAL)
-        glacial(true)
+        glacial(true),
 #else
-        glacial(false)
+        glacial(false),
 #endif
+        dayStartMovementPC(0), budgetDay(~0)
       { }
 
     // Force a read/poll/recomputation of the target position and call for heat.
@@ -511,6 +562,26 @@ class ModelledRadValve : public AbstractRadValve
     // The lifetime of the pointed-to text must be at least that of this instance.
     const char *tagCMPC() const { return("vC|%"); }
 
+    // Get valve movement so far today as a percentage of DEFAULT_MAX_CUMULATIVE_PC_DAILY_VALVE_MOVEMENT, capped at 255.
+    uint8_t getDailyMovementBudgetUsedPC() const;
+
+    // Returns a suggested (JSON) tag/field/key name including units of getDailyMovementBudgetUsedPC(); not NULL.
+    // The lifetime of the pointed-to text must be at least that of this instance.
+    const char *tagMBPC() const { return("vB|%"); }
+
+    // Get learned room heating rate (valve fully open) in C/16 per hour; 0xff if not yet learned.
+    uint8_t getLearnedHeatRateC16PerH() const { return(retainedState.heatRateC16PerH); }
+    // Get learned room cooling rate (valve shut) in C/16 per hour; 0xff if not yet learned.
+    uint8_t getLearnedCoolRateC16PerH() const { return(retainedState.coolRateC16PerH); }
+
+    // Estimated minutes to bring the room from its current temperature up to the WARM target at the learned heating rate.
+    // Returns 0 if already at/above the target, at most 254, or 0xff if no (non-zero) heating rate has been learned yet.
+    uint8_t getEstimatedMinsToWARMTarget() const;
+
+    // Save learned heating/cooling rates to EEPROM with minimal wear; unlearned values are left alone.
+    // Call infrequently, eg hourly, to bound EEPROM wear.
+    void persistLearnedRates() const;
+
     // Return minimum valve percentage open to be considered actually/significantly open; [1,100].
     // This is a value that has to mean all controlled valves are at least partially open if more than one valve.
     // At the boiler hub this is also the threshold percentage-open on eavesdropped requests that will call for heat.
@@ -521,6 +592,15 @@ class ModelledRadValve : public AbstractRadValve
     // Applies to local valve and, at hub, to calls for remote calls for heat.
     // Any out-of-range value (eg >100) clears the override and DEFAULT_MIN_VALVE_PC_REALLY_OPEN will be used.
     static void setMinValvePcReallyOpen(uint8_t percent);
+
+#if defined(UNIT_TESTS)
+    // Set cumulative valve movement % directly [0,4095].
+    void _TEST_setCumulativeMovementPC(const uint16_t pc) { retainedState.cumulativeMovementPC = pc; }
+    // Call the (private) daily movement budget pressure computation.
+    uint8_t _TEST_computeMovementBudgetPressure() { return(computeMovementBudgetPressure()); }
+    // Overwrite the cached target temperature, eg to see if computeTargetTemperature() recomputes it.
+    void _TEST_setTargetTempC(const uint8_t tC) { inputState.targetTempC = tC; }
+#endif
   };
 // Singleton implementation for entire node.
 extern ModelledRadValve NominalRadValve;
@@ -582,8 +662,53 @@ class OccupancyTracker : public SimpleTSUint8Sensor
     uint8_t vacancyH;
     uint8_t vacancyM;
 
+    // Strongest likelihood ratio (x16) of evidence of occupancy since the last read(), or 0 if none.
+    // Set (possibly from ISRs) by the mark...() routines and consumed by read().
+    // Marked volatile for thread-safe lock-free non-read-modify-write access to byte-wide value.
+    // Compound operations must block interrupts.
+    volatile uint8_t pendingEvidenceLRX16;
+
+    // Estimated probability that the room is occupied now, 0 to 0xffff for [0,1].
+    // Updated once per minute by read() as a two-state (vacant/occupied) Bayesian filter:
+    // moves towards the prior for the hour at a rate set by the learned dwell time,
+    // then is multiplied up by the odds of any evidence heard,
+    // or down a little for each minute of silence in proportion to the learned gap between evidence while occupied.
+    uint16_t pOccupied;
+
+    // Minutes since the last evidence of occupancy; does not wrap.
+    uint8_t quietM;
+    // Minutes from the first to the latest evidence in the current run of occupancy; does not wrap.
+    uint8_t sessionM;
+    // Learned (smoothed) gap in minutes between successive items of evidence while occupied; strictly positive.
+    uint8_t evidenceGapM;
+    // Learned (smoothed) time in minutes that the room typically stays occupied; strictly positive.
+    uint8_t dwellM;
+
+    // Update the Bayesian occupancy estimate by one minute; called from read().
+    void updateEstimate();
+
   public:
-    OccupancyTracker() : occupationCountdownM(0), activityCountdownM(0), vacancyH(0), vacancyM(0) { }
+    OccupancyTracker() : occupationCountdownM(0), activityCountdownM(0), vacancyH(0), vacancyM(0),
+      pendingEvidenceLRX16(0), pOccupied(0x8000U), quietM(0xffU), sessionM(0),
+      evidenceGapM(OCCUPATION_TIMEOUT_M/2), dwellM(2*OCCUPATION_TIMEOUT_M) { }
+
+    // Likelihood ratios (x16) of each kind of evidence given occupancy, ie how much more likely it is if the room is occupied.
+    // They reflect the reliability of each signal: local UI use is near-certain,
+    // voice may be a TV or radio, and a light turning on may be a passing cloud or a timer.
+    static const uint8_t evidenceLRX16UI = 255;
+    static const uint8_t evidenceLRX16Voice = 64;
+    static const uint8_t evidenceLRX16Light = 48;
+
+    // Estimated probability that the room is occupied now from all evidence and history, as a percentage [0,100].
+    // Not thread-safe; call from the main loop only.
+    uint8_t getOccupancyProbabilityPC() const { return((uint8_t)((((uint32_t)pOccupied) * 100U + 0x8000U) >> 16)); }
+
+    // Probability below which the room is taken to be confidently vacant; [1,100].
+    static const uint8_t confidentlyVacantPC = 10;
+
+    // True if the room is (probably) unoccupied now and the Bayesian estimate is confidently vacant,
+    // which allows deeper setbacks to be used sooner than the plain occupancy timeout would.
+    bool isConfidentlyVacant() { return(isLikelyUnoccupied() && (getOccupancyProbabilityPC() < confidentlyVacantPC)); }
 
     // Force a read/poll of the occupancy and return the % likely occupied [0,100].
     // Potentially expensive/slow.
@@ -632,7 +757,7 @@ class OccupancyTracker : public SimpleTSUint8Sensor
     // Do not call from (for example) 'on' schedule change.
     // Makes occupation immediately visible.
     // Thread-safe and ISR-safe.
-    void markAsOccupied() { value = 100; occupationCountdownM = OCCUPATION_TIMEOUT_M; activityCountdownM = 2; }
+    void markAsOccupied() { value = 100; occupationCountdownM = OCCUPATION_TIMEOUT_M; activityCountdownM = 2; pendingEvidenceLRX16 = evidenceLRX16UI; }
 
     // Call when some/weak evidence of room occupation, such as a light being turned on, or voice heard.
     // Do not call based on internal/synthetic events.
@@ -640,8 +765,9 @@ class OccupancyTracker : public SimpleTSUint8Sensor
     // If the hardware allows this may immediately turn on the main GUI LED until normal GUI reverts it,
     // at least periodically.
     // Probably do not call on manual control operation to avoid interfering with UI operation.
-    // Thread-safe.
-    void markAsPossiblyOccupied();
+    // The evidence is weighted by its likelihood ratio (x16) in the Bayesian estimate, eg evidenceLRX16Voice.
+    // Thread-safe and ISR-safe.
+    void markAsPossiblyOccupied(uint8_t evidenceLRX16 = evidenceLRX16Light);
 
     // Two-bit occupancy: (00 not disclosed,) 1 not occupied, 2 possibly occupied, 3 probably occupied.
     // 0 is not returned by this implementation.
@@ -687,13 +813,13 @@ class OccupancyTracker : public SimpleTSUint8Sensor
     // Be careful of retriggering presence immediately if this is set locally.
     // Set apparent vacancy to maximum to make setting obvious and to hide further vacancy from snooping.
     // Code elsewhere may wish to put the system in FROST mode also.
-    void setHolidayMode() { activityCountdownM = 0; value = 0; occupationCountdownM = 0; vacancyH = 255U; }
+    void setHolidayMode() { activityCountdownM = 0; value = 0; occupationCountdownM = 0; vacancyH = 255U; pendingEvidenceLRX16 = 0; pOccupied = 0; }
 
 #ifdef UNIT_TESTS
     // If true then mark as occupied else mark as (just) unoccupied.
     // Hides basic _TEST_set_() which would not behave as expected.
     virtual void _TEST_set_(const bool occupied)
-      { if(occupied) { markAsOccupied(); } else { activityCountdownM = 0; value = 0; occupationCountdownM = 0; } }
+      { if(occupied) { markAsOccupied(); } else { activityCountdownM = 0; value = 0; occupationCountdownM = 0; pendingEvidenceLRX16 = 0; pOccupied = 0; } }
 //    // Set new value(s) for hours of vacancy, or marks as occupied is if zero vacancy.
 //    // If a non-zero value is set it clears the %-occupancy-confidence value for some consistency.
 //    // Makes this more usable as a mock for testing other components.
@@ -707,7 +833,9 @@ class OccupancyTracker
   {
   public:
     static void markAsOccupied() {} // Defined as NO-OP for convenience when no general occupancy support.
-    static void markAsPossiblyOccupied() {} // Defined as NO-OP for convenience when no general occupancy support.
+    static void markAsPossiblyOccupied(uint8_t = 0) {} // Defined as NO-OP for convenience when no general occupancy support.
+    static const uint8_t evidenceLRX16Voice = 0; // Unused without OCCUPANCY_SUPPORT.
+    static bool isConfidentlyVacant() { return(false); } // Always false without OCCUPANCY_SUPPORT.
     static bool isLikelyRecentlyOccupied() { return(false); } // Always false without OCCUPANCY_SUPPORT
     static bool isLikelyOccupied() { return(false); } // Always false without OCCUPANCY_SUPPORT
     static bool isLikelyUnoccupied() { return(false); } // Always false without OCCUPANCY_SUPPORT
@@ -731,6 +859,7 @@ extern OccupancyTracker Occupancy;
 void sampleStats(bool fullSample);
 
 // Clear all collected statistics, eg when moving device to a new room or at a major time change.
+// Includes the weekly profile.
 // Requires 1.8ms per byte for each byte that actually needs erasing.
 //   * maxBytesToErase limit the number of bytes erased to this; strictly positive, else 0 to allow 65536
 // Returns true if finished with all bytes erased.
@@ -740,6 +869,24 @@ bool zapStats(uint16_t maxBytesToErase = 0);
 // A value of 0xff (255) means unset (or out of range); other values depend on which stats set is being used.
 uint8_t getByHourStat(uint8_t hh, uint8_t statsSet);
 
+// Weekly profile by hour of the week [0,167] (see getHourOfWeekLT()), updated by sampleStats() at each full sample,
+// so that weekday and weekend patterns can be told apart, eg an office empty at weekends.
+// See EE_START_WEEK_PROFILE for the encoding.
+// Get the smoothed occupancy level [0,EE_WEEK_PROFILE_OCC_MAX] for the given hour of the week, or STATS_UNSET_BYTE if not known.
+uint8_t getWeeklyOccupancyLevel(uint8_t hourOfWeek);
+// Get the WARM mode history for the given hour of the week, bits 2--0 for the last three weeks (bit 2 most recent),
+// or STATS_UNSET_BYTE if not known.
+uint8_t getWeeklyWARMHistory(uint8_t hourOfWeek);
+// True if the weekly profile shows the given hour of the week as usually vacant,
+// ie occupancy seen rarely if ever at this hour in recent weeks; false if not known.
+bool isWeeklyProfileVacant(uint8_t hourOfWeek);
+// Compute the new weekly profile byte from the old one (0xff if unset),
+// the hour's mean occupancy percentage [0,100] (or STATS_UNSET_BYTE if not available) and whether it was mainly in WARM mode.
+// Occupancy moves halfway to each new level from the middle level at first, so at least two vacant samples are needed
+// for isWeeklyProfileVacant(); the first sample sets the WARM bits outright, then they shift along.
+// Pure function, exposed for unit testing.
+uint8_t updateWeeklyProfileByte(uint8_t old, uint8_t occPC, bool warm);
+
 // Returns true if specified hour is (conservatively) in the specifed outlier quartile for specified stats set.
 // Returns false if a full set of stats not available, eg including the specified hour.
 // Always returns false if all samples are the same.
@@ -748,6 +895,11 @@ uint8_t getByHourStat(uint8_t hh, uint8_t statsSet);
 //   * hour  hour of day to use or ~0 for current hour.
 bool inOutlierQuartile(uint8_t inTop, uint8_t statsSet, uint8_t hour = ~0);
 
+#if defined(UNIT_TESTS)
+// Update the last and (following) smoothed stats values for hour hh [0,23] as sampleStats() does, for unit tests.
+void _TEST_simpleUpdateStatsPair(uint8_t lastSetN, uint8_t hh, uint8_t value);
+#endif
+
 // 'Unset'/invalid values for byte (eg raw EEPROM byte) and int (eg after decompression).
 #define STATS_UNSET_BYTE 0xff
 #define STATS_UNSET_INT 0x7fff
@@ -755,7 +907,8 @@ bool inOutlierQuartile(uint8_t inTop, uint8_t statsSet, uint8_t hour = ~0);
 #ifdef ENABLE_ANTICIPATION
 // Returns true iff room likely to be occupied and need warming at the specified hour's sample point based on collected stats.
 // Used for predictively warming a room in smart mode and for choosing setback depths.
-// Returns false if no good evidence to warm the room at the given time based on past history over about one week.
+// Returns false if no good evidence to warm the room at the given time based on past history over recent weeks,
+// in particular if the weekly profile shows that hour of the week (today, or tomorrow if already passed) usually vacant.
 //   * hh hour to check for predictive warming [0,23]
 bool shouldBeWarmedAtHour(const uint_least8_t hh);
 #endif
@@ -793,6 +946,11 @@ int expandTempC16(uint8_t cTemp);
 
 
 
+#if defined(ALLOW_JSON_OUTPUT)
+// True if the managed stats sent by this unit include the given key, after updating them; eg to test that all fit.
+bool managedStatsContainsKey(const char *key);
+#endif
+
 // Clear and populate core stats structure with information from this node.
 // Exactly what gets filled in will depend on sensors on the node,
 // and may depend on stats TX security level (if collecting some sensitive items is also expensive).
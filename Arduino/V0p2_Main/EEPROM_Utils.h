@@ -119,6 +119,16 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2015
 // Default might be (say) DEFAULT_VALVE_PC_MODERATELY_OPEN eg 33%, or twice the minimum.
 #define EE_START_MIN_TOTAL_VALVE_PC_OPEN 31 // Ignored entirely if outside range [1,100], eg if default/unprogrammed 0xff.
 
+// Persistent top 16 bits (big-endian) of the secure frame message counter, bumped before each use so never reused.
+#define EE_START_SECURE_TX_EPOCH 32 // 2-byte epoch; 0xffff (unprogrammed) is treated as the last value before wrapping to 0.
+// Primary building (shared) AES-128 key used to authenticate/encrypt frames between leaf nodes and the hub.
+#define EE_START_PRIMARY_BUILDING_KEY 34 // 16-byte key; all 0xff (unprogrammed) means no key is set.
+#define EE_LEN_PRIMARY_BUILDING_KEY 16
+
+// Learned room heating (valve fully open) and cooling (valve shut) rates used to time pre-warming.
+#define EE_START_LEARNED_HEAT_RATE 50 // 1-byte rate in C/16 per hour; 0xff (unprogrammed) means not yet learned.
+#define EE_START_LEARNED_COOL_RATE 51 // 1-byte rate in C/16 per hour; 0xff (unprogrammed) means not yet learned.
+
 
 
 
@@ -144,7 +154,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2015
 #define EE_STATS_SET_RHPC_BY_HOUR_SMOOTHED      7  // Smoothed hourly relative humidity % samples in range [0,100].
 #define EE_STATS_SET_USER1_BY_HOUR              8  // Last hourly user-defined stats value in range [0,254].
 #define EE_STATS_SET_USER1_BY_HOUR_SMOOTHED     9  // Smoothed hourly user-defined stats value in range [0,254].
-//#define EE_STATS_SET_WARMMODE_BY_HOUR_OF_WK    10  // Each sample is last 7 days' WARM mode bitset by hour. [0,127].
+// Set 10 is reserved; WARM mode history is kept by hour of the week in the weekly profile below.
 
 #define EE_STATS_SETS 10 // Number of stats sets in range [0,EE_STATS_SETS-1].
 
@@ -157,9 +167,25 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2015
 
 
 
+// Weekly profile: one byte per hour of the week [0,167] from midnight starting Monday local time, straight after the stats sets.
+// Two nybbles per byte so that each hour of the week needs only one (rare, weekly) EEPROM update:
+//   * high nybble: smoothed occupancy level [0,EE_WEEK_PROFILE_OCC_MAX] (~7% steps), 0xf if unset;
+//   * low nybble: bit 3 clear once in use, bits 2--0 set if in WARM mode at this hour in each of the last three weeks, bit 2 most recent.
+// 0xff when unset/erased.
+#define EE_START_WEEK_PROFILE (EE_END_STATS+1)
+#define EE_WEEK_PROFILE_SIZE 168
+#define EE_WEEK_PROFILE_OCC_MAX 14
+// INCLUSIVE END OF WEEKLY PROFILE: must point to last byte used.
+#define EE_END_WEEK_PROFILE (EE_START_WEEK_PROFILE+EE_WEEK_PROFILE_SIZE-1)
+
+
+
 #if EE_END_HUB_HC_FILTER >= EE_START_STATS
 #error EEPROM allocation problem: Hub HC filter overlaps with stats
 #endif
+#if EE_END_WEEK_PROFILE > 1023
+#error EEPROM allocation problem: weekly profile does not fit in 1kB EEPROM
+#endif
 
 
 // Updates an EEPROM byte iff not currently at the specified target value.
@@ -74,19 +74,8 @@ const uint8_t FHT8V_RFM22_Reg_Values[][2] PROGMEM =
 // The maximum legal ERP (not TX output power) on 868.35 MHz is 25 mW with a 1% duty cycle (see IR2030/1/16).
 //EEPROM ($6d,%00001111) ; RFM22REG_TX_POWER: Maximum TX power: 100mW for RFM22; not legal in UK/EU on RFM22 for this band.
 //EEPROM ($6d,%00001000) ; RFM22REG_TX_POWER: Minimum TX power (-1dBm).
-#ifndef RFM22_IS_ACTUALLY_RFM23
-    #ifndef RFM22_GOOD_RF_ENV
-    {0x6d,0xd}, // RFM22REG_TX_POWER: RFM22 +14dBm ~25mW ERP with 1/4-wave antenna.
-    #else // Tone down for good RF backplane, etc.
-    {0x6d,0x9},
-    #endif
-#else
-    #ifndef RFM22_GOOD_RF_ENV
-    {0x6d,0xf}, // RFM22REG_TX_POWER: RFM23 max power (+13dBm) for ERP ~25mW with 1/4-wave antenna.
-    #else // Tone down for good RF backplane, etc.
-    {0x6d,0xb},
-    #endif
-#endif
+// RFM22_TX_POWER_MAX_STEP is selected in RFM22_Radio.h for the module and RF environment; may be turned down at run-time.
+    {0x6d,RFM22_TX_POWER_LNA_SW|RFM22_TX_POWER_MAX_STEP}, // RFM22REG_TX_POWER: 0xd/0x9 for RFM22, 0xf/0xb for RFM23.
 
     {0x6e,40}, {0x6f,245}, // 5000bps, ie 200us/bit for FHT (6 for 1, 4 for 0).  10485 split across the registers, MSB first.
     {0x70,0x20}, // MOD CTRL 1: low bit rate (<30kbps), no Manchester encoding, no whitening.
@@ -268,7 +257,8 @@ uint8_t *FHT8VCreateValveSetCmdFrameHT_r(uint8_t *const bptrInitial, const bool
 #if defined(ALLOW_MINIMAL_STATS_TXRX)
     // As bandwidth optimisation just write minimal trailer if only temp&power available.
     if(trailer->containsTempAndPower &&
-       !trailer->containsID && !trailer->containsAmbL)
+       !trailer->containsID && !trailer->containsAmbL &&
+       !trailer->containsRHP && !trailer->containsCFH)
       {
       writeTrailingMinimalStatsPayload(bptr, &(trailer->tempAndPower));
       bptr += 3;
@@ -470,6 +460,16 @@ static void FHT8VTXFHTQueueAndSendCmd(uint8_t *bptr, const bool doubleTX)
   StopEavesdropOnFHT8V(); // Unconditional cleardown of eavesdrop.
 #endif
 
+#if defined(RFM22_NATIVE_PACKET_HANDLER)
+  // Always reload the raw FHT8V framing before valve TX, whatever profile RX or stats TX may have left selected;
+  // the native profile is selected again only when RX resumes.
+  RFM22ModeStandbyAndClearState();
+  RFM22LoadRawPacketHandler();
+#if defined(DEBUG)
+  if(!RFM22IsRawPacketHandlerLoaded()) { DEBUG_SERIAL_PRINTLN_FLASHSTRING("FHT8V TX without raw profile"); panic(); }
+#endif
+#endif
+
   RFM22QueueCmdToFF(bptr);
   RFM22TXFIFO(); // Send it!  Approx 1.6ms/byte and < 80ms max.
 
@@ -823,6 +823,9 @@ static volatile uint16_t lastCallForHeatHC = ~0;
 // Useful to assess the noise enviromentment.
 static volatile uint8_t lastRXerrno;
 
+// RSSI captured at the most recent sync detection, to attribute to the frame that follows.
+static volatile uint8_t lastSyncRSSI;
+
 // Atomically returns and clears last (FHT8V) RX error code, or 0 if none.
 // Set with such codes as FHT8VRXErr_GENERIC; never set to zero.
 static void setLastRXErr(const uint8_t err) { ATOMIC_BLOCK (ATOMIC_RESTORESTATE) { lastRXerrno = err; } }
@@ -831,7 +834,13 @@ static void setLastRXErr(const uint8_t err) { ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
 static void _SetupRFM22ToEavesdropOnFHT8V()
   {
   RFM22ModeStandbyAndClearState();
+#if defined(RFM22_NATIVE_PACKET_HANDLER_RX)
+  // Listen only for OpenTRV-native frames, validated (length and CRC) by the radio.
+  RFM22SetNativePacketHandler(true);
+  RFM22SetUpNativeRX(true);
+#else
   RFM22SetUpRX(MIN_FHT8V_200US_BIT_STREAM_BUF_SIZE, true, true); // Set to RX longest-possible valid FS20 encoded frame.
+#endif
 #if !defined(V0p2_REV)
 #error Board revision not defined.
 #endif
@@ -865,6 +874,9 @@ void StopEavesdropOnFHT8V(bool force)
   if(!force && !eavesdropping) { return; }
   eavesdropping = false;
   RFM22ModeStandbyAndClearState();
+#if defined(RFM22_NATIVE_PACKET_HANDLER)
+  RFM22SetNativePacketHandler(false); // Revert to FHT8V-compatible framing until RX resumes.
+#endif
 #if 0 && defined(DEBUG)
   DEBUG_SERIAL_PRINTLN_FLASHSTRING("RX stop");
 #endif
@@ -1102,6 +1114,140 @@ void debugReportRSSI(const uint8_t id)
 #else
 #define debugReportRSSI(id)
 #endif
+
+// Record JSON stats frame already checked and adjusted by adjustJSONMsgForRXAndCheckCRC(), unless a recent repeat.
+// The frame has no binary ID and its CRC has been stripped,
+// so a Fletcher-style checksum of the text stands in for the ID and the length for the CRC,
+// ie repeats are recognised by their whole content.
+static void _recordRXedJSON(const char * const json)
+  {
+  uint8_t s1 = 0, s2 = 0, len = 0;
+  for(const char *p = json; '\0' != *p; ++p, ++len) { s1 += (uint8_t)*p; s2 += s1; }
+  if(isRecentDuplicateRXFrame(s1, s2, len)) { return; }
+#if defined(ALLOW_JSON_DICT_COMPRESSION)
+  // Expand any dictionary compression back to plain JSON.
+  char plain[MSG_JSON_MAX_EXPANDED_LENGTH+1];
+  if(0 == expandJSONDict(json, plain, sizeof(plain))) { return; }
+  recordJSONStats(false, plain);
+#else
+  recordJSONStats(false, json);
+#endif
+  }
+
+#if defined(ALLOW_STATS_RX) && defined(ALLOW_STATS_ACK)
+// If the checked TLV frame asks for one, send an ACK straight back to its sender
+// (even for a repeat, since the earlier ACK may have been lost),
+// with a hint if its link has margin to spare so that it can turn down its TX power,
+// and with ENABLE_ZONE_COORDINATOR its pre-warm stagger slot.
+// The caller must restart RX afterwards.
+static void _ackStatsTLV(const uint8_t *const frame)
+  {
+  if(!statsTLVFrameWantsAck(frame)) { return; }
+  const uint8_t id0 = statsTLVFrameID0(frame), id1 = statsTLVFrameID1(frame);
+#if defined(ENABLE_ZONE_COORDINATOR)
+  const uint8_t staggerSlot = Zones.getStaggerSlot(((uint16_t)id0 << 8) | id1);
+#else
+  const uint8_t staggerSlot = 0;
+#endif
+  uint8_t buf[STATS_MSG_START_OFFSET + STATS_TLV_ACK_BYTES + 1];
+  if(0 == statsTLVWriteAck(buf + STATS_MSG_START_OFFSET, STATS_TLV_ACK_BYTES, statsTLVFrameSeq(frame), id0, id1, linkHasMargin(id0, id1), staggerSlot)) { return; }
+  buf[sizeof(buf) - 1] = 0xff; // Terminate message for TX.
+  RFM22RawStatsTX(true, buf, false);
+  }
+#else
+#define _ackStatsTLV(frame) {}
+#endif
+
+#if defined(ALLOW_STATS_RX) && !defined(ENABLE_STATS_RELAY)
+// Record each node's full stats frame carried in the checked relayed stats frame at buf, unless a repeat or stale (see isRecentDuplicateRelayedRXFrame()).
+// Link quality is not recorded since the RSSI is that of the relay.
+static void _recordRelayedStats(const uint8_t *const buf, const uint8_t len)
+  {
+  const uint8_t n = 1 + (buf[0] & ~RELAY_STATS_HEADER_MASK);
+  const uint8_t *p = buf + 2;
+  const uint8_t *const end = buf + len - 1; // Records end at the outer CRC.
+  for(uint8_t i = 0; i < n; ++i)
+    {
+    FullStatsMessageCore_t content;
+    const uint8_t *const tail = decodeFullStatsMessageCore(p, end - p, stTXalwaysAll, false, &content);
+    if(NULL == tail) { return; } // Cannot find any following records.
+    if(content.containsID && !isRecentDuplicateRelayedRXFrame(content.id0, content.id1, tail[-1]))
+      { recordCoreStats(0 != (p[0] & MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE), &content); }
+    p = tail;
+    }
+  }
+#else
+#define _recordRelayedStats(buf, len) {}
+#endif
+
+#if defined(ENABLE_STATS_RELAY)
+// Queue core stats decoded from an FHT8V frame's trailer for relay, re-encoded with the ID from the FHT8V house code.
+static void _relayCoreStats(const FullStatsMessageCore_t *const content)
+  {
+  uint8_t buf[FullStatsMessageCore_MAX_BYTES_ON_WIRE + 1];
+  const uint8_t *const tail = encodeFullStatsMessageCore(buf, sizeof(buf), stTXalwaysAll, false, content);
+  if(NULL != tail) { queueStatsFrameForRelay(buf, tail - buf); }
+  }
+#else
+#define _relayCoreStats(content) {}
+#endif
+
+#if defined(RFM22_NATIVE_PACKET_HANDLER_RX)
+// Handle OpenTRV-native frame of len bytes at the start of FHT8VRXHubArea already checked by the radio's CRC.
+// Returns true if the frame was recognised and recorded.
+static bool _handleNativeFrame(const uint8_t len)
+  {
+  const uint8_t b = FHT8VRXHubArea[0];
+  if(MSG_JSON_LEADING_CHAR == b)
+    {
+    // Still check/strip the in-frame CRC, which is part of the JSON frame format.
+    if(adjustJSONMsgForRXAndCheckCRC((char *)FHT8VRXHubArea, len) <= 0) { return(false); }
+    _recordRXedJSON((const char *)FHT8VRXHubArea);
+    return(true);
+    }
+#if defined(ALLOW_STATS_RX) && defined(ALLOW_STATS_TLV)
+  if(STATS_TLV_HEADER_MSBS == (b & STATS_TLV_HEADER_MASK))
+    {
+    const uint8_t tlvLen = statsTLVCheckFrame(FHT8VRXHubArea, len);
+    if(0 == tlvLen) { return(false); }
+    const uint8_t id0 = statsTLVFrameID0(FHT8VRXHubArea), id1 = statsTLVFrameID1(FHT8VRXHubArea);
+    recordLinkQuality(id0, id1, lastSyncRSSI, statsTLVFrameSeq(FHT8VRXHubArea));
+    _ackStatsTLV(FHT8VRXHubArea);
+    if(isRecentDuplicateRXFrame(id0, id1, FHT8VRXHubArea[tlvLen-1])) { return(true); }
+    recordStatsTLV(false, FHT8VRXHubArea, len);
+    return(true);
+    }
+#endif
+#if defined(ALLOW_STATS_RX)
+  if((MESSAGING_FULL_STATS_FLAGS_HEADER_MSBS == (b & MESSAGING_FULL_STATS_FLAGS_HEADER_MASK)) ||
+     MESSAGING_FULL_STATS_IS_SECURE_HEADER(b))
+    {
+    FullStatsMessageCore_t content;
+    const uint8_t *const tail = decodeFullStatsMessageCore(FHT8VRXHubArea, len, stTXalwaysAll, false, &content);
+    if(NULL == tail) { return(false); }
+    if(content.containsID)
+      {
+      recordLinkQuality(content.id0, content.id1, lastSyncRSSI, LINK_QUALITY_NO_SEQ);
+      if(!isRecentDuplicateRXFrame(content.id0, content.id1, tail[-1]))
+        {
+        recordCoreStats(0 != (b & MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE), &content);
+        queueStatsFrameForRelay(FHT8VRXHubArea, tail - FHT8VRXHubArea);
+        }
+      }
+    return(true);
+    }
+  if(RELAY_STATS_HEADER_MSBS == (b & RELAY_STATS_HEADER_MASK))
+    {
+    const uint8_t relayLen = checkRelayStatsFrame(FHT8VRXHubArea, len);
+    if(0 == relayLen) { return(false); }
+    _recordRelayedStats(FHT8VRXHubArea, relayLen);
+    return(true);
+    }
+#endif
+  return(false);
+  }
+#endif
+
 bool FHT8VCallForHeatPoll()
   {
   // Do nothing unless already in eavesdropping mode.
@@ -1122,6 +1268,24 @@ bool FHT8VCallForHeatPoll()
 
   const uint16_t status = RFM22ReadStatusBoth(); // reg1:reg2, on V0.08 PICAXE tempB2:SPI_DATAB.
 
+#if defined(RFM22_NATIVE_PACKET_HANDLER_RX)
+  if(status & RFM22_STATUS_NATIVE_PKT_VALID) // Received frame with good length and CRC.
+    {
+    memset(FHT8VRXHubArea, 0xff, sizeof(FHT8VRXHubArea));
+    const uint8_t len = RFM22RXNativeFrame(FHT8VRXHubArea, sizeof(FHT8VRXHubArea) - 1); // Leave room for terminator.
+    const bool gotFrame = (0 != len) && _handleNativeFrame(len);
+    if(!gotFrame) { setLastRXErr(FHT8VRXErr_BAD_RX_STATSFRAME); }
+    _SetupRFM22ToEavesdropOnFHT8V(); // Reset/restart RX.
+    return(gotFrame);
+    }
+  else if(status & RFM22_STATUS_NATIVE_CRC_ERROR) // Corrupt frame discarded by the radio: don't touch the FIFO.
+    {
+    setLastRXErr(FHT8VRXErr_BAD_RX_FRAME);
+    _SetupRFM22ToEavesdropOnFHT8V(); // Reset/restart RX.
+    return(false);
+    }
+  else
+#endif
   if(status & 0x1000) // Received frame.
     {
 #if 0 && defined(DEBUG)
@@ -1145,7 +1309,7 @@ bool FHT8VCallForHeatPoll()
           {
           if(adjustJSONMsgForRXAndCheckCRC((char *)(FHT8VRXHubArea + pos), sizeof(FHT8VRXHubArea)-pos) > 0)
             {
-            recordJSONStats(false, (const char *)(FHT8VRXHubArea + pos));
+            _recordRXedJSON((const char *)(FHT8VRXHubArea + pos));
             _SetupRFM22ToEavesdropOnFHT8V(); // Reset/restart RX.
             return(true); // Claim that something has been received.
             }
@@ -1156,7 +1320,27 @@ bool FHT8VCallForHeatPoll()
           _SetupRFM22ToEavesdropOnFHT8V(); // Reset/restart RX.
           return(false); // Didn't look like valid JSON.
           }
-        else if(MESSAGING_FULL_STATS_FLAGS_HEADER_MSBS == (b & MESSAGING_FULL_STATS_FLAGS_HEADER_MASK))
+#if defined(ALLOW_STATS_RX) && defined(ALLOW_STATS_TLV)
+        else if(STATS_TLV_HEADER_MSBS == (b & STATS_TLV_HEADER_MASK))
+          {
+          // May be compact binary TLV stats frame; its structure and CRC delimit it.
+          const uint8_t *const msg = FHT8VRXHubArea + pos;
+          const uint8_t tlvLen = statsTLVCheckFrame(msg, sizeof(FHT8VRXHubArea)-pos);
+          const bool ok = (0 != tlvLen);
+          if(ok)
+            {
+            const uint8_t id0 = statsTLVFrameID0(msg), id1 = statsTLVFrameID1(msg);
+            recordLinkQuality(id0, id1, lastSyncRSSI, statsTLVFrameSeq(msg));
+            _ackStatsTLV(msg);
+            if(!isRecentDuplicateRXFrame(id0, id1, msg[tlvLen-1])) { recordStatsTLV(false, msg, tlvLen); }
+            }
+          else { setLastRXErr(FHT8VRXErr_BAD_RX_STATSFRAME); }
+          _SetupRFM22ToEavesdropOnFHT8V(); // Reset/restart RX.
+          return(ok);
+          }
+#endif
+        else if((MESSAGING_FULL_STATS_FLAGS_HEADER_MSBS == (b & MESSAGING_FULL_STATS_FLAGS_HEADER_MASK)) ||
+                MESSAGING_FULL_STATS_IS_SECURE_HEADER(b))
           {
           // May be binary stats frame, so attempt to decode...
           FullStatsMessageCore_t content;
@@ -1174,7 +1358,12 @@ bool FHT8VCallForHeatPoll()
                DEBUG_SERIAL_PRINTFMT(content.id1, HEX);
                DEBUG_SERIAL_PRINTLN();
 #endif
-               recordCoreStats(false, &content);
+               recordLinkQuality(content.id0, content.id1, lastSyncRSSI, LINK_QUALITY_NO_SEQ);
+               if(!isRecentDuplicateRXFrame(content.id0, content.id1, msg[-1]))
+                 {
+                 recordCoreStats(0 != (b & MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE), &content);
+                 queueStatsFrameForRelay(FHT8VRXHubArea, msg - FHT8VRXHubArea);
+                 }
                }
              _SetupRFM22ToEavesdropOnFHT8V(); // Reset/restart RX.
              return(true); // Received something!
@@ -1190,6 +1379,15 @@ bool FHT8VCallForHeatPoll()
           _SetupRFM22ToEavesdropOnFHT8V(); // Reset/restart RX.
           return(false); // Nothing valid received.
           }
+        else if(RELAY_STATS_HEADER_MSBS == (b & RELAY_STATS_HEADER_MASK))
+          {
+          // May be several nodes' stats frames from a relay.
+          const uint8_t relayLen = checkRelayStatsFrame(FHT8VRXHubArea + pos, sizeof(FHT8VRXHubArea)-pos);
+          if(0 != relayLen) { _recordRelayedStats(FHT8VRXHubArea + pos, relayLen); }
+          else { setLastRXErr(FHT8VRXErr_BAD_RX_STATSFRAME); }
+          _SetupRFM22ToEavesdropOnFHT8V(); // Reset/restart RX.
+          return(0 != relayLen);
+          }
 
         if(pos < 2)
           {
@@ -1241,11 +1439,14 @@ bool FHT8VCallForHeatPoll()
       DEBUG_SERIAL_PRINTLN();
 #endif
 
+      // Note link quality for this sender (FS20 house codes never collide with OpenTRV IDs).
+      recordLinkQuality(command.hc1, command.hc2, lastSyncRSSI, LINK_QUALITY_NO_SEQ);
+
 #if defined(ALLOW_STATS_RX) // Only look for the trailer if supported.
       // If whole FHT8V frame was OK then check if there is a valid stats trailer.
 
       // Check for 'core' stats trailer.
-      if((trailer + FullStatsMessageCore_MAX_BYTES_ON_WIRE <= lastByte) && // Enough space for minimum-stats trailer.
+      if((trailer + FullStatsMessageCore_MAX_BYTES_ON_WIRE_NO_APL <= lastByte) && // Enough space for minimum-stats trailer.
          (MESSAGING_FULL_STATS_FLAGS_HEADER_MSBS == (trailer[0] & MESSAGING_FULL_STATS_FLAGS_HEADER_MASK)))
         {
         FullStatsMessageCore_t content;
@@ -1269,8 +1470,15 @@ bool FHT8VCallForHeatPoll()
             content.containsID = true;
             }
 
-          // If frame looks good then capture it.
-          if(allGood) { recordCoreStats(false, &content); }
+          // If frame looks good then capture it, unless a repeat (eg from the double TX of the valve command).
+          if(allGood)
+            {
+            if(!isRecentDuplicateRXFrame(content.id0, content.id1, tail[-1]))
+              {
+              recordCoreStats(false, &content);
+              _relayCoreStats(&content);
+              }
+            }
           else { setLastRXErr(FHT8VRXErr_BAD_RX_SUBFRAME); }
           // TODO: record error with mismatched ID.
           }
@@ -1319,6 +1527,12 @@ bool FHT8VCallForHeatPoll()
       // and the housecode is accepted.
       if(0x26 == command.command)
         {
+#if defined(ENABLE_BOILER_DRIVER_LOGIC)
+        // Pass every valve setting heard (including low ones that end a call for heat early) to the boiler logic
+        // to weigh against all the other radiators' latest signals.
+        if(FHT8VHubAcceptedHouseCode(command.hc1, command.hc2))
+          { BoilerControl.receiveSignal((command.hc1 << 8) | command.hc2, (uint8_t)((command.extension * 100 + 127) / 255)); }
+#endif
         // Initial fix for TODO-520: Bad comparison screening incoming calls for heat at boiler hub.
         const uint8_t mvro = NominalRadValve.getMinValvePcReallyOpen();
         if((command.extension > (mvro << 1)) && // Quick approximation as filter with some false positives.
@@ -1357,7 +1571,7 @@ bool FHT8VCallForHeatPoll()
 #endif
     // Capture some entropy from RSSI and timing...
     const uint8_t rssi = RFM22RSSI();
-    // TODO adjust output power down a little if RX very loud.
+    lastSyncRSSI = rssi; // Attribute to the frame that follows.
     addEntropyToPool(rssi ^ (uint8_t)(status ^ (status >> 8)), 1); // Maybe ~1 real bit of entropy.
 #if 0 && defined(DEBUG)
     if(rssi > 0)
@@ -89,7 +89,8 @@ uint8_t *FHT8VCreateValveSetCmdFrame_r(uint8_t *bptr, fht8v_msg_t *command, cons
 #else
 #define FHT8V_MAX_EXTRA_PREAMBLE_BYTES 0
 #endif
-#define FHT8V_MAX_EXTRA_TRAILER_BYTES (1+max(MESSAGING_TRAILING_MINIMAL_STATS_PAYLOAD_BYTES,FullStatsMessageCore_MAX_BYTES_ON_WIRE))
+// Stats trailers never carry an ASCII payload, to keep the whole frame within the radio TX FIFO.
+#define FHT8V_MAX_EXTRA_TRAILER_BYTES (1+max(MESSAGING_TRAILING_MINIMAL_STATS_PAYLOAD_BYTES,FullStatsMessageCore_MAX_BYTES_ON_WIRE_NO_APL))
 #define FHT8V_200US_BIT_STREAM_FRAME_BUF_SIZE (FHT8V_MAX_EXTRA_PREAMBLE_BYTES + MIN_FHT8V_200US_BIT_STREAM_BUF_SIZE + FHT8V_MAX_EXTRA_TRAILER_BYTES) // Buffer space needed.
 
 
@@ -23,9 +23,11 @@ Author(s) / Copyright (s): Damon Hart-Davis 2014--2015
 #include <util/atomic.h>
 
 #include "Messaging.h"
+#include "AES_GCM.h"
 #include "EEPROM_Utils.h"
 #include "PRNG.h"
 #include "Power_Management.h"
+#include "RTC_Support.h"
 #include "Security.h"
 #include "Serial_IO.h"
 
@@ -159,31 +161,154 @@ void extractTrailingMinimalStatsPayload(const uint8_t *const buf, trailingMinima
 
 
 #if defined(ALLOW_STATS_RX)
-#ifndef getInboundStatsQueueOverrun
-// Count of dropped inbound stats message due to insufficient queue space.
-// Must only be accessed under a lock (ATOMIC_BLOCK).
-static uint16_t inboundStatsQueueOverrun = 0;
+// Inbound stats queue.
+// A single-producer/single-consumer ring buffer of variable-length frames.
+// Each frame is stored as a one-byte header (type in the msbit, body length in the low 7 bits)
+// followed by the body, and may wrap around the end of the buffer.
+// The producer only writes queueHead and the consumer only writes queueTail;
+// each index is a single byte so is read/written atomically on AVR without a lock,
+// and is only advanced once the bytes it covers have been completely written/read.
+// One byte is always left free to distinguish full from empty.
+#if (INBOUND_STATS_QUEUE_SIZE & (INBOUND_STATS_QUEUE_SIZE - 1)) || (INBOUND_STATS_QUEUE_SIZE > 256)
+#error INBOUND_STATS_QUEUE_SIZE must be a power of two no larger than 256
+#endif
+#if (MSG_JSON_MAX_EXPANDED_LENGTH + 2 > INBOUND_STATS_QUEUE_SIZE) || (MSG_JSON_MAX_EXPANDED_LENGTH > 0x7f)
+#error INBOUND_STATS_QUEUE_SIZE too small to hold a maximum-length JSON frame
+#endif
+#define INBOUND_STATS_QUEUE_MASK ((uint8_t)(INBOUND_STATS_QUEUE_SIZE - 1))
+#define INBOUND_STATS_HEADER_JSON 0x80 // Header msbit set for JSON (text) frame, else core stats.
+static uint8_t inboundStatsQueue[INBOUND_STATS_QUEUE_SIZE];
+static volatile uint8_t queueHead; // Index of next byte to write; only written by producer.
+static volatile uint8_t queueTail; // Index of next byte to read; only written by consumer.
+
+// Count of dropped inbound stats messages due to insufficient queue space; saturates.
+// Only written by the producer.
+static volatile uint16_t inboundStatsQueueOverrun;
+// Maximum number of bytes (including headers) ever queued at once.
+// Only written by the producer.
+static volatile uint8_t inboundStatsQueueHighWater;
+
+// Bytes currently in use, given head and tail snapshots.
+static inline uint8_t _queueUsed(const uint8_t head, const uint8_t tail) { return((uint8_t)(head - tail) & INBOUND_STATS_QUEUE_MASK); }
+
+// Append a frame of the given type and body to the queue, or count a drop if there is no space.
+// Producer side only.
+static void _queueFrame(const uint8_t header, const uint8_t *body, const uint8_t len)
+  {
+  const uint8_t head = queueHead;
+  const uint8_t used = _queueUsed(head, queueTail);
+  const uint8_t needed = len + 1;
+  if(used + needed > INBOUND_STATS_QUEUE_SIZE - 1)
+    {
+    ATOMIC_BLOCK (ATOMIC_RESTORESTATE) // Keep 16-bit count consistent for readers.
+      { if(inboundStatsQueueOverrun < 0xffffU) { ++inboundStatsQueueOverrun; } }
+    return;
+    }
+  uint8_t i = head;
+  inboundStatsQueue[i] = header | len;
+  for(uint8_t n = 0; n < len; ++n)
+    {
+    i = (i + 1) & INBOUND_STATS_QUEUE_MASK;
+    inboundStatsQueue[i] = body[n];
+    }
+  if(used + needed > inboundStatsQueueHighWater) { inboundStatsQueueHighWater = used + needed; }
+  // Publish the whole frame at once.
+  queueHead = (i + 1) & INBOUND_STATS_QUEUE_MASK;
+  }
 
+#ifndef getInboundStatsQueueOverrun
 // Get count of dropped inbound stats messages due to insufficient queue space.
 uint16_t getInboundStatsQueueOverrun()
   {
   ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
     { return(inboundStatsQueueOverrun); }
+  return(0); // Not reachable.
   }
 #endif
-#endif
 
+// Get the maximum number of bytes (including per-frame overhead) ever held in the inbound stats queue.
+uint8_t getInboundStatsQueueHighWaterMark() { return(inboundStatsQueueHighWater); }
+
+// Get the number of bytes (including per-frame overhead) currently held in the inbound stats queue.
+uint8_t getInboundStatsQueueDepth() { return(_queueUsed(queueHead, queueTail)); }
+
+// Recently-accepted frames for duplicate suppression.
+typedef struct RXDedupEntry
+  {
+  uint8_t id0, id1; // Sender ID.
+  uint8_t crc; // Frame CRC or other check value.
+  bool used : 1; // True once this slot holds a frame.
+  bool relayed : 1; // True if the frame was relayed rather than heard directly from its sender.
+  uint16_t when; // Seconds since midnight (mod 2^16) when accepted.
+  } RXDedupEntry_t;
+static RXDedupEntry_t rxDedupTable[RX_DEDUP_TABLE_SIZE];
+// Next slot to overwrite; slots are filled in order so this is also the oldest.
+static uint8_t rxDedupNext;
+// Count of inbound frames dropped as duplicates; saturates.
+// Only written by the producer.
+static volatile uint16_t rxDuplicatesSuppressed;
+
+// True if the frame is a recent duplicate, in which case it should be dropped (and it is counted),
+// else remembers this frame as accepted and returns false.
+// A direct frame is a duplicate if the same sender ID and CRC (or other check value) was accepted within RX_DEDUP_WINDOW_S seconds.
+// A relayed frame is a duplicate if the same was accepted, or the sender was heard directly, within RX_DEDUP_RELAY_WINDOW_S seconds.
+// The timestamp jumps back at midnight, which at worst lets a repeat through.
+static bool _isRecentDuplicateRXFrame(const uint8_t id0, const uint8_t id1, const uint8_t crc, const bool relayed)
+  {
+  const uint16_t now = (uint16_t)(getMinutesSinceMidnightLT() * 60U) + getSecondsLT();
+  for(uint8_t i = 0; i < RX_DEDUP_TABLE_SIZE; ++i)
+    {
+    const RXDedupEntry_t &e = rxDedupTable[i];
+    if(!e.used || (e.id0 != id0) || (e.id1 != id1)) { continue; }
+    const uint16_t age = (uint16_t)(now - e.when);
+    if(relayed ? ((age <= RX_DEDUP_RELAY_WINDOW_S) && ((e.crc == crc) || !e.relayed)) :
+                 ((age <= RX_DEDUP_WINDOW_S) && (e.crc == crc)))
+      {
+      ATOMIC_BLOCK (ATOMIC_RESTORESTATE) // Keep 16-bit count consistent for readers.
+        { if(rxDuplicatesSuppressed < 0xffffU) { ++rxDuplicatesSuppressed; } }
+      return(true);
+      }
+    }
+  RXDedupEntry_t &e = rxDedupTable[rxDedupNext];
+  e.id0 = id0;
+  e.id1 = id1;
+  e.crc = crc;
+  e.used = true;
+  e.relayed = relayed;
+  e.when = now;
+  if(++rxDedupNext >= RX_DEDUP_TABLE_SIZE) { rxDedupNext = 0; }
+  return(false);
+  }
+
+// True if a frame with the same sender ID and CRC (or other check value) was accepted within the last RX_DEDUP_WINDOW_S seconds,
+// in which case the frame should be dropped (and it is counted),
+// else remembers this frame as accepted and returns false.
+bool isRecentDuplicateRXFrame(const uint8_t id0, const uint8_t id1, const uint8_t crc)
+  { return(_isRecentDuplicateRXFrame(id0, id1, crc, false)); }
+
+// As isRecentDuplicateRXFrame() but for a record relayed (ie delayed) from the given sender:
+// true, and counted, if the same record was accepted or anything was heard directly from that sender
+// within the last RX_DEDUP_RELAY_WINDOW_S seconds, since the relayed copy is then a repeat or stale,
+// else remembers this record as accepted and returns false.
+bool isRecentDuplicateRelayedRXFrame(const uint8_t id0, const uint8_t id1, const uint8_t crc)
+  { return(_isRecentDuplicateRXFrame(id0, id1, crc, true)); }
+
+// Get count of inbound frames dropped as recent duplicates; saturates.
+uint16_t getRXDuplicatesSuppressed()
+  {
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+    { return(rxDuplicatesSuppressed); }
+  return(0); // Not reachable.
+  }
+#endif
 
-// Last JSON (\0-terminated) stats record received, or with first byte \0 if none.
-// Should only be accessed under a lock for thread safety.
-static /* volatile */ char jsonStats[MSG_JSON_MAX_LENGTH + 1];
 
 // Record stats (local or remote) in JSON (ie non-empty, {}-surrounded, \0-terminated text) format.
 // If secure is true then this message arrived over a secure channel.
 // The supplied buffer's content is not altered.
 // The supplied JSON should already have been somewhat validated.
 // Is thread/ISR-safe and moderately fast (though will require a data copy).
-// May be backed by a finite-depth queue, even zero-length (ie discarding); usually holds just one item.
+// Queued behind any frames not yet collected; dropped (and counted) if there is no space.
 #if defined(ALLOW_STATS_RX)
 #ifndef recordJSONStats
 void recordJSONStats(bool secure, const char *json)
@@ -192,53 +317,58 @@ void recordJSONStats(bool secure, const char *json)
   if(NULL == json) { panic(); }
   if('\0' == *json) { panic(); }
 #endif
-  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+  const size_t len = strnlen(json, MSG_JSON_MAX_EXPANDED_LENGTH+1);
+  // Drop over-length message,
+  if(len > MSG_JSON_MAX_EXPANDED_LENGTH)
     {
-    if('\0' != *jsonStats) { ++inboundStatsQueueOverrun; } // Dropped a frame.
-    // Atomically overwrite existing buffer with new non-empty stats message.
-    strncpy(jsonStats, json, MSG_JSON_MAX_LENGTH+1);
-    // Drop over-length message,
-    if('\0' != jsonStats[sizeof(jsonStats) - 1]) { *jsonStats = '\0'; }
+    ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+      { if(inboundStatsQueueOverrun < 0xffffU) { ++inboundStatsQueueOverrun; } }
+    return;
     }
+  _queueFrame(INBOUND_STATS_HEADER_JSON, (const uint8_t *)json, (uint8_t)len);
   }
 #endif
 #endif
 
-// Gets (and clears) the last JSON record received, if any,
-// filling in the supplied buffer
-// else leaving it starting with '\0' if none available.
-// The buffer must be at least MSG_JSON_MAX_LENGTH+1 chars.
-#if defined(ALLOW_STATS_RX)
-#ifndef getLastJSONStats
-void getLastJSONStats(char *buf)
+#if defined(ALLOW_STATS_RX) && defined(ALLOW_STATS_TLV)
+// Per-sender state for decoding TLV stats, most-recently-heard first; slots with hasSeq false are unused.
+static StatsTLVRXState_t statsTLVRXStates[STATS_TLV_RX_SENDERS];
+
+// Record compact binary TLV stats frame (see Stats_TLV.h) of up to buflen bytes (already checked with statsTLVCheckFrame()).
+// Values are converted to the equivalent JSON (split over more than one if need be) and recorded via recordJSONStats().
+// Repeats (eg from double TX) are ignored.
+void recordStatsTLV(const bool secure, const uint8_t * const buf, const uint8_t buflen)
   {
-#if 0 && defined(DEBUG)
-  if(NULL == buf) { panic(); }
-#endif
-  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+  const uint8_t len = statsTLVCheckFrame(buf, buflen);
+  if(0 == len) { return; }
+  const uint8_t id0 = statsTLVFrameID0(buf);
+  const uint8_t id1 = statsTLVFrameID1(buf);
+  // Find this sender's state, else take over the least-recently-heard slot.
+  uint8_t i;
+  for(i = 0; i < STATS_TLV_RX_SENDERS - 1; ++i)
     {
-    if('\0' == *jsonStats)
-      { *buf = '\0'; } // No message available.
-    else
-      {
-      // Copy the message to the receiver.
-      strcpy(buf, jsonStats);
-      // Clear the buffer.
-      *jsonStats = '\0';
-      }
+    const StatsTLVRXState_t &st = statsTLVRXStates[i];
+    if(!st.hasSeq || ((st.id0 == id0) && (st.id1 == id1))) { break; }
+    }
+  StatsTLVRXState_t state = statsTLVRXStates[i];
+  if(!state.hasSeq || (state.id0 != id0) || (state.id1 != id1)) { memset(&state, 0, sizeof(state)); }
+  // Move to the front as most recently heard.
+  memmove(statsTLVRXStates + 1, statsTLVRXStates, i * sizeof(StatsTLVRXState_t));
+  if(!statsTLVApplyFrame(buf, len, &state)) { statsTLVRXStates[0] = state; return; }
+  // Emit values as JSON.
+  while(0 != (state.fresh & state.valid))
+    {
+    char json[MSG_JSON_MAX_LENGTH+1];
+    if(0 == statsTLVWriteJSON(&state, json, sizeof(json))) { break; }
+    recordJSONStats(secure, json);
     }
+  statsTLVRXStates[0] = state;
   }
 #endif
-#endif
-
-
-// Last core stats record received, or with no ID set if none.
-// Should only be accessed under a lock for thread safety.
-static /* volatile */ FullStatsMessageCore_t coreStats; // Start up showing no record set.
 
 // Record minimal incoming stats from given ID (if each byte < 100, then may be FHT8V-compatible house code).
 // Is thread/ISR-safe and fast.
-// May be backed by a finite-depth queue, even zero-length (ie discarding); usually holds just one item.
+// Queued behind any frames not yet collected; dropped (and counted) if there is no space.
 #if defined(ALLOW_STATS_RX) && defined(ALLOW_MINIMAL_STATS_TXRX)
 #ifndef recordMinimalStats
 void recordMinimalStats(const bool secure, const uint8_t id0, const uint8_t id1, const trailingMinimalStatsPayload_t * const payload)
@@ -246,62 +376,156 @@ void recordMinimalStats(const bool secure, const uint8_t id0, const uint8_t id1,
 #if 0 && defined(DEBUG)
   if(NULL == payload) { panic(); }
 #endif
-   ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
-    {
-    if(coreStats.containsID) { ++inboundStatsQueueOverrun; } // Dropped a frame.
-    clearFullStatsMessageCore(&coreStats);
-    coreStats.id0 = id0;
-    coreStats.id1 = id1;
-    coreStats.containsID = true;
-    memcpy((void *)&coreStats.tempAndPower, payload, sizeof(coreStats.tempAndPower));
-    coreStats.containsTempAndPower = true;
-    }
+  FullStatsMessageCore_t stats;
+  clearFullStatsMessageCore(&stats);
+  stats.id0 = id0;
+  stats.id1 = id1;
+  stats.containsID = true;
+  memcpy((void *)&stats.tempAndPower, payload, sizeof(stats.tempAndPower));
+  stats.containsTempAndPower = true;
+  _queueFrame(0, (const uint8_t *)&stats, sizeof(stats));
   }
 #endif
 #endif
 
 // Record core incoming stats; ID must be set as a minimum.
 // Is thread/ISR-safe and fast.
-// May be backed by a finite-depth queue, even zero-length (ie discarding); usually holds just one item.
+// Queued behind any frames not yet collected; dropped (and counted) if there is no space.
 #if defined(ALLOW_STATS_RX)
 #ifndef recordCoreStats
 void recordCoreStats(const bool secure, const FullStatsMessageCore_t * const stats)
   {
 #if 0 && defined(DEBUG)
-  if(NULL == payload) { panic(); }
-#endif  // TODO
-   if(!stats->containsID) { return; } // Ignore if no ID.
-   ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
-    {
-    if(coreStats.containsID) { ++inboundStatsQueueOverrun; } // Dropped a frame.
-    memcpy((void *)&coreStats, stats, sizeof(coreStats));
-    }
+  if(NULL == stats) { panic(); }
+#endif
+  if(!stats->containsID) { return; } // Ignore if no ID.
+  _queueFrame(0, (const uint8_t *)stats, sizeof(FullStatsMessageCore_t));
   }
 #endif
 #endif
 
-// Gets (and clears) the last core stats record received, if any, returning true and filling in the stats struct.
-// If no minimal stats record has been received since the last call then the ID will be absent and the rest undefined.
+// Removes and returns the type of the oldest queued inbound stats frame, if any.
+// A core stats frame is copied into stats; a JSON frame is copied into buf as a \0-terminated string.
+// The buf must be at least MSG_JSON_MAX_EXPANDED_LENGTH+1 chars.
+// Consumer side only; should be called from just one context (eg the main loop).
 #if defined(ALLOW_STATS_RX)
-#ifndef getLastCoreStats
-void getLastCoreStats(FullStatsMessageCore_t *stats)
+uint8_t getNextInboundStats(FullStatsMessageCore_t *const stats, char *const buf)
   {
 #if 0 && defined(DEBUG)
-  if(NULL == stats) { panic(); }
+  if((NULL == stats) || (NULL == buf)) { panic(); }
+#endif
+  uint8_t i = queueTail;
+  if(i == queueHead) { return(INBOUND_STATS_NONE); }
+  const uint8_t header = inboundStatsQueue[i];
+  const uint8_t len = header & ~INBOUND_STATS_HEADER_JSON;
+  const bool isJSON = (0 != (header & INBOUND_STATS_HEADER_JSON));
+  uint8_t *const dest = isJSON ? (uint8_t *)buf : (uint8_t *)stats;
+  for(uint8_t n = 0; n < len; ++n)
+    {
+    i = (i + 1) & INBOUND_STATS_QUEUE_MASK;
+    dest[n] = inboundStatsQueue[i];
+    }
+  // Release the space to the producer only once copied out.
+  queueTail = (i + 1) & INBOUND_STATS_QUEUE_MASK;
+  if(isJSON) { buf[len] = '\0'; return(INBOUND_STATS_JSON); }
+  return(INBOUND_STATS_CORE);
+  }
 #endif
+
+
+#if defined(ALLOW_STATS_RX)
+// Per-sender link quality table, most-recently-heard first; empty slots have ID 0xff 0xff.
+// Must only be accessed under a lock (ATOMIC_BLOCK).
+static LinkQuality_t linkQuality[LINK_QUALITY_TABLE_SIZE] =
+  { {0xff,0xff}, {0xff,0xff}, {0xff,0xff}, {0xff,0xff}, {0xff,0xff}, {0xff,0xff}, {0xff,0xff}, {0xff,0xff} };
+#if LINK_QUALITY_TABLE_SIZE != 8
+#error linkQuality[] initialiser must match LINK_QUALITY_TABLE_SIZE
+#endif
+
+// Record a frame heard from the given sender, with the RSSI seen for it
+// and its 4-bit sequence number (eg from a TLV stats frame) or LINK_QUALITY_NO_SEQ if it has none.
+// Gaps in the sequence since the previous sequenced frame from this sender are counted as missed frames;
+// repeats (same sequence number) are not.
+// Is thread/ISR-safe and fast.
+void recordLinkQuality(const uint8_t id0, const uint8_t id1, const uint8_t rssi, const uint8_t seq)
+  {
   ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
     {
-    if(!coreStats.containsID)
-      { stats->containsID = false; } // Nothing there; just clear containsID field in response for speed.
+    // Find existing entry, else take the last (least-recently-heard or empty) slot.
+    uint8_t i;
+    for(i = 0; i < LINK_QUALITY_TABLE_SIZE-1; ++i)
+      { if((id0 == linkQuality[i].id0) && (id1 == linkQuality[i].id1)) { break; } }
+    LinkQuality_t lq = linkQuality[i];
+    if((id0 != lq.id0) || (id1 != lq.id1))
+      {
+      // New (or evicted) entry: start from this frame.
+      lq.id0 = id0;
+      lq.id1 = id1;
+      lq.rssiSmoothed = rssi;
+      lq.rssiMin = rssi;
+      lq.framesHeard = 0;
+      lq.framesMissed = 0;
+      lq.lastSeq = LINK_QUALITY_NO_SEQ;
+      }
     else
       {
-      // Copy everything.
-      memcpy(stats, (void *)&coreStats, sizeof(*stats));
-      coreStats.containsID = false; // Mark stats as read.
+      // Smooth RSSI with weight 1/4 on the new sample, rounding up so it can reach the top of the range.
+      lq.rssiSmoothed = (uint8_t)((3 * (uint16_t)lq.rssiSmoothed + rssi + 3) >> 2);
+      // Track the worst case, decaying slowly back up so one bad frame is eventually forgotten.
+      if(rssi < lq.rssiMin) { lq.rssiMin = rssi; }
+      else if(lq.rssiMin < lq.rssiSmoothed) { ++lq.rssiMin; }
       }
+    if(lq.framesHeard < 255) { ++lq.framesHeard; }
+    // Frames missed since the last sequenced frame from this sender, if both are sequenced.
+    uint8_t missed = 0;
+    if(LINK_QUALITY_NO_SEQ != seq)
+      {
+      if(LINK_QUALITY_NO_SEQ != lq.lastSeq) { missed = (seq - lq.lastSeq - 1) & 0xf; }
+      if(seq == lq.lastSeq) { missed = 0; } // Repeat, eg double TX or ACK retry.
+      lq.lastSeq = seq & 0xf;
+      }
+    // Accumulate misses, forgetting one for every 8 frames heard without a loss.
+    if(0 != missed) { lq.framesMissed = (missed > (uint8_t)(255 - lq.framesMissed)) ? 255 : (lq.framesMissed + missed); }
+    else if((0 != lq.framesMissed) && (0 == (lq.framesHeard & 7))) { --lq.framesMissed; }
+    // Move to the front.
+    memmove(linkQuality + 1, linkQuality, i * sizeof(LinkQuality_t));
+    linkQuality[0] = lq;
     }
   }
-#endif
+
+// Minimum frames heard before a link may be judged to have margin.
+#define LINK_QUALITY_MIN_FRAMES_FOR_MARGIN 4
+
+// True if the link from the given sender has margin for it to drop its TX power by one step.
+// Requires a few frames, no recent losses, and even the recent worst-case RSSI a full TX step above the comfortable minimum.
+// False if the sender is unknown.
+bool linkHasMargin(const uint8_t id0, const uint8_t id1)
+  {
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+    {
+    for(uint8_t i = 0; i < LINK_QUALITY_TABLE_SIZE; ++i)
+      {
+      const LinkQuality_t &lq = linkQuality[i];
+      if((id0 != lq.id0) || (id1 != lq.id1)) { continue; }
+      return((lq.framesHeard >= LINK_QUALITY_MIN_FRAMES_FOR_MARGIN) &&
+             (0 == lq.framesMissed) &&
+             (lq.rssiMin >= LINK_QUALITY_RSSI_MIN_OK + LINK_QUALITY_RSSI_PER_TX_STEP));
+      }
+    }
+  return(false);
+  }
+
+// Copy out the link quality entry at the given index, most-recently-heard first.
+// Returns false if there is no entry at that index.
+bool getLinkQuality(const uint8_t index, LinkQuality_t *const lq)
+  {
+  if(index >= LINK_QUALITY_TABLE_SIZE) { return(false); }
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+    {
+    *lq = linkQuality[index];
+    }
+  return((0xff != lq->id0) || (0xff != lq->id1));
+  }
 #endif
 
 
@@ -313,6 +537,18 @@ void getLastCoreStats(FullStatsMessageCore_t *stats)
 // TODO: allow cacheing in RAM for speed.
 bool enableTrailingStatsPayload() { return(eeprom_read_byte((uint8_t *)EE_START_STATS_TX_ENABLE) <= stTXmostUnsec); }
 #endif
+#if defined(ALLOW_SECURE_STATS)
+// Returns true if stats may be sent in the secure (encrypted) form, ie a building key is set,
+// and the TX_ENABLE value is no higher than stTXsecOnly.
+bool enableSecureStatsPayload()
+  {
+  if(eeprom_read_byte((uint8_t *)EE_START_STATS_TX_ENABLE) > stTXsecOnly) { return(false); }
+  uint8_t key[EE_LEN_PRIMARY_BUILDING_KEY];
+  const bool haveKey = getPrimaryBuildingKey(key);
+  memset(key, 0, sizeof(key));
+  return(haveKey);
+  }
+#endif
 #endif
 
 
@@ -363,6 +599,84 @@ bool ensureIDCreated(const bool force)
   }
 
 
+#if defined(ALLOW_SECURE_STATS)
+// Packs n bytes from in 7 bits per output byte, msbits first, into out (every byte with msbit 0, last zero-padded).
+// Returns the number of bytes written, ie (8*n+6)/7.
+static uint8_t pack7(uint8_t *out, const uint8_t *in, uint8_t n)
+  {
+  uint8_t *const start = out;
+  uint16_t acc = 0;
+  uint8_t bits = 0;
+  while(n-- > 0)
+    {
+    acc = (acc << 8) | *in++;
+    bits += 8;
+    while(bits >= 7) { bits -= 7; *out++ = (uint8_t)(acc >> bits) & 0x7f; }
+    }
+  if(0 != bits) { *out++ = (uint8_t)(acc << (7 - bits)) & 0x7f; }
+  return(out - start);
+  }
+
+// Unpacks n bytes into out from (8*n+6)/7 bytes at in as written by pack7().
+// Returns false if any input byte has its msbit set.
+static bool unpack7(uint8_t *out, const uint8_t *in, const uint8_t n)
+  {
+  uint16_t acc = 0;
+  uint8_t bits = 0;
+  for(uint8_t i = 0; i < n; )
+    {
+    const uint8_t c = *in++;
+    if(0 != (c & 0x80)) { return(false); }
+    acc = (acc << 7) | c;
+    bits += 7;
+    if(bits >= 8) { bits -= 8; out[i++] = (uint8_t)(acc >> bits); }
+    }
+  return(true);
+  }
+
+// Builds the 12-byte AES-GCM nonce for a secure full stats frame from the (full 8-bit) ID and the 4-byte message counter.
+static void fullStatsNonce(uint8_t *const nonce, const uint8_t id0, const uint8_t id1, const uint8_t *const counter)
+  {
+  memset(nonce, 0, AES_GCM_NONCE_BYTES);
+  nonce[0] = id0;
+  nonce[1] = id1;
+  memcpy(nonce + AES_GCM_NONCE_BYTES - FullStatsMessageCore_SECURE_COUNTER_BYTES, counter, FullStatsMessageCore_SECURE_COUNTER_BYTES);
+  }
+
+// Replaces the plaintext body of the full stats frame at buf (with ID) from buf+3 up to bodyEnd with the secure form.
+// Sets SEC in the header, then writes the length byte and the packed counter, ciphertext and tag.
+// Returns pointer to where the CRC should go,
+// or NULL if there is no key or not enough space before bufEnd for the secure form, CRC and terminating 0xff.
+static uint8_t *secureFullStatsBody(uint8_t *const buf, uint8_t *const bodyEnd, const uint8_t *const bufEnd,
+    const uint8_t id0, const uint8_t id1)
+  {
+  uint8_t *const body = buf + 3;
+  const uint8_t bodyLen = bodyEnd - body;
+  if((0 == bodyLen) || (bodyLen > FullStatsMessageCore_MAX_SECURE_BODY_BYTES)) { return(NULL); }
+  const uint8_t packedLen = FullStatsMessageCore_SECURE_PACKED_BYTES(bodyLen);
+  if(body + 1 + packedLen + 2 > bufEnd) { return(NULL); } // Need space for length, packed block, CRC and 0xff.
+  uint8_t key[EE_LEN_PRIMARY_BUILDING_KEY];
+  if(!getPrimaryBuildingKey(key)) { return(NULL); }
+  // Assemble counter || plaintext, leaving room for the tag.
+  uint8_t block[FullStatsMessageCore_SECURE_COUNTER_BYTES + FullStatsMessageCore_MAX_SECURE_BODY_BYTES + FullStatsMessageCore_SECURE_TAG_BYTES];
+  const uint32_t counter = getNextSecureTXMessageCounter();
+  block[0] = (uint8_t)(counter >> 24);
+  block[1] = (uint8_t)(counter >> 16);
+  block[2] = (uint8_t)(counter >> 8);
+  block[3] = (uint8_t)counter;
+  uint8_t *const text = block + FullStatsMessageCore_SECURE_COUNTER_BYTES;
+  memcpy(text, body, bodyLen);
+  // Header, ID and length byte as sent are the AAD.
+  buf[0] |= MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE;
+  *body = bodyLen;
+  uint8_t nonce[AES_GCM_NONCE_BYTES];
+  fullStatsNonce(nonce, id0, id1, block);
+  aes128GCMEncrypt(key, nonce, buf, 4, text, bodyLen, text, text + bodyLen, FullStatsMessageCore_SECURE_TAG_BYTES);
+  memset(key, 0, sizeof(key));
+  return(body + 1 + pack7(body + 1, block, FullStatsMessageCore_SECURE_COUNTER_BYTES + bodyLen + FullStatsMessageCore_SECURE_TAG_BYTES));
+  }
+#endif
+
 // Send core/common 'full' stats message.
 //   * content contains data to be sent in the message; must be non-null
 // Note that up to 7 bytes of payload is optimal for the CRC used.
@@ -374,18 +688,27 @@ uint8_t *encodeFullStatsMessageCore(uint8_t * const buf, const uint8_t buflen, c
   {
   if(NULL == buf) { return(NULL); } // Could be an assert/panic instead at a pinch.
   if(NULL == content) { return(NULL); } // Could be an assert/panic instead at a pinch.
-  if(secureChannel) { return(NULL); } // TODO: cannot create secure message yet.
+#if defined(ALLOW_SECURE_STATS)
+  if(secureChannel && !content->containsID) { return(NULL); } // Secure form needs the ID for the nonce.
+#else
+  if(secureChannel) { return(NULL); } // Secure form not supported in this build.
+#endif
 //  if(buflen < FullStatsMessageCore_MIN_BYTES_ON_WIRE+1) { return(NULL); } // Need space for at least the shortest possible message + terminating 0xff.
 //  if(buflen < FullStatsMessageCore_MAX_BYTES_ON_WIRE+1) { return(NULL); } // Need space for longest possible message + terminating 0xff.
 
   // Compute message payload length (excluding CRC and terminator).
   // Fail immediately (return NULL) if not enough space for message content.
+  const bool containsExt = content->containsCFH || content->containsAPL;
   const uint8_t payloadLength =
       1 + // Initial header.
       (content->containsID ? 2 : 0) +
       (content->containsTempAndPower ? 2 : 0) +
       1 + // Flags header.
-      (content->containsAmbL ? 1 : 0);
+      (containsExt ? 1 : 0) + // Extension flags header.
+      (content->containsCFH ? 1 : 0) +
+      (content->containsAmbL ? 1 : 0) +
+      (content->containsRHP ? 1 : 0) +
+      (content->containsAPL ? (1 + content->aplLen) : 0);
   if(buflen < payloadLength + 2)  { return(NULL); }
 
   // Validate some more detail.
@@ -400,22 +723,41 @@ uint8_t *encodeFullStatsMessageCore(uint8_t * const buf, const uint8_t buflen, c
     {
     if((content->ambL == 0) || (content->ambL == (uint8_t)0xff)) { return(NULL); } // Forbidden values.
     }
+  // Relative humidity.
+  if(content->containsRHP)
+    {
+    if(content->rhp > 100) { return(NULL); } // Out of range.
+    }
+  // Call for heat.
+  if(content->containsCFH)
+    {
+    if(content->cfhSecs > 253) { return(NULL); } // Out of range.
+    }
+  // ASCII payload.
+  if(content->containsAPL)
+    {
+    if((0 == content->aplLen) || (content->aplLen > FullStatsMessageCore_MAX_APL_BYTES)) { return(NULL); } // Bad length.
+    for(uint8_t i = content->aplLen; i-- > 0; )
+      {
+      const char c = content->apl[i];
+      if((c < 32) || (c > 126)) { return(NULL); } // Not printable ASCII.
+      }
+    }
 
   // WRITE THE MESSAGE!
   // Pointer to next byte to write in message.
   register uint8_t *b = buf;
 
-  // Construct the header.
-  // * byte 0 :  |  0  |  1  |  1  |  1  |  R0 | IDP | IDH | SEC |   header, 1x reserved 0 bit, ID Present, ID High, SECure
+  // Construct the header; SEC is added once the body has been encrypted.
+  // * byte 0 :  | SEC |  1  |  1  |  1  |  R0 | IDP | IDH |  0  |   SECure, header, 1x reserved 0 bit, ID Present, ID High
 //#define MESSAGING_FULL_STATS_HEADER_MSBS 0x70
-//#define MESSAGING_FULL_STATS_HEADER_MASK 0xf0
+//#define MESSAGING_FULL_STATS_HEADER_MASK 0x70
 //#define MESSAGING_FULL_STATS_HEADER_BITS_ID_PRESENT 4
 //#define MESSAGING_FULL_STATS_HEADER_BITS_ID_HIGH 2
-//#define MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE 1
+//#define MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE 0x80
   const uint8_t header = MESSAGING_FULL_STATS_HEADER_MSBS |
       (content->containsID ? MESSAGING_FULL_STATS_HEADER_BITS_ID_PRESENT : 0) |
-      ((content->containsID && (0 != (content->id0 & 0x80))) ? MESSAGING_FULL_STATS_HEADER_BITS_ID_HIGH : 0) |
-      0; // TODO: cannot do secure messages yet.
+      ((content->containsID && (0 != (content->id0 & 0x80))) ? MESSAGING_FULL_STATS_HEADER_BITS_ID_HIGH : 0);
   *b++ = header;
  
   // Insert ID if requested.
@@ -444,13 +786,41 @@ uint8_t *encodeFullStatsMessageCore(uint8_t * const buf, const uint8_t buflen, c
 //#define MESSAGING_FULL_STATS_FLAGS_HEADER_RHP 4
   // Omit occupancy data unless encoding for a secure channel or at a very permissive stats TX security level.
   const uint8_t flagsHeader = MESSAGING_FULL_STATS_FLAGS_HEADER_MSBS |
+    (containsExt ? MESSAGING_FULL_STATS_FLAGS_HEADER_EXT : 0) |
     (content->containsAmbL ? MESSAGING_FULL_STATS_FLAGS_HEADER_AMBL : 0) |
+    (content->containsRHP ? MESSAGING_FULL_STATS_FLAGS_HEADER_RHP : 0) |
     ((secureChannel || (secLevel <= stTXalwaysAll)) ? (content->occ & 3) : 0);
   *b++ = flagsHeader;
-  // Now insert extra fields as flagged.
+  // Insert extension flags header only if needed.
+  //   byte b+3: |  0  |  R1 |  R0 |  R0 |  R0 | CFH | RXH | APL |
+  if(containsExt)
+    {
+    *b++ = MESSAGING_FULL_STATS_FLAGS_EXT_MSBS |
+      (content->containsCFH ? MESSAGING_FULL_STATS_FLAGS_EXT_CFH : 0) |
+      (content->containsAPL ? MESSAGING_FULL_STATS_FLAGS_EXT_APL : 0);
+    }
+  // Now insert extra fields as flagged, in the documented order.
+  if(content->containsCFH)
+    { *b++ = content->cfhSecs + 1; }
   if(content->containsAmbL)
     { *b++ = content->ambL; }
-  // TODO: RH% etc
+  if(content->containsRHP)
+    { *b++ = content->rhp + 1; }
+  if(content->containsAPL)
+    {
+    *b++ = content->aplLen;
+    memcpy(b, content->apl, content->aplLen);
+    b += content->aplLen;
+    }
+
+#if defined(ALLOW_SECURE_STATS)
+  // Replace the body with its authenticated and encrypted form if required.
+  if(secureChannel)
+    {
+    b = secureFullStatsBody(buf, b, buf + buflen, content->id0, content->id1);
+    if(NULL == b) { return(NULL); }
+    }
+#endif
 
   // Finish off message by computing and appending the CRC and then terminating 0xff (and return pointer to 0xff).
   // Assumes that b now points just beyond the end of the payload.
@@ -459,15 +829,124 @@ uint8_t *encodeFullStatsMessageCore(uint8_t * const buf, const uint8_t buflen, c
   *b++ = crc;
   *b = 0xff;
 #if 0 && defined(DEBUG)
-  if(b - buf != payloadLength + 1) { panic(F("msg gen err")); }
+  if(!secureChannel && (b - buf != payloadLength + 1)) { panic(F("msg gen err")); }
 #endif
   return(b);
   }
 
+// Decodes the (plaintext) body of a full stats message at b, ie everything after the ID and before the CRC, into content.
+// The body must be followed by at least one more byte (eg the CRC) before end.
+// Returns pointer just beyond the body, or NULL if it is corrupt or truncated.
+static const uint8_t *decodeFullStatsMessageBody(const uint8_t *b, const uint8_t * const end, FullStatsMessageCore_t * const content)
+  {
+  // If next header is temp/power then extract it, else must be the flags header.
+  if(MESSAGING_TRAILING_MINIMAL_STATS_HEADER_MSBS == (*b & MESSAGING_TRAILING_MINIMAL_STATS_HEADER_MASK))
+    {
+    if(b + 3 >= end) { return(NULL); } // Truncated (no space for flags header and CRC).
+    if(0 != (0x80 & b[1])) { return(NULL); } // Following byte does not have msb correctly cleared.
+    extractTrailingMinimalStatsPayload(b, &(content->tempAndPower));
+    b += 2;
+    content->containsTempAndPower = true;
+    }
+
+  // If next header is flags then extract it.
+  // FIXME: risk of misinterpretting CRC.
+  if(MESSAGING_FULL_STATS_FLAGS_HEADER_MSBS != (*b & MESSAGING_FULL_STATS_FLAGS_HEADER_MASK)) { return(NULL); } // Corrupt message.
+  const uint8_t flagsHeader = *b++;
+  content->occ = flagsHeader & 3;
+  // Extract the extension flags header if present.
+  uint8_t extHeader = 0;
+  if(0 != (flagsHeader & MESSAGING_FULL_STATS_FLAGS_HEADER_EXT))
+    {
+    if(b >= end) { return(NULL); } // Truncated.
+    extHeader = *b++;
+    if(MESSAGING_FULL_STATS_FLAGS_EXT_MSBS != (extHeader & MESSAGING_FULL_STATS_FLAGS_EXT_MASK)) { return(NULL); } // Corrupt message.
+    }
+  // Check that the fixed-size optional sections and the CRC (or the APL length byte) are all within the buffer.
+  const uint8_t fixedSections =
+    ((0 != (extHeader & MESSAGING_FULL_STATS_FLAGS_EXT_CFH)) ? 1 : 0) +
+    ((0 != (flagsHeader & MESSAGING_FULL_STATS_FLAGS_HEADER_AMBL)) ? 1 : 0) +
+    ((0 != (flagsHeader & MESSAGING_FULL_STATS_FLAGS_HEADER_RHP)) ? 1 : 0);
+  if(b + fixedSections >= end) { return(NULL); } // Truncated.
+  if(0 != (extHeader & MESSAGING_FULL_STATS_FLAGS_EXT_CFH))
+    {
+    const uint8_t cfh = *b++;
+    if((0 == cfh) || (cfh == (uint8_t)0xff)) { return(NULL); } // Illegal value.
+    content->cfhSecs = cfh - 1;
+    content->containsCFH = true;
+    }
+  if(0 != (flagsHeader & MESSAGING_FULL_STATS_FLAGS_HEADER_AMBL))
+    {
+    const uint8_t ambL = *b++;
+    if((0 == ambL) || (ambL == (uint8_t)0xff)) { return(NULL); } // Illegal value.
+    content->ambL = ambL;
+    content->containsAmbL = true;
+    }
+  if(0 != (flagsHeader & MESSAGING_FULL_STATS_FLAGS_HEADER_RHP))
+    {
+    const uint8_t rhp = *b++;
+    if((0 == rhp) || (rhp > 101)) { return(NULL); } // Illegal value.
+    content->rhp = rhp - 1;
+    content->containsRHP = true;
+    }
+  if(0 != (extHeader & MESSAGING_FULL_STATS_FLAGS_EXT_APL))
+    {
+    const uint8_t aplLen = *b++;
+    if((0 == aplLen) || (aplLen > FullStatsMessageCore_MAX_APL_BYTES)) { return(NULL); } // Illegal length.
+    if(b + aplLen >= end) { return(NULL); } // Truncated (no space for CRC).
+    for(uint8_t i = 0; i < aplLen; ++i)
+      {
+      const char c = (char) *b++;
+      if((c < 32) || (c > 126)) { return(NULL); } // Not printable ASCII.
+      content->apl[i] = c;
+      }
+    content->aplLen = aplLen;
+    content->containsAPL = true;
+    }
+
+  return(b);
+  }
+
+#if defined(ALLOW_SECURE_STATS)
+// Last accepted secure message counter by sender, most-recently-heard first; slots with used false are free.
+static struct SecureRXCounter
+  {
+  bool used;
+  uint8_t id0, id1;
+  uint32_t counter;
+  } secureRXCounters[SECURE_STATS_RX_SENDERS];
+
+// Returns true and remembers the counter if it is greater than the last accepted from this sender (or the sender is new),
+// else returns false, eg for a replayed frame, which must then be dropped.
+bool acceptSecureRXMessageCounter(const uint8_t id0, const uint8_t id1, const uint32_t counter)
+  {
+  // Find this sender, else take over the least-recently-heard slot.
+  uint8_t i;
+  for(i = 0; i < SECURE_STATS_RX_SENDERS - 1; ++i)
+    {
+    const SecureRXCounter &c = secureRXCounters[i];
+    if(!c.used || ((c.id0 == id0) && (c.id1 == id1))) { break; }
+    }
+  SecureRXCounter &c = secureRXCounters[i];
+  const bool known = c.used && (c.id0 == id0) && (c.id1 == id1);
+  if(known && (counter <= c.counter)) { return(false); }
+  // Move to the front as most recently heard.
+  memmove(secureRXCounters + 1, secureRXCounters, i * sizeof(SecureRXCounter));
+  SecureRXCounter &f = secureRXCounters[0];
+  f.used = true;
+  f.id0 = id0;
+  f.id1 = id1;
+  f.counter = counter;
+  return(true);
+  }
+#endif
+
 // Decode core/common 'full' stats message.
 // If successful returns pointer to next byte of message, ie just after full stats message decoded.
 // Returns null if failed (eg because of corrupt message data) and state of 'content' result is undefined.
 // This will avoid copying into the result data (possibly tainted) that has arrived at an inappropriate security level.
+// A secure (SEC==1) frame is only accepted if it authenticates with the building key
+// and has a message counter greater than that of the last secure frame accepted from the same sender.
 //   * content will contain data decoded from the message; must be non-null
 const uint8_t *decodeFullStatsMessageCore(const uint8_t * const buf, const uint8_t buflen, const stats_TX_level secLevel, const bool secureChannel,
     FullStatsMessageCore_t * const content)
@@ -490,50 +969,70 @@ const uint8_t *decodeFullStatsMessageCore(const uint8_t * const buf, const uint8
   // READ THE MESSAGE!
   // Pointer to next byte to read in message.
   register const uint8_t *b = buf;
+  // Just beyond the last byte that may be read.
+  const uint8_t * const end = buf + buflen;
 
   // Validate the message header and start to fill in structure.
   const uint8_t header = *b++;
   // Deonstruct the header.
-  // * byte 0 :  |  0  |  1  |  1  |  1  |  R0 | IDP | IDH | SEC |   header, 1x reserved 0 bit, ID Present, ID High, SECure
+  // * byte 0 :  | SEC |  1  |  1  |  1  |  R0 | IDP | IDH |  0  |   SECure, header, 1x reserved 0 bit, ID Present, ID High
 //#define MESSAGING_FULL_STATS_HEADER_MSBS 0x70
-//#define MESSAGING_FULL_STATS_HEADER_MASK 0xf0
+//#define MESSAGING_FULL_STATS_HEADER_MASK 0x70
 //#define MESSAGING_FULL_STATS_HEADER_BITS_ID_PRESENT 4
 //#define MESSAGING_FULL_STATS_HEADER_BITS_ID_HIGH 2
-//#define MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE 1
+//#define MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE 0x80
   if(MESSAGING_FULL_STATS_HEADER_MSBS != (header & MESSAGING_FULL_STATS_HEADER_MASK)) { return(NULL); } // Bad header.
-  if(0 != (header & MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE)) { return(NULL); } // TODO: cannot do secure messages yet.
+  const bool secure = (0 != (header & MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE));
+#if defined(ALLOW_SECURE_STATS)
+  if(secure && (0 == (header & MESSAGING_FULL_STATS_HEADER_BITS_ID_PRESENT))) { return(NULL); } // Secure form needs the ID.
+#else
+  if(secure) { return(NULL); } // Secure form not supported in this build.
+#endif
   // Extract ID if present.
   const bool containsID = (0 != (header & MESSAGING_FULL_STATS_HEADER_BITS_ID_PRESENT));
   if(containsID)
     {
+    if(b + 2 >= end) { return(NULL); } // Truncated.
     content->containsID = true;
     const uint8_t idHigh = ((0 != (header & MESSAGING_FULL_STATS_HEADER_BITS_ID_HIGH)) ? 0x80 : 0);
     content->id0 = *b++ | idHigh;
     content->id1 = *b++ | idHigh;
     }
 
-  // If next header is temp/power then extract it, else must be the flags header.
-  if(MESSAGING_TRAILING_MINIMAL_STATS_HEADER_MSBS == (*b & MESSAGING_TRAILING_MINIMAL_STATS_HEADER_MASK))
+#if defined(ALLOW_SECURE_STATS)
+  if(secure)
     {
-    if(0 != (0x80 & b[1])) { return(NULL); } // Following byte does not have msb correctly cleared.
-    extractTrailingMinimalStatsPayload(b, &(content->tempAndPower));
-    b += 2;
-    content->containsTempAndPower = true;
+    // Check the length and the CRC over the whole frame as sent before doing anything expensive.
+    if(b >= end) { return(NULL); } // Truncated.
+    const uint8_t bodyLen = *b++;
+    if((0 == bodyLen) || (bodyLen > FullStatsMessageCore_MAX_SECURE_BODY_BYTES)) { return(NULL); } // Illegal length.
+    const uint8_t packedLen = FullStatsMessageCore_SECURE_PACKED_BYTES(bodyLen);
+    if(b + packedLen >= end) { return(NULL); } // Truncated (no space for CRC).
+    uint8_t crc = MESSAGING_FULL_STATS_CRC_INIT; // Initialisation.
+    for(const uint8_t *p = buf; p < b + packedLen; ) { crc = OTRadioLink::crc7_5B_update(crc, *p++); }
+    if(crc != b[packedLen]) { return(NULL); } // Bad CRC.
+    // Unpack, authenticate and decrypt, then decode the plaintext body.
+    // One spare byte is left after the body (overlapping the tag) as the body decoder expects a CRC to follow.
+    uint8_t block[FullStatsMessageCore_SECURE_COUNTER_BYTES + FullStatsMessageCore_MAX_SECURE_BODY_BYTES + FullStatsMessageCore_SECURE_TAG_BYTES];
+    if(!unpack7(block, b, FullStatsMessageCore_SECURE_COUNTER_BYTES + bodyLen + FullStatsMessageCore_SECURE_TAG_BYTES)) { return(NULL); }
+    uint8_t key[EE_LEN_PRIMARY_BUILDING_KEY];
+    if(!getPrimaryBuildingKey(key)) { return(NULL); } // Cannot authenticate without a key.
+    uint8_t nonce[AES_GCM_NONCE_BYTES];
+    fullStatsNonce(nonce, content->id0, content->id1, block);
+    uint8_t *const text = block + FullStatsMessageCore_SECURE_COUNTER_BYTES;
+    const bool authentic = aes128GCMDecrypt(key, nonce, buf, 4, text, bodyLen, text, text + bodyLen, FullStatsMessageCore_SECURE_TAG_BYTES);
+    memset(key, 0, sizeof(key));
+    if(!authentic) { return(NULL); }
+    if(text + bodyLen != decodeFullStatsMessageBody(text, text + bodyLen + 1, content)) { return(NULL); } // Corrupt body.
+    // Only now that the frame is known to be genuine, reject it if replayed.
+    const uint32_t counter = ((uint32_t)block[0] << 24) | ((uint32_t)block[1] << 16) | ((uint16_t)block[2] << 8) | block[3];
+    if(!acceptSecureRXMessageCounter(content->id0, content->id1, counter)) { return(NULL); }
+    return(b + packedLen + 1); // Point to just after CRC.
     }
+#endif
 
-  // If next header is flags then extract it.
-  // FIXME: risk of misinterpretting CRC.
-  if(MESSAGING_FULL_STATS_FLAGS_HEADER_MSBS != (*b & MESSAGING_FULL_STATS_FLAGS_HEADER_MASK)) { return(NULL); } // Corrupt message.
-  const uint8_t flagsHeader = *b++;
-  content->occ = flagsHeader & 3;
-  const bool containsAmbL = (0 != (flagsHeader & MESSAGING_FULL_STATS_FLAGS_HEADER_AMBL));
-  if(containsAmbL)
-    {
-    const uint8_t ambL = *b++;
-    if((0 == ambL) || (ambL == (uint8_t)0xff)) { return(NULL); } // Illegal value.
-    content->ambL = ambL;
-    content->containsAmbL = true;
-    }
+  b = decodeFullStatsMessageBody(b, end, content);
+  if(NULL == b) { return(NULL); }
 
   // Finish off by computing and checking the CRC (and return pointer to just after CRC).
   // Assumes that b now points just beyond the end of the payload.
@@ -548,17 +1047,102 @@ const uint8_t *decodeFullStatsMessageCore(const uint8_t * const buf, const uint8
 
 
 
+// Returns the length of the valid relayed stats frame at buf (of buflen bytes) including its CRC, or 0 if it is not one.
+uint8_t checkRelayStatsFrame(const uint8_t * const buf, const uint8_t buflen)
+  {
+  if((NULL == buf) || (buflen < 3 + FullStatsMessageCore_MIN_BYTES_ON_WIRE)) { return(0); }
+  if(RELAY_STATS_HEADER_MSBS != (buf[0] & RELAY_STATS_HEADER_MASK)) { return(0); }
+  const uint8_t recordBytes = buf[1];
+  if((recordBytes < FullStatsMessageCore_MIN_BYTES_ON_WIRE) || (recordBytes > RELAY_STATS_MAX_RECORD_BYTES)) { return(0); }
+  const uint8_t len = 3 + recordBytes;
+  if(len > buflen) { return(0); } // Truncated.
+  uint8_t crc = MESSAGING_FULL_STATS_CRC_INIT; // Initialisation.
+  for(const uint8_t *p = buf; p < buf + len - 1; ) { crc = OTRadioLink::crc7_5B_update(crc, *p++); }
+  if(crc != buf[len - 1]) { return(0); } // Bad CRC.
+  return(len);
+  }
+
+#if defined(ENABLE_STATS_RELAY)
+// Received full stats frames awaiting relay, back to back, with their total length and count.
+static uint8_t relayRecords[RELAY_STATS_MAX_RECORD_BYTES];
+static volatile uint8_t relayRecordsLen;
+static volatile uint8_t relayRecordsCount;
+
+// Queues a copy of a validated received full stats frame of len bytes including its CRC for relaying.
+// Returns false if there is no room, in which case the frame is dropped.
+bool queueStatsFrameForRelay(const uint8_t * const frame, const uint8_t len)
+  {
+  bool queued = false;
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+    {
+    const uint8_t used = relayRecordsLen;
+    if((relayRecordsCount < RELAY_STATS_MAX_RECORDS) && (len <= sizeof(relayRecords) - used))
+      {
+      memcpy(relayRecords + used, frame, len);
+      relayRecordsLen = used + len;
+      ++relayRecordsCount;
+      queued = true;
+      }
+    }
+  return(queued);
+  }
+
+// Number of received frames waiting to be relayed.
+uint8_t getRelayStatsPendingCount() { return(relayRecordsCount); }
+
+// True if the pending relayed frame should be sent now since another full-size record might not fit.
+bool isRelayStatsFrameFull()
+  {
+  bool full;
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+    {
+    full = (relayRecordsCount >= RELAY_STATS_MAX_RECORDS) ||
+           (sizeof(relayRecords) - relayRecordsLen < FullStatsMessageCore_MAX_BYTES_ON_WIRE);
+    }
+  return(full);
+  }
+
+// Moves all pending records into a relayed frame at buf and terminates it with 0xff.
+// Returns the frame length excluding the 0xff, or 0 if nothing was pending or the buffer is too small.
+uint8_t writeRelayStatsFrame(uint8_t * const buf, const uint8_t buflen)
+  {
+  uint8_t len = 0;
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+    {
+    const uint8_t n = relayRecordsCount;
+    const uint8_t recordBytes = relayRecordsLen;
+    if((0 != n) && (buflen >= 3 + recordBytes + 1))
+      {
+      buf[0] = RELAY_STATS_HEADER_MSBS | (n - 1);
+      buf[1] = recordBytes;
+      memcpy(buf + 2, relayRecords, recordBytes);
+      relayRecordsLen = 0;
+      relayRecordsCount = 0;
+      len = 3 + recordBytes;
+      }
+    }
+  if(0 == len) { return(0); }
+  // Compute the CRC outside the atomic block to keep interrupts blocked only briefly.
+  uint8_t crc = MESSAGING_FULL_STATS_CRC_INIT; // Initialisation.
+  for(const uint8_t *p = buf; p < buf + len - 1; ) { crc = OTRadioLink::crc7_5B_update(crc, *p++); }
+  buf[len - 1] = crc;
+  buf[len] = 0xff;
+  return(len);
+  }
+#endif
+
+
 // Returns true unless the buffer clearly does not contain a possible valid raw JSON message.
 // This message is expected to be one object wrapped in '{' and '}'
 // and containing only ASCII printable/non-control characters in the range [32,126].
-// The message must be no longer than MSG_JSON_MAX_LENGTH excluding trailing null.
+// The message must be no longer than MSG_JSON_MAX_EXPANDED_LENGTH excluding trailing null.
 // This only does a quick validation for egregious errors.
 bool quickValidateRawSimpleJSONMessage(const char * const buf)
   {
   if('{' != buf[0]) { return(false); }
   // Scan up to maximum length for terminating '}'.
   const char *p = buf + 1;
-  for(int i = 1; i < MSG_JSON_MAX_LENGTH; ++i)
+  for(int i = 1; i < MSG_JSON_MAX_EXPANDED_LENGTH; ++i)
     {
     const char c = *p++;
     // With a terminating '}' (followed by '\0') the message is superficially valid.
@@ -582,6 +1166,10 @@ uint8_t adjustJSONMsgForTXAndComputeCRC(char * const bptr)
   {
   // Do initial quick validation before computing CRC, etc,
   if(!quickValidateRawSimpleJSONMessage(bptr)) { return(adjustJSONMsgForTXAndComputeCRC_ERR); }
+#if defined(ALLOW_JSON_DICT_COMPRESSION)
+  // Compress, and reject if still too long to send.
+  if(compressJSONDict(bptr) > MSG_JSON_MAX_LENGTH) { return(adjustJSONMsgForTXAndComputeCRC_ERR); }
+#endif
 //  if('{' != *bptr) { return(adjustJSONMsgForTXAndComputeCRC_ERR); }
   bool seenTrailingClosingBrace = false;
   uint8_t crc = '{';
@@ -603,6 +1191,105 @@ uint8_t adjustJSONMsgForTXAndComputeCRC(char * const bptr)
   return(crc);
   }
 
+#if defined(ALLOW_JSON_DICT_COMPRESSION)
+// Dictionary of common JSON stats fragments for on-air compression; entry i is sent as byte 0x80 + i.
+// Key fragments include the leading comma and trailing colon so that a whole field prefix is one byte.
+// NOTE: append only (never reorder/remove) to stay compatible with deployed units,
+// and keep entries to fewer than 125 so that no code can be ('}' | 0x80) or 0xff.
+// No entry may start with '{', '}' or any char that can start a value (eg digits and '-')
+// so that the saving for each field is exactly that given by jsonDictFieldSaving().
+static const char jsonDict0[] PROGMEM = "\"@\":\"";
+static const char jsonDict1[] PROGMEM = ",\"+\":";
+static const char jsonDict2[] PROGMEM = ",\"T|C16\":";
+static const char jsonDict3[] PROGMEM = ",\"H|%\":";
+static const char jsonDict4[] PROGMEM = ",\"O\":";
+static const char jsonDict5[] PROGMEM = ",\"vac|h\":";
+static const char jsonDict6[] PROGMEM = ",\"B|mV\":";
+static const char jsonDict7[] PROGMEM = ",\"B|cV\":";
+static const char jsonDict8[] PROGMEM = ",\"v|%\":";
+static const char jsonDict9[] PROGMEM = ",\"tT|C\":";
+static const char jsonDict10[] PROGMEM = ",\"vC|%\":";
+static const char jsonDict11[] PROGMEM = ",\"L\":";
+static const char jsonDict12[] PROGMEM = ",\"occ|%\":";
+static const char jsonDict13[] PROGMEM = ",\"";
+static const char jsonDict14[] PROGMEM = "\":";
+static const char * const jsonDict[] PROGMEM =
+  {
+  jsonDict0, jsonDict1, jsonDict2, jsonDict3, jsonDict4, jsonDict5, jsonDict6, jsonDict7,
+  jsonDict8, jsonDict9, jsonDict10, jsonDict11, jsonDict12, jsonDict13, jsonDict14
+  };
+#define JSON_DICT_ENTRIES ((uint8_t)(sizeof(jsonDict)/sizeof(jsonDict[0])))
+// Index of the generic field-prefix entries ," and ": used for keys not in the dictionary.
+#define JSON_DICT_FIRST_GENERIC 13
+
+static inline const char *jsonDictEntry(const uint8_t i) { return((const char *)pgm_read_word(jsonDict + i)); }
+
+// Returns true if the byte is a valid dictionary code.
+bool isJSONDictCode(const uint8_t b) { return((b >= 0x80) && (b < 0x80 + JSON_DICT_ENTRIES)); }
+
+// Compress plain null-terminated JSON in place, greedily replacing the longest dictionary fragment at each position.
+// Returns the new length (excluding the trailing '\0').
+uint8_t compressJSONDict(char * const bptr)
+  {
+  uint8_t w = 0;
+  for(uint8_t r = 0; '\0' != bptr[r]; )
+    {
+    // Find the longest entry matching at this position.
+    uint8_t bestLen = 1;
+    uint8_t bestCode = 0;
+    for(uint8_t i = 0; i < JSON_DICT_ENTRIES; ++i)
+      {
+      const char *e = jsonDictEntry(i);
+      const uint8_t l = (uint8_t)strlen_P(e);
+      if((l > bestLen) && (0 == strncmp_P(bptr + r, e, l))) { bestLen = l; bestCode = 0x80 + i; }
+      }
+    // Output never gets ahead of input, so this is safe in place.
+    if(0 != bestCode) { bptr[w++] = (char)bestCode; r += bestLen; }
+    else { bptr[w++] = bptr[r++]; }
+    }
+  bptr[w] = '\0';
+  return(w);
+  }
+
+// Expand null-terminated (possibly) compressed JSON at in to plain JSON at out of size outSize, with trailing '\0'.
+// Returns the expanded length (excluding '\0'), or 0 if it does not fit or contains an invalid code.
+uint8_t expandJSONDict(const char *in, char * const out, const uint8_t outSize)
+  {
+  uint8_t w = 0;
+  for(char c; '\0' != (c = *in++); )
+    {
+    if(0 == (c & 0x80))
+      {
+      if(w + 1 >= outSize) { return(0); }
+      out[w++] = c;
+      continue;
+      }
+    if(!isJSONDictCode((uint8_t)c)) { return(0); }
+    const char *e = jsonDictEntry((uint8_t)c - 0x80);
+    const uint8_t l = (uint8_t)strlen_P(e);
+    if(w + l >= outSize) { return(0); }
+    memcpy_P(out + w, e, l);
+    w += l;
+    }
+  out[w] = '\0';
+  return(w);
+  }
+
+// Bytes saved on air by compressing the JSON field prefix ,"key": for the given key.
+uint8_t jsonDictFieldSaving(const char * const key)
+  {
+  const uint8_t kl = (uint8_t)strlen(key);
+  for(uint8_t i = 1; i < JSON_DICT_FIRST_GENERIC; ++i)
+    {
+    // Match the key between the leading ," and trailing ": of the entry.
+    const char *e = jsonDictEntry(i);
+    if(((uint8_t)strlen_P(e) == kl + 4) && (0 == strncmp_P(key, e + 2, kl))) { return(kl + 3); }
+    }
+  // Else the generic ," and ": each save one byte.
+  return(2);
+  }
+#endif
+
 // IF DEFINED: allow raw ASCII JSON message terminated with '}' and '\0' in adjustJSONMsgForRXAndCheckCRC().
 // This has no error checking other than none of the values straying out of the printable range.
 // Only intended as a transitional measure!
@@ -656,6 +1343,9 @@ int8_t adjustJSONMsgForRXAndCheckCRC(char * const bptr, const uint8_t bufLen)
       }
     // Non-printable/control character makes the message invalid.
     if((c < 32) || (c > 126))
+#if defined(ALLOW_JSON_DICT_COMPRESSION)
+      if(!isJSONDictCode((uint8_t)c)) // Unless a dictionary code.
+#endif
       {
 #if 0 && defined(DEBUG)
       DEBUG_SERIAL_PRINT_FLASHSTRING(" bad: char 0x");
@@ -682,6 +1372,17 @@ size_t BufPrint::write(const uint8_t c)
   return(0);
   }
 
+// Bulk write, copying as much as fits in one go rather than a char at a time.
+size_t BufPrint::write(const uint8_t *buffer, size_t n)
+  {
+  const uint8_t space = capacity - size;
+  if(n > space) { n = space; }
+  memcpy(b + size, buffer, n);
+  size += n;
+  b[size] = '\0';
+  return(n);
+  }
+
 // Returns true iff if a valid key for our subset of JSON.
 // Rejects keys containing " or \ or any chars outside the range [32,126]
 // to avoid having to escape anything.
@@ -697,13 +1398,18 @@ bool isValidKey(const SimpleStatsKey key)
   }
 
 // Returns pointer to stats tuple with given (non-NULL) key if present, else NULL.
-// Does a simple linear search.
+// Does a simple linear search, first by pointer (the usual case) then by text.
 SimpleStatsRotationBase::DescValueTuple * SimpleStatsRotationBase::findByKey(const SimpleStatsKey key) const
   {
-  for(int i = 0; i < nStats; ++i)
+  for(uint8_t i = 0; i < nStats; ++i)
+    {
+    DescValueTuple * const p = stats + i;
+    if(p->descriptor.key == key) { return(p); }
+    }
+  for(uint8_t i = 0; i < nStats; ++i)
     {
     DescValueTuple * const p = stats + i;
-    if(0 == strcmp(p->descriptor.key, key)) { return(p); }
+    if((p->descriptor.key[0] == key[0]) && (0 == strcmp(p->descriptor.key, key))) { return(p); }
     }
   return(NULL); // Not found.
   }
@@ -739,6 +1445,7 @@ bool SimpleStatsRotationBase::putDescriptor(const GenericStatsDescriptor &descri
     p = stats + (nStats++);
     *p = DescValueTuple();
     p->descriptor = descriptor;
+    p->keyLen = strlen(descriptor.key);
     }
   // Else failed: no space to add a new item.
   else { return(false); }
@@ -751,18 +1458,11 @@ bool SimpleStatsRotationBase::putDescriptor(const GenericStatsDescriptor &descri
 // True if successful, false otherwise (eg capacity already reached).
 bool SimpleStatsRotationBase::put(const SimpleStatsKey key, const int newValue)
   {
-  if(!isValidKey(key))
-    {
-#if 0 && defined(DEBUG)
-DEBUG_SERIAL_PRINT_FLASHSTRING("Bad JSON key ");
-DEBUG_SERIAL_PRINT(key);
-DEBUG_SERIAL_PRINTLN();
-#endif
-    return(false);
-    }
+  if(NULL == key) { return(false); }
 
   DescValueTuple *p = findByKey(key);
   // If item already exists, update it.
+  // Its key was validated when first added, so need not be checked again.
   if(NULL != p)
     {
     // Update the value and mark as changed if changed.
@@ -770,11 +1470,28 @@ DEBUG_SERIAL_PRINTLN();
       {
       p->value = newValue;
       p->flags.changed = true;
+      // Note if now significantly different from the value last sent (or no longer so).
+      const uint8_t sd = p->descriptor.significantDelta;
+      if((0 != sd) && p->flags.sent)
+        {
+        const long d = (long)newValue - p->lastSent;
+        p->flags.significant = ((d >= sd) || (-d >= sd));
+        }
       }
     // Update done!
     return(true);
     }
 
+  if(!isValidKey(key))
+    {
+#if 0 && defined(DEBUG)
+DEBUG_SERIAL_PRINT_FLASHSTRING("Bad JSON key ");
+DEBUG_SERIAL_PRINT(key);
+DEBUG_SERIAL_PRINTLN();
+#endif
+    return(false);
+    }
+
   // If not yet at capacity then add this new item at the end.
   // Mark it as changed to prioritise seeing it in the JSON output.
   if(nStats < capacity)
@@ -785,6 +1502,7 @@ DEBUG_SERIAL_PRINTLN();
     p->flags.changed = true;
     // Copy descriptor .
     p->descriptor = GenericStatsDescriptor(key);
+    p->keyLen = strlen(key);
     // Addition of new field done!
     return(true);
     }
@@ -804,25 +1522,65 @@ size_t SimpleStatsRotationBase::print(BufPrint &bp, const SimpleStatsRotationBas
   size_t w = 0;
   if(commaPending) { w += bp.print(','); }
   w += bp.print('"');
-  w += bp.print(s.descriptor.key); // Assumed not to need escaping in any way.
-  w += bp.print('"');
-  w += bp.print(':');
+  w += bp.write((const uint8_t *)s.descriptor.key, s.keyLen); // Assumed not to need escaping in any way.
+  w += bp.write((const uint8_t *)"\":", 2);
   w += bp.print(s.value);
   commaPending = true;
   return(w);
   }
+
+// True if the field will fit in the space left, both as text and (if compressing) on air.
+//   * airSaved  bytes saved by on-air compression of the text written so far
+bool SimpleStatsRotationBase::fieldFits(const BufPrint &bp, const DescValueTuple &s, const uint8_t maxSize, const uint8_t airSaved)
+  {
+  const uint8_t l = fieldLength(s);
+  if(bp.getSize() + l > maxSize) { return(false); }
+#if defined(ALLOW_JSON_DICT_COMPRESSION)
+  // Leave space on air for the closing '}'.
+  if(bp.getSize() - airSaved + l - jsonDictFieldSaving(s.descriptor.key) > MSG_JSON_MAX_LENGTH - 1) { return(false); }
 #endif
+  return(true);
+  }
 
+// Compute the length of the object field ,"name":value as print() would generate it with a comma pending.
+uint8_t SimpleStatsRotationBase::fieldLength(const SimpleStatsRotationBase::DescValueTuple &s)
+  {
+  // Comma, two quotes and colon, plus the key.
+  uint8_t l = 4 + s.keyLen;
+  // Plus the (signed) decimal value; the magnitude is taken unsigned so that the most negative int does not overflow.
+  unsigned int v = (unsigned int)s.value;
+  if(s.value < 0) { ++l; v = 0U - v; }
+  do { ++l; v /= 10; } while(0 != v);
+  return(l);
+  }
+#endif
 
 // True if any changed values are pending (not yet written out).
 bool SimpleStatsRotationBase::changedValue()
   {
   DescValueTuple const *p = stats + nStats;
-  for(int8_t i = nStats; --i > 0; )
+  for(int8_t i = nStats; --i >= 0; )
     { if((--p)->flags.changed) { return(true); } }
   return(false);
   }
 
+// True if any value differs significantly from that last written out.
+bool SimpleStatsRotationBase::significantChange()
+  {
+  DescValueTuple const *p = stats + nStats;
+  for(int8_t i = nStats; --i >= 0; )
+    { if((--p)->flags.significant) { return(true); } }
+  return(false);
+  }
+
+// Note that the given stat has just been written out.
+void SimpleStatsRotationBase::markSent(DescValueTuple &s)
+  {
+  s.lastSent = s.value;
+  s.flags.sent = true;
+  s.flags.significant = false;
+  }
+
 #if defined(ALLOW_JSON_OUTPUT)
 // Write stats in JSON format to provided buffer; returns a non-zero value if successful.
 // Output starts with an "@" (ID) string field,
@@ -890,6 +1648,11 @@ uint8_t SimpleStatsRotationBase::writeJSON(uint8_t *const buf, const uint8_t buf
 
   bp.print('"');
   commaPending = true;
+  // Bytes saved so far by on-air compression, if any.
+  uint8_t airSaved = 0;
+#if defined(ALLOW_JSON_DICT_COMPRESSION)
+  airSaved += sizeof("\"@\":\"") - 2; // "@":" is one byte on air.
+#endif
 
   // Write count next iff enabled.
   if(c.enabled)
@@ -898,21 +1661,23 @@ uint8_t SimpleStatsRotationBase::writeJSON(uint8_t *const buf, const uint8_t buf
     bp.print(F("\"+\":"));
     bp.print(c.count);
     commaPending = true;
+#if defined(ALLOW_JSON_DICT_COMPRESSION)
+    airSaved += jsonDictFieldSaving("+");
+#endif
     }
 
-  // Be prepared to rewind back to logical start of buffer.
-  bp.setMark();
-
-  bool gotHiPri = false;
-  uint8_t hiPriIndex = 0;
-  bool gotLoPri = false;
-  uint8_t loPriIndex = 0;
   if(nStats != 0)
     {
+    // Clear record of stats included in this frame.
+    for(uint8_t i = 0; i < nStats; ++i) { stats[i].flags.thisRun = false; }
+    // Maximum size to allow fields to fill, leaving space for the closing "}\0" without running over-length.
+    const uint8_t maxSize = bufSize - 3;
+
     // High-pri/changed stats.
     // Only do this on a portion of runs to let 'normal' stats get a look-in.
     // This happens on even-numbered runs (eg including the first, typically).
-    // Write at most one high-priority item.
+    // Write at most one high-priority item unless maximising,
+    // in which case write all that fit, skipping any too large to fit in the remaining space.
     if(0 == (c.count & 1))
       {
       uint8_t next = lastTXedHiPri;
@@ -925,65 +1690,60 @@ uint8_t SimpleStatsRotationBase::writeJSON(uint8_t *const buf, const uint8_t buf
         if(sensitivity > s.descriptor.sensitivity) { continue; }
         // Skip stat if neither changed nor high-priority.
         if(!s.descriptor.highPriority && !s.flags.changed) { continue; }
+        // Skip stat if it will not fit; if not maximising give up on high-priority items entirely.
+        if(!fieldFits(bp, s, maxSize, airSaved)) { if(maximise) { continue; } break; }
         // Found suitable stat to include in output.
-        hiPriIndex = next;
-        gotHiPri = true;
-        // Add to JSON output.
         print(bp, s, commaPending);
-        // If successful, ie still space for the closing "}\0" without running over-length
-        // then mark this as a fall-back, else rewind and discard this item.
-        if(bp.getSize() > bufSize - 3) { bp.rewind(); break; }
-        else
-          {
-          bp.setMark();
-          lastTXed = lastTXedHiPri = hiPriIndex;
-          if(!suppressClearChanged) { stats[hiPriIndex].flags.changed = false; }
-          break;
-          }
-        /* if(!maximise) */ { break; }
+#if defined(ALLOW_JSON_DICT_COMPRESSION)
+        airSaved += jsonDictFieldSaving(s.descriptor.key);
+#endif
+        s.flags.thisRun = true;
+        lastTXed = lastTXedHiPri = next;
+        if(!maximise) { break; }
         }
       }
 
     // Insert normal-priority stats if space left.
     // Rotate through all eligible stats round-robin,
-    // adding one to the end of the current message if possible,
+    // adding one (or as many as fit, if maximising) to the end of the current message,
     // checking first the item indexed after the previous one sent.
-//    if(!gotHiPri)
+    // When maximising, an item passed over for lack of space is checked first next time
+    // so that large items are not starved by a steady stream of smaller ones.
       {
+      bool skipped = false; // True once an eligible item has been passed over for lack of space.
       uint8_t next = lastTXedLoPri;
       for(int i = nStats; --i >= 0; )
         {
         // Wrap around the end of the stats.
         if(++next >= nStats) { next = 0; }
-        // Avoid re-transmitting the very last thing TXed unless there in only one item!
-        if((lastTXed == next) && (nStats > 1)) { continue; }
-        // Avoid transmitting the hi-pri item just sent if any.
-        if(gotHiPri && (hiPriIndex == next)) { continue; }
-        // Skip stat if too sensitive to include in this output.
         DescValueTuple &s = stats[next];
+        // Avoid transmitting any item already in this message.
+        if(s.flags.thisRun) { continue; }
+        // Avoid re-transmitting the very last thing TXed unless there in only one item,
+        // or when maximising and simply filling spare space.
+        if(!maximise && (lastTXed == next) && (nStats > 1)) { continue; }
+        // Skip stat if too sensitive to include in this output.
         if(sensitivity > s.descriptor.sensitivity) { continue; }
-        // Found suitable stat to include in output.
-        loPriIndex = next;
-        gotLoPri = true;
-        // Add to JSON output.
-        print(bp, s, commaPending);
-        // If successful then mark this as a fall-back, else rewind and discard this item.
-        // If successful, ie still space for the closing "}\0" without running over-length
-        // then mark this as a fall-back, else rewind and discard this item.
-        if(bp.getSize() > bufSize - 3) { bp.rewind(); break; }
-        else
+        // Skip stat if it will not fit.
+        if(!fieldFits(bp, s, maxSize, airSaved))
           {
-          bp.setMark();
-          lastTXed = lastTXedLoPri = loPriIndex;
-          if(!suppressClearChanged) { stats[loPriIndex].flags.changed = false; }
+          if(!maximise) { break; }
+          if(!skipped) { skipped = true; lastTXedLoPri = ((0 == next) ? nStats : next) - 1; }
+          continue;
           }
+        // Found suitable stat to include in output.
+        print(bp, s, commaPending);
+#if defined(ALLOW_JSON_DICT_COMPRESSION)
+        airSaved += jsonDictFieldSaving(s.descriptor.key);
+#endif
+        s.flags.thisRun = true;
+        lastTXed = next;
+        if(!skipped) { lastTXedLoPri = next; }
         if(!maximise) { break; }
         }
       }
     }
 
-  // TODO: maximise.
-
   // Terminate object.
   bp.print('}');
 #if 0
@@ -1002,7 +1762,111 @@ uint8_t SimpleStatsRotationBase::writeJSON(uint8_t *const buf, const uint8_t buf
 
   // On successfully creating output, update some internal state including success count.
   ++c.count;
+  // Note the values sent, and clear their changed flags unless asked not to.
+  for(uint8_t i = 0; i < nStats; ++i)
+    {
+    DescValueTuple &s = stats[i];
+    if(!s.flags.thisRun) { continue; }
+    markSent(s);
+    if(!suppressClearChanged) { s.flags.changed = false; }
+    }
 
   return(bp.getSize()); // Success!
   }
 #endif
+
+#if defined(ALLOW_STATS_TLV)
+// Parse one ASCII hex digit [0-9a-fA-F], else return 0xff.
+static uint8_t parseHexDigit(const char c)
+  {
+  if((c >= '0') && (c <= '9')) { return(c - '0'); }
+  if((c >= 'a') && (c <= 'f')) { return(c - 'a' + 10); }
+  if((c >= 'A') && (c <= 'F')) { return(c - 'A' + 10); }
+  return(0xff);
+  }
+
+// Get the two ID bytes shown (as four hex digits) in the "@" field.
+// Returns false if the explicit ID string (if any) is not exactly four hex digits.
+bool SimpleStatsRotationBase::getIDBytes(uint8_t &id0, uint8_t &id1) const
+  {
+#ifdef USE_MODULE_FHT8VSIMPLE
+  if(NULL != id)
+    {
+    if(4 != strlen(id)) { return(false); }
+    uint8_t d[4];
+    for(uint8_t i = 0; i < 4; ++i) { if(0xff == (d[i] = parseHexDigit(id[i]))) { return(false); } }
+    id0 = (d[0] << 4) | d[1];
+    id1 = (d[2] << 4) | d[3];
+    return(true);
+    }
+  if(localFHT8VTRVEnabled())
+    {
+    id0 = FHT8VGetHC1();
+    id1 = FHT8VGetHC2();
+    return(true);
+    }
+#endif
+  id0 = eeprom_read_byte(0 + (uint8_t *)EE_START_ID);
+  id1 = eeprom_read_byte(1 + (uint8_t *)EE_START_ID);
+  return(true);
+  }
+
+// Write stats in compact binary TLV format (see Stats_TLV.h) to provided buffer; returns frame length if successful, else 0.
+// Includes every stat with a well-known TLV key that is not too sensitive, as space permits,
+// as a delta against the value last sent where that is shorter (and not due an absolute refresh).
+// Does not append a terminating 0xff.
+uint8_t SimpleStatsRotationBase::writeTLV(uint8_t * const buf, const uint8_t bufSize, const uint8_t sensitivity, const bool ackWanted)
+  {
+#ifdef DEBUG
+  if(NULL == buf) { panic(0); } // Should never happen.
+#endif
+  uint8_t id0, id1;
+  if(!getIDBytes(id0, id1)) { return(0); }
+  const uint8_t seq = c.tlvSeq;
+  uint8_t len = statsTLVStartFrame(buf, bufSize, seq, id0, id1, ackWanted);
+  if(0 == len) { return(0); }
+  // Leave space for the CRC.
+  const uint8_t maxLen = bufSize - 1;
+  for(uint8_t i = 0; i < nStats; ++i)
+    {
+    DescValueTuple &s = stats[i];
+    s.flags.thisRun = false;
+    // Skip stat if too sensitive to include in this output.
+    if(sensitivity > s.descriptor.sensitivity) { continue; }
+    // Skip stat if it has no compact key.
+    const int8_t keyID = statsTLVKeyID(s.descriptor.key);
+    if(keyID < 0) { continue; }
+    // Send a delta only if there is a baseline, no refresh is due, and it is actually shorter.
+    // Refreshes are staggered by key so that they do not all land in the same frame.
+    const int16_t delta = (int16_t)(s.value - s.tlvLastSent);
+    const bool useDelta = s.flags.tlvSent &&
+                          (0 != ((seq + keyID) % STATS_TLV_ABS_INTERVAL)) &&
+                          (statsTLVRecordSize(delta) < statsTLVRecordSize(s.value));
+    const uint8_t w = statsTLVPutRecord(buf + len, maxLen - len, keyID, useDelta, useDelta ? delta : s.value);
+    if(0 == w) { continue; } // Did not fit; maybe a smaller one will.
+    len += w;
+    s.flags.thisRun = true;
+    }
+  len = statsTLVFinishFrame(buf, len, bufSize);
+  if(0 == len) { return(0); }
+
+  // On successfully creating output, update baselines and the sequence number.
+  ++c.tlvSeq;
+  for(uint8_t i = 0; i < nStats; ++i)
+    {
+    DescValueTuple &s = stats[i];
+    if(!s.flags.thisRun) { continue; }
+    s.tlvLastSent = s.value;
+    s.flags.tlvSent = true;
+    s.flags.changed = false;
+    markSent(s);
+    }
+  return(len); // Success!
+  }
+
+// Forget the values last sent in TLV frames so that the next frame carries absolute values only.
+void SimpleStatsRotationBase::resetTLVBaselines()
+  {
+  for(uint8_t i = 0; i < nStats; ++i) { stats[i].flags.tlvSent = false; }
+  }
+#endif
@@ -42,6 +42,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2014--2015
 
 #include "Security.h"
 #include "Sensor.h"
+#include "Stats_TLV.h"
 
 
 
@@ -110,10 +111,12 @@ struct GenericStatsDescriptor
     // and all copies have been disposed of (so is probably best a static string).
     // The default sensitivity is set to forbid transmission at all but minimum (0) leaf TX security settings.
     // By default the stat is normal priority.
+    // By default no change in value is regarded as significant (see significantDelta).
     GenericStatsDescriptor(const char * const statKey,
                            const uint8_t statSensitivity = 1,
-                           const bool statHighPriority = false)
-      : key(statKey), sensitivity(statSensitivity), highPriority(statHighPriority)
+                           const bool statHighPriority = false,
+                           const uint8_t statSignificantDelta = 0)
+      : key(statKey), sensitivity(statSensitivity), highPriority(statHighPriority), significantDelta(statSignificantDelta)
     { }
 
     // Null-terminated short stat/key name.
@@ -128,6 +131,11 @@ struct GenericStatsDescriptor
 
     // If true, this statistic has high priority/importance and should be sent in all transmissions.
     bool highPriority;
+
+    // If non-zero, a value differing by at least this much from that last sent is a significant change,
+    // eg worth sending stats early rather than waiting for the next scheduled transmission.
+    // If zero, changes in this stat are never significant.
+    uint8_t significantDelta;
   };
 
 
@@ -145,6 +153,9 @@ class BufPrint : public Print
     // A buffer of size n can accommodate n-1 characters.
     BufPrint(char *buf, uint8_t bufSize) : b(buf), capacity(bufSize-1), size(0), mark(0) { buf[0] = '\0'; }
     virtual size_t write(uint8_t c);
+    // Bulk write, copying as much as fits in one go rather than a char at a time.
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    using Print::write; // Keep the other overloads visible.
     // True if buffer is completely full.
     bool isFull() const { return(size == capacity); }
     // Get size/chars already in the buffer, not including trailing '\0'.
@@ -184,6 +195,9 @@ class SimpleStatsRotationBase
     // True iff the item existed and was removed.
     bool remove(SimpleStatsKey key);
 
+    // True iff the given (non-NULL) key is being managed, ie has been put() successfully.
+    bool containsKey(SimpleStatsKey key) const { return(NULL != findByKey(key)); }
+
     // Set ID to given value, or null to track system ID; returns false if ID unsafe.
     // If null (the default) then dynamically generate the system ID,
     // eg house code as two bytes of hex if set, else first two bytes of binary ID as hex.
@@ -204,6 +218,10 @@ class SimpleStatsRotationBase
     // True if any changed values are pending (not yet written out).
     bool changedValue();
 
+    // True if any value differs significantly from that last written out (see GenericStatsDescriptor::significantDelta).
+    // Values never yet written out are not counted as significant.
+    bool significantChange();
+
     // Iff true enable the count ("+") field and display immediately after the "@"/ID field.
     // The unsigned count increments as a successful write() operation completes,
     // and wraps after 63 (to limit space), potentially allowing easy detection of lost stats/transmissions.
@@ -231,10 +249,26 @@ class SimpleStatsRotationBase
                       const bool maximise = false, const bool suppressClearChanged = false);
 #endif
 
+#if defined(ALLOW_STATS_TLV)
+    // Write stats in compact binary TLV format (see Stats_TLV.h) to provided buffer; returns frame length if successful, else 0.
+    // Includes every stat with a well-known TLV key that is not too sensitive, as space permits,
+    // as a delta against the value last sent where that is shorter (and not due an absolute refresh).
+    // Does not append a terminating 0xff.
+    //   * buf  is the byte buffer to write the frame to; never NULL
+    //   * bufSize is the capacity of the buffer starting at buf in bytes
+    //   * sensitivity  threshold below which (sensitive) stats will not be included; 0 means include everything
+    //   * ackWanted  if true the frame asks the hub for an ACK (see statsTLVWriteAck())
+    uint8_t writeTLV(uint8_t * const buf, const uint8_t bufSize, const uint8_t sensitivity, const bool ackWanted = false);
+
+    // Forget the values last sent in TLV frames so that the next frame carries absolute values only.
+    // Call when the receiver may have lost its baseline, eg an important frame was never ACKed.
+    void resetTLVBaselines();
+#endif
+
   protected:
     struct DescValueTuple
       {
-      DescValueTuple() : descriptor(NULL), value(0) { }
+      DescValueTuple() : descriptor(NULL), value(0), keyLen(0), lastSent(0) { }
 
       // Descriptor of this stat.
       GenericStatsDescriptor descriptor;
@@ -242,27 +276,50 @@ class SimpleStatsRotationBase
       // Value.
       int value;
 
+      // Cached length of descriptor.key (excluding trailing '\0').
+      // Allows the key to be copied out and the field length computed without rescanning it.
+      uint8_t keyLen;
+
+      // Value last written out, valid if flags.sent is true.
+      int lastSent;
+
+#if defined(ALLOW_STATS_TLV)
+      // Value last sent in a TLV frame, as the baseline for deltas.
+      int tlvLastSent;
+#endif
+
       // Various run-time flags.
       struct Flags
         {
-        Flags() : changed(false) { }
+        Flags() : changed(false), sent(false), significant(false), tlvSent(false) { }
 
         // Set true when the value is changed.
         // Set false when the value written out,
         // ie nominally transmitted to a remote listener,
         // to allow priority to be given to sending changed values.
         bool changed : 1;
-//
-//        // True if included in the current putative JSON output.
-//        // Initial state unimportant.
-//        bool thisRun : 1;
+
+        // True if included in the current putative JSON output.
+        // Initial state unimportant.
+        bool thisRun : 1;
+
+        // True once the value has been written out, ie lastSent is valid.
+        bool sent : 1;
+
+        // True while the value differs from lastSent by at least descriptor.significantDelta.
+        bool significant : 1;
+
+        // True once a value has been sent in a TLV frame, ie tlvLastSent is valid.
+        bool tlvSent : 1;
         } flags;
       };
 
     // Maximum capacity including overheads.
     const uint8_t capacity;
 
-    // Returns pointer to stat tuple with given key if present, else NULL.
+    // Returns pointer to stat tuple with given (non-NULL) key if present, else NULL.
+    // Keys are usually static strings passed in repeatedly from the same place (eg Sensor::tag())
+    // so pointer identity is checked before falling back to comparing the text.
     DescValueTuple *findByKey(SimpleStatsKey key) const;
 
     // Initialise base with appropriate storage (non-null) and capacity knowledge.
@@ -306,14 +363,32 @@ class SimpleStatsRotationBase
     // Takes minimal space (1 byte).
     struct WriteCount
       {
-      WriteCount() : enabled(0), count(0) { }
+      WriteCount() : enabled(0), count(0), tlvSeq(0) { }
       uint8_t enabled : 1; // 1 if display of counter is enabled, else 0.
       uint8_t count : 3; // Increments on each successful write.
+      uint8_t tlvSeq : 4; // TLV frame sequence number; increments on each successful writeTLV().
       } c;
 
+    // Note that the given stat has just been written out, updating lastSent and clearing the significant flag.
+    static void markSent(DescValueTuple &s);
+
+#if defined(ALLOW_STATS_TLV)
+    // Get the two ID bytes shown (as four hex digits) in the "@" field.
+    // Returns false if the explicit ID string (if any) is not exactly four hex digits.
+    bool getIDBytes(uint8_t &id0, uint8_t &id1) const;
+#endif
+
 #if defined(ALLOW_JSON_OUTPUT)
     // Print an object field "name":value to the given buffer.
     size_t print(BufPrint &bp, const DescValueTuple &dvt, bool &commaPending) const;
+
+    // Compute the length of the object field ,"name":value as print() would generate it with a comma pending.
+    // Allows fields to be selected to fill a frame without trial printing.
+    static uint8_t fieldLength(const DescValueTuple &dvt);
+
+    // True if the field will fit in the space left (up to maxSize), both as text and (if compressing) on air.
+    //   * airSaved  bytes saved by on-air compression of the text written so far
+    static bool fieldFits(const BufPrint &bp, const DescValueTuple &dvt, uint8_t maxSize, uint8_t airSaved);
 #endif
   };
 
@@ -370,6 +445,9 @@ bool quickValidateRawSimpleJSONMessage(const char *buf);
 // Computes and returns 0x5B 7-bit CRC in range [0,127]
 // or 0xff if the JSON message obviously invalid and should not be TXed.
 // The CRC is initialised with the initial '{' character.
+// With ALLOW_JSON_DICT_COMPRESSION the message may be up to MSG_JSON_MAX_EXPANDED_LENGTH bytes,
+// and is first compressed with compressJSONDict() to no more than MSG_JSON_MAX_LENGTH bytes (else 0xff is returned),
+// so the caller should use strlen() to find the adjusted length.
 // NOTE: adjusts content in place.
 uint8_t adjustJSONMsgForTXAndComputeCRC(char *bptr);
 
@@ -384,8 +462,31 @@ uint8_t adjustJSONMsgForTXAndComputeCRC(char *bptr);
 //  * bptr  pointer to first byte/char (which must be '{')
 //  * bufLen  remaining bytes in buffer starting at bptr
 // NOTE: adjusts content in place iff the message appears to be valid JSON.
+// With ALLOW_JSON_DICT_COMPRESSION valid dictionary codes are also accepted and left in place,
+// so the result should be passed through expandJSONDict() before use as plain JSON.
 int8_t adjustJSONMsgForRXAndCheckCRC(char *bptr, uint8_t bufLen);
 
+#if defined(ALLOW_JSON_DICT_COMPRESSION)
+// Static-dictionary compression of JSON stats frames on the air.
+// Each byte with the high bit set, 0x80 + i, stands for entry i of a fixed dictionary of common fragments
+// such as "@":" and ,"T|C16": (see Messaging.cpp), shared by sender and receiver.
+// No code collides with the terminating ('}' | 0x80) or 0xff, so framing and the CRC work as for plain JSON.
+
+// Compress plain null-terminated JSON in place, greedily replacing the longest dictionary fragment at each position.
+// Returns the new length (excluding the trailing '\0').
+uint8_t compressJSONDict(char *bptr);
+
+// Expand null-terminated (possibly) compressed JSON at in to plain JSON at out of size outSize, with trailing '\0'.
+// Returns the expanded length (excluding '\0'), or 0 if it does not fit or contains an invalid code.
+uint8_t expandJSONDict(const char *in, char *out, uint8_t outSize);
+
+// Returns true if the byte is a valid dictionary code.
+bool isJSONDictCode(uint8_t b);
+
+// Bytes saved on air by compressing the JSON field prefix ,"key": for the given key.
+uint8_t jsonDictFieldSaving(const char *key);
+#endif
+
 
 
 
@@ -467,6 +568,14 @@ bool enableTrailingStatsPayload();
 #define enableTrailingStatsPayload() (false)
 #endif
 
+// Returns true if stats may be sent in the secure (encrypted) form, ie a building key is set,
+// and the TX_ENABLE value is no higher than stTXsecOnly.
+#if defined(ALLOW_STATS_TX) && defined(ALLOW_SECURE_STATS)
+bool enableSecureStatsPayload();
+#else
+#define enableSecureStatsPayload() (false)
+#endif
+
 
 
 // Full Stats Message (short ID)
@@ -496,15 +605,28 @@ bool enableTrailingStatsPayload();
 #define MESSAGING_FULL_STATS_HEADER_MASK 0x70
 #define MESSAGING_FULL_STATS_HEADER_BITS_ID_PRESENT 4
 #define MESSAGING_FULL_STATS_HEADER_BITS_ID_HIGH 2
-#define MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE 1
+#define MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE 0x80
+// True if leading byte b may start a secure (SEC==1) full stats frame, which the 0x60 flags-style msbits match alone would miss.
+#define MESSAGING_FULL_STATS_IS_SECURE_HEADER(b) \
+  ((MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE | MESSAGING_FULL_STATS_HEADER_MSBS) == ((b) & (MESSAGING_FULL_STATS_HEADER_BITS_ID_SECURE | MESSAGING_FULL_STATS_HEADER_MASK)))
 
 // ?ID: node ID if present (IDP==1)
 //             |  0  |            ID0                          |   7 lsbits of first ID byte, unencrypted
 //             |  0  |            ID1                          |   7 lsbits of second ID byte, unencrypted
 
 // SECURITY HEADER
-// IF SEC BIT IS 1 THEN ONE OR MORE BYTES INSERTED HERE, TBD, EG INCLUDING LENGTH / NONCE.
-// IF SEC BIT IS 1 then all bytes between here and the security trailer are encrypted and/or authenticated.
+// IF SEC BIT IS 1 (which requires IDP to be 1) then the body length follows,
+// and the body from here up to the security trailer is replaced by a 7-bit-packed block (see below).
+//             |  0  | body length L [1,FullStatsMessageCore_MAX_SECURE_BODY_BYTES] |
+// The packed block is the concatenation of:
+//   * a 4-byte big-endian message counter, never repeated by a node for a given key,
+//   * the L body bytes (as below) encrypted with AES-128-GCM,
+//   * a FullStatsMessageCore_SECURE_TAG_BYTES AES-128-GCM tag,
+// sent 7 bits per byte msbits first, each byte with its msbit 0, with the last byte zero-padded.
+// The additional authenticated data is the 4 bytes header, ID0, ID1, length, exactly as on the wire,
+// and the 12-byte nonce is the full (8-bit) ID0 and ID1, 6 zero bytes, then the message counter.
+// The key is the primary building key (see getPrimaryBuildingKey()).
+// A recipient should also reject a counter not above the last one seen from that ID to defeat replays.
 
 // Temperature and power section, optional, encoded exactly as for minimal stats payload.
 //   byte b :  |  0  |  1  |  0  |  PL |  T3 |  T2 |  T1 |  T0 |   header, power-low flag, temperature lsbits (C/16)
@@ -518,11 +640,20 @@ bool enableTrailingStatsPayload();
 // * byte b+2: |  0  |  1  |  1  | EXT | ABML| RH% | OC1 | OC2 |   EXTension-follows flag, plus optional section flags.
 #define MESSAGING_FULL_STATS_FLAGS_HEADER_MSBS 0x60
 #define MESSAGING_FULL_STATS_FLAGS_HEADER_MASK 0xe0
+#define MESSAGING_FULL_STATS_FLAGS_HEADER_EXT 0x10
 #define MESSAGING_FULL_STATS_FLAGS_HEADER_AMBL 8
 #define MESSAGING_FULL_STATS_FLAGS_HEADER_RHP 4
 // If EXT = 1:
 // Call For Heat, RX High (meaning TX hub can probably turn down power), (SenML) ASCII PayLoad
-//   byte b+3: |  0  |  R1 |  R0 |  R0 |  R0 | CFH | RXH | APL |   1x reserved 1 bit, 4x reserved 0 bit, plus optional section flags.
+//   byte b+3: |  0  |  R1 |  R0 |  R0 |  R0 | CFH | RXH | APL |   1x reserved 1 bit, 3x reserved 0 bit, plus optional section flags.
+// RXH is currently ignored on receipt and never sent.
+#define MESSAGING_FULL_STATS_FLAGS_EXT_MSBS 0x40
+#define MESSAGING_FULL_STATS_FLAGS_EXT_MASK 0xf8
+#define MESSAGING_FULL_STATS_FLAGS_EXT_CFH 4
+#define MESSAGING_FULL_STATS_FLAGS_EXT_RXH 2
+#define MESSAGING_FULL_STATS_FLAGS_EXT_APL 1
+
+// Optional sections follow in the order below (CFH, ABML, RH%, APL), each only if flagged.
 
 // ?CFH: Call For Heat section, if present.
 // May be used as a keep-alive and/or to abruptly stop calling for heat.
@@ -540,13 +671,21 @@ bool enableTrailingStatsPayload();
 // Offset by 1 (encoded range [1,101]) so that a zero byte is never sent.
 //             |  0  | RH% [0,100] + 1                         |
 
+// ?APL: ASCII PayLoad, if present.
+// Length byte followed by that many printable ASCII characters [32,126], eg a short SenML fragment.
+//             |  0  | length [1,FullStatsMessageCore_MAX_APL_BYTES] |
+//             |  0  | ASCII char [32,126]                     |   repeated length times
+
 // SECURITY TRAILER
-// IF SEC BIT IS 1 THEN ZERO OR MORE BYTES INSERTED HERE, TBD.
+// IF SEC BIT IS 1 THEN the tag is carried in the packed block above and nothing further is inserted here.
 
 #define MESSAGING_FULL_STATS_CRC_INIT 0x7f // Initialisation value for CRC.
 // *           |  0  |  C6 |  C5 |  C5 |  C3 |  C2 |  C1 |  C0 |    7-bit CRC (crc7_5B_update), unencrypted
 
 
+// Maximum ASCII payload length in a FullStatsMessageCore.
+#define FullStatsMessageCore_MAX_APL_BYTES 8
+
 // Representation of core/common elements of a 'full' stats message.
 // Flags indicate which fields are actually present.
 // All-zeros initialisation ensures no fields marked as present.
@@ -557,6 +696,9 @@ typedef struct FullStatsMessageCore
 
   bool containsTempAndPower : 1;
   bool containsAmbL : 1;
+  bool containsRHP : 1;
+  bool containsCFH : 1;
+  bool containsAPL : 1;
 
   // Node ID (mandatory, 2 bytes)
   uint8_t id0, id1; // ID bytes must share msbit value.
@@ -569,12 +711,33 @@ typedef struct FullStatsMessageCore
 
   // Occupancy; 00 not disclosed, 01 probably, 10 possibly, 11 not occupied recently.
   uint8_t occ : 2;
+
+  // Relative humidity % [0,100] (optional, 1 byte)
+  uint8_t rhp;
+
+  // Call for heat for this many seconds [0,253], where 0 cancels any current call (optional, 1 byte)
+  uint8_t cfhSecs;
+
+  // ASCII payload of aplLen [1,FullStatsMessageCore_MAX_APL_BYTES] printable chars, not '\0'-terminated (optional)
+  uint8_t aplLen;
+  char apl[FullStatsMessageCore_MAX_APL_BYTES];
   } FullStatsMessageCore_t;
 
+// Maximum size on wire including trailing CRC of core of FullStatsMessage without an ASCII payload.
+// This is the limit for a trailer on an FHT8V frame, which must fit in the radio TX FIFO.
+#define FullStatsMessageCore_MAX_BYTES_ON_WIRE_NO_APL 11
 // Maximum size on wire including trailing CRC of core of FullStatsMessage.  TX message buffer should be one larger for trailing 0xff.
-#define FullStatsMessageCore_MAX_BYTES_ON_WIRE 8
+#define FullStatsMessageCore_MAX_BYTES_ON_WIRE (FullStatsMessageCore_MAX_BYTES_ON_WIRE_NO_APL + 1 + FullStatsMessageCore_MAX_APL_BYTES)
 // Minimum size on wire including trailing CRC of core of FullStatsMessage.  TX message buffer should be one larger for trailing 0xff.
 #define FullStatsMessageCore_MIN_BYTES_ON_WIRE 3
+// Secure (SEC==1) form: counter and tag bytes, and maximum body (everything but header, ID and CRC) that is encrypted.
+#define FullStatsMessageCore_SECURE_COUNTER_BYTES 4
+#define FullStatsMessageCore_SECURE_TAG_BYTES 16
+#define FullStatsMessageCore_MAX_SECURE_BODY_BYTES (FullStatsMessageCore_MAX_BYTES_ON_WIRE - 4)
+// Bytes in the 7-bit-packed block of the secure form for a body of L bytes.
+#define FullStatsMessageCore_SECURE_PACKED_BYTES(L) ((8 * (FullStatsMessageCore_SECURE_COUNTER_BYTES + (L) + FullStatsMessageCore_SECURE_TAG_BYTES) + 6) / 7)
+// Maximum size on wire including trailing CRC of the secure form.  TX message buffer should be one larger for trailing 0xff.
+#define FullStatsMessageCore_MAX_BYTES_ON_WIRE_SECURE (4 + FullStatsMessageCore_SECURE_PACKED_BYTES(FullStatsMessageCore_MAX_SECURE_BODY_BYTES) + 1)
 
 // Clear a FullStatsMessageCore_t, also indicating no optional fields present.
 static inline void clearFullStatsMessageCore(FullStatsMessageCore_t *const p) { memset(p, 0, sizeof(FullStatsMessageCore_t)); }
@@ -585,6 +748,8 @@ static inline void clearFullStatsMessageCore(FullStatsMessageCore_t *const p) {
 // If successful, returns pointer to terminating 0xff at end of message.
 // Returns null if failed (eg because of bad inputs or insufficient buffer space).
 // This will omit from transmission data not appropriate given the channel security and the stats_TX_level.
+// If secureChannel is true the frame is sent in the secure (SEC==1) form,
+// which needs ALLOW_SECURE_STATS, an ID, and a building key, else this fails.
 uint8_t *encodeFullStatsMessageCore(uint8_t *buf, uint8_t buflen, stats_TX_level secLevel, bool secureChannel,
     const FullStatsMessageCore_t *content);
 
@@ -592,42 +757,232 @@ uint8_t *encodeFullStatsMessageCore(uint8_t *buf, uint8_t buflen, stats_TX_level
 // If successful returns pointer to next byte of message, ie just after full stats message decoded.
 // Returns null if failed (eg because of corrupt message data) and state of 'content' result is undefined.
 // This will avoid copying into the result data (possibly tainted) that has arrived at an inappropriate security level.
+// A secure (SEC==1) frame is only accepted if ALLOW_SECURE_STATS is defined, it authenticates with the building key,
+// and its message counter is greater than that of any secure frame previously accepted from the same sender,
+// so a recorded frame cannot be replayed; only then may it be recorded as secure.
 //   * content will contain data decoded from the message; must be non-null
 const uint8_t *decodeFullStatsMessageCore(const uint8_t *buf, uint8_t buflen, stats_TX_level secLevel, bool secureChannel,
     FullStatsMessageCore_t *content);
 
+#if defined(ALLOW_SECURE_STATS)
+// Number of senders whose last accepted secure message counter is remembered to reject replays.
+// The least-recently-heard sender is forgotten to make room for a new one,
+// after which one of its old frames could be accepted again,
+// so set at least to the number of secure senders expected within earshot (eg BOILER_HUB_MAX_RADIATORS).
+// Costs 6 bytes of RAM per sender.
+#ifndef SECURE_STATS_RX_SENDERS
+#define SECURE_STATS_RX_SENDERS 8
+#endif
+#if (SECURE_STATS_RX_SENDERS < 1) || (SECURE_STATS_RX_SENDERS > 32)
+#error SECURE_STATS_RX_SENDERS must be in range [1,32]
+#endif
+// Returns true and remembers the counter if it is greater than the last accepted from this sender (or the sender is new),
+// else returns false, eg for a replayed frame, which must then be dropped.
+// Call only for a frame that has authenticated, so that forgeries cannot advance the counter.
+// Not thread-/ISR- safe.
+bool acceptSecureRXMessageCounter(uint8_t id0, uint8_t id1, uint32_t counter);
+#endif
+
+
 
+// Size in bytes of the inbound stats queue; a power of two no larger than 256.
+// Each queued frame takes one byte more than its body (core stats struct, or JSON text without trailing '\0').
+#ifndef INBOUND_STATS_QUEUE_SIZE
+#define INBOUND_STATS_QUEUE_SIZE 128
+#endif
+// A core stats struct is queued whole as the body of one frame, with its length in the 7-bit frame header,
+// and with the queue's one spare byte there must still be room for it.
+STATIC_ASSERT((sizeof(FullStatsMessageCore_t) <= 0x7f) && (sizeof(FullStatsMessageCore_t) + 2 <= INBOUND_STATS_QUEUE_SIZE), inbound_stats_queue_holds_core_stats);
+
+// Types of inbound stats frame returned by getNextInboundStats().
+#define INBOUND_STATS_NONE 0 // Queue empty.
+#define INBOUND_STATS_CORE 1 // FullStatsMessageCore_t.
+#define INBOUND_STATS_JSON 2 // JSON text.
 
 #if defined(ALLOW_STATS_RX)
 // Record core incoming stats; ID must be set as a minimum.
 // If secure is true then this message arrived over a secure channel.
 // Is thread/ISR-safe and fast.
-// May be backed by a finite-depth queue, even zero-length (ie discarding); usually holds just one item.
+// Backed by a finite-depth queue shared with other inbound stats frames; dropped (and counted) if full.
+// Producer side: should only be called from one context (eg ISR or main loop, not both).
 void recordCoreStats(bool secure, const FullStatsMessageCore_t *stats);
 
-// Gets (and clears) the last core stats record received, if any, filling in the stats struct.
-// If no minimal stats record has been received since the last call then the ID will be absent and the rest undefined.
-void getLastCoreStats(FullStatsMessageCore_t *stats);
+// Removes and returns the type of the oldest queued inbound stats frame, if any.
+// A core stats frame is copied into stats; a JSON frame is copied into buf as a \0-terminated string.
+// The buf must be at least MSG_JSON_MAX_EXPANDED_LENGTH+1 chars.
+// Consumer side only; should be called from just one context (eg the main loop).
+uint8_t getNextInboundStats(FullStatsMessageCore_t *stats, char *buf);
 
 // Get count of dropped inbound stats messages due to insufficient queue space.
 uint16_t getInboundStatsQueueOverrun();
+
+// Get the maximum number of bytes (including per-frame overhead) ever held in the inbound stats queue.
+uint8_t getInboundStatsQueueHighWaterMark();
+
+// Get the number of bytes (including per-frame overhead) currently held in the inbound stats queue.
+uint8_t getInboundStatsQueueDepth();
+
+// Frames seen again within this many seconds from the same sender with the same CRC are dropped as repeats,
+// eg from double TX or multi-path reception.
+// Long enough to cover a double TX, much shorter than any sender's normal stats interval.
+#define RX_DEDUP_WINDOW_S 4
+// Relayed records arrive up to a minute (the relay's flush interval) after the original TX,
+// so a relayed record is dropped if its sender was heard directly (or the same record was accepted) within this many seconds.
+// Longer than the relay flush interval plus TX time, shorter than any sender's normal stats interval.
+#define RX_DEDUP_RELAY_WINDOW_S 90
+// Number of senders expected to be heard, directly or relayed (eg as for BOILER_HUB_MAX_RADIATORS).
+#ifndef RX_DEDUP_EXPECTED_SENDERS
+#define RX_DEDUP_EXPECTED_SENDERS 8
+#endif
+// Most frames accepted from one sender within RX_DEDUP_RELAY_WINDOW_S, whatever their format (JSON, TLV, binary or FHT8V):
+// sustained stats TX is at most one frame every STATS_TX_TOKEN_REFILL_M (2) minutes so one direct frame per window,
+// plus one relayed record.
+#define RX_DEDUP_FRAMES_PER_SENDER 2
+// Number of recently-accepted frames remembered for duplicate suppression; the oldest is forgotten first.
+// Sized from the window and frame rate above so that a sender's direct frame is still remembered when its relayed copy arrives.
+// Costs 6 bytes of RAM per entry.
+#define RX_DEDUP_TABLE_SIZE (RX_DEDUP_EXPECTED_SENDERS * RX_DEDUP_FRAMES_PER_SENDER)
+#if (RX_DEDUP_TABLE_SIZE < 1) || (RX_DEDUP_TABLE_SIZE > 64)
+#error RX_DEDUP_TABLE_SIZE must be in range [1,64]
+#endif
+
+// True if a frame with the same sender ID and CRC (or other check value) was accepted within the last RX_DEDUP_WINDOW_S seconds,
+// in which case the frame should be dropped (and it is counted),
+// else remembers this frame as accepted and returns false.
+// Call just after the frame's CRC has been validated, before decoding/recording it.
+// Is thread/ISR-safe and fast.
+// Producer side: should only be called from one context (eg ISR or main loop, not both).
+bool isRecentDuplicateRXFrame(uint8_t id0, uint8_t id1, uint8_t crc);
+
+// As isRecentDuplicateRXFrame() but for a record relayed (ie delayed) from the given sender:
+// true, and counted, if the same record was accepted or anything was heard directly from that sender
+// within the last RX_DEDUP_RELAY_WINDOW_S seconds, since the relayed copy is then a repeat or stale,
+// else remembers this record as accepted and returns false.
+bool isRecentDuplicateRelayedRXFrame(uint8_t id0, uint8_t id1, uint8_t crc);
+
+// Get count of inbound frames dropped as recent duplicates; saturates.
+uint16_t getRXDuplicatesSuppressed();
 #else
 #define recordCoreStats(secure, stats) {} // Do nothing.
-#define getLastCoreStats(stats) {(stats)->containsID = false;} // Nothing to receive.
+#define getNextInboundStats(stats, buf) (INBOUND_STATS_NONE) // Nothing to receive.
 #define getInboundStatsQueueOverrun() 0 // No queue to overrun.
+#define getInboundStatsQueueHighWaterMark() 0 // No queue.
+#define getInboundStatsQueueDepth() 0 // No queue.
+#define isRecentDuplicateRXFrame(id0, id1, crc) (false) // Nothing received.
+#define isRecentDuplicateRelayedRXFrame(id0, id1, crc) (false) // Nothing received.
+#define getRXDuplicatesSuppressed() 0 // Nothing received.
+#endif
+
+#if defined(ALLOW_STATS_RX)
+// Per-sender link quality as seen by the hub.
+// RSSI values are as read from the RFM22 at sync detection (roughly 0.5dB per unit).
+typedef struct LinkQuality
+  {
+  uint8_t id0, id1; // Sender ID; both 0xff for an empty slot.
+  uint8_t rssiSmoothed; // Exponentially-smoothed RSSI.
+  uint8_t rssiMin; // Lowest RSSI seen recently; decays back towards rssiSmoothed.
+  uint8_t framesHeard; // Frames received; saturates at 255.
+  uint8_t framesMissed; // Recent frames known to have been missed (from sequence gaps); decays, saturates at 255.
+  uint8_t lastSeq; // Sequence number of the last sequenced frame heard, else LINK_QUALITY_NO_SEQ.
+  } LinkQuality_t;
+
+// Sequence number to pass for frames that do not carry one (eg FS20 and full stats frames).
+#define LINK_QUALITY_NO_SEQ 0xff
+
+// Maximum number of senders tracked; least-recently-heard is evicted first.
+#define LINK_QUALITY_TABLE_SIZE 8
+
+// Approximate lowest comfortable RSSI for reliable reception with OOK at 5kbps.
+#define LINK_QUALITY_RSSI_MIN_OK 80
+// Approximate RSSI change for one TX power step (~3dB).
+#define LINK_QUALITY_RSSI_PER_TX_STEP 6
+
+// Record a frame heard from the given sender, with the RSSI seen for it
+// and its 4-bit sequence number (eg from a TLV stats frame) or LINK_QUALITY_NO_SEQ if it has none.
+// Gaps in the sequence since the previous sequenced frame from this sender are counted as missed frames;
+// repeats (same sequence number) are not.
+// Is thread/ISR-safe and fast.
+void recordLinkQuality(uint8_t id0, uint8_t id1, uint8_t rssi, uint8_t seq);
+
+// True if the link from the given sender has margin for it to drop its TX power by one step.
+// Requires a few frames, no recent losses, and even the recent worst-case RSSI a full TX step above the comfortable minimum.
+// False if the sender is unknown.
+bool linkHasMargin(uint8_t id0, uint8_t id1);
+
+// Copy out the link quality entry at the given index, most-recently-heard first.
+// Returns false if there is no entry at that index.
+bool getLinkQuality(uint8_t index, LinkQuality_t *lq);
+#else
+#define recordLinkQuality(id0, id1, rssi, seq) {} // Do nothing.
+#define linkHasMargin(id0, id1) (false) // No information.
+#define getLinkQuality(index, lq) (false) // No entries.
 #endif
 
 #if defined(ALLOW_STATS_RX) && defined(ALLOW_MINIMAL_STATS_TXRX)
 // Record minimal incoming stats from given ID (if each byte < 100, then may be FHT8V-compatible house code).
 // If secure is true then this message arrived over a secure channel.
 // Is thread/ISR-safe and fast.
-// May be backed by a finite-depth queue, even zero-length (ie discarding); usually holds just one item.
+// Backed by a finite-depth queue shared with other inbound stats frames; dropped (and counted) if full.
 void recordMinimalStats(bool secure, uint8_t id0, uint8_t id1, const trailingMinimalStatsPayload_t *payload);
 #else
 #define recordMinimalStats(secure, id0, id1, payload) {} // Do nothing.
 #endif
 
 
+// Relayed (multi-record) stats frame
+// ==================================
+// Sent by a relay node (ENABLE_STATS_RELAY) to carry several neighbours' full stats frames to the hub in one TX,
+// eg for valves at the edge of the hub's radio range.
+// Each record is a complete full stats frame exactly as the relay received it (including its own CRC, and SEC form if secure),
+// so the hub decodes and de-duplicates each just as if heard directly, and the relay needs no keys.
+// The relay never relays a relayed frame, so relays cannot loop traffic between themselves.
+// Link quality is not recorded at the hub for relayed records since the RSSI is the relay's.
+//
+//           BIT  7     6     5     4     3     2     1     0
+// * byte 0 :  |  0  |  0  |  0  |  0  |  1  |  N2 |  N1 |  N0 |   header, record count - 1, ie [1,8] records
+// * byte 1 :  |  0  |  total length L of records in bytes     |
+// * L bytes of records, back to back.
+// * last   :  |  0  |  C6 |  C5 |  C4 |  C3 |  C2 |  C1 |  C0 |   7-bit CRC (crc7_5B_update, init MESSAGING_FULL_STATS_CRC_INIT) over all preceding bytes
+// The frame never contains 0xff.
+#define RELAY_STATS_HEADER_MSBS 0x08
+#define RELAY_STATS_HEADER_MASK 0xf8
+// Maximum number of records in one relayed frame.
+#define RELAY_STATS_MAX_RECORDS 8
+// Maximum size on wire of a relayed frame including trailing CRC (ie STATS_MSG_MAX_LEN).  TX buffer should be one larger for trailing 0xff.
+#define RELAY_STATS_MAX_FRAME_BYTES 56
+// Maximum total bytes of records in a relayed frame.
+#define RELAY_STATS_MAX_RECORD_BYTES (RELAY_STATS_MAX_FRAME_BYTES - 3)
+#if FullStatsMessageCore_MAX_BYTES_ON_WIRE > RELAY_STATS_MAX_RECORD_BYTES
+#error RELAY_STATS_MAX_RECORD_BYTES too small for a maximum-length full stats frame
+#endif
+
+// Returns the length of the valid relayed stats frame at buf (of buflen bytes) including its CRC, or 0 if it is not one.
+// The records themselves are not validated; use decodeFullStatsMessageCore() on each from buf+2 onwards.
+uint8_t checkRelayStatsFrame(const uint8_t *buf, uint8_t buflen);
+
+#if defined(ENABLE_STATS_RELAY)
+// Queues a copy of a validated (and not duplicate) received full stats frame of len bytes including its CRC for relaying.
+// Returns false if there is no room, in which case the frame is dropped: the caller should TX the pending frame soon.
+// Is thread/ISR-safe.
+bool queueStatsFrameForRelay(const uint8_t *frame, uint8_t len);
+
+// Number of received frames waiting to be relayed.
+uint8_t getRelayStatsPendingCount();
+
+// True if the pending relayed frame should be sent now since another full-size record might not fit.
+bool isRelayStatsFrameFull();
+
+// Moves all pending records into a relayed frame at buf (buflen >= RELAY_STATS_MAX_FRAME_BYTES+1 is always enough)
+// and terminates it with 0xff.
+// Returns the frame length excluding the 0xff, or 0 if nothing was pending or the buffer is too small (then nothing is removed).
+// Is thread/ISR-safe.
+uint8_t writeRelayStatsFrame(uint8_t *buf, uint8_t buflen);
+#else
+#define queueStatsFrameForRelay(frame, len) (false) // Not relaying.
+#define getRelayStatsPendingCount() 0 // Not relaying.
+#endif
+
+
 // Maximum length of JSON (text) message payload.
 // A little bit less than a power of 2
 // to enable packing along with other info.
@@ -635,6 +990,14 @@ void recordMinimalStats(bool secure, uint8_t id0, uint8_t id1, const trailingMin
 // to allow other explicit preamble/postamble (such as CRC) to be added.
 #define MSG_JSON_MAX_LENGTH 55
 
+// Maximum length of JSON (text) message once any on-air compression has been expanded.
+// Must be no more than 126 to fit in the inbound stats queue.
+#if defined(ALLOW_JSON_DICT_COMPRESSION)
+#define MSG_JSON_MAX_EXPANDED_LENGTH 100
+#else
+#define MSG_JSON_MAX_EXPANDED_LENGTH MSG_JSON_MAX_LENGTH
+#endif
+
 #define MSG_JSON_LEADING_CHAR ('{') // This is for a JSON object { ... }.
 
 #if defined(ALLOW_STATS_RX)
@@ -643,17 +1006,35 @@ void recordMinimalStats(bool secure, uint8_t id0, uint8_t id1, const trailingMin
 // The supplied buffer's content is not altered.
 // The supplied JSON should already have been somewhat validated.
 // Is thread/ISR-safe and moderately fast (though will require a data copy).
-// May be backed by a finite-depth queue, even zero-length (ie discarding); usually holds just one item.
+// Backed by a finite-depth queue shared with other inbound stats frames; dropped (and counted) if full.
+// Producer side: should only be called from one context (eg ISR or main loop, not both).
 void recordJSONStats(bool secure, const char *json);
-
-// Gets (and clears) the last JSON record received, if any,
-// filling in the supplied buffer
-// else leaving it starting with '\0' if none available.
-// The buffer must be at least MSG_JSON_MAX_LENGTH+1 chars.
-void getLastJSONStats(char *buf);
 #else
 #define recordJSONStats(secure, json) {} // Do nothing.
-#define getLastJSONStats(buf) {*(buf) = '\0';} // Nothing to receive.
+#endif
+
+#if defined(ALLOW_STATS_RX) && defined(ALLOW_STATS_TLV)
+// Number of senders whose state is tracked to decode compact binary TLV stats deltas.
+// The least-recently-heard sender is forgotten to make room for a new one;
+// its deltas are then ignored until its next absolute values arrive.
+// So set at least to the number of TLV senders expected within earshot (eg BOILER_HUB_MAX_RADIATORS),
+// else they take turns to evict each other and most of their values are lost.
+// Costs about 30 bytes of RAM per sender.
+#ifndef STATS_TLV_RX_SENDERS
+#define STATS_TLV_RX_SENDERS 8
+#endif
+#if (STATS_TLV_RX_SENDERS < 1) || (STATS_TLV_RX_SENDERS > 32)
+#error STATS_TLV_RX_SENDERS must be in range [1,32]
+#endif
+// Record compact binary TLV stats frame (see Stats_TLV.h) of up to buflen bytes (already checked with statsTLVCheckFrame()).
+// Values are converted to the equivalent JSON (split over more than one if need be) and recorded via recordJSONStats(),
+// so that the hub output is the same as if the sender had sent JSON.
+// Repeats (eg from double TX) are ignored.
+// If secure is true then this message arrived over a secure channel.
+// Not thread/ISR-safe: call from the same context as other stats RX.
+void recordStatsTLV(bool secure, const uint8_t *buf, uint8_t buflen);
+#else
+#define recordStatsTLV(secure, buf, buflen) {} // Do nothing.
 #endif
 
 #endif
@@ -208,9 +208,21 @@ do { \
 } while (0)
 #endif
 
+// Check if serial is (already) powered up.
+static bool _serialIsPoweredUp() { return(!(PRR & _BV(PRUSART0))); }
+
 // Sleep with BOD disabled in power-save mode; will wake on any interrupt.
+// If serial output is still draining then sleeps in IDLE mode instead so that the UART keeps running,
+// and performs any deferred serial power-down first if the output has now fully drained.
 void sleepPwrSaveWithBODDisabled()
   {
+#ifdef __AVR_ATmega328P__
+  pollSerialPowerDown();
+  // The UART clock stops in power-save mode, which would garble/stall any byte part way out,
+  // so idle instead (waking on each UDRE interrupt) until the output has gone.
+  if(_serialIsPoweredUp() && !serialTXDrained()) { set_sleep_mode(SLEEP_MODE_IDLE); }
+  else
+#endif
   set_sleep_mode(SLEEP_MODE_PWR_SAVE); // Stop all but timer 2 and watchdog when sleeping.
   cli();
   sleep_enable();
@@ -688,9 +700,6 @@ void powerDownADC()
   }
 
 
-// Check if serial is (already) powered up.
-static bool _serialIsPoweredUp() { return(!(PRR & _BV(PRUSART0))); }
-
 // If serial was disabled, power it up, do Serial.begin(), and return true.
 // If already powered up then do nothing other than return false.
 // If this returns true then a matching powerDownSerial() may be advisable.
@@ -759,9 +768,53 @@ void flushSerialSCTSensitive()
 #endif
 
 
+#ifdef __AVR_ATmega328P__
+// True if the UART is to be powered down once its output has drained.
+static bool serialPowerDownDeferred;
+
+// Power down the UART once all queued output has drained, without waiting for it here.
+void powerDownSerialWhenDrained()
+  {
+  if(!_serialIsPoweredUp()) { powerDownSerial(); return; } // Ensure pins etc are in low-power state.
+  serialPowerDownDeferred = true;
+  pollSerialPowerDown(); // Do it now if nothing is queued.
+  }
+
+// Perform any deferred serial power-down if output has now fully drained.
+// Returns true if no deferred power-down remains pending.
+bool pollSerialPowerDown()
+  {
+  if(!serialPowerDownDeferred) { return(true); }
+  if(_serialIsPoweredUp() && !serialTXDrained()) { return(false); }
+  powerDownSerial(); // Clears serialPowerDownDeferred.
+  return(true);
+  }
+
+// Wait for queued serial output to drain, but give up at (or shortly after) the specified sub-cycle time.
+// Returns true if all output has been sent, false if the time limit was reached first.
+bool flushSerialBounded(const uint8_t maxSCT)
+  {
+  if(!_serialIsPoweredUp()) { return(true); }
+  while(!serialTXDrained())
+    {
+    if(getSubCycleTime() >= maxSCT) { return(false); }
+#ifdef ENABLE_AVR_IDLE_MODE
+    idle15AndPoll(); // Save much power by idling CPU, though everything else runs; UDRE interrupts will wake it.
+#else
+    burnHundredsOfCyclesProductivelyAndPoll();
+#endif
+    }
+  return(true);
+  }
+#endif
+
 // Flush any pending serial output and power it down if up.
+// Cancels any deferred power-down.
 void powerDownSerial()
   {
+#ifdef __AVR_ATmega328P__
+  serialPowerDownDeferred = false;
+#endif
   if(_serialIsPoweredUp())
     {
     // Flush serial output and shut down if apparently active.
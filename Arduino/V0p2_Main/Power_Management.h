@@ -150,6 +150,8 @@ int readInternalTemperatureC16();
 void minimisePowerWithoutSleep();
 
 // Sleep with BOD disabled in power-save mode; will wake on any interrupt.
+// If serial output is still draining then sleeps in IDLE mode instead so that the UART keeps running,
+// and performs any deferred serial power-down first if the output has now fully drained.
 // This particular API is not guaranteed to be maintained: please use sleepUntilInt() instead.
 void sleepPwrSaveWithBODDisabled();
 
@@ -293,12 +295,33 @@ void powerDownADC();
 // If this returns true then a matching powerDownSerial() may be advisable.
 bool powerUpSerialIfDisabled();
 // Flush any pending serial (UART/USART0) output and power it down.
+// Cancels any deferred power-down.
 void powerDownSerial();
 #ifdef __AVR_ATmega328P__
 // Returns true if hardware USART0 buffer in ATMmega328P is non-empty; may occasionally return a spurious false.
 // There may still be a byte in the process of being transmitted when this is false.
 // This should not interfere with HardwareSerial's handling.
 #define serialTXInProgress() (!(UCSR0A & _BV(UDRE0)))
+// Returns true if all queued serial output has been fully sent, including the last stop bit.
+// HardwareSerial leaves the UDRE interrupt enabled only while its TX ring buffer is non-empty,
+// and clears TXC0 on each write so that TXC0 is only set once the final byte has left the shift register.
+// Only meaningful while the UART is powered up.
+#define serialTXDrained() (!(UCSR0B & _BV(UDRIE0)) && (UCSR0A & _BV(UDRE0)) && (UCSR0A & _BV(TXC0)))
+// Power down the UART once all queued output has drained, without waiting for it here.
+// Output queued via HardwareSerial continues to be sent from its UDRE interrupt in the meantime,
+// with sleepUntilInt()/nap() idling rather than stopping the UART clock while bytes remain.
+// A subsequent powerUpSerialIfDisabled() finds the UART still up and does not cancel this.
+void powerDownSerialWhenDrained();
+// Perform any deferred serial power-down if output has now fully drained.
+// Returns true if no deferred power-down remains pending.
+// Cheap enough to call often, eg before each sleep.
+bool pollSerialPowerDown();
+// Wait for queued serial output to drain, but give up at (or shortly after) the specified sub-cycle time.
+// Idles the CPU (or polls I/O productively) while waiting.
+// Returns true if all output has been sent, false if the time limit was reached first.
+// Sleeps in IDLE mode for up to 15ms at a time so may overshoot maxSCT by a couple of ticks;
+// the caller must be sure RX overrun (etc) will not be an issue.
+bool flushSerialBounded(uint8_t maxSCT);
 // Does a Serial.flush() attempting to do some useful work (eg I/O polling) while waiting for output to drain.
 // Assumes hundreds of CPU cycles available for each character queued for TX.
 // Does not change CPU clock speed or disable or mess with USART0, though may poll it.
@@ -313,6 +336,9 @@ void flushSerialSCTSensitive();
 #else
 #define flushSerialProductive() Serial.flush()
 #define flushSerialSCTSensitive() Serial.flush()
+#define powerDownSerialWhenDrained() powerDownSerial()
+#define pollSerialPowerDown() (true)
+#define flushSerialBounded(maxSCT) (Serial.flush(), true)
 #endif
 
 
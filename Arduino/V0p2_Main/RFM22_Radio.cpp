@@ -38,9 +38,12 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2015
 #define RFM22REG_OP_CTRL1_SWRES 0x80 // Software reset (at write) in OP_CTRL1.
 #define RFM22REG_OP_CTRL2 8 // Operation and control register 2.
 #define RFM22REG_RSSI 0x26 // RSSI.
+#define RFM22REG_DATA_ACCESS_CTRL 0x30 // Packet handler data access control.
+#define RFM22REG_TX_PKT_LEN 0x3e // Transmit packet length (packet handler).
+#define RFM22REG_RX_PKT_LEN 0x4b // Received packet length (packet handler).
 #define RFM22REG_RSSI1 0x28 // Antenna 1 diversity / RSSI.
 #define RFM22REG_RSSI2 0x29 // Antenna 2 diversity / RSSI.
-#define RFM22REG_TX_POWER $0x6d // Transmit power.
+#define RFM22REG_TX_POWER 0x6d // Transmit power.
 #define RFM22REG_RX_FIFO_CTRL 0x7e // RX FIFO control.
 #define RFM22REG_FIFO  0x7f // TX FIFO on write, RX FIFO on read.
 
@@ -199,6 +202,48 @@ uint8_t RFM22RSSI()
   return(rssi);
   }
 
+// Current TX power step; starts at the value loaded with the radio register block.
+static uint8_t txPowerStep = RFM22_TX_POWER_MAX_STEP;
+
+// Get current TX power step in range [0,RFM22_TX_POWER_MAX_STEP].
+uint8_t RFM22GetTXPowerStep() { return(txPowerStep); }
+
+// Set TX power step, coerced to range [0,RFM22_TX_POWER_MAX_STEP].
+void RFM22SetTXPowerStep(const uint8_t step)
+  {
+  txPowerStep = min(step, RFM22_TX_POWER_MAX_STEP);
+  const bool neededEnable = powerUpSPIIfDisabled();
+  _RFM22WriteReg8Bit(RFM22REG_TX_POWER, RFM22_TX_POWER_LNA_SW | txPowerStep);
+  if(neededEnable) { powerDownSPI(); }
+  }
+
+// Consecutive 'link has margin' reports needed before stepping TX power down.
+// Stepping down slowly and up quickly should avoid oscillating around the margin.
+#define RFM22_TX_POWER_MARGIN_REPORTS_TO_STEP_DOWN 4
+
+// Adapt TX power one step at a time from link feedback.
+// Call with linkHasMargin true when told (eg by the hub) that the link has margin to spare:
+// several consecutive such reports are needed before stepping down one level.
+// Call with linkHasMargin false on a missed ACK or sequence gap:
+// this steps straight back up one level (towards the compile-time maximum) for fast recovery.
+// Returns true if the TX power step was changed.
+bool RFM22AdaptTXPower(const bool linkHasMargin)
+  {
+  static uint8_t marginReports;
+  if(!linkHasMargin)
+    {
+    marginReports = 0;
+    if(txPowerStep >= RFM22_TX_POWER_MAX_STEP) { return(false); }
+    RFM22SetTXPowerStep(txPowerStep + 1);
+    return(true);
+    }
+  if(++marginReports < RFM22_TX_POWER_MARGIN_REPORTS_TO_STEP_DOWN) { return(false); }
+  marginReports = 0;
+  if(0 == txPowerStep) { return(false); }
+  RFM22SetTXPowerStep(txPowerStep - 1);
+  return(true);
+  }
+
 // Minimal set-up of I/O (etc) after system power-up.
 // Performs a software reset and leaves the radio deselected and in a low-power and safe state.
 // Will power up SPI if needed.
@@ -400,6 +445,130 @@ void RFM22RXFIFO(uint8_t *buf, const uint8_t bufSize)
 
 
 
+#if defined(RFM22_NATIVE_PACKET_HANDLER)
+// Packet-handler register overlay for OpenTRV-native frames.
+// Consists of a sequence of (reg#,value) pairs terminated with a 0xff register number.
+static const uint8_t RFM22_Native_PH_Reg_Values[][2] PROGMEM =
+  {
+    {0x30,0x8d}, // DATA ACCESS CTRL: enpacrx | enpactx | encrc, CRC-16 (IBM).
+    {0x32,0}, // HEADER CTRL 1: no header/broadcast checks.
+    {0x33,2}, // HEADER CTRL 2: no header, length byte sent (not fixed length), 2-byte sync word.
+    {0x34,2*RFM22_PREAMBLE_BYTES}, // Preamble length in nybbles.
+    {0x35,0x20}, // Preamble detection threshold 4 nybbles / 2 bytes.
+    {0x36,RFM22_NATIVE_SYNC_BYTE0}, {0x37,RFM22_NATIVE_SYNC_BYTE1},
+    { 0xff, 0xff } // End of settings.
+  };
+
+// Packet-handler register overlay restoring raw FHT8V-compatible framing.
+// Must match the packet-handler entries of FHT8V_RFM22_Reg_Values.
+static const uint8_t RFM22_Raw_PH_Reg_Values[][2] PROGMEM =
+  {
+    {0x30,0}, {0x33,6}, {0x34,8}, {0x35,0x10}, {0x36,0xaa}, {0x37,0xcc}, {0x38,0xcc}, {0x39,0xcc},
+    { 0xff, 0xff } // End of settings.
+  };
+
+// True while the native packet-handler profile is selected.
+// Initially false as FHT8V_RFM22_Reg_Values is loaded at start-up.
+static bool nativePH;
+
+// Switch between the native packet-handler profile and the raw (FHT8V-compatible) profile.
+// Only the packet-handler registers are changed; the radio should be in standby.
+// Does nothing if the requested profile is already selected.
+void RFM22SetNativePacketHandler(const bool enable)
+  {
+  if(enable == nativePH) { return; }
+  RFM22RegisterBlockSetup(enable ? RFM22_Native_PH_Reg_Values : RFM22_Raw_PH_Reg_Values);
+  nativePH = enable;
+  }
+
+// Returns true iff the native packet-handler profile is currently selected.
+bool RFM22IsNativePacketHandler() { return(nativePH); }
+
+// Unconditionally reload the raw (FHT8V-compatible) packet-handler registers, eg before every FHT8V valve TX.
+// The radio should be in standby.
+void RFM22LoadRawPacketHandler()
+  {
+  RFM22RegisterBlockSetup(RFM22_Raw_PH_Reg_Values);
+  nativePH = false;
+  }
+
+// Returns true iff the radio's packet-handler registers actually hold the raw (FHT8V-compatible) profile.
+// Reads back the packet-handler enable and sync-length registers from the radio.
+bool RFM22IsRawPacketHandlerLoaded()
+  {
+  const bool neededEnable = powerUpSPIIfDisabled();
+  const bool result = (0 == _RFM22ReadReg8Bit(0x30)) && (6 == _RFM22ReadReg8Bit(0x33));
+  if(neededEnable) { powerDownSPI(); }
+  return(result);
+  }
+
+// Clears the RFM22 TX FIFO and queues up a native frame of len bytes (excluding length and CRC) for RFM22TXFIFO().
+// The radio adds preamble, sync, length byte and CRC; the frame body may contain any byte values including 0xff.
+// Native profile must be selected; len must be in range [1,RFM22_NATIVE_MAX_FRAME_BYTES].
+void RFM22QueueNativeFrame(const uint8_t *buf, uint8_t len)
+  {
+  if((0 == len) || (len > RFM22_NATIVE_MAX_FRAME_BYTES)) { return; }
+  const bool neededEnable = powerUpSPIIfDisabled();
+  _RFM22ClearTXFIFO();
+  _RFM22WriteReg8Bit(RFM22REG_TX_PKT_LEN, len);
+  _RFM22_SELECT();
+  _RFM22_wr(RFM22REG_FIFO | 0x80); // Start burst write to TX FIFO.
+  while(len-- > 0) { _RFM22_wr(*buf++); }
+  _RFM22_DESELECT();
+  if(neededEnable) { powerDownSPI(); }
+  }
+
+// Put RFM22 into RX mode for native frames with 'valid packet' and 'CRC error' interrupts enabled.
+// Native profile must be selected.
+//   * syncInt  if true also enable the sync-word-detected interrupt (eg to gather RSSI/entropy)
+void RFM22SetUpNativeRX(const bool syncInt)
+  {
+  const bool neededEnable = powerUpSPIIfDisabled();
+
+  // Clear RX and TX FIFOs.
+  _RFM22WriteReg8Bit(RFM22REG_OP_CTRL2, 3); // FFCLRRX | FFCLRTX
+  _RFM22WriteReg8Bit(RFM22REG_OP_CTRL2, 0);
+
+  // Set RX FIFO almost-full threshold high so that it does not trigger ahead of a whole valid packet.
+  _RFM22WriteReg8Bit(RFM22REG_RX_FIFO_CTRL, 63);
+
+  // Enable packet-level interrupts only: the CPU need not touch the FIFO until a whole valid frame has arrived.
+  _RFM22WriteReg8Bit(RFM22REG_INT_ENABLE1, 3); // enpkvalid | encrcerror
+  _RFM22WriteReg8Bit(RFM22REG_INT_ENABLE2, (syncInt?0x80:0)); // enswdet: Enable Sync Word Detected.
+
+  // Clear any current interrupt/status.
+  _RFM22ClearInterrupts();
+
+  // Start listening.
+  _RFM22ModeRX();
+
+  if(neededEnable) { powerDownSPI(); }
+  }
+
+// Read a native frame that the packet handler has already validated (after 'valid packet' status).
+// Puts RFM22 into standby with FIFOs and interrupts cleared.
+// Returns body length in bytes (excluding length and CRC), or 0 if none or too large for buf.
+uint8_t RFM22RXNativeFrame(uint8_t *buf, const uint8_t bufSize)
+  {
+  const bool neededEnable = powerUpSPIIfDisabled();
+  _RFM22ModeStandby();
+  uint8_t len = _RFM22ReadReg8Bit(RFM22REG_RX_PKT_LEN);
+  if(len > bufSize) { len = 0; } // Reject rather than truncate.
+  if(0 != len)
+    {
+    _RFM22_SELECT();
+    _RFM22_io(RFM22REG_FIFO & 0x7F); // Start burst read from RX FIFO.
+    for(uint8_t i = 0; i < len; ++i)
+      { buf[i] = _RFM22_io(0); }
+    _RFM22_DESELECT();
+    }
+  if(neededEnable) { powerDownSPI(); }
+  RFM22ModeStandbyAndClearState();
+  return(len);
+  }
+#endif
+
+
 // Send the underlying stats binary/text 'whitened' message.
 // This must be terminated with an 0xff (which is not sent),
 // and no longer than STATS_MSG_MAX_LEN bytes long in total (excluding the terminating 0xff).
@@ -423,15 +592,63 @@ void RFM22RawStatsTX(const bool isBinary, uint8_t * const buf, const bool double
   bptr += RFM22_SYNC_MIN_BYTES;
 
   // TODO: put in listen before TX to reduce collisions (CSMA).
+#if defined(RFM22_NATIVE_PACKET_HANDLER)
+  // Let the packet handler supply preamble, sync, length and CRC.
+  // The message body is everything up to (not including) the terminating 0xff.
+  const uint8_t *const body = buf + STATS_MSG_START_OFFSET;
+  uint8_t len = 0;
+  while((len < STATS_MSG_MAX_LEN) && (0xff != body[len])) { ++len; }
+  RFM22ModeStandbyAndClearState();
+  RFM22SetNativePacketHandler(true);
+  RFM22QueueNativeFrame(body, len);
+#else
   // Send message starting will preamble.
   // Assume RFM22/23 support for now.
   RFM22QueueCmdToFF(buf);
+#endif
   RFM22TXFIFO(); // Send it!  Approx 1.6ms/byte.
   if(doubleTX)
     {
     nap(WDTO_15MS);
     RFM22TXFIFO(); // Re-send it!
     }
+#if defined(RFM22_NATIVE_PACKET_HANDLER)
+  // Revert to FHT8V-compatible framing for valve traffic.
+  RFM22ModeStandbyAndClearState();
+  RFM22SetNativePacketHandler(false);
+#endif
   //DEBUG_SERIAL_PRINTLN_FLASHSTRING("RS");
   }
 
+// Listen for up to about maxMs milliseconds for a short frame such as an ACK sent in the same way as RFM22RawStatsTX(),
+// then put the radio in standby with FIFOs and interrupts cleared.
+// Returns the number of bytes read into buf, or 0 if nothing was heard in time.
+uint8_t RFM22RXFrameWithin(uint8_t *const buf, const uint8_t bufSize, const uint8_t maxMs)
+  {
+  RFM22ModeStandbyAndClearState();
+#if defined(RFM22_NATIVE_PACKET_HANDLER)
+  RFM22SetNativePacketHandler(true);
+  RFM22SetUpNativeRX(false);
+#else
+  RFM22SetUpRX(bufSize, false, true);
+#endif
+  uint8_t len = 0;
+  // Poll the status every couple of milliseconds rather than hooking the interrupt for so short a wait.
+  for(uint8_t t = 0; t < maxMs; t += 2)
+    {
+    sleepLowPowerMs(2);
+    const uint16_t status = RFM22ReadStatusBoth();
+#if defined(RFM22_NATIVE_PACKET_HANDLER)
+    if(status & RFM22_STATUS_NATIVE_PKT_VALID) { len = RFM22RXNativeFrame(buf, bufSize); break; }
+    if(status & RFM22_STATUS_NATIVE_CRC_ERROR) { RFM22SetUpNativeRX(false); } // Discard and keep listening.
+#else
+    if(status & 0x1000) { RFM22RXFIFO(buf, bufSize); len = bufSize; break; } // RX FIFO almost full.
+#endif
+    }
+  RFM22ModeStandbyAndClearState();
+#if defined(RFM22_NATIVE_PACKET_HANDLER)
+  RFM22SetNativePacketHandler(false);
+#endif
+  return(len);
+  }
+
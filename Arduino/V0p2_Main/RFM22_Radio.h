@@ -63,6 +63,39 @@ void RFM22RXFIFO(uint8_t *buf, uint8_t bufSize);
 // Only valid when in RX mode.
 uint8_t RFM22RSSI();
 
+// TX power: RFM22REG_TX_POWER holds the LNA switch control bit and a 3-bit power step (~3dB per step).
+// The compile-time maximum step is the legal/appropriate level for the module and RF environment,
+// and is what the radio is initially configured with.
+// From AN440: txpow[2:0]=000 corresponds to min output power, while txpow[2:0]=111 corresponds to max output power.
+#define RFM22_TX_POWER_LNA_SW 0x08 // LNA switch control bit in RFM22REG_TX_POWER; always set.
+#ifndef RFM22_IS_ACTUALLY_RFM23
+    #ifndef RFM22_GOOD_RF_ENV
+    #define RFM22_TX_POWER_MAX_STEP 5 // RFM22 +14dBm ~25mW ERP with 1/4-wave antenna.
+    #else // Tone down for good RF backplane, etc.
+    #define RFM22_TX_POWER_MAX_STEP 1
+    #endif
+#else
+    #ifndef RFM22_GOOD_RF_ENV
+    #define RFM22_TX_POWER_MAX_STEP 7 // RFM23 max power (+13dBm) for ERP ~25mW with 1/4-wave antenna.
+    #else // Tone down for good RF backplane, etc.
+    #define RFM22_TX_POWER_MAX_STEP 3
+    #endif
+#endif
+
+// Get current TX power step in range [0,RFM22_TX_POWER_MAX_STEP].
+uint8_t RFM22GetTXPowerStep();
+
+// Set TX power step, coerced to range [0,RFM22_TX_POWER_MAX_STEP].
+void RFM22SetTXPowerStep(uint8_t step);
+
+// Adapt TX power one step at a time from link feedback.
+// Call with linkHasMargin true when told (eg by the hub) that the link has margin to spare:
+// several consecutive such reports are needed before stepping down one level.
+// Call with linkHasMargin false on a missed ACK or sequence gap:
+// this steps straight back up one level (towards the compile-time maximum) for fast recovery.
+// Returns true if the TX power step was changed.
+bool RFM22AdaptTXPower(bool linkHasMargin);
+
 // Read status (both registers) and clear interrupts.
 // Status register 1 is returned in the top 8 bits, register 2 in the bottom 8 bits.
 // Zero indicates no pending interrupts or other status flags set.
@@ -74,6 +107,52 @@ uint16_t RFM22ReadStatusBoth();
 #define RFM22_SYNC_BYTE 0xcc // Sync-word trailing byte (with FHT8V primarily).
 #define RFM22_SYNC_MIN_BYTES 3 // Minimum number of sync bytes.
 
+#if defined(RFM22_NATIVE_PACKET_HANDLER)
+// Alternative radio profile for OpenTRV-native (non-FHT8V) frames.
+// Uses the on-chip packet handler to generate/check preamble and sync,
+// send a leading length byte and append/verify a CRC-16,
+// so that corrupt frames are discarded by the radio without waking the CPU to validate them.
+// Carrier, bit rate and modulation are as for FHT8V, so the same channel is shared.
+// A distinct sync word is used so that native and FHT8V frames cannot be confused.
+#define RFM22_NATIVE_SYNC_BYTE0 0x2d // First (of two) native-frame sync bytes.
+#define RFM22_NATIVE_SYNC_BYTE1 0xd4 // Second (of two) native-frame sync bytes.
+#define RFM22_NATIVE_MAX_FRAME_BYTES 64 // Maximum native frame body (excluding length and CRC), ie one FIFO-full.
+
+// Switch between the native packet-handler profile and the raw (FHT8V-compatible) profile.
+// Only the packet-handler registers are changed; the radio should be in standby.
+// Does nothing if the requested profile is already selected.
+void RFM22SetNativePacketHandler(bool enable);
+
+// Returns true iff the native packet-handler profile is currently selected.
+bool RFM22IsNativePacketHandler();
+
+// Unconditionally reload the raw (FHT8V-compatible) packet-handler registers, eg before every FHT8V valve TX.
+// The radio should be in standby.
+void RFM22LoadRawPacketHandler();
+
+// Returns true iff the radio's packet-handler registers actually hold the raw (FHT8V-compatible) profile.
+bool RFM22IsRawPacketHandlerLoaded();
+
+// Clears the RFM22 TX FIFO and queues up a native frame of len bytes (excluding length and CRC) for RFM22TXFIFO().
+// The radio adds preamble, sync, length byte and CRC; the frame body may contain any byte values including 0xff.
+// Native profile must be selected; len must be in range [1,RFM22_NATIVE_MAX_FRAME_BYTES].
+void RFM22QueueNativeFrame(const uint8_t *buf, uint8_t len);
+
+// Put RFM22 into RX mode for native frames with 'valid packet' and 'CRC error' interrupts enabled.
+// Native profile must be selected.
+//   * syncInt  if true also enable the sync-word-detected interrupt (eg to gather RSSI/entropy)
+void RFM22SetUpNativeRX(bool syncInt);
+
+// Read a native frame that the packet handler has already validated (after 'valid packet' status).
+// Puts RFM22 into standby with FIFOs and interrupts cleared.
+// Returns body length in bytes (excluding length and CRC), or 0 if none or too large for buf.
+uint8_t RFM22RXNativeFrame(uint8_t *buf, uint8_t bufSize);
+
+// RFM22ReadStatusBoth() bits for native RX.
+#define RFM22_STATUS_NATIVE_PKT_VALID 0x0200 // ipkvalid: valid packet received (length and CRC good).
+#define RFM22_STATUS_NATIVE_CRC_ERROR 0x0100 // icrcerror: packet received with bad CRC.
+#endif
+
 
 // Send the underlying stats binary/text 'whitened' message.
 // This must be terminated with an 0xff (which is not sent),
@@ -89,6 +168,15 @@ uint16_t RFM22ReadStatusBoth();
 #define STATS_MSG_MAX_LEN (64 - STATS_MSG_START_OFFSET)
 void RFM22RawStatsTX(const bool isBinary, uint8_t * const buf, const bool doubleTX);
 
+// Listen for up to about maxMs milliseconds for a short frame such as an ACK sent in the same way as RFM22RawStatsTX(),
+// then put the radio in standby with FIFOs and interrupts cleared.
+// With the native packet handler the frame body is read once the radio has validated it;
+// otherwise the first bufSize bytes after the sync word are read once that many have arrived,
+// which may include some leading RFM22_SYNC_BYTE bytes and trailing noise.
+// The caller must still check the content (eg its CRC).
+// Returns the number of bytes read into buf, or 0 if nothing was heard in time.
+uint8_t RFM22RXFrameWithin(uint8_t *buf, uint8_t bufSize, uint8_t maxMs);
+
 
 #endif
 
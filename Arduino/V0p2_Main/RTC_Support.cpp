@@ -191,6 +191,41 @@ uint_least16_t getDaysSince1999LT()
   return(result);
   }
 
+// Get the day of the week [0,6] for the given day count, caching the last result
+// to avoid a slow software division in all but the first call each day.
+static uint_least8_t dayOfWeekCached(const uint_least16_t days)
+  {
+  static uint_least16_t cachedDays = (uint_least16_t)~0U;
+  static uint_least8_t cachedDoW;
+  if(days != cachedDays) { cachedDoW = dayOfWeekFromDays(days); cachedDays = days; }
+  return(cachedDoW);
+  }
+
+// Get the day of the week local time [0,6], 0 for Monday.
+// Thread-safe but not ISR-safe.
+uint_least8_t getDayOfWeekLT() { return(dayOfWeekCached(getDaysSince1999LT())); }
+
+// Get the hour of the week local time [0,167], 0 being the hour from midnight starting Monday.
+// Thread-safe but not ISR-safe.
+uint_least8_t getHourOfWeekLT()
+  {
+  uint_least16_t days;
+  uint_least8_t hh;
+  do { days = getDaysSince1999LT(); hh = getHoursLT(); } while(days != getDaysSince1999LT()); // Retry if midnight intervened.
+  return((uint_least8_t)((dayOfWeekCached(days) * 24U) + hh));
+  }
+
+// Get the hour of the week local time [0,167] the given number of minutes ahead of now, wrapping at the end of the week.
+// Thread-safe but not ISR-safe.
+uint_least8_t getHourOfWeekAheadLT(const uint_least16_t minsAhead)
+  {
+  uint_least16_t days;
+  uint_least16_t mm;
+  do { days = getDaysSince1999LT(); mm = getMinutesSinceMidnightLT(); } while(days != getDaysSince1999LT()); // Retry if midnight intervened.
+  const uint32_t m = (dayOfWeekCached(days) * (uint32_t)MINS_PER_DAY) + mm + minsAhead;
+  return((uint_least8_t)((m / 60) % 168));
+  }
+
 
 
 
@@ -86,6 +86,25 @@ uint_least16_t getMinutesSinceMidnightLT();
 // Thread-safe and ISR-safe.
 uint_least16_t getDaysSince1999LT();
 
+// Get the day of the week [0,6], 0 for Monday, for the given whole days since the start of 2000/01/01 (a Saturday).
+static inline uint_least8_t dayOfWeekFromDays(const uint_least16_t days) { return((uint_least8_t)((days + 5U) % 7U)); }
+
+// Get the day of the week local time [0,6], 0 for Monday.
+// The day count starts from 0 on a fresh device, so the days are only named correctly once the date has been set,
+// but they always follow a consistent 7-day cycle.
+// Fast: only recomputed when the day changes.
+// Thread-safe but not ISR-safe.
+uint_least8_t getDayOfWeekLT();
+
+// Get the hour of the week local time [0,167], 0 being the hour from midnight starting Monday.
+// The day and hour are taken consistently even across midnight.
+// Thread-safe but not ISR-safe.
+uint_least8_t getHourOfWeekLT();
+
+// Get the hour of the week local time [0,167] the given number of minutes ahead of now, wrapping at the end of the week.
+// Thread-safe but not ISR-safe.
+uint_least8_t getHourOfWeekAheadLT(uint_least16_t minsAhead);
+
 
 // Set time as hours [0,23] and minutes [0,59].
 // Will ignore attempts to set bad values and return false in that case.
@@ -53,6 +53,26 @@ void _TEST_set_schedule_override(const _TEST_schedule_override override)
 // Maximum mins-after-midnight compacted value in one byte.
 #define MAX_COMPRESSED_MINS_AFTER_MIDNIGHT ((MINS_PER_DAY / SIMPLE_SCHEDULE_GRANULARITY_MINS) - 1)
 
+// RAM copy of the encoded schedule on-time bytes to save EEPROM access in the frequent (per-minute) schedule checks.
+// Loaded on first use and kept in step by setSimpleSchedule() and clearSimpleSchedule(), the only writers of these bytes.
+static uint8_t scheduleOnCache[MAX_SIMPLE_SCHEDULES];
+static bool scheduleOnCacheLoaded;
+
+// Get the encoded on time of the given (valid) schedule, from the RAM copy.
+static uint8_t getEncodedScheduleOn(const uint8_t which)
+  {
+  if(!scheduleOnCacheLoaded)
+    {
+    ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+      {
+      for(uint8_t i = 0; i < MAX_SIMPLE_SCHEDULES; ++i)
+        { scheduleOnCache[i] = eeprom_read_byte((uint8_t*)(EE_START_SIMPLE_SCHEDULE0_ON + i)); }
+      }
+    scheduleOnCacheLoaded = true;
+    }
+  return(scheduleOnCache[which]);
+  }
+
 
 // If LEARN_BUTTON_AVAILABLE then what is the schedule on time?
 #ifdef LEARN_BUTTON_AVAILABLE
@@ -78,6 +98,37 @@ static uint8_t onTime()
 // Important for slow-to-heat rooms that have become very cold.
 // Similar to PREWARM_MINS so that we can safely use this without causing distress, eg waking people up.
 #define PREPREWARM_MINS (PREWARM_MINS)
+// Maximum setback period before WARM once a room heating rate has been learned, bounding early heating of slow/cold rooms.
+#define MAX_PREPREWARM_MINS 180
+
+// Minutes by which each pre-warm stagger slot advances the start of the setback period.
+// At 8 slots spreads valve openings on a shared boiler over about 20 minutes.
+#define PREWARM_STAGGER_STEP_MINS 3
+
+// Pre-warm stagger slot [0,7] last suggested by the hub; 0 until then (no stagger).
+static uint8_t preWarmStaggerSlot;
+
+// Set the pre-warm stagger slot suggested by the hub, taken modulo 8.
+void setPreWarmStaggerSlot(const uint8_t slot) { preWarmStaggerSlot = slot & 7; }
+
+// Get the setback period in minutes before the (already wound-back) WARM period.
+// With a learned room heating rate this is just long enough (plus a 25% margin) to reach the WARM target on time,
+// so slow or cold rooms start earlier and fast or still-warm ones later (down to not at all);
+// until a rate has been learned it is the fixed PREPREWARM_MINS.
+// Either way it is then extended by the hub's stagger slot so that valves sharing a boiler do not all open at once.
+static uint_least16_t getPrePreWarmMins()
+  {
+  uint_least16_t baseM = PREPREWARM_MINS;
+#if defined(LOCAL_TRV)
+  const uint8_t m = NominalRadValve.getEstimatedMinsToWARMTarget();
+  if(0xff != m)
+    {
+    const uint_least16_t leadM = m + (m >> 2);
+    baseM = (leadM <= PREWARM_MINS) ? 0 : fnmin((uint_least16_t)(leadM - PREWARM_MINS), (uint_least16_t)MAX_PREPREWARM_MINS);
+    }
+#endif
+  return(baseM + (uint_least16_t)(preWarmStaggerSlot * PREWARM_STAGGER_STEP_MINS));
+  }
 
 // Get the simple/primary schedule on time, as minutes after midnight [0,1439]; invalid (eg ~0) if none set.
 // Will usually include a pre-warm time before the actual time set.
@@ -86,9 +137,7 @@ static uint8_t onTime()
 uint_least16_t getSimpleScheduleOn(const uint8_t which)
   {
   if(which >= MAX_SIMPLE_SCHEDULES) { return(~0); } // Invalid schedule number.
-  uint8_t startMM;
-  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
-    { startMM = eeprom_read_byte((uint8_t*)(EE_START_SIMPLE_SCHEDULE0_ON + which)); }
+  const uint8_t startMM = getEncodedScheduleOn(which);
   if(startMM > MAX_COMPRESSED_MINS_AFTER_MIDNIGHT) { return(~0); } // No schedule set.
   // Compute start time from stored shedule value.
   uint_least16_t startTime = SIMPLE_SCHEDULE_GRANULARITY_MINS * startMM;
@@ -129,6 +178,7 @@ bool setSimpleSchedule(const uint_least16_t startMinutesSinceMidnightLT, const u
   const uint8_t startMM = startMinutesSinceMidnightLT / SIMPLE_SCHEDULE_GRANULARITY_MINS; // Round down...
   ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
     { eeprom_smart_update_byte((uint8_t*)(EE_START_SIMPLE_SCHEDULE0_ON + which), startMM); }
+  scheduleOnCacheLoaded = false; // Reload from EEPROM on next use.
   return(true); // Assume EEPROM programmed OK...
   }
 
@@ -141,6 +191,7 @@ void clearSimpleSchedule(const uint8_t which)
   // Clear the schedule back to 'unprogrammed' values, minimising wear.
   ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
     { eeprom_smart_erase_byte((uint8_t*)(EE_START_SIMPLE_SCHEDULE0_ON + which)); }
+  scheduleOnCacheLoaded = false; // Reload from EEPROM on next use.
   }
 
 // Returns true if any simple schedule is set, false otherwise.
@@ -158,13 +209,10 @@ bool isAnySimpleScheduleSet()
     }
 #endif
 
-  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+  for(uint8_t which = 0; which < MAX_SIMPLE_SCHEDULES; ++which)
     {
-    for(uint8_t which = 0; which < MAX_SIMPLE_SCHEDULES; ++which)
-      {
-      if(eeprom_read_byte((uint8_t*)(EE_START_SIMPLE_SCHEDULE0_ON + which)) <= MAX_COMPRESSED_MINS_AFTER_MIDNIGHT)
-        { return(true); }
-      }
+    if(getEncodedScheduleOn(which) <= MAX_COMPRESSED_MINS_AFTER_MIDNIGHT)
+      { return(true); }
     }
   return(false);
   }
@@ -202,35 +250,49 @@ bool isAnyScheduleOnWARMNow()
   }
 
 
-// True iff any schedule is due 'on'/'WARM' soon even when schedules overlap.
+// Get the minutes until the earliest WARM start of any schedule due 'on'/'WARM' soon, 0 if such a schedule has already started,
+// else ~0 if none is due soon.
 // May be relatively slow/expensive.
-// Can be used to allow room to be brought up to at least a set-back temperature
-// if very cold when a WARM period is due soon (to help ensure that WARM target is met on time).
-// In unit-test override mode is true for soon, false for now/off.
-bool isAnyScheduleOnWARMSoon()
+// In unit-test override mode is 0 for soon, ~0 for now/off.
+uint_least16_t getMinsUntilScheduleOnWARMSoon()
   {
 #if defined(UNIT_TESTS)
   // Special behaviour for unit tests.
   switch(_soUT_override)
     {
-    case _soUT_off: return(false);
-    case _soUT_soon: return(true);
-    case _soUT_now: return(false);
+    case _soUT_off: return(~0);
+    case _soUT_soon: return(0);
+    case _soUT_now: return(~0);
     }
 #endif
 
-  const uint_least16_t mm0 = getMinutesSinceMidnightLT() + PREPREWARM_MINS; // Look forward...
+  const uint_least16_t now = getMinutesSinceMidnightLT();
+  const uint_least16_t lookM = getPrePreWarmMins();
+  const uint_least16_t mm0 = now + lookM; // Look forward...
   const uint_least16_t mm = (mm0 >= MINS_PER_DAY) ? (mm0 - MINS_PER_DAY) : mm0;
 
+  uint_least16_t result = ~0;
   for(uint8_t which = 0; which < MAX_SIMPLE_SCHEDULES; ++which)
     {
     const uint_least16_t s = getSimpleScheduleOn(which);
-    if(mm < s) { continue; } // Also deals with case where this schedule is not set at all (s == ~0);
+    if(s == (uint_least16_t)~0) { continue; } // This schedule is not set at all.
+    // Also cover the whole run-up to the start in case a learned look-ahead is longer than the WARM period itself.
+    const uint_least16_t untilM = (s >= now) ? (s - now) : (s + MINS_PER_DAY - now);
+    if((0 != untilM) && (untilM <= lookM)) { result = fnmin(result, untilM); continue; }
+    if(mm < s) { continue; }
     uint_least16_t e = getSimpleScheduleOff(which);
     if(e < s) { e += MINS_PER_DAY; } // Cope with schedule wrap around midnight.
-    if(mm < e) { return(true); }
+    if(mm < e) { return(0); } // Started already.
     }
 
-  return(false);
+  return(result);
   }
 
+// True iff any schedule is due 'on'/'WARM' soon even when schedules overlap.
+// May be relatively slow/expensive.
+// Can be used to allow room to be brought up to at least a set-back temperature
+// if very cold when a WARM period is due soon (to help ensure that WARM target is met on time).
+// In unit-test override mode is true for soon, false for now/off.
+bool isAnyScheduleOnWARMSoon()
+  { return((uint_least16_t)~0 != getMinsUntilScheduleOnWARMSoon()); }
+
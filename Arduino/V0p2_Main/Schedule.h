@@ -69,12 +69,22 @@ bool isAnyScheduleOnWARMNow();
 // if very cold when a WARM period is due soon (to help ensure that WARM target is met on time).
 bool isAnyScheduleOnWARMSoon();
 
+// Get the minutes until the earliest WARM start of any schedule due 'on'/'WARM' soon (as for isAnyScheduleOnWARMSoon()),
+// 0 if such a schedule has already started, else ~0 if none is due soon.
+// Can be used to look up what usually happens at the hour that the WARM period actually starts.
+uint_least16_t getMinsUntilScheduleOnWARMSoon();
+
 // True iff any schedule is currently 'on'/'WARM' even when schedules overlap.
 // May be relatively slow/expensive.
 // Can be used to suppress all 'off' activity except for the final one.
 // Can be used to suppress set-backs during on times.
 bool isAnySimpleScheduleSet();
 
+// Set the pre-warm stagger slot [0,7] suggested by the hub in stats ACKs, taken modulo 8.
+// Each slot starts the setback period before a WARM period a few minutes earlier
+// so that valves sharing a boiler open in turn rather than all together; 0 (the default) for no stagger.
+void setPreWarmStaggerSlot(uint8_t slot);
+
 
 #if defined(UNIT_TESTS)
 // Support for unit tests to force particular apparent schedule state (without EEPROM writes).
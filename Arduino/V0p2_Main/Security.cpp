@@ -36,6 +36,44 @@ stats_TX_level getStatsTXLevel() { return((stats_TX_level)eeprom_read_byte((uint
 
 
 
+#if defined(ALLOW_SECURE_STATS)
+// Copies the primary building (shared) AES-128 key from EEPROM into key, which must have EE_LEN_PRIMARY_BUILDING_KEY bytes.
+// Returns false (and key is zeroed) if no key has been set (unprogrammed EEPROM, all 0xff).
+bool getPrimaryBuildingKey(uint8_t *const key)
+  {
+  uint8_t allSet = 0xff;
+  for(uint8_t i = 0; i < EE_LEN_PRIMARY_BUILDING_KEY; ++i)
+    { allSet &= (key[i] = eeprom_read_byte((uint8_t *)(EE_START_PRIMARY_BUILDING_KEY + i))); }
+  if(0xff != allSet) { return(true); }
+  memset(key, 0, EE_LEN_PRIMARY_BUILDING_KEY);
+  return(false);
+  }
+
+// Current epoch (top 16 bits of the counter) and count within it; epoch is only valid once secureTXEpochValid.
+static bool secureTXEpochValid;
+static uint16_t secureTXEpoch;
+static uint16_t secureTXCount;
+
+// Returns a 32-bit message counter never returned before for this node (while its EEPROM survives).
+uint32_t getNextSecureTXMessageCounter()
+  {
+  if(!secureTXEpochValid || (0 == secureTXCount))
+    {
+    // Bump and persist the epoch before any counter in it is used.
+    const uint16_t e = 1 + (((uint16_t)eeprom_read_byte((uint8_t *)EE_START_SECURE_TX_EPOCH) << 8) |
+                            eeprom_read_byte((uint8_t *)(EE_START_SECURE_TX_EPOCH + 1)));
+    eeprom_smart_update_byte((uint8_t *)EE_START_SECURE_TX_EPOCH, (uint8_t)(e >> 8));
+    eeprom_smart_update_byte((uint8_t *)(EE_START_SECURE_TX_EPOCH + 1), (uint8_t)e);
+    secureTXEpoch = e;
+    secureTXEpochValid = true;
+    }
+  const uint32_t result = ((uint32_t)secureTXEpoch << 16) | secureTXCount;
+  ++secureTXCount; // Wraps to 0 to force a new epoch.
+  return(result);
+  }
+#endif
+
+
 // Counter to help whiten getSecureRandomByte() output.
 static uint8_t count8;
 
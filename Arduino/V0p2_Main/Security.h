@@ -61,6 +61,21 @@ uint8_t getSecureRandomByte(bool whiten = true);
 void addEntropyToPool(uint8_t data, uint8_t estBits);
 
 
+#if defined(ALLOW_SECURE_STATS)
+// Copies the primary building (shared) AES-128 key from EEPROM into key, which must have EE_LEN_PRIMARY_BUILDING_KEY bytes.
+// Returns false (and key is zeroed) if no key has been set (unprogrammed EEPROM, all 0xff).
+// Not thread-/ISR- safe.
+bool getPrimaryBuildingKey(uint8_t *key);
+
+// Returns a 32-bit message counter never returned before for this node (while its EEPROM survives),
+// for use in the nonce of a secure frame.
+// The top 16 bits are a persistent epoch bumped in EEPROM on first use after each restart and when the bottom 16 bits wrap;
+// the key should be replaced before the epoch itself wraps (after 65536 restarts).
+// Not thread-/ISR- safe.
+uint32_t getNextSecureTXMessageCounter();
+#endif
+
+
 
 #if 0 // Pairing API outline.
 struct pairInfo { bool successfullyPaired; };
@@ -130,6 +130,55 @@ void serialPrintlnAndFlush()
   }
 
 
+// Start of an async print: power up the UART if need be, and if so arrange to power it down again once drained.
+static void _asyncPowerUp()
+  {
+  if(powerUpSerialIfDisabled()) { powerDownSerialWhenDrained(); }
+  }
+
+// Write a single (Flash-resident) string to serial followed by line-end without waiting for transmission.
+void serialPrintlnAsync(__FlashStringHelper const * const line)
+  {
+  _asyncPowerUp();
+  Serial.println(line);
+  }
+
+// Write a single (Flash-resident) string to serial without waiting for transmission.
+void serialPrintAsync(__FlashStringHelper const * const text)
+  {
+  _asyncPowerUp();
+  Serial.print(text);
+  }
+
+// Write a single string to serial without waiting for transmission.
+void serialPrintAsync(const char * const text)
+  {
+  _asyncPowerUp();
+  Serial.print(text);
+  }
+
+// Write a single character to serial without waiting for transmission.
+void serialPrintAsync(const char c)
+  {
+  _asyncPowerUp();
+  Serial.print(c);
+  }
+
+// Write a single number to serial without waiting for transmission.
+void serialPrintAsync(const int i, const int fmt)
+  {
+  _asyncPowerUp();
+  Serial.print(i, fmt);
+  }
+
+// Write line-end to serial without waiting for transmission.
+void serialPrintlnAsync()
+  {
+  _asyncPowerUp();
+  Serial.println();
+  }
+
+
 
 
 
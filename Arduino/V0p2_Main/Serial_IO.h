@@ -72,6 +72,32 @@ void serialPrintAndFlush(unsigned long u, int fmt = DEC);
 void serialPrintlnAndFlush();
 
 
+// Non-blocking variants of the above that queue output for interrupt-driven TX and return without waiting for it to drain.
+// These enable the serial if required and, if it wasn't enabled, power it down once all output has drained.
+// Only wait (idling) if the HardwareSerial TX ring buffer is full, so keep bursts short (eg under 64 chars)
+// to avoid stalling the caller.
+// Use flushSerialBounded() where output must be complete by some point in the cycle.
+// Sleeping via nap()/sleepUntilInt() while output drains is safe as these idle rather than stop the UART.
+
+// Write a single (Flash-resident) string to serial followed by line-end without waiting for transmission.
+void serialPrintlnAsync(__FlashStringHelper const *line);
+
+// Write a single (Flash-resident) string to serial without waiting for transmission.
+void serialPrintAsync(__FlashStringHelper const *text);
+
+// Write a single string to serial without waiting for transmission.
+void serialPrintAsync(char const *text);
+
+// Write a single character to serial without waiting for transmission.
+void serialPrintAsync(char c);
+
+// Write a single number to serial without waiting for transmission.
+void serialPrintAsync(int i, int fmt = DEC);
+
+// Write line-end to serial without waiting for transmission.
+void serialPrintlnAsync();
+
+
 
 #ifndef DEBUG
 #define DEBUG_SERIAL_PRINT(s) // Do nothing.
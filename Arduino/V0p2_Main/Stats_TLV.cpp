@@ -0,0 +1,305 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): agent 2026
+*/
+
+/*
+ Compact binary TLV stats frame encoding and decoding.
+
+ Portable: builds for AVR (keys kept in Flash) and for a host.
+ */
+
+#include <string.h>
+
+#include "Stats_TLV.h"
+
+#if defined(ARDUINO)
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define strcmp_P(s1, s2) strcmp((s1), (s2))
+#define strlen_P(s) strlen(s)
+#define memcpy_P(d, s, n) memcpy((d), (s), (n))
+#define pgm_read_word(p) (*(p))
+#endif
+
+
+// Well-known stats keys by TLV ID; order is part of the wire format so only append.
+static const char key0[] PROGMEM = "T|C16";
+static const char key1[] PROGMEM = "H|%";
+static const char key2[] PROGMEM = "O";
+static const char key3[] PROGMEM = "vac|h";
+static const char key4[] PROGMEM = "B|mV";
+static const char key5[] PROGMEM = "v|%";
+static const char key6[] PROGMEM = "tT|C";
+static const char key7[] PROGMEM = "vC|%";
+static const char key8[] PROGMEM = "L";
+static const char key9[] PROGMEM = "occ|%";
+static const char key10[] PROGMEM = "vB|%";
+static const char * const keys[STATS_TLV_KEY_COUNT] PROGMEM =
+  { key0, key1, key2, key3, key4, key5, key6, key7, key8, key9, key10 };
+
+// Returns the TLV ID [0,STATS_TLV_KEY_COUNT-1] for a well-known stats key, or -1 if it has none.
+int8_t statsTLVKeyID(const char *const key)
+  {
+  if(NULL == key) { return(-1); }
+  for(uint8_t i = 0; i < STATS_TLV_KEY_COUNT; ++i)
+    { if(0 == strcmp_P(key, (const char *)pgm_read_word(keys + i))) { return(i); } }
+  return(-1);
+  }
+
+// Copies the text of the key with the given ID (and a trailing '\0') into buf of at least bufSize bytes.
+// Returns the key length, or 0 if the ID is unknown or the key does not fit.
+uint8_t statsTLVKeyText(const uint8_t id, char *const buf, const uint8_t bufSize)
+  {
+  if(id >= STATS_TLV_KEY_COUNT) { return(0); }
+  const char *const k = (const char *)pgm_read_word(keys + id);
+  const uint8_t l = strlen_P(k);
+  if(l >= bufSize) { return(0); }
+  memcpy_P(buf, k, l + 1);
+  return(l);
+  }
+
+// 7-bit CRC, polynomial 0x5B (Koopman) aka 0x37 (normal); result always has top bit zero.
+// Bitwise so as to be portable and tiny; frames are short.
+static uint8_t crc7_5B(uint8_t crc, const uint8_t datum)
+  {
+  for(uint8_t m = 0x80; 0 != m; m >>= 1)
+    {
+    const bool fb = (0 != (crc & 0x40)) != (0 != (datum & m));
+    crc = (crc << 1) & 0x7f;
+    if(fb) { crc ^= 0x37; }
+    }
+  return(crc);
+  }
+
+// Zig-zag encode so that small magnitude values of either sign become small unsigned values.
+static inline uint16_t zigzag(const int16_t v) { return((uint16_t)(((uint16_t)v << 1) ^ (uint16_t)(v >> 15))); }
+static inline int16_t unzigzag(const uint16_t u) { return((int16_t)((u >> 1) ^ (uint16_t)(-(int16_t)(u & 1)))); }
+
+// Number of 7-bit value bytes needed for zig-zag value u: 0--3.
+static inline uint8_t valueBytes(const uint16_t u) { return((0 == u) ? 0 : ((u < 0x80) ? 1 : ((u < 0x4000) ? 2 : 3))); }
+
+// Number of bytes needed for a record carrying the given value or delta (1--4).
+uint8_t statsTLVRecordSize(const int16_t v) { return(1 + valueBytes(zigzag(v))); }
+
+// Write frame header and ID into buf; the frame does not ask for an ACK unless ackWanted is true.
+// Returns bytes written, or 0 if the buffer is too small or an ID byte is 0xff.
+uint8_t statsTLVStartFrame(uint8_t *const buf, const uint8_t bufSize, const uint8_t seq, const uint8_t id0, const uint8_t id1, const bool ackWanted)
+  {
+  if(bufSize < STATS_TLV_MIN_BYTES) { return(0); }
+  if((0xff == id0) || (0xff == id1)) { return(0); }
+  buf[0] = STATS_TLV_HEADER_MSBS | (ackWanted ? 0 : STATS_TLV_HEADER_NOACK) | (seq & 0xf);
+  buf[1] = id0;
+  buf[2] = id1;
+  return(3);
+  }
+
+// Append one record for the given key ID and absolute value or delta to buf with space bytes free.
+// Returns bytes written, or 0 if there is not space or the ID is invalid.
+uint8_t statsTLVPutRecord(uint8_t *const buf, const uint8_t space, const uint8_t keyID, const bool isDelta, const int16_t v)
+  {
+  if(keyID >= STATS_TLV_KEY_COUNT) { return(0); }
+  const uint16_t u = zigzag(v);
+  const uint8_t n = valueBytes(u);
+  if(space < 1 + n) { return(0); }
+  buf[0] = STATS_TLV_TAG_BIT | (isDelta ? STATS_TLV_TAG_DELTA : 0) | (n << 4) | keyID;
+  for(uint8_t i = n; i > 0; --i)
+    { buf[1 + n - i] = (uint8_t)((u >> (7 * (i-1))) & 0x7f) ^ STATS_TLV_WHITEN; }
+  return(1 + n);
+  }
+
+// Append the CRC to the len-byte frame at buf of capacity bufSize.
+// Returns the total frame length, or 0 if there is not space.
+uint8_t statsTLVFinishFrame(uint8_t *const buf, const uint8_t len, const uint8_t bufSize)
+  {
+  if(len >= bufSize) { return(0); }
+  uint8_t crc = STATS_TLV_CRC_INIT;
+  for(uint8_t i = 0; i < len; ++i) { crc = crc7_5B(crc, buf[i]); }
+  buf[len] = crc;
+  return(len + 1);
+  }
+
+// Check the structure and CRC of a putative frame of at most buflen bytes.
+// Returns the frame length including CRC, or 0 if not a valid frame.
+uint8_t statsTLVCheckFrame(const uint8_t *const buf, const uint8_t buflen)
+  {
+  if((NULL == buf) || (buflen < STATS_TLV_MIN_BYTES)) { return(0); }
+  if(STATS_TLV_HEADER_MSBS != (buf[0] & STATS_TLV_HEADER_MASK)) { return(0); }
+  uint8_t crc = STATS_TLV_CRC_INIT;
+  crc = crc7_5B(crc, buf[0]);
+  crc = crc7_5B(crc, buf[1]);
+  crc = crc7_5B(crc, buf[2]);
+  uint8_t pos = 3;
+  // Walk the records until the CRC (first byte at a record boundary without the tag bit).
+  while(pos < buflen)
+    {
+    const uint8_t b = buf[pos];
+    if(0 == (b & STATS_TLV_TAG_BIT)) { return((b == crc) ? (pos + 1) : 0); }
+    if((0xff == b) || ((b & 0xf) >= STATS_TLV_KEY_COUNT)) { return(0); } // Terminator or unknown key.
+    const uint8_t n = (b >> 4) & 3;
+    if(pos + 1 + n >= buflen) { return(0); } // Truncated.
+    crc = crc7_5B(crc, b);
+    for(uint8_t i = 1; i <= n; ++i)
+      {
+      const uint8_t v = buf[pos + i];
+      if(0 != (v & 0x80)) { return(0); }
+      crc = crc7_5B(crc, v);
+      }
+    pos += 1 + n;
+    }
+  return(0); // No CRC found.
+  }
+
+// Apply a frame already checked by statsTLVCheckFrame() to the sender's state.
+// Returns false if the frame is a repeat of the last (or otherwise unusable) and should be ignored.
+// On success marks the keys whose values were received as fresh.
+bool statsTLVApplyFrame(const uint8_t *const buf, const uint8_t len, StatsTLVRXState_t *const state)
+  {
+  if(len < STATS_TLV_MIN_BYTES) { return(false); }
+  const uint8_t seq = buf[0] & 0xf;
+  if(state->hasSeq)
+    {
+    if((state->id0 != buf[1]) || (state->id1 != buf[2])) { return(false); } // Wrong sender.
+    if(seq == state->lastSeq) { return(false); } // Repeat.
+    // A missed frame may have moved the sender's baseline for any key, so forget everything.
+    if(seq != ((state->lastSeq + 1) & 0xf)) { state->valid = 0; }
+    }
+  else
+    {
+    state->id0 = buf[1];
+    state->id1 = buf[2];
+    state->valid = 0;
+    state->hasSeq = true;
+    }
+  state->lastSeq = seq;
+  // Walk the records (structure already checked) up to the CRC.
+  for(uint8_t pos = 3; pos < len - 1; )
+    {
+    const uint8_t tag = buf[pos];
+    const uint8_t n = (tag >> 4) & 3;
+    const uint8_t k = tag & 0xf;
+    uint16_t u = 0;
+    for(uint8_t i = 1; i <= n; ++i) { u = (u << 7) | (0x7f & (buf[pos + i] ^ STATS_TLV_WHITEN)); }
+    pos += 1 + n;
+    const int16_t v = unzigzag(u);
+    const uint16_t bit = ((uint16_t)1) << k;
+    if(0 != (tag & STATS_TLV_TAG_DELTA))
+      {
+      // Delta needs a known baseline; else the key stays unknown until the next absolute value.
+      if(0 == (state->valid & bit)) { continue; }
+      state->values[k] = (int16_t)((uint16_t)state->values[k] + (uint16_t)v);
+      }
+    else
+      {
+      state->values[k] = v;
+      state->valid |= bit;
+      }
+    state->fresh |= bit;
+    }
+  return(true);
+  }
+
+// Extract ASCII hex digit in range [0-9][a-f] from bottom 4 bits of argument.
+static inline char hexDigit4(const uint8_t value) { const uint8_t v = 0xf&value; return((v < 10) ? ('0'+v) : ('a'+(v-10))); }
+
+// Format v in decimal into buf (at least 7 bytes); returns the length (no trailing '\0' written).
+static uint8_t formatInt(const int16_t v, char *const buf)
+  {
+  char tmp[6];
+  uint8_t n = 0;
+  uint16_t u = (v < 0) ? (uint16_t)(-(int32_t)v) : (uint16_t)v;
+  do { tmp[n++] = '0' + (u % 10); u /= 10; } while(0 != u);
+  uint8_t l = 0;
+  if(v < 0) { buf[l++] = '-'; }
+  while(n > 0) { buf[l++] = tmp[--n]; }
+  return(l);
+  }
+
+// Write fresh values from state as a JSON object in the same form as a SimpleStatsRotation JSON frame,
+// clearing the fresh flag of each value written.
+// Returns the JSON length (excluding '\0'), or 0 if the buffer cannot hold even the "@" field.
+uint8_t statsTLVWriteJSON(StatsTLVRXState_t *const state, char *const json, const uint8_t jsonSize)
+  {
+  // {"@":"hhhh"} plus '\0'.
+  if(jsonSize < 13) { return(0); }
+  uint8_t l = 0;
+  memcpy(json, "{\"@\":\"", 6); l = 6;
+  json[l++] = hexDigit4(state->id0 >> 4);
+  json[l++] = hexDigit4(state->id0);
+  json[l++] = hexDigit4(state->id1 >> 4);
+  json[l++] = hexDigit4(state->id1);
+  json[l++] = '"';
+  // Only ever report known values.
+  state->fresh &= state->valid;
+  for(uint8_t k = 0; k < STATS_TLV_KEY_COUNT; ++k)
+    {
+    const uint16_t bit = ((uint16_t)1) << k;
+    if(0 == (state->fresh & bit)) { continue; }
+    // Format field ,"key":value then append it if it fits with the closing "}\0".
+    char field[16];
+    uint8_t f = 0;
+    field[f++] = ',';
+    field[f++] = '"';
+    const uint8_t kl = statsTLVKeyText(k, field + f, sizeof(field) - f);
+    f += kl;
+    field[f++] = '"';
+    field[f++] = ':';
+    f += formatInt(state->values[k], field + f);
+    if(l + f + 2 > jsonSize)
+      {
+      // Leave for next call, unless it would not fit even alone (so could never be written).
+      if(11 == l) { state->fresh &= ~bit; }
+      continue;
+      }
+    memcpy(json + l, field, f);
+    l += f;
+    state->fresh &= ~bit;
+    }
+  json[l++] = '}';
+  json[l] = '\0';
+  return(l);
+  }
+
+// Write an ACK for the frame with the given sequence number and sender ID into buf.
+// The pre-warm stagger slot is taken modulo 8; 0 (the default) asks for no stagger.
+// Returns STATS_TLV_ACK_BYTES, or 0 if the buffer is too small or an ID byte is 0xff.
+uint8_t statsTLVWriteAck(uint8_t *const buf, const uint8_t bufSize, const uint8_t seq, const uint8_t id0, const uint8_t id1, const bool linkHasMargin, const uint8_t staggerSlot)
+  {
+  if(bufSize < STATS_TLV_ACK_BYTES) { return(0); }
+  if((0xff == id0) || (0xff == id1)) { return(0); }
+  buf[0] = STATS_TLV_ACK_HEADER_MSBS | (seq & 0xf);
+  buf[1] = id0;
+  buf[2] = id1;
+  buf[3] = (linkHasMargin ? STATS_TLV_ACK_FLAG_MARGIN : 0) |
+           ((staggerSlot << STATS_TLV_ACK_STAGGER_SHIFT) & STATS_TLV_ACK_STAGGER_MASK);
+  uint8_t crc = STATS_TLV_CRC_INIT;
+  for(uint8_t i = 0; i < STATS_TLV_ACK_BYTES - 1; ++i) { crc = crc7_5B(crc, buf[i]); }
+  buf[STATS_TLV_ACK_BYTES - 1] = crc;
+  return(STATS_TLV_ACK_BYTES);
+  }
+
+// Check the structure and CRC of a putative ACK of at most buflen bytes.
+// Returns STATS_TLV_ACK_BYTES, or 0 if not a valid ACK.
+uint8_t statsTLVCheckAck(const uint8_t *const buf, const uint8_t buflen)
+  {
+  if((NULL == buf) || (buflen < STATS_TLV_ACK_BYTES)) { return(0); }
+  if(STATS_TLV_ACK_HEADER_MSBS != (buf[0] & STATS_TLV_ACK_HEADER_MASK)) { return(0); }
+  if(0 != (buf[3] & ~(STATS_TLV_ACK_FLAG_MARGIN | STATS_TLV_ACK_STAGGER_MASK))) { return(0); }
+  uint8_t crc = STATS_TLV_CRC_INIT;
+  for(uint8_t i = 0; i < STATS_TLV_ACK_BYTES - 1; ++i) { crc = crc7_5B(crc, buf[i]); }
+  return((crc == buf[STATS_TLV_ACK_BYTES - 1]) ? STATS_TLV_ACK_BYTES : 0);
+  }
@@ -0,0 +1,170 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): agent 2026
+*/
+
+/*
+ Compact binary TLV stats frame, as a low-bandwidth alternative to JSON stats.
+
+ Deliberately free of Arduino/V0p2 dependencies (only <stdint.h> and <string.h>)
+ so that the same encoder/decoder can be built into host-side tools,
+ eg to turn captured frames back into the JSON that the hub would emit (see host/StatsTLVDecode.cpp).
+ */
+
+#ifndef STATS_TLV_H
+#define STATS_TLV_H
+
+#include <stdint.h>
+
+
+// Compact binary (TLV) stats frame
+// ================================
+// Carries the same values as a SimpleStatsRotation JSON frame in typically 2--4x fewer bytes,
+// using small numeric IDs for the well-known stats keys,
+// and sending values as zig-zag-encoded deltas against the value last sent for the same key where that is shorter.
+// The frame never contains 0xff (would be taken to be a message terminator; one can be appended),
+// and value bytes are whitened to avoid runs of zeros.
+// Leading nybble 0x2 or 0x3 distinguishes it from JSON ('{'), full/minimal stats (0x40--0x7f) and FHT8V (0xcc/0xaa) frames.
+//
+//           BIT  7     6     5     4     3     2     1     0
+// * byte 0 :  |  0  |  0  |  1  | /A  |  S3 |  S2 |  S1 |  S0 |   header, ACK not wanted, 4-bit frame sequence number
+// * byte 1 :  |              ID0 (never 0xff)                 |   first ID byte, as shown in JSON "@" field
+// * byte 2 :  |              ID1 (never 0xff)                 |   second ID byte
+// Zero or more records, each a tag byte followed by N value bytes:
+// * tag    :  |  1  |  D  |  N1 |  N0 |  K3 |  K2 |  K1 |  K0 |   Delta flag, N value bytes [0,3], Key ID [0,14]
+// * value  :  |  0  |  7 bits of zig-zag value/delta, msbits first, XORed with STATS_TLV_WHITEN  |
+// N == 0 means a value (or delta) of zero.
+// A delta (D == 1) is relative to the previous value sent for that key,
+// and can only be applied by a receiver that saw the previous frame (sequence number one less) from this sender;
+// otherwise it must treat that key as unknown until its next absolute (D == 0) record.
+// The sender sends each key absolute at least every STATS_TLV_ABS_INTERVAL frames to bound recovery time.
+// Identical repeats (eg from double TX) have the same sequence number and should be ignored.
+// A sender wanting to know that an important frame arrived clears /A and listens briefly after TX for an ACK (see below);
+// /A is set in routine frames (and in all frames from senders predating ACKs).
+// * last   :  |  0  |  C6 |  C5 |  C4 |  C3 |  C2 |  C1 |  C0 |   7-bit CRC (poly 0x5B Koopman) over all preceding bytes
+// Since tag bytes have their msbit set and the CRC does not, the frame is self-delimiting.
+#define STATS_TLV_HEADER_MSBS 0x20
+#define STATS_TLV_HEADER_MASK 0xe0
+#define STATS_TLV_HEADER_NOACK 0x10
+#define STATS_TLV_TAG_BIT 0x80
+#define STATS_TLV_TAG_DELTA 0x40
+#define STATS_TLV_WHITEN 0x2a
+#define STATS_TLV_CRC_INIT 0x7f
+// Maximum number of frames between absolute values for each key.
+#define STATS_TLV_ABS_INTERVAL 8
+// Minimum frame size: header, two ID bytes and CRC.
+#define STATS_TLV_MIN_BYTES 4
+// Maximum bytes for one record.
+#define STATS_TLV_MAX_RECORD_BYTES 4
+
+// Number of well-known keys with TLV IDs; at most 15 (ID 15 is reserved so that no tag can be 0xff).
+#define STATS_TLV_KEY_COUNT 11
+
+// Returns the TLV ID [0,STATS_TLV_KEY_COUNT-1] for a well-known stats key, or -1 if it has none.
+int8_t statsTLVKeyID(const char *key);
+
+// Copies the text of the key with the given ID (and a trailing '\0') into buf of at least bufSize bytes.
+// Returns the key length, or 0 if the ID is unknown or the key does not fit.
+uint8_t statsTLVKeyText(uint8_t id, char *buf, uint8_t bufSize);
+
+// Number of bytes needed for a record carrying the given value or delta (1--4).
+uint8_t statsTLVRecordSize(int16_t v);
+
+// Write frame header and ID into buf; the frame does not ask for an ACK unless ackWanted is true.
+// Returns bytes written, or 0 if the buffer is too small or an ID byte is 0xff.
+uint8_t statsTLVStartFrame(uint8_t *buf, uint8_t bufSize, uint8_t seq, uint8_t id0, uint8_t id1, bool ackWanted = false);
+
+// Append one record for the given key ID and absolute value or delta to buf with space bytes free.
+// Returns bytes written, or 0 if there is not space or the ID is invalid.
+uint8_t statsTLVPutRecord(uint8_t *buf, uint8_t space, uint8_t keyID, bool isDelta, int16_t v);
+
+// Append the CRC to the len-byte frame at buf of capacity bufSize.
+// Returns the total frame length, or 0 if there is not space.
+uint8_t statsTLVFinishFrame(uint8_t *buf, uint8_t len, uint8_t bufSize);
+
+// Check the structure and CRC of a putative frame of at most buflen bytes.
+// Returns the frame length including CRC, or 0 if not a valid frame.
+uint8_t statsTLVCheckFrame(const uint8_t *buf, uint8_t buflen);
+
+// Receiver state for one sender, needed to apply deltas.
+// Initialise (eg with memset to zero) then set hasSeq false for a new sender.
+typedef struct StatsTLVRXState
+  {
+  uint8_t id0, id1; // Sender ID.
+  bool hasSeq; // True once a frame has been seen, making lastSeq meaningful.
+  uint8_t lastSeq; // Sequence number of last frame seen.
+  uint16_t valid; // Bit set for each key whose value is known.
+  uint16_t fresh; // Bit set for each key updated by the last frame and not yet written as JSON.
+  int16_t values[STATS_TLV_KEY_COUNT]; // Last value for each key.
+  } StatsTLVRXState_t;
+
+// Apply a frame already checked by statsTLVCheckFrame() to the sender's state.
+// The state must be for the sender in the frame (see statsTLVFrameID0/1()) or freshly initialised.
+// Returns false if the frame is a repeat of the last (or otherwise unusable) and should be ignored.
+// On success marks the keys whose values were received as fresh.
+bool statsTLVApplyFrame(const uint8_t *buf, uint8_t len, StatsTLVRXState_t *state);
+
+// Sender ID bytes from a checked frame (or ACK).
+static inline uint8_t statsTLVFrameID0(const uint8_t *buf) { return(buf[1]); }
+static inline uint8_t statsTLVFrameID1(const uint8_t *buf) { return(buf[2]); }
+// Sequence number from a checked frame (or ACK).
+static inline uint8_t statsTLVFrameSeq(const uint8_t *buf) { return(buf[0] & 0xf); }
+// True if a checked frame asks for an ACK.
+static inline bool statsTLVFrameWantsAck(const uint8_t *buf) { return(0 == (buf[0] & STATS_TLV_HEADER_NOACK)); }
+
+// Write fresh values from state as a JSON object in the same form as a SimpleStatsRotation JSON frame,
+// eg {"@":"c2e0","T|C16":311,"H|%":81}, with a trailing '\0', clearing the fresh flag of each value written.
+// Writes as many values as fit in jsonSize bytes (including the '\0'),
+// so call again while state->fresh is non-zero to get the rest.
+// Returns the JSON length (excluding '\0'), or 0 if the buffer cannot hold even the "@" field.
+uint8_t statsTLVWriteJSON(StatsTLVRXState_t *state, char *json, uint8_t jsonSize);
+
+
+// ACK for a TLV frame that asked for one
+// =======================================
+// Sent by the hub straight after receiving the frame (including a repeat, since an earlier ACK may have been lost).
+// Leading nybble 0x1 distinguishes it from all the frame types above.
+//
+//           BIT  7     6     5     4     3     2     1     0
+// * byte 0 :  |  0  |  0  |  0  |  1  |  S3 |  S2 |  S1 |  S0 |   header, sequence number of the frame acknowledged
+// * byte 1 :  |              ID0 (never 0xff)                 |   first ID byte of the frame acknowledged
+// * byte 2 :  |              ID1 (never 0xff)                 |   second ID byte
+// * byte 3 :  |  0  |  0  |  0  |  0  | G2  | G1  | G0  |  M  |   flags: M set if the hub sees link margin to spare
+//                                                                     G: pre-warm stagger slot [0,7] for the sender
+// * byte 4 :  |  0  |  C6 |  C5 |  C4 |  C3 |  C2 |  C1 |  C0 |   7-bit CRC (poly 0x5B Koopman) over all preceding bytes
+#define STATS_TLV_ACK_HEADER_MSBS 0x10
+#define STATS_TLV_ACK_HEADER_MASK 0xf0
+#define STATS_TLV_ACK_FLAG_MARGIN 1
+#define STATS_TLV_ACK_STAGGER_SHIFT 1
+#define STATS_TLV_ACK_STAGGER_MASK 0xe
+#define STATS_TLV_ACK_BYTES 5
+
+// Write an ACK for the frame with the given sequence number and sender ID into buf.
+// The pre-warm stagger slot is taken modulo 8; 0 (the default) asks for no stagger.
+// Returns STATS_TLV_ACK_BYTES, or 0 if the buffer is too small or an ID byte is 0xff.
+uint8_t statsTLVWriteAck(uint8_t *buf, uint8_t bufSize, uint8_t seq, uint8_t id0, uint8_t id1, bool linkHasMargin, uint8_t staggerSlot = 0);
+
+// Check the structure and CRC of a putative ACK of at most buflen bytes.
+// Returns STATS_TLV_ACK_BYTES, or 0 if not a valid ACK.
+uint8_t statsTLVCheckAck(const uint8_t *buf, uint8_t buflen);
+
+// True if a checked ACK reports link margin to spare.
+static inline bool statsTLVAckHasMargin(const uint8_t *buf) { return(0 != (buf[3] & STATS_TLV_ACK_FLAG_MARGIN)); }
+
+// Pre-warm stagger slot [0,7] from a checked ACK; 0 from hubs that do not stagger.
+static inline uint8_t statsTLVAckStaggerSlot(const uint8_t *buf) { return((buf[3] & STATS_TLV_ACK_STAGGER_MASK) >> STATS_TLV_ACK_STAGGER_SHIFT); }
+
+#endif
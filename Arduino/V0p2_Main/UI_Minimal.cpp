@@ -558,10 +558,9 @@ void serialStatusReport()
   // Terminate line.
   Serial.println();
 
-  // Ensure that all text is sent before this routine returns, in case any sleep/powerdown follows that kills the UART.
-  flushSerialSCTSensitive();
-
-  if(neededWaking) { powerDownSerial(); }
+  // Let the tail of the line drain under interrupts while other work proceeds;
+  // sleeping safely idles until the UART is done, and it is powered down when drained if it was off before.
+  if(neededWaking) { powerDownSerialWhenDrained(); }
   }
 
 #define SYNTAX_COL_WIDTH 10 // Width of 'syntax' column; strictly positive.
@@ -842,9 +841,6 @@ void pollCLI(const uint8_t maxSCT)
             case EE_STATS_SET_OCCPC_BY_HOUR: case EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED: { Serial.print(F("occ%")); break; }
             case EE_STATS_SET_RHPC_BY_HOUR: case EE_STATS_SET_RHPC_BY_HOUR_SMOOTHED: { Serial.print(F("RH%")); break; }
             case EE_STATS_SET_USER1_BY_HOUR: case EE_STATS_SET_USER1_BY_HOUR_SMOOTHED: { Serial.print('u'); break; }
-#if defined(EE_STATS_SET_WARMMODE_BY_HOUR_OF_WK)
-            case EE_STATS_SET_WARMMODE_BY_HOUR_OF_WK: { Serial.print('W'); break; }
-#endif
             }
           Serial_print_space();
           if(setN & 1) { Serial.print(F("smoothed")); } else { Serial.print(F("last")); }
@@ -864,11 +860,6 @@ void pollCLI(const uint8_t maxSCT)
               case EE_STATS_SET_TEMP_BY_HOUR: case EE_STATS_SET_TEMP_BY_HOUR_SMOOTHED:
                 // Uncompanded temperature, rounded.
                 { Serial.print((expandTempC16(statRaw)+8) >> 4); break; }
-#if defined(EE_STATS_SET_WARMMODE_BY_HOUR_OF_WK)
-              case EE_STATS_SET_WARMMODE_BY_HOUR_OF_WK:
-                // Warm mode usage bitmap by hour over week.
-                { Serial.print(statRaw, HEX); break; }
-#endif
               }
             if(hh == thisHH) { Serial.print('<'); } // Highlight current stat in this set.
 #if 0 && defined(DEBUG)
@@ -1023,6 +1014,18 @@ void pollCLI(const uint8_t maxSCT)
         const uint8_t overrunCount = (~eeprom_read_byte((uint8_t *)EE_START_OVERRUN_COUNTER)) & 0xff;
         Serial.print(overrunCount);
         Serial.println();
+#if defined(ALLOW_STATS_RX)
+        Serial.print(F("Stats RX queue dropped/HWM/size: "));
+        Serial.print(getInboundStatsQueueOverrun());
+        Serial.print('/');
+        Serial.print(getInboundStatsQueueHighWaterMark());
+        Serial.print('/');
+        Serial.print(INBOUND_STATS_QUEUE_SIZE);
+        Serial.println();
+        Serial.print(F("Stats RX repeats dropped: "));
+        Serial.print(getRXDuplicatesSuppressed());
+        Serial.println();
+#endif
 #ifdef ENABLE_ANTICIPATION
         uint_least8_t hh = getHoursLT();
         Serial.print(F("Smart warming: "));
@@ -41,6 +41,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2015
 
 #include <util/atomic.h>
 
+#include "AES_GCM.h"
 #include "Control.h"
 #include "EEPROM_Utils.h"
 #include "FHT8V_Wireless_Rad_Valve.h"
@@ -122,6 +123,166 @@ static void testOnOffBoilerDriverLogic()
   // Ensure no 'live' or other records created.
   OnOffBoilerDriverLogic::PerIDStatus valves1[1];
   AssertIsEqual(0, oobdl1.valvesStatus(valves1, 1, randRNG8NextBoolean()));
+  // A valid call for heat takes effect on the next tick (once any minimum time off has passed)
+  // and an explicit low signal from the same valve cancels it.
+  OnOffBoilerDriverLogic oobdl2;
+  oobdl2.setMinTicksInEitherState(1);
+  AssertIsTrue(oobdl2.receiveSignal(0x8081u, 100));
+  AssertIsTrue(!oobdl2.isCallingForHeat()); // Only queued so far.
+  oobdl2.tick2s();
+  AssertIsTrue(oobdl2.isCallingForHeat());
+  AssertIsEqual(1, oobdl2.valvesStatus(valves1, 1, true));
+  AssertIsEqual(0x8081u, valves1[0].id);
+  AssertIsEqual(100, valves1[0].percentOpen);
+  AssertIsTrue(oobdl2.receiveSignal(0x8081u, 0));
+  oobdl2.tick2s();
+  AssertIsTrue(!oobdl2.isCallingForHeat());
+  AssertIsEqual(0, oobdl2.valvesStatus(valves1, 1, true));
+  AssertIsEqual(1, oobdl2.valvesStatus(valves1, 1, false)); // Still tracked.
+  // With every slot taken by a live call, a new weaker call is dropped but a new stronger one evicts the weakest.
+  OnOffBoilerDriverLogic oobdl3;
+  oobdl3.setMinTicksInEitherState(1);
+  for(uint8_t i = 0; i < OnOffBoilerDriverLogic::maxRadiators; ++i)
+    {
+    AssertIsTrue(oobdl3.receiveSignal(0x8000u + i, 50 + (i & 0x1f)));
+    // Apply signals often enough that the queue never fills and none expire.
+    if((BOILER_HUB_SIGNAL_QUEUE - 2) == (i % (BOILER_HUB_SIGNAL_QUEUE - 1))) { oobdl3.tick2s(); }
+    }
+  oobdl3.tick2s();
+  AssertIsTrue(oobdl3.isCallingForHeat());
+  AssertIsTrue(oobdl3.receiveSignal(0x9000u, 40));
+  oobdl3.tick2s();
+  OnOffBoilerDriverLogic::PerIDStatus valves3[OnOffBoilerDriverLogic::maxRadiators];
+  uint8_t n3 = oobdl3.valvesStatus(valves3, OnOffBoilerDriverLogic::maxRadiators, false);
+  AssertIsEqual(OnOffBoilerDriverLogic::maxRadiators, n3);
+  for(uint8_t i = 0; i < n3; ++i) { AssertIsTrue(0x9000u != valves3[i].id); }
+  AssertIsTrue(oobdl3.receiveSignal(0x9001u, 100));
+  oobdl3.tick2s();
+  n3 = oobdl3.valvesStatus(valves3, OnOffBoilerDriverLogic::maxRadiators, false);
+  bool found9001 = false;
+  for(uint8_t i = 0; i < n3; ++i) { AssertIsTrue(0x8000u != valves3[i].id); if(0x9001u == valves3[i].id) { found9001 = true; } }
+  AssertIsTrue(found9001);
+  // A burst of one signal from every radiator within one tick is held, and any beyond the queue are dropped and counted.
+  OnOffBoilerDriverLogic oobdl5;
+  for(uint8_t i = 0; i < BOILER_HUB_SIGNAL_QUEUE - 1; ++i) { AssertIsTrue(oobdl5.receiveSignal(0x8000u + i, 50)); }
+  AssertIsEqual(0, oobdl5.getSignalOverruns());
+  AssertIsTrue(!oobdl5.receiveSignal(0x9000u, 50));
+  AssertIsEqual(1, oobdl5.getSignalOverruns());
+  oobdl5.tick2s();
+  AssertIsTrue(oobdl5.receiveSignal(0x9000u, 50));
+  // Calls expire after about 2 minutes without a repeat and the boiler goes off.
+  for(uint8_t i = 61; i-- > 0; ) { oobdl3.tick2s(); }
+  AssertIsEqual(0, oobdl3.valvesStatus(valves3, OnOffBoilerDriverLogic::maxRadiators, true));
+  AssertIsTrue(!oobdl3.isCallingForHeat());
+  // In TPI mode the boiler is on for a fraction of each period in proportion to demand,
+  // with spells shorter than the minimum rounded up or away.
+  OnOffBoilerDriverLogic oobdl4;
+  oobdl4.setMinTicksInEitherState(4);
+  oobdl4.setThresholds(5, 5);
+  for(uint8_t i = 5; i-- > 0; ) { oobdl4.tick2s(); } // Pass minimum time off.
+  oobdl4.setTPIMode(30);
+  AssertIsTrue(oobdl4.isTPIMode());
+  static const uint8_t demandPC[] = { 50, 10, 90 };
+  static const uint8_t expectedOnTicks[] = { 15, 4, 30 };
+  for(uint8_t p = 0; p < sizeof(demandPC); ++p)
+    {
+    uint8_t onTicks = 0;
+    for(uint8_t i = 0; i < 30; ++i)
+      {
+      if(0 == (i % 20)) { oobdl4.receiveSignal(0x8081u, demandPC[p]); }
+      oobdl4.tick2s();
+      if(oobdl4.isCallingForHeat()) { ++onTicks; }
+      }
+    AssertIsEqual(expectedOnTicks[p], onTicks);
+    }
+  AssertIsEqual(90, oobdl4.getAggregateDemandPC());
+  // Marginal aggregate demand, below the minimum-aggregate threshold, leaves the boiler off for the whole period.
+  oobdl4.setThresholds(5, 40);
+  uint8_t marginalOnTicks = 0;
+  for(uint8_t i = 0; i < 30; ++i)
+    {
+    if(0 == (i % 20)) { oobdl4.receiveSignal(0x8081u, 30); }
+    oobdl4.tick2s();
+    if(oobdl4.isCallingForHeat()) { ++marginalOnTicks; }
+    }
+  AssertIsEqual(0, marginalOnTicks);
+  AssertIsEqual(30, oobdl4.getAggregateDemandPC());
+  // A TPI period shorter than the minimum time in either state is stretched to twice the minimum,
+  // and with no demand the boiler is never called for.
+  OnOffBoilerDriverLogic oobdl6;
+  oobdl6.setMinTicksInEitherState(20);
+  oobdl6.setTPIMode(10);
+  for(uint8_t i = 0; i < 100; ++i)
+    {
+    oobdl6.tick2s();
+    AssertIsTrue(!oobdl6.isCallingForHeat());
+    }
+#if defined(BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY)
+  // Once any ID is authorised, signals from all others are ignored, until the list is cleared.
+  OnOffBoilerDriverLogic oobdl7;
+  oobdl7.setMinTicksInEitherState(1);
+  AssertIsTrue(!oobdl7.authoriseID(0xffffu));
+  AssertIsTrue(oobdl7.authoriseID(0x8081u));
+  AssertIsTrue(oobdl7.authoriseID(0x8081u)); // Already present.
+  AssertIsTrue(oobdl7.receiveSignal(0x8082u, 100)); // Queued but not authorised.
+  oobdl7.tick2s();
+  AssertIsTrue(!oobdl7.isCallingForHeat());
+  AssertIsEqual(0, oobdl7.valvesStatus(valves1, 1, false));
+  AssertIsTrue(oobdl7.receiveSignal(0x8081u, 100));
+  oobdl7.tick2s();
+  AssertIsTrue(oobdl7.isCallingForHeat());
+  AssertIsEqual(1, oobdl7.valvesStatus(valves1, 1, false));
+  AssertIsEqual(0x8081u, valves1[0].id);
+  for(uint8_t i = 1; i < OnOffBoilerDriverLogic::maxRadiators; ++i) { AssertIsTrue(oobdl7.authoriseID(0x9000u + i)); }
+  AssertIsTrue(!oobdl7.authoriseID(0x8082u)); // List full.
+  oobdl7.clearAuthorisedIDs();
+  AssertIsTrue(oobdl7.receiveSignal(0x8082u, 100));
+  oobdl7.tick2s();
+  AssertIsEqual(2, oobdl7.valvesStatus(valves3, OnOffBoilerDriverLogic::maxRadiators, false));
+#endif
+#if defined(OnOffBoilerDriverLogic_CLEANUP)
+  // An entry quiet for as long as can be tracked (~6 minutes) is dropped, while one still repeating is kept.
+  OnOffBoilerDriverLogic oobdl8;
+  AssertIsTrue(oobdl8.receiveSignal(0x8081u, 100));
+  AssertIsTrue(oobdl8.receiveSignal(0x8082u, 100));
+  for(uint8_t i = 0; i < 188; ++i)
+    {
+    if(0 == (i % 30)) { oobdl8.receiveSignal(0x8082u, 100); }
+    oobdl8.tick2s();
+    }
+  AssertIsEqual(2, oobdl8.valvesStatus(valves3, OnOffBoilerDriverLogic::maxRadiators, false)); // Stale but still tracked.
+  AssertIsEqual(1, oobdl8.valvesStatus(valves3, OnOffBoilerDriverLogic::maxRadiators, true));
+  oobdl8.tick2s();
+  AssertIsEqual(1, oobdl8.valvesStatus(valves3, OnOffBoilerDriverLogic::maxRadiators, false));
+  AssertIsEqual(0x8082u, valves3[0].id);
+#endif
+  }
+#endif
+
+#if defined(ENABLE_ZONE_COORDINATOR)
+// Test hub allocation of pre-warm stagger slots to zones.
+static void testZoneCoordinator()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("ZoneCoordinator");
+  ZoneCoordinator zc;
+  // Each new zone takes the least-used slot, so the first few all differ, starting with no stagger.
+  const uint8_t n = (ZoneCoordinator::maxZones < ZoneCoordinator::staggerSlots) ? ZoneCoordinator::maxZones : ZoneCoordinator::staggerSlots;
+  for(uint8_t i = 0; i < n; ++i) { AssertIsEqual(i, zc.getStaggerSlot(0x8000u + i)); }
+  AssertIsEqual(n, zc.getZoneCount());
+  // A zone keeps its slot.
+  AssertIsEqual(n - 1, zc.getStaggerSlot(0x8000u + n - 1));
+  // With the table full a further zone still gets a stable slot though it is not tracked.
+  for(uint8_t i = n; i < ZoneCoordinator::maxZones; ++i) { zc.getStaggerSlot(0x8000u + i); }
+  AssertIsEqual(ZoneCoordinator::maxZones, zc.getZoneCount());
+  const uint8_t s = zc.getStaggerSlot(0x9123u);
+  AssertIsTrue(s < ZoneCoordinator::staggerSlots);
+  AssertIsEqual(s, zc.getStaggerSlot(0x9123u));
+  AssertIsEqual(ZoneCoordinator::maxZones, zc.getZoneCount());
+  // Once zones have been quiet long enough a new zone takes over the first longest-quiet entry and its now-free slot.
+  for(uint16_t m = 60U * ZoneCoordinator::forgetH; m-- > 0; ) { zc.tickMinute(); }
+  AssertIsEqual(0, zc.getStaggerSlot(0x9000u));
+  AssertIsEqual(0, zc.getStaggerSlot(0x9000u));
+  AssertIsEqual(ZoneCoordinator::maxZones, zc.getZoneCount());
   }
 #endif
 
@@ -296,6 +457,157 @@ static void testComputeRequiredTRVPercentOpen()
 #endif
   }
 
+// Test the O(1) running filter state of ModelledRadValveState: history order, running sum and jump count.
+static void testModelledRadValveFilter()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("ModelledRadValveFilter");
+  ModelledRadValveInputState is0(100<<4);
+  is0.targetTempC = FROST;
+  ModelledRadValveState rs0;
+  volatile uint8_t valvePCOpen = 0;
+  rs0.tick(valvePCOpen, is0);
+  // Initialisation should fill the whole history with the first reading.
+  for(int i = ModelledRadValveState::filterLength; --i >= 0; ) { AssertIsEqual(100<<4, rs0.getPrevRawTempC16(i)); }
+  AssertIsEqual(100<<4, rs0.getSmoothedRecent());
+  AssertIsEqual(0, rs0.prevRawTempJumps);
+  AssertIsEqual(0, rs0.getRawDelta());
+  AssertIsTrue(!rs0.isFiltering);
+  // A single big jump should engage filtering and be reflected in the running sum and history,
+  // and filtering should stay engaged until the jump has aged out of the filter memory.
+  is0.refTempC16 += 8;
+  rs0.tick(valvePCOpen, is0);
+  AssertIsEqual((100<<4) + 8, rs0.getPrevRawTempC16(0));
+  AssertIsEqual(100<<4, rs0.getPrevRawTempC16(1));
+  AssertIsEqual(8, rs0.getRawDelta());
+  AssertIsEqual(1, rs0.prevRawTempJumps);
+  AssertIsEqual((100<<4) + 1, rs0.getSmoothedRecent()); // 8/16 rounds up.
+  AssertIsTrue(rs0.isFiltering);
+  for(int i = ModelledRadValveState::filterLength - 1; --i > 0; ) { rs0.tick(valvePCOpen, is0); }
+  AssertIsEqual(1, rs0.prevRawTempJumps);
+  AssertIsEqual((100<<4) + 8, rs0.getPrevRawTempC16(ModelledRadValveState::filterLength - 2));
+  rs0.tick(valvePCOpen, is0);
+  AssertIsEqual(0, rs0.prevRawTempJumps);
+  AssertIsEqual((100<<4) + 8, rs0.getSmoothedRecent());
+  AssertIsTrue(!rs0.isFiltering);
+  }
+
+#if defined(LOCAL_TRV)
+// Set the local time to the given day and minute of day, with the RTC ISR shut out.
+// Seconds are zeroed so that the minute cannot roll during a short test.
+static void setTestDayAndMinuteLT(const uint_least16_t days, const uint_least16_t mins)
+  {
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+    {
+    _secondsLT = 0;
+    _minutesSinceMidnightLT = mins;
+    _daysSince1999LT = days;
+    }
+  }
+#endif
+
+// Test of the daily valve movement budget and the anti-seek delays it lengthens.
+static void testMovementBudgetPressure()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("MovementBudgetPressure");
+  // Anti-seek delays can be lengthened on request, eg when valve movement is running ahead of its daily budget.
+  ModelledRadValveInputState is4(0);
+  is4.targetTempC = WARM;
+  is4.antiSeekDelayShift = 1;
+  ModelledRadValveState rs4;
+  volatile uint8_t valvePCOpen = 0;
+  rs4.tick(valvePCOpen, is4);
+  AssertIsTrue(valvePCOpen > 0);
+  AssertIsEqual(ANTISEEK_VALVE_RECLOSE_DELAY_M << 1, rs4.valveTurnupCountdownM);
+  rs4.valveTurndown(2);
+  AssertIsEqual(ANTISEEK_VALVE_REOPEN_DELAY_M << 2, rs4.valveTurndownCountdownM);
+#if defined(LOCAL_TRV)
+  uint_fast8_t oldS;
+  uint_least16_t oldM, oldD;
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE) { oldS = _secondsLT; oldM = _minutesSinceMidnightLT; oldD = _daysSince1999LT; }
+  const uint16_t budget = DEFAULT_MAX_CUMULATIVE_PC_DAILY_VALVE_MOVEMENT;
+  const uint16_t slack = budget / 2; // Slack before pro-rata limiting applies.
+  const uint16_t step = budget / 8; // Movement ahead of pro-rata for each further pressure level.
+  // Just after midnight only the slack is available, and each further 1/8th of the budget ahead adds a level, up to 3.
+  ModelledRadValve mrv0;
+  setTestDayAndMinuteLT(100, 0);
+  AssertIsEqual(0, mrv0._TEST_computeMovementBudgetPressure()); // Starts the day's budget at 0.
+  mrv0._TEST_setCumulativeMovementPC(slack);
+  AssertIsEqual(0, mrv0._TEST_computeMovementBudgetPressure());
+  AssertIsEqual(50, mrv0.getDailyMovementBudgetUsedPC());
+  mrv0._TEST_setCumulativeMovementPC(slack + 1);
+  AssertIsEqual(1, mrv0._TEST_computeMovementBudgetPressure());
+  mrv0._TEST_setCumulativeMovementPC(slack + step);
+  AssertIsEqual(2, mrv0._TEST_computeMovementBudgetPressure());
+  mrv0._TEST_setCumulativeMovementPC(slack + 2*step);
+  AssertIsEqual(3, mrv0._TEST_computeMovementBudgetPressure());
+  mrv0._TEST_setCumulativeMovementPC(budget - 1);
+  AssertIsEqual(3, mrv0._TEST_computeMovementBudgetPressure()); // Capped at 3.
+  // The allowance grows pro-rata through the day: at 06:00 a quarter of the budget plus the slack.
+  setTestDayAndMinuteLT(100, 6*60 - 1);
+  mrv0._TEST_setCumulativeMovementPC(budget/4 + slack);
+  AssertIsEqual(0, mrv0._TEST_computeMovementBudgetPressure());
+  mrv0._TEST_setCumulativeMovementPC(budget/4 + slack + 1);
+  AssertIsEqual(1, mrv0._TEST_computeMovementBudgetPressure());
+  // Once the whole day's budget is used the pressure is maximal, however late in the day, even though slack remains.
+  setTestDayAndMinuteLT(100, MINS_PER_DAY - 1);
+  mrv0._TEST_setCumulativeMovementPC(budget - 1);
+  AssertIsEqual(0, mrv0._TEST_computeMovementBudgetPressure());
+  mrv0._TEST_setCumulativeMovementPC(budget);
+  AssertIsEqual(3, mrv0._TEST_computeMovementBudgetPressure());
+  AssertIsEqual(100, mrv0.getDailyMovementBudgetUsedPC());
+  // Local midnight starts a fresh budget from the movement so far.
+  setTestDayAndMinuteLT(101, 0);
+  AssertIsEqual(0, mrv0._TEST_computeMovementBudgetPressure());
+  AssertIsEqual(0, mrv0.getDailyMovementBudgetUsedPC());
+  mrv0._TEST_setCumulativeMovementPC(budget + slack + 1);
+  AssertIsEqual(1, mrv0._TEST_computeMovementBudgetPressure());
+  // Movement used today is computed correctly across the 12-bit wrap of the cumulative counter.
+  ModelledRadValve mrv1;
+  mrv1._TEST_setCumulativeMovementPC(0xfff - 9);
+  AssertIsEqual(0, mrv1._TEST_computeMovementBudgetPressure()); // Starts the day's budget just below the wrap.
+  mrv1._TEST_setCumulativeMovementPC((0xfff - 9 + slack) & 0xfff);
+  AssertIsEqual(0, mrv1._TEST_computeMovementBudgetPressure());
+  AssertIsEqual(50, mrv1.getDailyMovementBudgetUsedPC());
+  mrv1._TEST_setCumulativeMovementPC((0xfff - 9 + slack + step) & 0xfff);
+  AssertIsEqual(2, mrv1._TEST_computeMovementBudgetPressure());
+  setTestDayAndMinuteLT(oldD, oldM);
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE) { _secondsLT = oldS; }
+#endif
+  }
+
+// Test learning of room heating/cooling rates from steady ramps with the valve held fully open/shut.
+static void testLearnedRoomRates()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("LearnedRoomRates");
+  // Cold room warming at 1/16C per minute (60 C/16 per hour) once the valve is driven fully open.
+  ModelledRadValveInputState is0(5<<4);
+  is0.targetTempC = WARM;
+  ModelledRadValveState rs0;
+  AssertIsEqual(0xff, rs0.heatRateC16PerH);
+  volatile uint8_t valvePCOpen = 0;
+  for(int i = 100; --i >= 0; ) { rs0.tick(valvePCOpen, is0); ++is0.refTempC16; }
+  AssertIsEqual(100, valvePCOpen);
+  AssertIsEqual(60, rs0.heatRateC16PerH);
+  AssertIsEqual(0xff, rs0.coolRateC16PerH); // Valve was never held shut.
+  // Warm room cooling at 2/16C per minute (120 C/16 per hour) with the valve shut.
+  ModelledRadValveInputState is1(30<<4);
+  is1.targetTempC = FROST;
+  ModelledRadValveState rs1;
+  valvePCOpen = 0;
+  for(int i = 100; --i >= 0; ) { rs1.tick(valvePCOpen, is1); is1.refTempC16 -= 2; }
+  AssertIsEqual(0, valvePCOpen);
+  AssertIsEqual(120, rs1.coolRateC16PerH);
+  AssertIsEqual(0xff, rs1.heatRateC16PerH); // Valve was never fully open.
+  // Cold room not warming at all with the valve fully open (eg boiler off) teaches nothing about the heating rate.
+  ModelledRadValveInputState is2(5<<4);
+  is2.targetTempC = WARM;
+  ModelledRadValveState rs2;
+  valvePCOpen = 0;
+  for(int i = 100; --i >= 0; ) { rs2.tick(valvePCOpen, is2); }
+  AssertIsEqual(100, valvePCOpen);
+  AssertIsEqual(0xff, rs2.heatRateC16PerH);
+  }
+
 
 // Test set derived from following status lines from a hard-to-regulate-smoothly unit DHD20141230
 // (poor static balancing, direct radiative heat, low thermal mass, insufficiently insulated?):
@@ -482,6 +794,31 @@ static void testComputeRequiredTRVPercentOpen()
 
 
 
+#ifdef OCCUPANCY_SUPPORT
+// Test that the Bayesian occupancy estimate weights evidence by reliability.
+static void testOccupancyEstimator()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("OccupancyEstimator");
+  // From the same starting point, a quiet minute lowers the estimate
+  // and progressively more reliable evidence raises it further.
+  OccupancyTracker quiet, light, voice, ui;
+  light.markAsPossiblyOccupied(OccupancyTracker::evidenceLRX16Light);
+  voice.markAsPossiblyOccupied(OccupancyTracker::evidenceLRX16Voice);
+  ui.markAsOccupied();
+  quiet.read(); light.read(); voice.read(); ui.read();
+  AssertIsTrue(quiet.getOccupancyProbabilityPC() < light.getOccupancyProbabilityPC());
+  AssertIsTrue(light.getOccupancyProbabilityPC() < voice.getOccupancyProbabilityPC());
+  AssertIsTrue(voice.getOccupancyProbabilityPC() < ui.getOccupancyProbabilityPC());
+  AssertIsTrue(ui.getOccupancyProbabilityPC() <= 100);
+  AssertIsTrue(!ui.isConfidentlyVacant());
+  // Holiday mode is confidently vacant at once.
+  ui.setHolidayMode();
+  AssertIsEqual(0, ui.getOccupancyProbabilityPC());
+  AssertIsTrue(ui.isConfidentlyVacant());
+  }
+#endif
+
+
 // Test basic computation of target temperature and the associated energy saving rules.
 // This ensures that basic energy efficiency techniques are functional.
 /*
@@ -621,6 +958,78 @@ DEBUG_SERIAL_PRINTLN();
   AssertIsTrue(maxComSetback <= 2);
   }
 
+#if defined(LOCAL_TRV)
+// True if computeTargetTemperature() recomputed the target rather than reusing its cached value.
+// Overwrites the cached value with 0, which is never a legitimate target, so a recomputation is visible.
+static bool isTargetRecomputed(ModelledRadValve &mrv)
+  {
+  mrv._TEST_setTargetTempC(0);
+  mrv.computeTargetTemperature();
+  return(0 != mrv.getTargetTempC());
+  }
+#endif
+
+// Test that the target temperature is reused while its inputs are unchanged, and recomputed when any of them changes.
+static void testTargetTempCache()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("TargetTempCache");
+#if defined(LOCAL_TRV)
+  uint_fast8_t oldS;
+  uint_least16_t oldM, oldD;
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE) { oldS = _secondsLT; oldM = _minutesSinceMidnightLT; oldD = _daysSince1999LT; }
+  // Hold the time mid-hour so that the hour cannot roll between checks.
+  setTestDayAndMinuteLT(oldD, 10*60 + 30);
+  _TEST_set_basetemp_override(_btoUT_mid);
+  _TEST_set_schedule_override(_soUT_off);
+  setWarmModeDebounced(true);
+#ifdef OCCUPANCY_SUPPORT
+  Occupancy.markAsOccupied();
+#endif
+#ifndef OMIT_MODULE_LDROCCUPANCYDETECTION
+  AmbLight._TEST_set_multi_(1023, true, 0);
+#endif
+  ModelledRadValve mrv;
+  AssertIsTrue(isTargetRecomputed(mrv)); // Always computed first time.
+  // Unchanged inputs reuse the cached value, however often asked.
+  AssertIsTrue(!isTargetRecomputed(mrv));
+  AssertIsTrue(!isTargetRecomputed(mrv));
+  // Schedule.
+  _TEST_set_schedule_override(_soUT_now);
+  AssertIsTrue(isTargetRecomputed(mrv));
+  AssertIsTrue(!isTargetRecomputed(mrv));
+  // Mode.
+  setWarmModeDebounced(false);
+  AssertIsTrue(isTargetRecomputed(mrv));
+  AssertIsTrue(!isTargetRecomputed(mrv));
+  setWarmModeDebounced(true);
+  AssertIsTrue(isTargetRecomputed(mrv));
+#ifdef OCCUPANCY_SUPPORT
+  // Occupancy.
+  Occupancy.setHolidayMode();
+  AssertIsTrue(isTargetRecomputed(mrv));
+  AssertIsTrue(!isTargetRecomputed(mrv));
+#endif
+#ifndef OMIT_MODULE_LDROCCUPANCYDETECTION
+  // Ambient light.
+  AmbLight._TEST_set_multi_(0, false, 0);
+  AssertIsTrue(isTargetRecomputed(mrv));
+  AssertIsTrue(!isTargetRecomputed(mrv));
+#endif
+  // WARM target temperature.
+  _TEST_set_basetemp_override(_btoUT_max);
+  AssertIsTrue(isTargetRecomputed(mrv));
+  AssertIsTrue(!isTargetRecomputed(mrv));
+  // Hour of day, standing in for the by-hour stats.
+  setTestDayAndMinuteLT(oldD, 11*60 + 30);
+  AssertIsTrue(isTargetRecomputed(mrv));
+  AssertIsTrue(!isTargetRecomputed(mrv));
+  _TEST_set_basetemp_override(_btoUT_normal); // Override off.
+  _TEST_set_schedule_override(_soUT_normal); // Override off.
+  setTestDayAndMinuteLT(oldD, oldM);
+  ATOMIC_BLOCK (ATOMIC_RESTORESTATE) { _secondsLT = oldS; }
+#endif
+  }
+
 
 // Test self-mocking of sensor modules (and others) to facilitate other unit tests. 
 static void testSensorMocking()
@@ -731,6 +1140,67 @@ static void testQuartiles()
     }
   }
 
+// Test that the RAM quartile index for the control sets agrees with a direct scan of the EEPROM stats,
+// and is rebuilt when the stats are updated.
+static void testQuartileIndex()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("QuartileIndex");
+  // Seed a known pattern (10 * hour) into the occupancy stats pair through the normal update path,
+  // erasing each smoothed value first so that the new value is taken as is,
+  // then restore the original values afterwards.
+  // This writes to EEPROM, though only a few dozen bytes per run.
+  uint8_t * const pL = (uint8_t *)(EE_STATS_START_ADDR(EE_STATS_SET_OCCPC_BY_HOUR));
+  uint8_t * const pS = (uint8_t *)(EE_STATS_START_ADDR(EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED));
+  uint8_t oldL[24], oldS[24];
+  for(uint8_t hh = 0; hh < 24; ++hh)
+    {
+    oldL[hh] = eeprom_read_byte(pL + hh);
+    oldS[hh] = eeprom_read_byte(pS + hh);
+    eeprom_smart_erase_byte(pS + hh);
+    _TEST_simpleUpdateStatsPair(EE_STATS_SET_OCCPC_BY_HOUR, hh, 10 * hh);
+    }
+  // Hours 0--5 are in the bottom quartile and 18--23 in the top.
+  for(uint8_t hh = 0; hh < 24; ++hh)
+    {
+    AssertIsEqual(hh < 6, inOutlierQuartile(false, EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED, hh));
+    AssertIsEqual(hh >= 18, inOutlierQuartile(true, EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED, hh));
+    }
+  // Raising hour 0 to the highest value moves it to the top quartile and hour 6 into the bottom one.
+  eeprom_smart_erase_byte(pS);
+  _TEST_simpleUpdateStatsPair(EE_STATS_SET_OCCPC_BY_HOUR, 0, 250);
+  AssertIsTrue(inOutlierQuartile(true, EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED, 0));
+  AssertIsTrue(!inOutlierQuartile(false, EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED, 0));
+  AssertIsTrue(inOutlierQuartile(false, EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED, 6));
+  AssertIsTrue(!inOutlierQuartile(true, EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED, 18));
+  // Restore the original values, leaving the index stale until the next query.
+  for(uint8_t hh = 0; hh < 24; ++hh)
+    {
+    eeprom_smart_erase_byte(pS + hh);
+    _TEST_simpleUpdateStatsPair(EE_STATS_SET_OCCPC_BY_HOUR, hh, oldL[hh]);
+    eeprom_smart_update_byte(pS + hh, oldS[hh]);
+    }
+  // The index for whatever is now in EEPROM agrees with a direct scan.
+  const uint8_t sets[] = { EE_STATS_SET_OCCPC_BY_HOUR_SMOOTHED, EE_STATS_SET_AMBLIGHT_BY_HOUR_SMOOTHED };
+  for(uint8_t s = 0; s < sizeof(sets); ++s)
+    {
+    const uint8_t *ss = (uint8_t *)(EE_STATS_START_ADDR(sets[s]));
+    bool full = true;
+    for(uint8_t j = 0; j < 24; ++j) { if(STATS_UNSET_BYTE == eeprom_read_byte(ss + j)) { full = false; } }
+    for(uint8_t hh = 0; hh < 24; ++hh)
+      {
+      const uint8_t sample = eeprom_read_byte(ss + hh);
+      uint8_t higher = 0, lower = 0;
+      for(uint8_t j = 0; j < 24; ++j)
+        {
+        const uint8_t v = eeprom_read_byte(ss + j);
+        if(v > sample) { ++higher; } else if(v < sample) { ++lower; }
+        }
+      AssertIsEqual(full && (higher >= 18), inOutlierQuartile(false, sets[s], hh));
+      AssertIsEqual(full && (lower >= 18), inOutlierQuartile(true, sets[s], hh));
+      }
+    }
+  }
+
 // Test handling of JSON stats.
 static void testJSONStats()
   {
@@ -774,6 +1244,113 @@ static void testJSONStats()
   AssertIsEqual(1, ss1.size());
   AssertIsEqual(22, ss1.writeJSON((uint8_t*)buf, sizeof(buf), 0, randRNG8NextBoolean()));
   AssertIsTrue(0 == strcmp_P(buf, (const char PROGMEM *)F("{\"@\":\"1234\",\"f1\":-111}")));
+  // Check that maximising packs in all the fields that fit, and skips (but does not starve) one too big for the space left.
+  SimpleStatsRotation<4> ss2;
+  ss2.setID("1234");
+  ss2.put("a", 1);
+  ss2.put("b", 2);
+  ss2.put("c", 3);
+  ss2.put("abcdefghijklmnopqrstuvwxyz01", 4);
+  AssertIsEqual(30, ss2.writeJSON((uint8_t*)buf, sizeof(buf), 0, true));
+  AssertIsTrue(0 == strcmp_P(buf, (const char PROGMEM *)F("{\"@\":\"1234\",\"a\":1,\"b\":2,\"c\":3}")));
+  AssertIsTrue(ss2.changedValue());
+  // The skipped item goes first next time, with the rest filling the space left after it.
+  AssertIsEqual(51, ss2.writeJSON((uint8_t*)buf, sizeof(buf), 0, true));
+  AssertIsTrue(0 == strcmp_P(buf, (const char PROGMEM *)F("{\"@\":\"1234\",\"abcdefghijklmnopqrstuvwxyz01\":4,\"a\":1}")));
+  // Then the round-robin resumes after the last item sent, again skipping the big one that no longer fits.
+  AssertIsEqual(30, ss2.writeJSON((uint8_t*)buf, sizeof(buf), 0, true));
+  AssertIsTrue(0 == strcmp_P(buf, (const char PROGMEM *)F("{\"@\":\"1234\",\"b\":2,\"c\":3,\"a\":1}")));
+  AssertIsTrue(!ss2.changedValue());
+  // The most negative value is sized and written correctly when maximising.
+  SimpleStatsRotation<1> ssMin;
+  ssMin.setID("1234");
+  ssMin.put("f1", (int)-32768);
+  AssertIsEqual(24, ssMin.writeJSON((uint8_t*)buf, sizeof(buf), 0, true));
+  AssertIsTrue(0 == strcmp_P(buf, (const char PROGMEM *)F("{\"@\":\"1234\",\"f1\":-32768}")));
+  // Check that only changes of at least the threshold from the value last sent are significant.
+  SimpleStatsRotation<2> ss3;
+  ss3.putDescriptor(GenericStatsDescriptor("T", 1, false, 8));
+  ss3.put("T", 320);
+  ss3.put("x", 1);
+  AssertIsTrue(!ss3.significantChange()); // Nothing sent yet to compare against.
+  AssertIsTrue(0 != ss3.writeJSON((uint8_t*)buf, sizeof(buf), 0, true));
+  ss3.put("T", 313);
+  ss3.put("x", 100); // No threshold, so never significant.
+  AssertIsTrue(ss3.changedValue());
+  AssertIsTrue(!ss3.significantChange());
+  ss3.put("T", 312);
+  AssertIsTrue(ss3.significantChange());
+  ss3.put("T", 319); // Drifted back.
+  AssertIsTrue(!ss3.significantChange());
+  ss3.put("T", 330);
+  AssertIsTrue(ss3.significantChange());
+  AssertIsTrue(0 != ss3.writeJSON((uint8_t*)buf, sizeof(buf), 0, true));
+  AssertIsTrue(!ss3.significantChange());
+#endif
+  }
+
+#if defined(BENCHMARK_JSON_STATS) && defined(ALLOW_JSON_OUTPUT)
+// Keys for JSON stats timing: the usual sensor/valve tags padded out with extras.
+static const char * const benchKeys[16] =
+  { "T|C16", "H|%", "O", "vac|h", "B|mV", "v|%", "tT|C", "vC|%", "L", "a", "b", "c", "d", "e", "f", "g" };
+// Time writeJSON() alone on the given rotation after put() of n stats, reporting the worst case in CPU cycles.
+// Timer1 (otherwise powered down) counts undivided CPU clocks, so fails if the encoder takes 65536 cycles or more.
+static void _timeJSONStats(SimpleStatsRotationBase &ss, const uint8_t n)
+  {
+  char buf[MSG_JSON_MAX_LENGTH + 2];
+  uint16_t worst = 0;
+  for(uint8_t r = 0; r < 16; ++r)
+    {
+    for(uint8_t i = 0; i < n; ++i) { ss.put(benchKeys[i], (int)(r * i)); }
+    uint8_t l;
+    uint16_t cycles;
+    bool overflowed;
+    power_timer1_enable();
+    ATOMIC_BLOCK (ATOMIC_RESTORESTATE) // Keep ISR time out of the count.
+      {
+      TCCR1A = 0;
+      TCCR1B = 0; // Stop timer1 while setting it up.
+      TCNT1 = 0;
+      TIFR1 = _BV(TOV1); // Clear any stale overflow.
+      TCCR1B = _BV(CS10); // Run from the CPU clock with no prescaling.
+      l = ss.writeJSON((uint8_t*)buf, sizeof(buf), 0, true);
+      TCCR1B = 0;
+      cycles = TCNT1;
+      overflowed = (0 != (TIFR1 & _BV(TOV1)));
+      }
+    power_timer1_disable();
+    AssertIsTrue(0 != l);
+    AssertIsTrue(!overflowed);
+    if(cycles > worst) { worst = cycles; }
+    }
+  DEBUG_SERIAL_PRINT(n);
+  DEBUG_SERIAL_PRINT_FLASHSTRING(" stats, max CPU cycles per writeJSON(): ");
+  DEBUG_SERIAL_PRINT(worst);
+  DEBUG_SERIAL_PRINTLN();
+  }
+
+// Benchmark JSON stats generation with typical and large numbers of stats.
+// Run once ahead of the unit tests as timings depend on CPU clock and build.
+static void benchmarkJSONStats()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("JSONStatsTiming");
+  static SimpleStatsRotation<8> ss8;
+  _timeJSONStats(ss8, 8);
+  static SimpleStatsRotation<16> ss16;
+  _timeJSONStats(ss16, 16);
+  }
+#endif
+
+// Test that all the stats that this unit manages fit in its stats rotation.
+static void testManagedStats()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("ManagedStats");
+#if defined(ALLOW_JSON_OUTPUT)
+  AssertIsTrue(managedStatsContainsKey(TemperatureC16.tag()));
+#if defined(LOCAL_TRV)
+  // The last stats put, so only present if all the others fitted.
+  AssertIsTrue(managedStatsContainsKey(NominalRadValve.tagMBPC()));
+#endif
 #endif
   }
 
@@ -846,6 +1423,7 @@ static void testJSONForTX()
   // Now a longer message...
   memset(buf, 0, sizeof(buf));
   strcpy_P(buf, (const char PROGMEM *)longJSONMsg1);
+#if !defined(ALLOW_JSON_DICT_COMPRESSION)
   const int8_t l2o = strlen(buf);
   const uint8_t crc2 = adjustJSONMsgForTXAndComputeCRC(buf);
   // Check that top bit is not set (ie CRC was computed OK).
@@ -858,6 +1436,121 @@ static void testJSONForTX()
   const int8_t l2 = adjustJSONMsgForRXAndCheckCRC(buf, sizeof(buf));
   AssertIsTrueWithErr(l2o == l2, l2);
   AssertIsTrue(quickValidateRawSimpleJSONMessage(buf));
+#else
+  // The message is compressed (from 52 to 23 bytes) for TX.
+  const uint8_t crc2 = adjustJSONMsgForTXAndComputeCRC(buf);
+  AssertIsTrueWithErr((0x31 == crc2), crc2);
+  const int8_t l2o = strlen(buf);
+  AssertIsTrueWithErr(23 == l2o, l2o);
+  for(int8_t i = 1; i < l2o; ++i) { AssertIsTrue(0xff != (uint8_t)buf[i]); } // No terminator nor other bad bytes.
+  // Check that TX-format can be converted for RX.
+  buf[l2o] = crc2;
+  buf[l2o+1] = 0xff;
+  const int8_t l2 = adjustJSONMsgForRXAndCheckCRC(buf, sizeof(buf));
+  AssertIsTrueWithErr(l2o == l2, l2);
+  // Check that it expands back to the original.
+  char plain[MSG_JSON_MAX_EXPANDED_LENGTH + 1];
+  AssertIsTrueWithErr(52 == expandJSONDict(buf, plain, sizeof(plain)), expandJSONDict(buf, plain, sizeof(plain)));
+  AssertIsTrue(0 == strcmp_P(plain, (const char PROGMEM *)longJSONMsg1));
+  AssertIsTrue(quickValidateRawSimpleJSONMessage(plain));
+  // Expansion must not overrun the output buffer.
+  AssertIsTrue(0 == expandJSONDict(buf, plain, 52));
+  // Known keys save the whole field prefix, others just the generic ," and ": fragments.
+  AssertIsTrueWithErr(8 == jsonDictFieldSaving("T|C16"), jsonDictFieldSaving("T|C16"));
+  AssertIsTrueWithErr(2 == jsonDictFieldSaving("x"), jsonDictFieldSaving("x"));
+#endif
+#endif
+  }
+
+// Test compact binary TLV stats frame encoding and decoding.
+static void testStatsTLV()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("StatsTLV");
+  // Well-known keys have IDs, others do not.
+  AssertIsTrue(0 == statsTLVKeyID("T|C16"));
+  AssertIsTrue(1 == statsTLVKeyID("H|%"));
+  AssertIsTrue(10 == statsTLVKeyID("vB|%"));
+  AssertIsTrue(-1 == statsTLVKeyID("T"));
+  // Build an absolute frame with two values.
+  uint8_t buf[16];
+  uint8_t n = statsTLVStartFrame(buf, sizeof(buf), 5, 0xc2, 0xe0);
+  AssertIsTrueWithErr(3 == n, n);
+  n += statsTLVPutRecord(buf + n, sizeof(buf) - n, 0, false, 311);
+  n += statsTLVPutRecord(buf + n, sizeof(buf) - n, 1, false, 81);
+  n = statsTLVFinishFrame(buf, n, sizeof(buf));
+  AssertIsTrueWithErr(10 == n, n);
+  // Must never contain 0xff (the TX terminator), and must be self-delimiting.
+  for(uint8_t i = 0; i < n; ++i) { AssertIsTrue(0xff != buf[i]); }
+  AssertIsTrueWithErr(n == statsTLVCheckFrame(buf, sizeof(buf)), statsTLVCheckFrame(buf, sizeof(buf)));
+  // Decode to JSON, as the hub would.
+  StatsTLVRXState_t state;
+  memset(&state, 0, sizeof(state));
+  AssertIsTrue(statsTLVApplyFrame(buf, n, &state));
+  char json[40];
+  const uint8_t jl = statsTLVWriteJSON(&state, json, sizeof(json));
+  AssertIsTrueWithErr(0 == strcmp_P(json, (const char PROGMEM *)F("{\"@\":\"c2e0\",\"T|C16\":311,\"H|%\":81}")), jl);
+  AssertIsTrue(0 == state.fresh);
+  // A repeat (eg from double TX) is ignored.
+  AssertIsTrue(!statsTLVApplyFrame(buf, n, &state));
+  // The next frame can carry a delta.
+  n = statsTLVStartFrame(buf, sizeof(buf), 6, 0xc2, 0xe0);
+  n += statsTLVPutRecord(buf + n, sizeof(buf) - n, 0, true, -2);
+  n = statsTLVFinishFrame(buf, n, sizeof(buf));
+  AssertIsTrueWithErr(6 == n, n);
+  AssertIsTrue(statsTLVApplyFrame(buf, n, &state));
+  AssertIsTrueWithErr(309 == state.values[0], state.values[0]);
+  // A delta after a missed frame must not be applied, and invalidates the old values.
+  n = statsTLVStartFrame(buf, sizeof(buf), 8, 0xc2, 0xe0);
+  n += statsTLVPutRecord(buf + n, sizeof(buf) - n, 0, true, 1);
+  n = statsTLVFinishFrame(buf, n, sizeof(buf));
+  AssertIsTrue(statsTLVApplyFrame(buf, n, &state));
+  AssertIsTrueWithErr(0 == state.valid, state.valid);
+  // Corruption is detected.
+  buf[3] ^= 1;
+  AssertIsTrue(0 == statsTLVCheckFrame(buf, sizeof(buf)));
+  // Routine frames do not ask for an ACK; important ones do, and are still valid frames.
+  n = statsTLVStartFrame(buf, sizeof(buf), 9, 0xc2, 0xe0);
+  n = statsTLVFinishFrame(buf, n, sizeof(buf));
+  AssertIsTrue(!statsTLVFrameWantsAck(buf));
+  n = statsTLVStartFrame(buf, sizeof(buf), 9, 0xc2, 0xe0, true);
+  n = statsTLVFinishFrame(buf, n, sizeof(buf));
+  AssertIsTrueWithErr(n == statsTLVCheckFrame(buf, sizeof(buf)), n);
+  AssertIsTrue(statsTLVFrameWantsAck(buf));
+  AssertIsEqual(9, statsTLVFrameSeq(buf));
+  // The hub's ACK echoes the sequence number and ID.
+  uint8_t ack[STATS_TLV_ACK_BYTES];
+  AssertIsEqual(STATS_TLV_ACK_BYTES, statsTLVWriteAck(ack, sizeof(ack), statsTLVFrameSeq(buf), statsTLVFrameID0(buf), statsTLVFrameID1(buf), true));
+  AssertIsEqual(STATS_TLV_ACK_BYTES, statsTLVCheckAck(ack, sizeof(ack)));
+  AssertIsEqual(9, statsTLVFrameSeq(ack));
+  AssertIsEqual(0xc2, statsTLVFrameID0(ack));
+  AssertIsEqual(0xe0, statsTLVFrameID1(ack));
+  AssertIsTrue(statsTLVAckHasMargin(ack));
+  AssertIsEqual(0, statsTLVAckStaggerSlot(ack));
+  // A stagger slot survives the round trip independently of the margin flag.
+  AssertIsEqual(STATS_TLV_ACK_BYTES, statsTLVWriteAck(ack, sizeof(ack), 9, 0xc2, 0xe0, false, 5));
+  AssertIsEqual(STATS_TLV_ACK_BYTES, statsTLVCheckAck(ack, sizeof(ack)));
+  AssertIsEqual(5, statsTLVAckStaggerSlot(ack));
+  AssertIsTrue(!statsTLVAckHasMargin(ack));
+  // An ACK is not mistaken for a stats frame, nor vice versa.
+  AssertIsTrue(0 == statsTLVCheckFrame(ack, sizeof(ack)));
+  AssertIsTrue(0 == statsTLVCheckAck(buf, sizeof(buf)));
+  ack[2] ^= 1;
+  AssertIsTrue(0 == statsTLVCheckAck(ack, sizeof(ack)));
+#if defined(ALLOW_STATS_TLV)
+  // The sender uses a delta where shorter, but only absolute values once its baselines are reset,
+  // eg after an important frame went un-ACKed so the hub may have lost track.
+  SimpleStatsRotation<2> ss;
+  ss.setID("c2e0");
+  ss.put("T|C16", 311);
+  AssertIsTrue(0 != ss.writeTLV(buf, sizeof(buf), 0));
+  AssertIsTrue(0 == (buf[3] & STATS_TLV_TAG_DELTA));
+  ss.put("T|C16", 309);
+  AssertIsTrue(0 != ss.writeTLV(buf, sizeof(buf), 0));
+  AssertIsTrue(0 != (buf[3] & STATS_TLV_TAG_DELTA));
+  ss.put("T|C16", 308);
+  ss.resetTLVBaselines();
+  AssertIsTrue(0 != ss.writeTLV(buf, sizeof(buf), 0));
+  AssertIsTrue(0 == (buf[3] & STATS_TLV_TAG_DELTA));
 #endif
   }
 
@@ -1157,6 +1850,30 @@ static void testFHTEncodingHeadAndTail()
 #endif
   }
 
+#if defined(RFM22_NATIVE_PACKET_HANDLER)
+// Test that the raw FHT8V framing is loaded into the radio ready for valve TX whatever profile was left selected.
+// Needs the radio to be fitted.
+static void testRFM22RawProfileForValveTX()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("RFM22RawProfileForValveTX");
+  RFM22ModeStandbyAndClearState();
+  RFM22SetNativePacketHandler(true);
+  AssertIsTrue(RFM22IsNativePacketHandler());
+  AssertIsTrue(!RFM22IsRawPacketHandlerLoaded());
+  // Reloading works even if the cached profile state is already (wrongly) raw.
+  RFM22LoadRawPacketHandler();
+  AssertIsTrue(!RFM22IsNativePacketHandler());
+  AssertIsTrue(RFM22IsRawPacketHandlerLoaded());
+  RFM22LoadRawPacketHandler();
+  AssertIsTrue(RFM22IsRawPacketHandlerLoaded());
+  // Stopping RX reverts to the raw profile.
+  RFM22SetNativePacketHandler(true);
+  SetupToEavesdropOnFHT8V(true);
+  StopEavesdropOnFHT8V(true);
+  AssertIsTrue(RFM22IsRawPacketHandlerLoaded());
+  }
+#endif
+
 
 // Test elements of encoding and decoding FullStatsMessageCore_t.
 // These are the routines primarily under test:
@@ -1239,7 +1956,7 @@ static void testFullStatsMessageCoreEncDec()
   content.occ = 3; // Not occupied recently.
   const uint8_t *msg1 = encodeFullStatsMessageCore(buf, sizeof(buf), stTXalwaysAll, false, &content);
   AssertIsTrue(NULL != msg1); // Must succeed.
-  AssertIsTrueWithErr(msg1 - buf == FullStatsMessageCore_MAX_BYTES_ON_WIRE, msg1 - buf); // Must correspond to minimum size + 2 ID bytes.
+  AssertIsTrueWithErr(msg1 - buf == 8, msg1 - buf); // Must correspond to minimum size + 2 ID bytes + 2 temp/power bytes + 1 ambient light byte.
   AssertIsTrueWithErr((MESSAGING_FULL_STATS_HEADER_MSBS | MESSAGING_FULL_STATS_HEADER_BITS_ID_PRESENT | MESSAGING_FULL_STATS_HEADER_BITS_ID_HIGH) == buf[0], buf[0]); // Header byte.
   AssertIsTrueWithErr(0x03 == buf[1], buf[1]); // ID0 without msbit.
   AssertIsTrueWithErr(0x18 == buf[2], buf[2]); // ID1 without msbit.
@@ -1262,10 +1979,357 @@ static void testFullStatsMessageCoreEncDec()
   AssertIsTrue((19 << 4) + 1 == content.tempAndPower.tempC16);
   AssertIsTrue(content.containsAmbL);
   AssertIsTrue(42 == content.ambL);
+  AssertIsTrue(!content.containsRHP);
+  AssertIsTrue(!content.containsCFH);
+  AssertIsTrue(!content.containsAPL);
+
+  // Prepare a non-secure message with all the extended sections: RH%, call for heat and ASCII payload.
+  memset(buf, 0, sizeof(buf));
+  clearFullStatsMessageCore(&content);
+  content.id0 = 0x83;
+  content.id1 = 0x98;
+  content.containsID = true;
+  content.tempAndPower.tempC16 = (19 << 4) + 1; // (19 + 1/16)C.
+  content.containsTempAndPower = true;
+  content.ambL = 42;
+  content.containsAmbL = true;
+  content.rhp = 101;
+  content.containsRHP = true;
+  AssertIsTrue(NULL == encodeFullStatsMessageCore(buf, sizeof(buf), stTXalwaysAll, false, &content)); // Should reject RH% out of range.
+  content.rhp = 0;
+  content.cfhSecs = 254;
+  content.containsCFH = true;
+  AssertIsTrue(NULL == encodeFullStatsMessageCore(buf, sizeof(buf), stTXalwaysAll, false, &content)); // Should reject CFH out of range.
+  content.cfhSecs = 0;
+  content.aplLen = 2;
+  content.apl[0] = 'v';
+  content.apl[1] = '\n';
+  content.containsAPL = true;
+  AssertIsTrue(NULL == encodeFullStatsMessageCore(buf, sizeof(buf), stTXalwaysAll, false, &content)); // Should reject non-printable payload.
+  // Maximum-length ASCII payload with RH% and call-for-heat values at the ends of their ranges.
+  content.rhp = 100;
+  content.cfhSecs = 253;
+  content.aplLen = FullStatsMessageCore_MAX_APL_BYTES;
+  memset(content.apl, '~', FullStatsMessageCore_MAX_APL_BYTES);
+  content.apl[0] = ' ';
+  const uint8_t *msg2 = encodeFullStatsMessageCore(buf, sizeof(buf), stTXalwaysAll, false, &content);
+  AssertIsTrue(NULL != msg2); // Must succeed.
+  AssertIsTrueWithErr(msg2 - buf == FullStatsMessageCore_MAX_BYTES_ON_WIRE, msg2 - buf); // Must be maximum size.
+  AssertIsTrueWithErr((MESSAGING_FULL_STATS_FLAGS_HEADER_MSBS | MESSAGING_FULL_STATS_FLAGS_HEADER_EXT | MESSAGING_FULL_STATS_FLAGS_HEADER_AMBL | MESSAGING_FULL_STATS_FLAGS_HEADER_RHP) == buf[5], buf[5]); // Flags header (no occupancy).
+  AssertIsTrueWithErr((MESSAGING_FULL_STATS_FLAGS_EXT_MSBS | MESSAGING_FULL_STATS_FLAGS_EXT_CFH | MESSAGING_FULL_STATS_FLAGS_EXT_APL) == buf[6], buf[6]); // Extension flags header.
+  AssertIsTrueWithErr(254 == buf[7], buf[7]); // Call for heat.
+  AssertIsTrueWithErr(42 == buf[8], buf[8]); // Ambient light.
+  AssertIsTrueWithErr(101 == buf[9], buf[9]); // RH%.
+  AssertIsTrueWithErr(FullStatsMessageCore_MAX_APL_BYTES == buf[10], buf[10]); // ASCII payload length.
+  for(const uint8_t *p = buf; p < msg2; ++p) { AssertIsTrue(((uint8_t)0xff) != *p); } // Must not contain a terminator.
+  AssertIsTrue(((uint8_t)0xff) == *msg2); // Must be correctly terminated.
+  // Decode the message just generated into a freshly-scrubbed content structure.
+  clearFullStatsMessageCore(&content);
+  const uint8_t *msg2DE = decodeFullStatsMessageCore(buf, msg2-buf, stTXalwaysAll, false, &content);
+  AssertIsTrue(NULL != msg2DE); // Must succeed.
+  AssertIsTrue(msg2 == msg2DE); // Must return correct end of message.
+  AssertIsTrue(content.containsID);
+  AssertIsTrueWithErr(content.id1 == (uint8_t)0x98, content.id1);
+  AssertIsTrue((19 << 4) + 1 == content.tempAndPower.tempC16);
+  AssertIsTrue(42 == content.ambL);
+  AssertIsTrue(content.containsRHP);
+  AssertIsTrueWithErr(100 == content.rhp, content.rhp);
+  AssertIsTrue(content.containsCFH);
+  AssertIsTrueWithErr(253 == content.cfhSecs, content.cfhSecs);
+  AssertIsTrue(content.containsAPL);
+  AssertIsTrueWithErr(FullStatsMessageCore_MAX_APL_BYTES == content.aplLen, content.aplLen);
+  AssertIsTrue(' ' == content.apl[0]);
+  AssertIsTrue('~' == content.apl[FullStatsMessageCore_MAX_APL_BYTES-1]);
+  // Must reject a truncated message rather than read beyond the end of the buffer.
+  AssertIsTrue(NULL == decodeFullStatsMessageCore(buf, msg2-buf-1, stTXalwaysAll, false, &content));
+  // Must reject a corrupt extension flags header.
+  buf[6] |= 0x20;
+  AssertIsTrue(NULL == decodeFullStatsMessageCore(buf, msg2-buf, stTXalwaysAll, false, &content));
+
+  // Call for heat of zero (cancel) alone, with no ASCII payload.
+  memset(buf, 0, sizeof(buf));
+  clearFullStatsMessageCore(&content);
+  content.containsCFH = true;
+  const uint8_t *msg3 = encodeFullStatsMessageCore(buf, sizeof(buf), stTXalwaysAll, false, &content);
+  AssertIsTrue(NULL != msg3); // Must succeed.
+  AssertIsTrueWithErr(msg3 - buf == FullStatsMessageCore_MIN_BYTES_ON_WIRE + 2, msg3 - buf); // Extension flags and CFH bytes.
+  AssertIsTrueWithErr(1 == buf[3], buf[3]); // Zero seconds encoded as 1.
+  clearFullStatsMessageCore(&content);
+  AssertIsTrue(msg3 == decodeFullStatsMessageCore(buf, msg3-buf, stTXalwaysAll, false, &content));
+  AssertIsTrue(content.containsCFH);
+  AssertIsTrue(0 == content.cfhSecs);
+  AssertIsTrue(!content.containsAPL);
+  }
+
+// Test AES-128-GCM against the all-zeros vector of javasrc/.../leafauthenc/AESGCMTest.java so that the hub side interoperates,
+// and the secure full stats frame round-trip if a building key is set.
+static void testAESGCM()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("AESGCM");
+  // All-zeros 16-byte key, 12-byte nonce, 4-byte AAD and 30-byte plaintext; 16-byte tag.
+  static const uint8_t expected[30 + 16] PROGMEM =
+    {
+    0x03, 0x88, 0xda, 0xce, 0x60, 0xb6, 0xa3, 0x92, 0xf3, 0x28, 0xc2, 0xb9, 0x71, 0xb2, 0xfe, 0x78,
+    0xf7, 0x95, 0xaa, 0xab, 0x49, 0x4b, 0x59, 0x23, 0xf7, 0xfd, 0x89, 0xff, 0x94, 0x8b,
+    0x61, 0x47, 0x72, 0xc7, 0x92, 0x9c, 0xd0, 0xdd, 0x68, 0x1b, 0xd8, 0xa3, 0x7a, 0x65, 0x6f, 0x33,
+    };
+  uint8_t key[AES128_KEY_BYTES], nonce[AES_GCM_NONCE_BYTES], aad[4], text[30], tag[AES_GCM_MAX_TAG_BYTES];
+  memset(key, 0, sizeof(key));
+  memset(nonce, 0, sizeof(nonce));
+  memset(aad, 0, sizeof(aad));
+  memset(text, 0, sizeof(text));
+#if 1 && defined(DEBUG)
+  const uint8_t t0 = getSubCycleTime();
+#endif
+  aes128GCMEncrypt(key, nonce, aad, sizeof(aad), text, sizeof(text), text, tag, sizeof(tag));
+#if 1 && defined(DEBUG)
+  // Coarse timing: SUB_CYCLE_TICKS_PER_S ticks per second.
+  const uint8_t t1 = getSubCycleTime();
+  DEBUG_SERIAL_PRINT_FLASHSTRING("GCM 30 bytes sub-cycle ticks: ");
+  DEBUG_SERIAL_PRINT((uint8_t)(t1 - t0));
+  DEBUG_SERIAL_PRINTLN();
+#endif
+  AssertIsTrue(0 == memcmp_P(text, expected, sizeof(text)));
+  AssertIsTrue(0 == memcmp_P(tag, expected + sizeof(text), sizeof(tag)));
+  // Round trip in place.
+  AssertIsTrue(aes128GCMDecrypt(key, nonce, aad, sizeof(aad), text, sizeof(text), text, tag, sizeof(tag)));
+  for(uint8_t i = 0; i < sizeof(text); ++i) { AssertIsTrueWithErr(0 == text[i], i); }
+  // Any corruption of tag, AAD or ciphertext must be rejected, leaving the output untouched.
+  aes128GCMEncrypt(key, nonce, aad, sizeof(aad), text, sizeof(text), text, tag, sizeof(tag));
+  tag[randRNG8() & 0xf] ^= 1 << (randRNG8() & 7);
+  AssertIsTrue(!aes128GCMDecrypt(key, nonce, aad, sizeof(aad), text, sizeof(text), text, tag, sizeof(tag)));
+  AssertIsTrue(0 == memcmp_P(text, expected, sizeof(text)));
+  memcpy_P(tag, expected + sizeof(text), sizeof(tag));
+  aad[randRNG8() & 3] ^= 0x80;
+  AssertIsTrue(!aes128GCMDecrypt(key, nonce, aad, sizeof(aad), text, sizeof(text), text, tag, sizeof(tag)));
+  // Truncated tags work the same way.
+  memset(aad, 0, sizeof(aad));
+  AssertIsTrue(aes128GCMDecrypt(key, nonce, aad, sizeof(aad), text, sizeof(text), text, tag, 8));
+  AssertIsTrue(0 == text[0]);
+
+#if defined(ALLOW_SECURE_STATS)
+  // Replay protection: each sender's accepted counter must strictly increase, independently of other senders,
+  // and a sender pushed out of the table by too many others is accepted afresh.
+  static uint32_t base; // The table persists, so counters keep increasing from round to round.
+  base += 0x100;
+  AssertIsTrue(acceptSecureRXMessageCounter(0x11, 0x22, base + 2));
+  AssertIsTrue(!acceptSecureRXMessageCounter(0x11, 0x22, base + 2)); // Replay.
+  AssertIsTrue(!acceptSecureRXMessageCounter(0x11, 0x22, base + 1)); // Older.
+  AssertIsTrue(acceptSecureRXMessageCounter(0x11, 0x23, base + 1)); // Another sender.
+  AssertIsTrue(acceptSecureRXMessageCounter(0x11, 0x22, base + 3));
+  for(uint8_t i = 0; i < SECURE_STATS_RX_SENDERS; ++i) { AssertIsTrue(acceptSecureRXMessageCounter(0x33, i, base)); }
+  AssertIsTrue(acceptSecureRXMessageCounter(0x11, 0x22, base + 1)); // Forgotten.
+  // Secure full stats frame: needs a building key in EEPROM, which is not set up by this test.
+  FullStatsMessageCore_t content, decoded;
+  clearFullStatsMessageCore(&content);
+  content.containsID = true;
+  content.id0 = 0x81;
+  content.id1 = 0x82;
+  content.containsTempAndPower = true;
+  content.tempAndPower.tempC16 = (19 << 4) + 3;
+  content.occ = 3;
+  uint8_t buf[FullStatsMessageCore_MAX_BYTES_ON_WIRE_SECURE + 1];
+  const uint8_t *const msg = encodeFullStatsMessageCore(buf, sizeof(buf), stTXsecOnly, true, &content);
+  if(!getPrimaryBuildingKey(key)) { AssertIsTrue(NULL == msg); return; }
+  AssertIsTrue(NULL != msg);
+  AssertIsTrueWithErr(msg - buf == 4 + FullStatsMessageCore_SECURE_PACKED_BYTES(3) + 1, msg - buf);
+  AssertIsTrueWithErr((0xf4 | MESSAGING_FULL_STATS_HEADER_BITS_ID_HIGH) == buf[0], buf[0]);
+  AssertIsTrue(MESSAGING_FULL_STATS_IS_SECURE_HEADER(buf[0]));
+  AssertIsTrueWithErr(3 == buf[3], buf[3]); // Body length.
+  for(const uint8_t *p = buf + 1; p < msg; ++p) { AssertIsTrue(0 == (*p & 0x80)); } // Only the header has its msbit set.
+  AssertIsTrue(msg == decodeFullStatsMessageCore(buf, msg - buf, stTXalwaysAll, true, &decoded));
+  AssertIsTrue(decoded.containsID);
+  AssertIsTrueWithErr(0x81 == decoded.id0, decoded.id0);
+  AssertIsTrueWithErr(0x82 == decoded.id1, decoded.id1);
+  AssertIsTrue(decoded.containsTempAndPower);
+  AssertIsTrue(content.tempAndPower.tempC16 == decoded.tempAndPower.tempC16);
+  AssertIsTrueWithErr(3 == decoded.occ, decoded.occ); // Occupancy is sent on a secure channel.
+  // The same frame heard again (eg recorded and replayed) is rejected.
+  AssertIsTrue(NULL == decodeFullStatsMessageCore(buf, msg - buf, stTXalwaysAll, true, &decoded));
+  // Tampering with an authenticated byte (re-CRCed so only GCM can catch it) must be rejected.
+  buf[3 + 1 + 5] ^= 1;
+  uint8_t crc = MESSAGING_FULL_STATS_CRC_INIT;
+  for(const uint8_t *p = buf; p < msg - 1; ) { crc = OTRadioLink::crc7_5B_update(crc, *p++); }
+  buf[msg - buf - 1] = crc;
+  AssertIsTrue(NULL == decodeFullStatsMessageCore(buf, msg - buf, stTXalwaysAll, true, &decoded));
+  // Successive frames use different counters and so look different on air.
+  uint8_t buf2[sizeof(buf)];
+  AssertIsTrue(NULL != encodeFullStatsMessageCore(buf2, sizeof(buf2), stTXsecOnly, true, &content));
+  AssertIsTrue(0 != memcmp(buf + 4, buf2 + 4, FullStatsMessageCore_SECURE_COUNTER_BYTES + 1));
+  // Once a later frame is accepted an earlier one is rejected, though genuine and never heard before.
+  AssertIsTrue(msg == encodeFullStatsMessageCore(buf, sizeof(buf), stTXsecOnly, true, &content));
+  AssertIsTrue(msg == decodeFullStatsMessageCore(buf, msg - buf, stTXalwaysAll, true, &decoded));
+  AssertIsTrue(NULL == decodeFullStatsMessageCore(buf2, msg - buf, stTXalwaysAll, true, &decoded));
+#endif
+  }
+
+
+
+
+// Test the relayed (multi-record) stats frame carrying several nodes' full stats frames.
+static void testRelayStatsFrame()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("RelayStatsFrame");
+  // Two nodes' frames, back to back.
+  uint8_t records[2 * (FullStatsMessageCore_MAX_BYTES_ON_WIRE_NO_APL + 1)];
+  FullStatsMessageCore_t content;
+  clearFullStatsMessageCore(&content);
+  content.containsID = true;
+  content.id0 = 0x81;
+  content.id1 = 0x82;
+  content.containsTempAndPower = true;
+  content.tempAndPower.tempC16 = (18 << 4) + 5;
+  const uint8_t *const r1 = encodeFullStatsMessageCore(records, sizeof(records), stTXalwaysAll, false, &content);
+  AssertIsTrue(NULL != r1);
+  content.id0 = 0x12;
+  content.id1 = 0x34;
+  content.containsTempAndPower = false;
+  content.containsRHP = true;
+  content.rhp = 55;
+  const uint8_t *const r2 = encodeFullStatsMessageCore((uint8_t *)r1, sizeof(records) - (r1 - records), stTXalwaysAll, false, &content);
+  AssertIsTrue(NULL != r2);
+  const uint8_t recordBytes = r2 - records;
+#if defined(ENABLE_STATS_RELAY)
+  // Queue and build via the relay itself.
+  uint8_t drain[RELAY_STATS_MAX_FRAME_BYTES + 1];
+  writeRelayStatsFrame(drain, sizeof(drain)); // Discard anything already pending.
+  AssertIsTrue(0 == getRelayStatsPendingCount());
+  AssertIsTrue(queueStatsFrameForRelay(records, r1 - records));
+  AssertIsTrue(queueStatsFrameForRelay(r1, r2 - r1));
+  AssertIsTrue(2 == getRelayStatsPendingCount());
+  AssertIsTrue(!isRelayStatsFrameFull());
+  uint8_t buf[RELAY_STATS_MAX_FRAME_BYTES + 1];
+  AssertIsTrue(0 == writeRelayStatsFrame(buf, recordBytes + 3)); // No space for the 0xff.
+  AssertIsTrue(2 == getRelayStatsPendingCount()); // Nothing lost.
+  const uint8_t len = writeRelayStatsFrame(buf, sizeof(buf));
+  AssertIsTrueWithErr(recordBytes + 3 == len, len);
+  AssertIsTrue(0xff == buf[len]);
+  AssertIsTrue(0 == getRelayStatsPendingCount());
+  // Fill up: no more than RELAY_STATS_MAX_RECORDS records however small.
+  for(uint8_t i = 0; i < RELAY_STATS_MAX_RECORDS; ++i) { AssertIsTrue(queueStatsFrameForRelay(r1, r2 - r1)); }
+  AssertIsTrue(isRelayStatsFrameFull());
+  AssertIsTrue(!queueStatsFrameForRelay(r1, r2 - r1));
+  writeRelayStatsFrame(drain, sizeof(drain));
+#else
+  // Build by hand as a relay would.
+  uint8_t buf[RELAY_STATS_MAX_FRAME_BYTES + 1];
+  buf[0] = RELAY_STATS_HEADER_MSBS | 1; // 2 records.
+  buf[1] = recordBytes;
+  memcpy(buf + 2, records, recordBytes);
+  const uint8_t len = recordBytes + 3;
+  uint8_t crc = MESSAGING_FULL_STATS_CRC_INIT;
+  for(uint8_t i = 0; i < len - 1; ++i) { crc = OTRadioLink::crc7_5B_update(crc, buf[i]); }
+  buf[len - 1] = crc;
+  buf[len] = 0xff;
+#endif
+  AssertIsTrueWithErr(len == checkRelayStatsFrame(buf, len + 1), len);
+  AssertIsTrue(0 == checkRelayStatsFrame(buf, len - 1)); // Truncated.
+  for(uint8_t i = 0; i < len; ++i) { AssertIsTrue(0xff != buf[i]); }
+  // Each record decodes as sent.
+  const uint8_t *p = buf + 2;
+  p = decodeFullStatsMessageCore(p, buf + len - 1 - p, stTXalwaysAll, false, &content);
+  AssertIsTrue(NULL != p);
+  AssertIsTrue((0x81 == content.id0) && content.containsTempAndPower && !content.containsRHP);
+  p = decodeFullStatsMessageCore(p, buf + len - 1 - p, stTXalwaysAll, false, &content);
+  AssertIsTrue(buf + len - 1 == p);
+  AssertIsTrue((0x12 == content.id0) && (0x34 == content.id1) && content.containsRHP && (55 == content.rhp));
+  // Corruption is rejected.
+  buf[3] ^= 1;
+  AssertIsTrue(0 == checkRelayStatsFrame(buf, len));
   }
 
+#if defined(ALLOW_STATS_RX)
+// Test inbound stats queue ordering, content and overrun handling.
+static void testInboundStatsQueue()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("InboundStatsQueue");
+  FullStatsMessageCore_t stats;
+  char buf[MSG_JSON_MAX_EXPANDED_LENGTH+1];
+  // Start from an empty queue.
+  while(INBOUND_STATS_NONE != getNextInboundStats(&stats, buf)) { }
+  AssertIsEqual(0, getInboundStatsQueueDepth());
+  // Queue a core frame then a JSON frame and check that they come out in order intact.
+  FullStatsMessageCore_t content;
+  clearFullStatsMessageCore(&content);
+  content.id0 = 0x83;
+  content.id1 = 0x98;
+  content.containsID = true;
+  content.ambL = 42;
+  content.containsAmbL = true;
+  recordCoreStats(false, &content);
+  recordJSONStats(false, "{\"@\":\"cdfb\",\"T|C16\":299}");
+  AssertIsTrue(getInboundStatsQueueHighWaterMark() >= getInboundStatsQueueDepth());
+  AssertIsEqual(INBOUND_STATS_CORE, getNextInboundStats(&stats, buf));
+  AssertIsTrue(stats.containsID);
+  AssertIsEqual(0x83, stats.id0);
+  AssertIsEqual(0x98, stats.id1);
+  AssertIsEqual(42, stats.ambL);
+  AssertIsEqual(INBOUND_STATS_JSON, getNextInboundStats(&stats, buf));
+  AssertIsTrue(0 == strcmp(buf, "{\"@\":\"cdfb\",\"T|C16\":299}"));
+  AssertIsEqual(INBOUND_STATS_NONE, getNextInboundStats(&stats, buf));
+  // Overfill the queue (wrapping round the end) and check that drops are counted and nothing is corrupted.
+  const uint16_t droppedBefore = getInboundStatsQueueOverrun();
+  const uint8_t n = (INBOUND_STATS_QUEUE_SIZE / (sizeof(FullStatsMessageCore_t) + 1)) + 2;
+  for(uint8_t i = 0; i < n; ++i) { content.id1 = 0x80 + i; recordCoreStats(false, &content); }
+  AssertIsTrue(getInboundStatsQueueOverrun() > droppedBefore);
+  for(uint8_t i = 0; INBOUND_STATS_NONE != getNextInboundStats(&stats, buf); ++i)
+    { AssertIsEqual(0x80 + i, stats.id1); }
+  AssertIsEqual(0, getInboundStatsQueueDepth());
+  }
 
+// Test suppression of repeated inbound frames.
+static void testRXDedup()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("RXDedup");
+  const uint16_t before = getRXDuplicatesSuppressed();
+  // First sight of a frame is accepted, an immediate repeat is dropped and counted.
+  AssertIsTrue(!isRecentDuplicateRXFrame(0xf1, 0xe2, 0x33));
+  AssertIsTrue(isRecentDuplicateRXFrame(0xf1, 0xe2, 0x33));
+  AssertIsEqual(before + 1, getRXDuplicatesSuppressed());
+  // A different CRC or sender is a different frame.
+  AssertIsTrue(!isRecentDuplicateRXFrame(0xf1, 0xe2, 0x34));
+  AssertIsTrue(!isRecentDuplicateRXFrame(0xf1, 0xe3, 0x33));
+  AssertIsTrue(isRecentDuplicateRXFrame(0xf1, 0xe2, 0x33));
+  // Once pushed out of the table by enough other frames the original is accepted again.
+  for(uint8_t i = 0; i < RX_DEDUP_TABLE_SIZE; ++i) { AssertIsTrue(!isRecentDuplicateRXFrame(0xf2, i, 0x33)); }
+  AssertIsTrue(!isRecentDuplicateRXFrame(0xf1, 0xe2, 0x33));
+  AssertIsEqual(before + 2, getRXDuplicatesSuppressed());
+  // A (delayed) relayed record is dropped as stale if its sender was heard directly recently, even with different content.
+  AssertIsTrue(isRecentDuplicateRelayedRXFrame(0xf1, 0xe2, 0x35));
+  // Else it is accepted once, and further relayed records from that sender are judged on content.
+  AssertIsTrue(!isRecentDuplicateRelayedRXFrame(0xf4, 0xe5, 0x36));
+  AssertIsTrue(isRecentDuplicateRelayedRXFrame(0xf4, 0xe5, 0x36));
+  AssertIsTrue(!isRecentDuplicateRelayedRXFrame(0xf4, 0xe5, 0x37));
+  // A direct frame is not suppressed by a relayed record with different content.
+  AssertIsTrue(!isRecentDuplicateRXFrame(0xf4, 0xe5, 0x38));
+  AssertIsEqual(before + 4, getRXDuplicatesSuppressed());
+  // With every expected sender heard directly and relayed (of any format) the direct frames are all still remembered,
+  // so late relayed copies of them are all dropped.
+  for(uint8_t i = 0; i < RX_DEDUP_EXPECTED_SENDERS; ++i) { AssertIsTrue(!isRecentDuplicateRXFrame(0xf6, i, 0x40 + i)); }
+  for(uint8_t i = 0; i < RX_DEDUP_EXPECTED_SENDERS; ++i) { AssertIsTrue(!isRecentDuplicateRelayedRXFrame(0xf7, i, 0x39)); }
+  for(uint8_t i = 0; i < RX_DEDUP_EXPECTED_SENDERS; ++i) { AssertIsTrue(isRecentDuplicateRelayedRXFrame(0xf6, i, 0x40 + i)); }
+  AssertIsEqual(before + 4 + RX_DEDUP_EXPECTED_SENDERS, getRXDuplicatesSuppressed());
+  }
 
+// Test that link quality counts frames missed from sequence gaps but not repeats or unsequenced frames.
+static void testLinkQualitySeq()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("LinkQualitySeq");
+  LinkQuality_t lq;
+  recordLinkQuality(0xf3, 0xe4, 100, 14);
+  recordLinkQuality(0xf3, 0xe4, 100, 14); // Repeat.
+  recordLinkQuality(0xf3, 0xe4, 100, 15);
+  recordLinkQuality(0xf3, 0xe4, 100, LINK_QUALITY_NO_SEQ);
+  AssertIsTrue(getLinkQuality(0, &lq));
+  AssertIsTrue((0xf3 == lq.id0) && (0xe4 == lq.id1));
+  AssertIsEqual(0, lq.framesMissed);
+  // Sequence wraps from 15 to 0; skipping 0 and 1 loses two frames.
+  recordLinkQuality(0xf3, 0xe4, 100, 2);
+  AssertIsTrue(getLinkQuality(0, &lq));
+  AssertIsEqual(2, lq.framesMissed);
+  AssertIsTrue(!linkHasMargin(0xf3, 0xe4));
+  }
+#endif
 
 
 
@@ -1432,6 +2496,39 @@ static void testSmoothStatsValue()
   for(int i = 256; --i >= 0; ) { AssertIsTrue((uint8_t)i == smoothStatsValue((uint8_t)i, (uint8_t)i)); }
   }
 
+// Test day-of-week calculation and the weekly profile encoding.
+static void testWeeklyProfile()
+  {
+  DEBUG_SERIAL_PRINTLN_FLASHSTRING("WeeklyProfile");
+  AssertIsEqual(5, dayOfWeekFromDays(0)); // 2000/01/01 was a Saturday.
+  AssertIsEqual(0, dayOfWeekFromDays(2)); // 2000/01/03 was a Monday.
+  AssertIsEqual(3, dayOfWeekFromDays(5479)); // 2015/01/01 was a Thursday.
+  AssertIsTrue(getHourOfWeekLT() < EE_WEEK_PROFILE_SIZE);
+  AssertIsTrue(getHourOfWeekAheadLT(0) == getHourOfWeekLT());
+  AssertIsTrue(getHourOfWeekAheadLT(7 * 24 * 60U) == getHourOfWeekLT()); // Wraps at the end of the week.
+  // The first sample moves occupancy halfway from the middle level and sets the WARM history outright,
+  // and never produces an unset byte or nybble.
+  AssertIsEqual(0xb7, updateWeeklyProfileByte(0xff, 100, true));
+  AssertIsEqual(0x30, updateWeeklyProfileByte(0xff, 0, false));
+  AssertIsEqual(0xf0, updateWeeklyProfileByte(0xff, STATS_UNSET_BYTE, false)); // No occupancy data.
+  // A single vacant sample does not make an hour usually vacant (level <= 1), but a second does.
+  AssertIsTrue((updateWeeklyProfileByte(0xff, 0, false) >> 4) > 1);
+  AssertIsTrue((updateWeeklyProfileByte(updateWeeklyProfileByte(0xff, 0, false), 0, false) >> 4) <= 1);
+  // Successive vacant weeks at an hour once occupied become usually vacant (level <= 1) by the third.
+  uint8_t b = 0xe7;
+  b = updateWeeklyProfileByte(b, 0, false);
+  AssertIsEqual(0x73, b);
+  b = updateWeeklyProfileByte(b, 0, false);
+  AssertIsEqual(0x31, b);
+  b = updateWeeklyProfileByte(b, 0, false);
+  AssertIsEqual(0x10, b);
+  b = updateWeeklyProfileByte(b, 0, false);
+  AssertIsEqual(0x00, b);
+  // A steady pattern reaches a steady byte, so needs no further EEPROM writes.
+  AssertIsEqual(b, updateWeeklyProfileByte(b, 0, false));
+  AssertIsEqual(0xe7, updateWeeklyProfileByte(0xe7, 100, true));
+  }
+
 // Test for expected behaviour of RNG8 PRNG starting from a known state.
 static void testRNG8()
   {
@@ -1571,18 +2668,38 @@ void loopUnitTest()
     }
   serialPrintlnAndFlush();
 
+#if defined(BENCHMARK_JSON_STATS) && defined(ALLOW_JSON_OUTPUT)
+  // Benchmark once only, outside the repeated tests.
+  if(0 == loopCount) { benchmarkJSONStats(); }
+#endif
 
   // Run the tests, fastest / newest / most-fragile / most-interesting first...
   testLibVersions();
   testCurrentSenseValveMotorDirect();
   testComputeRequiredTRVPercentOpen();
+  testModelledRadValveFilter();
+  testMovementBudgetPressure();
+  testLearnedRoomRates();
+#ifdef OCCUPANCY_SUPPORT
+  testOccupancyEstimator();
+#endif
   testFastDigitalIOCalcs();
   testTargetComputation();
+  testTargetTempCache();
   testSensorMocking();
   testModeControls();
   testJSONStats();
+  testManagedStats();
   testJSONForTX();
+  testStatsTLV();
   testFullStatsMessageCoreEncDec();
+  testAESGCM();
+  testRelayStatsFrame();
+#if defined(ALLOW_STATS_RX)
+  testInboundStatsQueue();
+  testRXDedup();
+  testLinkQualitySeq();
+#endif
 //  testCRC();
   testTempCompand();
   testRNG8();
@@ -1590,7 +2707,9 @@ void loopUnitTest()
   testRTCPersist();
   testEEPROM();
   testQuartiles();
+  testQuartileIndex();
   testSmoothStatsValue();
+  testWeeklyProfile();
   testSleepUntilSubCycleTime();
   testFHTEncoding();
   testFHTEncodingHeadAndTail();
@@ -1599,6 +2718,9 @@ void loopUnitTest()
 #ifdef ENABLE_BOILER_HUB
   testOnOffBoilerDriverLogic();
 #endif
+#if defined(ENABLE_ZONE_COORDINATOR)
+  testZoneCoordinator();
+#endif
 
   // Sensor tests.
   // May need to be disabled if, for example, running in a simulator or on a partial board.
@@ -1608,6 +2730,9 @@ void loopUnitTest()
   testInternalTempSensor();
   testSupplyVoltageMonitor();
 #endif
+#if !defined(DISABLE_SENSOR_UNIT_TESTS) && defined(RFM22_NATIVE_PACKET_HANDLER)
+  testRFM22RawProfileForValveTX();
+#endif
 
 
   // Announce successful loop completion and count.
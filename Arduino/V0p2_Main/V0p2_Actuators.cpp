@@ -31,6 +31,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2014--2015
 #include "V0p2_Board_IO_Config.h" // I/O pin allocation: include ahead of I/O module headers.
 #include "V0p2_Actuators.h" // I/O code access.
 
+#include "EEPROM_Utils.h"
 #include "Serial_IO.h"
 #include "Power_Management.h"
 
@@ -239,13 +240,34 @@ void OnOffBoilerDriverLogic::setThresholds(const uint8_t minIndividual, const ui
   minAggregatePC = constrain(minAggregate, minIndividual, 100);
   }
 
+// Select time-proportional (TPI) mode with the given period in ticks, or plain on/off mode with 0.
+// A non-zero period is stretched to at least twice the minimum ticks in either state
+// so that there is always room for a minimum on and a minimum off spell.
+// The current period is restarted only if the period changes.
+void OnOffBoilerDriverLogic::setTPIMode(const uint16_t periodTicks, const uint16_t fullDemandPC)
+  {
+  const uint16_t p = (0 == periodTicks) ? 0 : fnmax(periodTicks, (uint16_t)(2U * minTicksInEitherState));
+  if(p != tpiPeriodTicks) { tpiPeriodTicks = p; tpiTick = 0; tpiOnTicks = 0; }
+  tpiFullDemandPC = fnmax(fullDemandPC, (uint16_t)1);
+  }
+
+#if defined(BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY)
+// Add an ID to the authorised list; returns false if the ID is invalid or the list is full.
+// Once any ID is authorised, signals from all other IDs are ignored.
+bool OnOffBoilerDriverLogic::authoriseID(const uint16_t id)
+  {
+  if(badID == id) { return(false); }
+  for(uint8_t i = 0; i < authedCount; ++i) { if(id == authedIDs[i]) { return(true); } } // Already present.
+  if(authedCount >= maxRadiators) { return(false); }
+  authedIDs[authedCount++] = id;
+  return(true);
+  }
+#endif
+
 // Called upon incoming notification of status or call for heat from given (valid) ID.
-// ISR-/thread- safe to allow for interrupt-driven comms, and as quick as possible.
-// Returns false if the signal is rejected, eg from an unauthorised ID.
-// The basic behaviour is that a signal with sufficient percent open
-// is good for 2 minutes (120s, 60 ticks) unless explicitly cancelled earler,
-// for all valve types including FS20/FHT8V-style.
-// That may be slightly adjusted for IDs that indicate FS20 housecodes, etc.
+// ISR-/thread- safe to allow for interrupt-driven comms, and as quick as possible:
+// O(1) whatever maxRadiators, as the signal is only queued here for the next tick2s() to apply.
+// Returns false if the signal is rejected, eg a bad ID or too many signals since the last tick2s().
 //   * id  is the two-byte ID or house code; 0xffffu is never valid
 //   * percentOpen  percentage open that the remote valve is reporting
 bool OnOffBoilerDriverLogic::receiveSignal(const uint16_t id, const uint8_t percentOpen)
@@ -257,45 +279,80 @@ bool OnOffBoilerDriverLogic::receiveSignal(const uint16_t id, const uint8_t perc
   // Under lock to be ISR-safe.
   ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
     {
-#if defined(BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY)
-    // Reject unrecognised IDs if any in the auth list with false return.
-    if(badID != authedIDs[0])
+    const uint8_t next = (signalHead + 1) & (BOILER_HUB_SIGNAL_QUEUE - 1);
+    if(next != signalTail) // Else queue full: drop (and count) the signal; the valve will repeat it.
       {
-        // TODO
+      volatile QueuedSignal &q = signals[signalHead];
+      q.id = id;
+      q.percentOpen = percentOpen;
+      signalHead = next;
+      accepted = true;
       }
-#endif
+    else if(signalOverruns < 255) { ++signalOverruns; }
+    }
+
+  return(accepted);
+  }
 
+// Ticks for which a signal is good: 2 minutes,
+// or as long as possible (~4 minutes, ~2 TX cycles) for FS20/FHT8V house codes (each byte [0,99])
+// since those valves only TX about every 2 minutes so one lost frame should not drop a call for heat.
+static int8_t signalLifetimeTicks(const uint16_t id)
+  { return((((id >> 8) <= 99) && ((id & 0xff) <= 99)) ? 127 : 60); }
 
+// Apply one signal from the queue to status[], inserting, updating or evicting as needed.
 // Find current entry in list if present and update,
 // else extend list if possible,
-// or replace 0 entry if available to make space,
-// or replace lower/lowest entry if this passed 'individual' threshold,
+// or replace an entry not calling for heat if available to make space (longest-expired first),
+// or replace the lowest entry if this passed 'individual' threshold and is higher,
 // else reject update.
+void OnOffBoilerDriverLogic::applySignal(const uint16_t id, const uint8_t percentOpen)
+  {
+#if defined(BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY)
+  // Ignore unrecognised IDs if any in the auth list.
+  if(0 != authedCount)
+    {
+    bool authed = false;
+    for(uint8_t i = 0; i < authedCount; ++i) { if(id == authedIDs[i]) { authed = true; break; } }
+    if(!authed) { return; }
+    }
+#endif
 
-    // Find entry for current ID if present or create one at end if space,
-    // but note in passing lowest % lower than current signal in case above not possible.
-
-
+  // Find entry for current ID if present,
+  // noting in passing the best eviction candidates in case there is no space for a new entry.
+  PerIDStatus *idle = NULL; // Longest-expired/quiet entry not calling for heat.
+  PerIDStatus *lowest = NULL; // Live entry with the lowest percent open.
+  for(PerIDStatus *p = status; p < status+statusCount; ++p)
+    {
+    if(id == p->id) { idle = p; lowest = NULL; break; }
+    if((p->ticksUntilOff < 0) || (p->percentOpen < minIndividualPC))
+      { if((NULL == idle) || (p->ticksUntilOff < idle->ticksUntilOff)) { idle = p; } }
+    else if((NULL == lowest) || (p->percentOpen < lowest->percentOpen)) { lowest = p; }
     }
 
-  return(accepted);
+  PerIDStatus *slot;
+  if((NULL != idle) && (id == idle->id)) { slot = idle; } // Update extant entry.
+  else if(statusCount < maxRadiators) { slot = status + statusCount++; } // Extend list.
+  else if(NULL != idle) { slot = idle; } // Evict quiet/expired entry.
+  else if((percentOpen >= minIndividualPC) && (NULL != lowest) && (lowest->percentOpen < percentOpen)) { slot = lowest; } // Evict weakest call.
+  else { return; } // No room.
+
+  slot->id = id;
+  slot->percentOpen = percentOpen;
+  slot->ticksUntilOff = signalLifetimeTicks(id);
   }
 
 #if defined(OnOffBoilerDriverLogic_CLEANUP)
 // Do some incremental clean-up to speed up future operations.
 // Aim to free up at least one status slot if possible.
+// Kills off entries that have been quiet for as long as can be tracked,
+// moving the last entry into each hole to keep the list compact.
 void OnOffBoilerDriverLogic::cleanup()
   {
-  // Swap more-recently-heard-from items towards lower indexes.
-  // Kill off trailing old entries.
-  // Don't necessarily run on every tick:
-  // possibly only run when something actually expires or when out of space.
-  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+  for(uint8_t i = 0; i < statusCount; )
     {
-    if(badID != status[0].id)
-      {
-      // TODO
-      }
+    if(status[i].ticksUntilOff > -128) { ++i; continue; }
+    status[i] = status[--statusCount];
     }
   }
 #endif
@@ -310,17 +367,14 @@ void OnOffBoilerDriverLogic::cleanup()
 uint8_t OnOffBoilerDriverLogic::valvesStatus(PerIDStatus valves[], const uint8_t size, const bool onlyLiveAndCallingForHeat) const
   {
   uint8_t result = 0;
-  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+  for(const PerIDStatus *p = status; p < status+statusCount; ++p)
     {
-    for(volatile const PerIDStatus *p = status; (p < status+maxRadiators) && (badID != p->id); ++p)
-      {
-      // Stop if retun array full.
-      if(result >= size) { break; }
-      // Skip if filtering and current item not of interest.
-      if(onlyLiveAndCallingForHeat && ((p->ticksUntilOff < 0) || (p->percentOpen < minIndividualPC))) { continue; }
-      // Copy data into result array and increment count.
-      valves[result++] = *(PerIDStatus *)p;
-      }
+    // Stop if retun array full.
+    if(result >= size) { break; }
+    // Skip if filtering and current item not of interest.
+    if(onlyLiveAndCallingForHeat && ((p->ticksUntilOff < 0) || (p->percentOpen < minIndividualPC))) { continue; }
+    // Copy data into result array and increment count.
+    valves[result++] = *p;
     }
   return(result);
   }
@@ -334,6 +388,26 @@ uint8_t OnOffBoilerDriverLogic::valvesStatus(PerIDStatus valves[], const uint8_t
 // and no use of wall-clack time is made within this or sibling class methods.
 void OnOffBoilerDriverLogic::tick2s()
   {
+  // Apply all signals queued since the last tick,
+  // holding the lock only long enough to take each one from the queue.
+  for( ; ; )
+    {
+    uint16_t id = badID;
+    uint8_t percentOpen = 0;
+    ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+      {
+      if(signalTail != signalHead)
+        {
+        volatile const QueuedSignal &q = signals[signalTail];
+        id = q.id;
+        percentOpen = q.percentOpen;
+        signalTail = (signalTail + 1) & (BOILER_HUB_SIGNAL_QUEUE - 1);
+        }
+      }
+    if(badID == id) { break; } // Queue empty.
+    applySignal(id, percentOpen);
+    }
+
   bool doCleanup = false;
 
   // If individual and aggregate limits are passed by set of IDs (and minimumTicksUntilOn is zero)
@@ -341,31 +415,47 @@ void OnOffBoilerDriverLogic::tick2s()
   // Such change of state may be prevented/delayed by duty-cycle limits.
   //
   // Adjust all expiry timers too.
-  //
-  // Be careful not to lock out interrupts (ie hold the lock) too long.
+  // (status[] is not touched by ISRs so this needs no lock.)
 
   // Set true if at least one valve has met/passed the individual % threshold to be considered calling for heat.
   bool atLeastOneValceCallingForHeat = false;
-  // Partial cumulative percent open (stops accumulating once threshold has been passed).
-  uint8_t partialCumulativePC = 0;
-  ATOMIC_BLOCK (ATOMIC_RESTORESTATE)
+  // Cumulative percent open of all live entries.
+  uint16_t cumulativePC = 0;
+  for(PerIDStatus *p = status; p < status+statusCount; ++p)
     {
-    for(volatile PerIDStatus *p = status; (p < status+maxRadiators) && (badID != p->id); ++p)
-      {
-      // Decrement time-until-expiry until lower limit is reached, at which point call for a cleanup!
-      volatile int8_t &t = p->ticksUntilOff;
-      if(t > -128) { --t; } else { doCleanup = true; continue; }
-      // Ignore stale entries for boiler-state calculation.
-      if(t < 0) { continue; }
-      // Check if at least one valve is really open.
-      if(!atLeastOneValceCallingForHeat && (p->percentOpen >= minIndividualPC)) { atLeastOneValceCallingForHeat = true; }
-      // Check if aggregate limits are being reached.
-      if(partialCumulativePC < minAggregatePC) { partialCumulativePC += p->percentOpen; }
-      }
+    // Decrement time-until-expiry until lower limit is reached, at which point call for a cleanup!
+    int8_t &t = p->ticksUntilOff;
+    if(t > -128) { --t; } else { doCleanup = true; continue; }
+    // Ignore stale entries for boiler-state calculation.
+    if(t < 0) { continue; }
+    // Check if at least one valve is really open.
+    if(!atLeastOneValceCallingForHeat && (p->percentOpen >= minIndividualPC)) { atLeastOneValceCallingForHeat = true; }
+    // Accumulate aggregate demand.
+    cumulativePC += p->percentOpen;
     }
   // Compute desired boiler state unconstrained by duty-cycle limits.
   // Boiler should be on if both individual and aggregate limits are met.
-  const bool desiredBoilerState = atLeastOneValceCallingForHeat && (partialCumulativePC >= minAggregatePC);
+  bool desiredBoilerState = atLeastOneValceCallingForHeat && (cumulativePC >= minAggregatePC);
+  aggregatePC = cumulativePC;
+
+  // In TPI mode instead call for heat for a fraction of each period in proportion to aggregate demand.
+  if(0 != tpiPeriodTicks)
+    {
+    if(0 == tpiTick)
+      {
+      // Set the on time for this period, rounding spells too short to be worthwhile to none or all,
+      // and leaving the boiler off for marginal aggregate demand as in on/off mode.
+      uint16_t on = (!atLeastOneValceCallingForHeat || (cumulativePC < minAggregatePC)) ? 0 :
+          ((cumulativePC >= tpiFullDemandPC) ? tpiPeriodTicks : (uint16_t)(((uint32_t)tpiPeriodTicks * cumulativePC) / tpiFullDemandPC));
+      if(on < minTicksInEitherState) { on = (on >= minTicksInEitherState/2) ? fnmin((uint16_t)minTicksInEitherState, tpiPeriodTicks) : 0; }
+      if((0 != on) && (tpiPeriodTicks - on < minTicksInEitherState)) { on = tpiPeriodTicks; }
+      tpiOnTicks = on;
+      }
+    // Cut the on spell short if all demand has gone away (subject to the minimum on time below).
+    if(!atLeastOneValceCallingForHeat && (tpiTick < tpiOnTicks)) { tpiOnTicks = tpiTick; }
+    desiredBoilerState = (tpiTick < tpiOnTicks);
+    if(++tpiTick >= tpiPeriodTicks) { tpiTick = 0; }
+    }
 
 #if defined(OnOffBoilerDriverLogic_CLEANUP)
   if(doCleanup) { cleanup(); }
@@ -385,13 +475,76 @@ void OnOffBoilerDriverLogic::tick2s()
   ticksInCurrentState = 0;
   }
 
+// Regular poll/update; value is 100 while calling for heat, else 0.
 uint8_t BoilerDriver::read()
    {
    logic.tick2s();
-   value = (logic.isCallingForHeat()) ? 0 : 100;
+   value = (logic.isCallingForHeat()) ? 100 : 0;
    return(value);
    }
 
+#if defined(BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY)
+// Reload the authorised IDs from the hub house code filter in EEPROM, each entry hc1 then hc2.
+// Unused (0xff) entries are skipped, and if none are set then signals from all IDs are accepted.
+void BoilerDriver::loadAuthorisedIDs()
+  {
+  logic.clearAuthorisedIDs();
+  for(uint8_t i = 0; i < EE_HUB_HC_FILTER_COUNT; ++i)
+    {
+    const uint8_t *const p = (const uint8_t *)(EE_START_HUB_HC_FILTER + 2*i);
+    const uint16_t id = (((uint16_t)eeprom_read_byte(p)) << 8) | eeprom_read_byte(p+1);
+    logic.authoriseID(id); // Ignores unused entries.
+    }
+  }
+#endif
+
+#if defined(ENABLE_BOILER_DRIVER_LOGIC)
+// Singleton implementation/instance.
+BoilerDriver BoilerControl;
+#endif
+
+#if defined(ENABLE_ZONE_COORDINATOR)
+// Get the stagger slot [0,staggerSlots-1] for the given stats sender ID, noting that it has been heard from.
+// Finds the extant entry if present,
+// else extends the list if possible,
+// or replaces the longest-quiet entry if forgotten,
+// and gives a new entry the least-used slot (lowest first on a tie);
+// else falls back to a slot hashed from the ID.
+uint8_t ZoneCoordinator::getStaggerSlot(const uint16_t id)
+  {
+  Zone *forgotten = NULL; // Longest-quiet entry not heard from for forgetH hours.
+  for(Zone *p = zones; p < zones+zoneCount; ++p)
+    {
+    if(id == p->id) { p->quietH = 0; return(p->slot); }
+    if((p->quietH >= forgetH) && ((NULL == forgotten) || (p->quietH > forgotten->quietH))) { forgotten = p; }
+    }
+
+  Zone *z;
+  if(zoneCount < maxZones) { z = zones + zoneCount++; }
+  else if(NULL != forgotten) { z = forgotten; }
+  else { return(((id >> 8) ^ id) & (staggerSlots - 1)); } // No room: stable but possibly shared.
+
+  // Count slots in use by other zones and pick the least used.
+  uint8_t used[staggerSlots] = { 0 };
+  for(const Zone *p = zones; p < zones+zoneCount; ++p) { if((p != z) && (used[p->slot] < 0xff)) { ++used[p->slot]; } }
+  uint8_t slot = 0;
+  for(uint8_t i = 1; i < staggerSlots; ++i) { if(used[i] < used[slot]) { slot = i; } }
+
+  z->id = id;
+  z->slot = slot;
+  z->quietH = 0;
+  return(slot);
+  }
+
+// Call once per minute in real/virtual time to age zones not heard from.
+void ZoneCoordinator::tickMinute()
+  {
+  if(++minutes < 60) { return; }
+  minutes = 0;
+  for(Zone *p = zones; p < zones+zoneCount; ++p) { if(p->quietH < 0xff) { ++p->quietH; } }
+  }
+
 // Singleton implementation/instance.
-extern BoilerDriver BoilerControl;
+ZoneCoordinator Zones;
+#endif
 #endif
@@ -278,20 +278,48 @@ extern ValveMotorDirectV1 ValveDirect;
 
 
 #if defined(ENABLE_BOILER_HUB)
+// Maximum distinct radiators tracked by the boiler hub logic; [1,64].
+// Each costs 4 bytes of RAM, plus 2 more with BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY.
+// May be overridden in the configuration for large buildings.
+#ifndef BOILER_HUB_MAX_RADIATORS
+#define BOILER_HUB_MAX_RADIATORS 8
+#endif
+#if (BOILER_HUB_MAX_RADIATORS < 1) || (BOILER_HUB_MAX_RADIATORS > 64)
+#error BOILER_HUB_MAX_RADIATORS must be in range [1,64]
+#endif
+// Always build the authorised-ID filter for unit tests.
+#if defined(UNIT_TESTS) && !defined(BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY)
+#define BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY
+#endif
+// Drop entries from the boiler hub logic once quiet for as long as can be tracked, to keep its scans short.
+#define OnOffBoilerDriverLogic_CLEANUP
+// Size of the queue of incoming signals held between tick2s() calls, which holds one fewer than this; a power of two.
+// Even 64 radiators each signalling every ~2 minutes average only about one signal per tick,
+// but several may report in the same tick, eg just after a common schedule time,
+// so there is room for one from every radiator, up to 31 (each slot costs 3 bytes of RAM).
+// Any signals dropped for lack of space are counted (see getSignalOverruns()).
+#if BOILER_HUB_MAX_RADIATORS < 4
+#define BOILER_HUB_SIGNAL_QUEUE 4
+#elif BOILER_HUB_MAX_RADIATORS < 8
+#define BOILER_HUB_SIGNAL_QUEUE 8
+#elif BOILER_HUB_MAX_RADIATORS < 16
+#define BOILER_HUB_SIGNAL_QUEUE 16
+#else
+#define BOILER_HUB_SIGNAL_QUEUE 32
+#endif
+
 // Internal logic for simple on/off boiler output, fully testable.
 class OnOffBoilerDriverLogic
   {
   public:
-    // MAximum distinct radiators tracked by this system.
-    // The algorithms uses will assume that this is a smallish number,
-    // and may work best of a power of two.
-    // Reasonable candidiates are 8 or 16.
-    static const uint8_t maxRadiators = 8;
+    // Maximum distinct radiators tracked by this system.
+    // Set with BOILER_HUB_MAX_RADIATORS.
+    static const uint8_t maxRadiators = BOILER_HUB_MAX_RADIATORS;
 
     // Per-radiator data status.
     struct PerIDStatus
       {
-      // ID of remote device; an empty slot is marked with the (invalid) ID of 0xffffu.
+      // ID of remote device.
       uint16_t id;
       // Ticks until we expect new update from given valve else its data has expired when non-negative.
       // A zero or negative value means no active call for heat from the matching ID.
@@ -326,23 +354,47 @@ class OnOffBoilerDriverLogic
     // Minimum aggreate valve percentage to be considered open, no lower than minIndividualPC; [1,100].
     uint8_t minAggregatePC;
 
+    // Sum of percent open of all live valves as of the last tick2s().
+    uint16_t aggregatePC;
+
+    // Time-proportional (TPI) mode period in ticks, or 0 for plain on/off mode (the default).
+    uint16_t tpiPeriodTicks;
+    // Ticks into the current TPI period; [0,tpiPeriodTicks-1].
+    uint16_t tpiTick;
+    // Ticks to call for heat from the start of the current TPI period.
+    uint16_t tpiOnTicks;
+    // Aggregate valve percentage open at and above which TPI mode calls for heat for the whole period.
+    uint16_t tpiFullDemandPC;
+
     // 'Bad' (never valid as housecode or OpenTRV code) ID.
     static const uint16_t badID = 0xffffu;
 
 #if defined(BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY)
-    // List of authorised IDs.
-    // Entries beyond the last valid authorised ID are set to 0xffffu (never a valid ID);
-    // if there are none then [0] is set to 0xffffu.
+    // List of authorised IDs, the first authedCount entries valid.
     // If no authorised IDs then no authorisation is done and alls IDs are accepted
     // and kicked out expiry-first if there is a shortage of slots.
     uint16_t authedIDs[maxRadiators];
+    uint8_t authedCount;
 #endif
 
-    // List of recently-heard IDs and ticks until their last call for heat will expire (matched by index).
-    // If there any authorised IDs then only such IDs are admitted to the list.
-    // The first empty empty slot is marked with the (invalid) ID of 0xffffu.
+    // Signals received (possibly in an ISR) and not yet applied to status[] by tick2s().
+    // Circular buffer: receiveSignal() adds at signalHead and tick2s() removes from signalTail; empty when equal.
     // Marked volatile since may be updated by ISR.
-    volatile PerIDStatus status[maxRadiators];
+    struct QueuedSignal { uint16_t id; uint8_t percentOpen; };
+    volatile QueuedSignal signals[BOILER_HUB_SIGNAL_QUEUE];
+    volatile uint8_t signalHead;
+    volatile uint8_t signalTail;
+    // Count of signals dropped because the queue was full; saturates at 255.
+    volatile uint8_t signalOverruns;
+
+    // List of recently-heard IDs and ticks until their last call for heat will expire, the first statusCount entries valid.
+    // If there any authorised IDs then only such IDs are admitted to the list.
+    // Only accessed from tick2s() and other non-ISR routines, so needs no lock.
+    PerIDStatus status[maxRadiators];
+    uint8_t statusCount;
+
+    // Apply one signal from the queue to status[], inserting, updating or evicting as needed.
+    void applySignal(uint16_t id, uint8_t percentOpen);
 
 #if defined(OnOffBoilerDriverLogic_CLEANUP)
     // Do some incremental clean-up to speed up future operations.
@@ -351,13 +403,13 @@ class OnOffBoilerDriverLogic
 #endif
 
   public:
-    OnOffBoilerDriverLogic() : callForHeat(false), ticksInCurrentState(0), minTicksInEitherState(60), minIndividualPC(DEFAULT_MIN_VALVE_PC_REALLY_OPEN), minAggregatePC(DEFAULT_VALVE_PC_MODERATELY_OPEN)
-      {
+    OnOffBoilerDriverLogic() : callForHeat(false), ticksInCurrentState(0), minTicksInEitherState(60), minIndividualPC(DEFAULT_MIN_VALVE_PC_REALLY_OPEN), minAggregatePC(DEFAULT_VALVE_PC_MODERATELY_OPEN), aggregatePC(0),
+        tpiPeriodTicks(0), tpiTick(0), tpiOnTicks(0), tpiFullDemandPC(100),
 #if defined(BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY)
-      authedIDs[0] = badID;
+        authedCount(0),
 #endif
-      status[0].id = badID;
-      }
+        signalHead(0), signalTail(0), signalOverruns(0), statusCount(0)
+      { }
 
     // Set thresholds for per-value and minimum-aggregate percentages to fire the boiler.
     // Coerces values to be valid:
@@ -368,9 +420,35 @@ class OnOffBoilerDriverLogic
     // Typically the equivalent of 2--10 minutes (eg ~2+ for gas, ~8 for oil).
     void setMinTicksInEitherState(uint8_t minTicks) { minTicksInEitherState = minTicks; }
 
+    // Select time-proportional (TPI) mode with the given period in ticks, or plain on/off mode with 0 (the default).
+    // Eg 300 ticks gives 6 cycles per hour.
+    // In TPI mode, at the start of each period, the sum of live valves' percent open sets
+    // the fraction of the period for which to call for heat, all of it at fullDemandPC and above,
+    // so long as at least one valve passes the individual threshold
+    // and the aggregate passes the minimum-aggregate threshold, so marginal demand leaves the boiler off.
+    // On or off spells shorter than the minimum ticks in either state are rounded away.
+    // A non-zero period is stretched to at least twice the minimum ticks in either state,
+    // so set that minimum first.
+    // The current period is restarted only if the period changes, so this may be called repeatedly.
+    void setTPIMode(uint16_t periodTicks, uint16_t fullDemandPC = 100);
+
+    // True if in time-proportional (TPI) mode.
+    bool isTPIMode() const { return(0 != tpiPeriodTicks); }
+
+#if defined(BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY)
+    // Add an ID to the authorised list; returns false if the ID is invalid or the list is full.
+    // Once any ID is authorised, signals from all other IDs are ignored.
+    // Not to be called from ISRs.
+    bool authoriseID(uint16_t id);
+    // Clear the authorised list so that all IDs are accepted again.
+    void clearAuthorisedIDs() { authedCount = 0; }
+#endif
+
     // Called upon incoming notification of status or call for heat from given (valid) ID.
-    // ISR-/thread- safe to allow for interrupt-driven comms, and as quick as possible.
-    // Returns false if the signal is rejected, eg from an unauthorised ID.
+    // ISR-/thread- safe to allow for interrupt-driven comms, and as quick as possible:
+    // O(1) whatever maxRadiators, as the signal is only queued here for the next tick2s() to apply.
+    // Returns false if the signal is rejected, eg a bad ID or too many signals since the last tick2s();
+    // a signal from an unauthorised ID is accepted here but then ignored by tick2s().
     // The basic behaviour is that a signal with sufficient percent open
     // is good for 2 minutes (120s, 60 ticks) unless explicitly cancelled earler,
     // for all valve types including FS20/FHT8V-style.
@@ -379,13 +457,21 @@ class OnOffBoilerDriverLogic
     //   * percentOpen  percentage open that the remote valve is reporting
     bool receiveSignal(uint16_t id, uint8_t percentOpen);
 
+    // Count of signals dropped because too many arrived between tick2s() calls; saturates at 255.
+    uint8_t getSignalOverruns() const { return(signalOverruns); }
+
     // Iff true then call for heat from the boiler.
     bool isCallingForHeat() const { return(callForHeat); }
 
+    // Aggregate demand: the sum of percent open of all live valves as of the last tick2s(); may exceed 100.
+    uint16_t getAggregateDemandPC() const { return(aggregatePC); }
+
     // Poll every 2 seconds in real/virtual time to update state in particular the callForHeat value.
     // Not to be called from ISRs,
     // in part because this may perform occasional expensive-ish operations
     // such as incremental clean-up.
+    // Interrupts are only ever locked out briefly to take each queued signal,
+    // so lock hold time does not grow with maxRadiators.
     // Because this does not assume a tick is in real time
     // this remains entirely unit testable,
     // and no use of wall-clack time is made within this or sibling class methods.
@@ -393,6 +479,8 @@ class OnOffBoilerDriverLogic
 
     // Fetches statuses of valves recently heard from and returns the count; 0 if none.
     // Optionally filters to return only those still live and apparently calling for heat.
+    // Signals not yet applied by tick2s() are not included.
+    // Not to be called from ISRs.
     //   * valves  array to copy status to the start of; never null
     //   * size  size of valves[] in entries (not bytes), no more entries than that are used,
     //     and no more than maxRadiators entries are ever needed
@@ -405,7 +493,8 @@ class OnOffBoilerDriverLogic
 // Boiler output control (call-for-heat driver).
 // Nominally drives on scale of [0,100]%
 // but any non-zero value should be regarded as calling for heat from an on/off boiler,
-// and only values of 0 and 100 may be produced.
+// and only values of 0 and 100 may be produced;
+// in TPI mode demand is modulated by the time spent at 100.
 // Implementations require poll() called at a fixed rate (every 2s).
 class BoilerDriver : public SimpleTSUint8Actuator
   {
@@ -419,10 +508,86 @@ class BoilerDriver : public SimpleTSUint8Actuator
     // Preferred poll interval (2 seconds).
     virtual uint8_t preferredPollInterval_s() const { return(2); }
 
+    // Iff true then call for heat from the boiler.
+    bool isCallingForHeat() const { return(logic.isCallingForHeat()); }
+
+    // Aggregate demand from all live valves; see OnOffBoilerDriverLogic.
+    uint16_t getAggregateDemandPC() const { return(logic.getAggregateDemandPC()); }
+
+    // Called upon incoming notification of status or call for heat from given (valid) ID.
+    // ISR-/thread- safe and O(1); see OnOffBoilerDriverLogic::receiveSignal().
+    bool receiveSignal(const uint16_t id, const uint8_t percentOpen) { return(logic.receiveSignal(id, percentOpen)); }
+
+    // Count of signals dropped for lack of queue space; see OnOffBoilerDriverLogic.
+    uint8_t getSignalOverruns() const { return(logic.getSignalOverruns()); }
+
+    // Set thresholds for per-value and minimum-aggregate percentages to fire the boiler; see OnOffBoilerDriverLogic.
+    void setThresholds(const uint8_t minIndividual, const uint8_t minAggregate) { logic.setThresholds(minIndividual, minAggregate); }
+
+    // Set minimum ticks for boiler to stay in each state to avoid short-cycling; see OnOffBoilerDriverLogic.
+    void setMinTicksInEitherState(const uint8_t minTicks) { logic.setMinTicksInEitherState(minTicks); }
+
+    // Select time-proportional (TPI) mode, or on/off mode with a zero period; see OnOffBoilerDriverLogic.
+    void setTPIMode(const uint16_t periodTicks, const uint16_t fullDemandPC = 100) { logic.setTPIMode(periodTicks, fullDemandPC); }
+
+#if defined(BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY)
+    // Reload the authorised IDs from the hub house code filter in EEPROM, each entry hc1 then hc2.
+    // Unused (0xff) entries are skipped, and if none are set then signals from all IDs are accepted.
+    // Not to be called from ISRs; call infrequently, eg once per minute.
+    void loadAuthorisedIDs();
+#endif
   };
+#if defined(ENABLE_BOILER_DRIVER_LOGIC)
 // Singleton implementation/instance.
 extern BoilerDriver BoilerControl;
 #endif
 
+#if defined(ENABLE_ZONE_COORDINATOR)
+// Hub-side coordinator of the zones (rooms) sharing the boiler, fully testable.
+// Gives each node that asks for a stats ACK a pre-warm stagger slot to return in the ACK
+// so that nodes advance their pre-warm starts by different amounts
+// and valves open in turn rather than all together at common schedule times,
+// easing the flow surge on the boiler that would otherwise make it short-cycle.
+// Slots are handed out least-used first, and kept while a node is still heard from,
+// so a few zones get well-spread slots and a node's slot does not change under it.
+// Stats sender IDs are not the same as the valve IDs seen by BoilerControl, so zones are tracked separately.
+class ZoneCoordinator
+  {
+  public:
+    // Maximum distinct zones tracked; as for radiators.
+    static const uint8_t maxZones = BOILER_HUB_MAX_RADIATORS;
+    // Distinct stagger slots, as carried in the ACK.
+    static const uint8_t staggerSlots = 8;
+    // Hours without hearing from a zone after which its entry (and slot) may be given to another.
+    static const uint8_t forgetH = 48;
+
+  private:
+    // Per-zone status.
+    struct Zone { uint16_t id; uint8_t slot; uint8_t quietH; };
+    Zone zones[maxZones];
+    uint8_t zoneCount;
+    // Minutes into the current hour for aging zones.
+    uint8_t minutes;
+
+  public:
+    ZoneCoordinator() : zoneCount(0), minutes(0) { }
+
+    // Get the stagger slot [0,staggerSlots-1] for the given stats sender ID, noting that it has been heard from.
+    // A new ID takes the least-used slot, or if no entry can be freed for it
+    // a slot derived from the ID so that it is still stable.
+    // Not to be called from ISRs.
+    uint8_t getStaggerSlot(uint16_t id);
+
+    // Call once per minute in real/virtual time to age zones not heard from.
+    void tickMinute();
+
+    // Number of zones currently tracked.
+    uint8_t getZoneCount() const { return(zoneCount); }
+  };
+// Singleton implementation/instance.
+extern ZoneCoordinator Zones;
+#endif
+#endif
+
 
 #endif
@@ -40,6 +40,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2015
 #define CONFIG_Trial2013Winter_Round2 // REV2 cut4
 //#define CONFIG_Trial2013Winter_Round2_BOILERHUB // REV2 cut4 as boiler hub.
 //#define CONFIG_Trial2013Winter_Round2_STATSHUB // REV2 cut4 as stats hub.
+//#define CONFIG_Trial2013Winter_Round2_RELAY // REV2 cut4 as stats relay for nodes at the edge of the hub's range.
 //#define CONFIG_DORM1 // REV7 / DORM1 Winter 2014/2015 all-in-one valve unit.
 //#define CONFIG_DORM1_BOILER // REV8 / DORM1 Winter 2014/2015 boiler-control unit.
 
@@ -126,6 +127,18 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2015
 #define ALLOW_STATS_RX
 #endif
 
+#ifdef CONFIG_Trial2013Winter_Round2_RELAY // For trial over winter of 2013--4, second round (REV2), as stats relay.
+#define CONFIG_Trial2013Winter_Round2 // Just like normal REV except...
+// IF DEFINED: this unit can act as boiler-control hub listening to remote thermostats, possibly in addition to controlling a local TRV.
+// The relay only runs in hub mode: set the minimum boiler on-time to 1 with the CLI ("C 1", stats hub mode) so that it listens all the time.
+// In hub mode this unit also drives BOILER_OUT from calls for heat that it hears, so leave that output unconnected on a relay.
+#define ENABLE_BOILER_HUB
+// IF DEFINED: allow RX of stats frames.
+#define ALLOW_STATS_RX
+// IF DEFINED: forward neighbours' full stats frames to the hub, aggregated several per TX.
+#define ENABLE_STATS_RELAY
+#endif
+
 #ifdef CONFIG_Trial2013Winter_Round2 // For trial over winter of 2013--4, second round (REV2).
 // Revision REV2 (cut4+) of V0.2 board.
 #define V0p2_REV 2
@@ -336,6 +349,10 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2015
 // IF DEFINED: good RF environment means that TX power level can be reduced.
 #define RFM22_GOOD_RF_ENV // Good ground-plane and antenna on V0.2 PCB: drop TX level.
 #endif
+// IF DEFINED: send OpenTRV-native (non-FHT8V) stats frames using the RFM22 packet handler with length byte and hardware CRC-16.
+//#define RFM22_NATIVE_PACKET_HANDLER
+// IF DEFINED: hub listens only for native packet-handler frames (needs RFM22_NATIVE_PACKET_HANDLER); cannot then hear FHT8V valves.
+//#define RFM22_NATIVE_PACKET_HANDLER_RX
 // Anticipation logic not yet ready for prime-time.
 //#define ENABLE_ANTICIPATION
 // IF DEFINED: this unit supports CLI over the USB/serial connection, eg for run-time reconfig.
@@ -360,12 +377,31 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2015
 #define SUPPORT_SINGLETON_SCHEDULE
 // IF DEFINED: this unit can act as boiler-control hub listening to remote thermostats, possibly in addition to controlling a local TRV.
 //#define ENABLE_BOILER_HUB // NOT defined by default to allow omission for pure leaf nodes.
+// IF DEFINED: boiler hub weighs all radiators' recent valve positions (with anti-short-cycling) rather than firing on any call for heat heard.
+//#define ENABLE_BOILER_DRIVER_LOGIC
+// IF DEFINED: boiler hub logic ignores signals from radiators not in the hub house code filter in EEPROM, when any are set there.
+//#define BOILER_RESPOND_TO_SPECIFIED_IDS_ONLY
+// IF DEFINED: boiler hub modulates the boiler by time-proportional (TPI) control with this many cycles per hour (eg 6) rather than on/off.
+// Only worthwhile with a minimum boiler on time of around 5 minutes or more (as for typical gas and oil boilers):
+// with a short (eg 2 minute) minimum plain on/off control makes fewer boiler starts; see TPIBoilerSimTest.
+// Each cycle is stretched to at least twice the minimum boiler on time.
+//#define BOILER_TPI_CYCLES_PER_HOUR 6
 //// IF DEFINED: allow TX of stats frames.
 //#define ALLOW_STATS_TX
 // IF DEFINED: allow RX of stats frames.
 //#define ALLOW_STATS_RX
 // IF DEFINED: allow minimal binary format in addition to more generic one: ~400 bytes.
 //#define ALLOW_MINIMAL_STATS_TXRX
+// IF DEFINED: send compact binary TLV stats frames in place of JSON, and decode them to JSON at the hub.
+//#define ALLOW_STATS_TLV
+// IF DEFINED: compress JSON stats frames on air with a static dictionary of common keys (hub needs this too to expand them).
+//#define ALLOW_JSON_DICT_COMPRESSION
+// IF DEFINED: TLV stats frames with important content (eg call for heat, battery low) ask the hub for an ACK and are retried if not heard.
+//#define ALLOW_STATS_ACK
+// IF DEFINED: boiler hub gives each node a pre-warm stagger slot in its stats ACKs so that valves do not all open at once.
+//#define ENABLE_ZONE_COORDINATOR
+// IF DEFINED: send full stats frames authenticated and encrypted (AES-128-GCM) when a building key is set, and accept them at the hub: ~2.5kB.
+//#define ALLOW_SECURE_STATS
 #endif
 
 
@@ -379,12 +415,40 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2015
 // By default, use the RFM22/RFM23 module to talk to an FHT8V wireless radiator valve.
 #ifdef USE_MODULE_FHT8VSIMPLE
 #define USE_MODULE_RFM22RADIOSIMPLE
-// If this can be a hub, enable extra RX code.
-#ifdef ENABLE_BOILER_HUB
+// If this can be a hub, or must listen for ACKs, enable extra RX code.
+#if defined(ENABLE_BOILER_HUB) || defined(ALLOW_STATS_ACK)
 #define USE_MODULE_FHT8VSIMPLE_RX
 #endif
 #endif
 
+#if defined(RFM22_NATIVE_PACKET_HANDLER_RX) && !defined(RFM22_NATIVE_PACKET_HANDLER)
+#error RFM22_NATIVE_PACKET_HANDLER_RX needs RFM22_NATIVE_PACKET_HANDLER
+#endif
+#if defined(ALLOW_STATS_TLV) && !defined(ALLOW_JSON_OUTPUT)
+#error ALLOW_STATS_TLV needs ALLOW_JSON_OUTPUT
+#endif
+#if defined(ALLOW_JSON_DICT_COMPRESSION) && !defined(ALLOW_JSON_OUTPUT)
+#error ALLOW_JSON_DICT_COMPRESSION needs ALLOW_JSON_OUTPUT
+#endif
+#if defined(ALLOW_STATS_ACK) && !defined(ALLOW_STATS_TLV)
+#error ALLOW_STATS_ACK needs ALLOW_STATS_TLV
+#endif
+#if defined(ENABLE_STATS_RELAY) && (!defined(ENABLE_BOILER_HUB) || !defined(ALLOW_STATS_RX) || !defined(ALLOW_STATS_TX))
+#error ENABLE_STATS_RELAY needs ENABLE_BOILER_HUB, ALLOW_STATS_RX and ALLOW_STATS_TX
+#endif
+#if defined(ENABLE_BOILER_DRIVER_LOGIC) && !defined(ENABLE_BOILER_HUB)
+#error ENABLE_BOILER_DRIVER_LOGIC needs ENABLE_BOILER_HUB
+#endif
+#if defined(BOILER_TPI_CYCLES_PER_HOUR) && (!defined(ENABLE_BOILER_DRIVER_LOGIC) || (BOILER_TPI_CYCLES_PER_HOUR < 1) || (BOILER_TPI_CYCLES_PER_HOUR > 30))
+#error BOILER_TPI_CYCLES_PER_HOUR needs ENABLE_BOILER_DRIVER_LOGIC and must be in range [1,30]
+#endif
+#if defined(ENABLE_ZONE_COORDINATOR) && (!defined(ENABLE_BOILER_DRIVER_LOGIC) || !defined(ALLOW_STATS_RX) || !defined(ALLOW_STATS_ACK))
+#error ENABLE_ZONE_COORDINATOR needs ENABLE_BOILER_DRIVER_LOGIC, ALLOW_STATS_RX and ALLOW_STATS_ACK
+#endif
+#if defined(ALLOW_SECURE_STATS) && !defined(ALLOW_STATS_TX) && !defined(ALLOW_STATS_RX)
+#error ALLOW_SECURE_STATS needs ALLOW_STATS_TX and/or ALLOW_STATS_RX
+#endif
+
 //// Supporting library required for OneWire-connected sensors.
 //// Will also need a #include in the .ino file because of Arduino's pre-preprocessing logic (IDE 1.0.x).
 //#if defined(SENSOR_DS18B20_ENABLE)
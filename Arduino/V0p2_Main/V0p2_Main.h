@@ -31,6 +31,7 @@ Author(s) / Copyright (s): Damon Hart-Davis 2013--2015
 #define DEBUG // If defined, do extra checks and serial logging.  Will take more code space and power.
 //#define ALT_MAIN_LOOP // If defined, normal main loop and POST are REPLACED with alternates, for non-OpenTRV builds.
 //#define UNIT_TESTS // If defined, normal main loop is REPLACED with a unit test cycle.  Usually define DEBUG also for get serial logging.
+//#define BENCHMARK_JSON_STATS // If defined with UNIT_TESTS, time JSON stats encoding once before the first test cycle.
 //#define EST_CPU_DUTYCYCLE // If defined, estimate CPU duty cycle and thus base power consumption.
 
 //#define COMPAT_UNO // If defined, allow code to run on stock Arduino UNO board.  NOT IMPLEMENTED
@@ -78,6 +79,10 @@ void serialPrintlnBuildVersion();
 template <class T> const T& fnmin(const T& a, const T& b) { return((a>b)?b:a); }
 template <class T> const T& fnmax(const T& a, const T& b) { return((a<b)?b:a); }
 
+// Compile-time assertion for conditions that #if cannot evaluate, eg involving sizeof(); C++03 so no static_assert.
+// Fails to compile (negative array size) if cond is false; name must be unique within the scope.
+#define STATIC_ASSERT(cond, name) typedef char static_assert_##name[(cond) ? 1 : -1]
+
 
 #endif
 
@@ -996,7 +996,7 @@ bool VoiceDetection::handleInterruptSimple()
       isDetected = true;
       // Don't regard this as a very srong indication,
       // as it could be a TV or radio on in the room.
-      Occupancy.markAsPossiblyOccupied();
+      Occupancy.markAsPossiblyOccupied(OccupancyTracker::evidenceLRX16Voice);
       }
     }
     // No further work to be done to 'clear' interrupt.
@@ -0,0 +1,161 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): agent 2026
+*/
+
+/*
+ Host multi-node simulation of pre-warm staggering by the hub's ZoneCoordinator.
+
+ A line-for-line port of javasrc/uk/org/opentrv/test/boiler/StaggerSimTest.java
+ (same model, same arithmetic, same checks) so that it can be run where there is no JDK;
+ keep the two in step.
+ Uses the boiler logic port from TPIBoilerSim.cpp as the Java uses TPIBoilerSimTest.Logic.
+ Prints the results with and without stagger for each minimum on/off time,
+ and exits with 0 if all the checks pass, else reports the first failing line and exits with 1.
+
+ Build and run on the host from this directory with eg
+   g++ -O2 -o StaggerSim StaggerSim.cpp && ./StaggerSim
+ */
+
+#define TPI_BOILER_SIM_LOGIC_ONLY
+#include "TPIBoilerSim.cpp"
+
+// Seconds per hub logic tick.
+static const int TICK_S = 2;
+// Ticks per day.
+static const long TICKS_PER_DAY = 24 * 3600 / TICK_S;
+// Days to simulate; the first is ignored as the rooms settle.
+static const int DAYS = 7;
+// Number of rooms/nodes.
+#define N 8
+// WARM start, and setback period before it without stagger, in minutes.
+static const int WARM_START_M = 7 * 60;
+static const int PREPREWARM_M = 30;
+
+// Results of one simulation run.
+struct Result
+  {
+  int peakOpeningsPerMinute;
+  int peakRise2MinPC;
+  double startsPerDay;
+  double meanTempAtWarmC;
+  void print() const
+    {
+    printf("peak openings/min %d, peak 2-minute demand rise %d%%, starts/day %.1f, mean temp 07:15 %.2fC\n",
+        peakOpeningsPerMinute, peakRise2MinPC, startsPerDay, meanTempAtWarmC);
+    }
+  };
+
+// Simulate a week with the given stagger step in minutes per slot (0 for none) and minimum boiler ticks in either state.
+static Result simulate(const int stepMins, const int minTicks)
+  {
+  Logic logic(minTicks, 0);
+  double room[N];
+  double rad[N];
+  for(int i = 0; i < N; ++i) { room[i] = 16; rad[i] = 16; }
+  double water = 20;
+  int pc[N] = { 0 };
+  int reported[N] = { 0 };
+  bool wasOpen[N] = { false };
+  int starts = 0;
+  bool wasOn = false;
+  int peakOpenings = 0, peakRise = 0;
+  int aggPrev2 = 0, aggPrev1 = 0;
+  double warmSum = 0;
+  int warmN = 0;
+  const double dt = TICK_S;
+  for(long t = 0; t < DAYS * TICKS_PER_DAY; ++t)
+    {
+    const double hour = fmod((t * dt) / 3600.0, 24.0);
+    const double mins = fmod((t * dt) / 60.0, 1440.0);
+    const double outC = 4 - 4*cos((hour - 3) * M_PI / 12); // 0--8C, coldest around 3am.
+    // Each valve moves once a minute in proportion to how far below its target (+0.5C) its room is.
+    if(0 == (t % 30))
+      {
+      int openings = 0;
+      int agg = 0;
+      for(int i = 0; i < N; ++i)
+        {
+        const int slot = i;
+        const double setbackStartM = WARM_START_M - PREPREWARM_M - slot * stepMins;
+        const double targetC = ((mins >= WARM_START_M) && (mins < 22*60)) ? 21 :
+            (((mins >= setbackStartM) && (mins < WARM_START_M)) ? 18 : 16);
+        const double e = (targetC + 0.5) - room[i];
+        pc[i] = imax(0, imin(100, (int)(e*100 + 0.5)));
+        const bool open = (pc[i] >= logic.minIndividualPC);
+        if(open && !wasOpen[i]) { ++openings; }
+        wasOpen[i] = open;
+        agg += pc[i];
+        }
+      if(t > TICKS_PER_DAY)
+        {
+        peakOpenings = imax(peakOpenings, openings);
+        peakRise = imax(peakRise, agg - aggPrev2);
+        if((long)mins == WARM_START_M + 15) { for(int i = 0; i < N; ++i) { warmSum += room[i]; ++warmN; } }
+        }
+      aggPrev2 = aggPrev1;
+      aggPrev1 = agg;
+      }
+    // Each valve reports its position to the hub every 2 minutes (staggered).
+    for(int i = 0; i < N; ++i) { if(0 == ((t + 7*i) % 60)) { reported[i] = pc[i]; } }
+    logic.tick2s(reported, N);
+    if(logic.callForHeat && !wasOn) { ++starts; }
+    wasOn = logic.callForHeat;
+    // Physics as TPIBoilerSim, with a 30kW boiler and ~80kg of water for the larger system,
+    // and room heat losses from 60 to 95W/K.
+    double qTotal = 0;
+    for(int i = 0; i < N; ++i)
+      {
+      const double q = (water > rad[i]) ? (400.0 * pc[i] / 100.0 * (water - rad[i])) : 0;
+      const double e = 100.0 * (rad[i] - room[i]);
+      qTotal += q;
+      rad[i] += dt * (q - e) / 150e3;
+      room[i] += dt * (e - (60 + 5*i)*(room[i] - outC)) / 3.0e6;
+      }
+    const double boilerW = logic.callForHeat ? 30000 : 0;
+    water += dt * (boilerW - qTotal - 20*(water - outC)) / (80 * 4200.0);
+    if(water > 75) { water = 75; } // Boiler thermostat.
+    }
+  Result r;
+  r.peakOpeningsPerMinute = peakOpenings;
+  r.peakRise2MinPC = peakRise;
+  r.startsPerDay = starts / (double)DAYS;
+  r.meanTempAtWarmC = warmSum / warmN;
+  return(r);
+  }
+
+// Compare no stagger with the 3-minute-per-slot stagger used by the nodes; as testStaggerAgainstNone().
+int main()
+  {
+  static const int minTicksList[] = { 60, 150 };
+  for(unsigned m = 0; m < sizeof(minTicksList)/sizeof(minTicksList[0]); ++m)
+    {
+    const int minTicks = minTicksList[m];
+    const Result none = simulate(0, minTicks);
+    const Result stagger = simulate(3, minTicks);
+    printf("min ticks %d: no stagger ", minTicks); none.print();
+    printf("min ticks %d: stagger    ", minTicks); stagger.print();
+    // Without stagger all valves open together.
+    AssertIsTrue(N == none.peakOpeningsPerMinute);
+    AssertIsTrue(stagger.peakOpeningsPerMinute <= N/2);
+    AssertIsTrue(2 * stagger.peakRise2MinPC < none.peakRise2MinPC);
+    // Rooms are no cooler at the WARM start and the boiler starts hardly more often.
+    AssertIsTrue(stagger.meanTempAtWarmC >= none.meanTempAtWarmC);
+    AssertIsTrue(stagger.startsPerDay <= none.startsPerDay + 1);
+    }
+  printf("OK\n");
+  return(0);
+  }
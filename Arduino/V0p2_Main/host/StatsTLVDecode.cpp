@@ -0,0 +1,113 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): agent 2026
+*/
+
+/*
+ Host-side decoder for compact binary TLV stats frames (see ../Stats_TLV.h).
+
+ Reads one frame per line as hex digits (spaces allowed, eg as captured off air, with or without the trailing ff)
+ and writes the JSON that the hub would emit for it, one object per line.
+ Keeps state per sender so that deltas are applied exactly as at the hub;
+ repeats and frames with nothing usable produce no output, and malformed lines are reported on stderr.
+
+ Not part of the sketch: build and run on the host from this directory with eg
+   g++ -I.. -o StatsTLVDecode StatsTLVDecode.cpp ../Stats_TLV.cpp
+   ./StatsTLVDecode < frames.txt
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Stats_TLV.h"
+
+// Longest frame accepted, comfortably more than fits in a radio packet.
+#define STATS_TLV_DECODE_MAX_FRAME_BYTES 64
+// JSON output buffer size, as used by the hub (MSG_JSON_MAX_LENGTH+1) so that values are split identically.
+#define STATS_TLV_DECODE_JSON_BYTES 56
+
+// Decoder state for every possible sender (ID bytes are never 0xff), initially all unseen.
+static StatsTLVRXState_t decodeStates[255][255];
+
+// Forget all senders, eg between independent captures.
+void statsTLVDecodeReset() { memset(decodeStates, 0, sizeof(decodeStates)); }
+
+// Parse one ASCII hex digit, else return -1.
+static int hexValue(const char c)
+  {
+  if((c >= '0') && (c <= '9')) { return(c - '0'); }
+  if((c >= 'a') && (c <= 'f')) { return(c - 'a' + 10); }
+  if((c >= 'A') && (c <= 'F')) { return(c - 'A' + 10); }
+  return(-1);
+  }
+
+// Decode one frame given as a line of hex, appending the resulting JSON objects (each followed by '\n') to out.
+// out must hold a '\0'-terminated string on entry and have outSize bytes in all.
+// Returns the number of JSON objects appended, or -1 if the line is not a valid frame (or out is full).
+int statsTLVDecodeHexLine(const char *line, char *const out, const size_t outSize)
+  {
+  uint8_t buf[STATS_TLV_DECODE_MAX_FRAME_BYTES];
+  uint8_t n = 0;
+  int hi = -1;
+  for( ; '\0' != *line; ++line)
+    {
+    const char c = *line;
+    if((' ' == c) || ('\t' == c) || ('\r' == c) || ('\n' == c)) { continue; }
+    const int v = hexValue(c);
+    if(v < 0) { return(-1); }
+    if(hi < 0) { hi = v; continue; }
+    if(n >= sizeof(buf)) { return(-1); }
+    buf[n++] = (uint8_t)((hi << 4) | v);
+    hi = -1;
+    }
+  if(hi >= 0) { return(-1); } // Odd number of digits.
+  const uint8_t len = statsTLVCheckFrame(buf, n);
+  if(0 == len) { return(-1); }
+  StatsTLVRXState_t *const state = &decodeStates[statsTLVFrameID0(buf)][statsTLVFrameID1(buf)];
+  if(!statsTLVApplyFrame(buf, len, state)) { return(0); } // Repeat.
+  int objects = 0;
+  while(0 != (state->fresh & state->valid))
+    {
+    char json[STATS_TLV_DECODE_JSON_BYTES];
+    const uint8_t jl = statsTLVWriteJSON(state, json, sizeof(json));
+    if(0 == jl) { break; }
+    const size_t used = strlen(out);
+    if(used + jl + 2 > outSize) { return(-1); }
+    memcpy(out + used, json, jl);
+    out[used + jl] = '\n';
+    out[used + jl + 1] = '\0';
+    ++objects;
+    }
+  return(objects);
+  }
+
+#if !defined(STATS_TLV_DECODE_NO_MAIN)
+int main()
+  {
+  char line[4 * STATS_TLV_DECODE_MAX_FRAME_BYTES];
+  unsigned lineNo = 0;
+  while(NULL != fgets(line, sizeof(line), stdin))
+    {
+    ++lineNo;
+    char out[8 * STATS_TLV_DECODE_JSON_BYTES];
+    out[0] = '\0';
+    if(statsTLVDecodeHexLine(line, out, sizeof(out)) < 0)
+      { fprintf(stderr, "line %u: not a valid TLV stats frame\n", lineNo); continue; }
+    fputs(out, stdout);
+    }
+  return(0);
+  }
+#endif
@@ -0,0 +1,140 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): agent 2026
+*/
+
+/*
+ Host tests for the TLV stats decoder (StatsTLVDecode.cpp).
+
+ Frames are built with the same encoder as the sketch uses, written out as hex, and decoded as captured frames would be.
+ Prints OK and exits with 0 if all pass, else reports the first failing line and exits with 1.
+
+ Build and run on the host from this directory with eg
+   g++ -I.. -o StatsTLVDecodeTest StatsTLVDecodeTest.cpp ../Stats_TLV.cpp && ./StatsTLVDecodeTest
+ */
+
+#define STATS_TLV_DECODE_NO_MAIN
+#include "StatsTLVDecode.cpp"
+
+#include <stdlib.h>
+
+#define AssertIsTrue(x) { if(!(x)) { fprintf(stderr, "***Test FAILED*** at line %d\n", __LINE__); exit(1); } }
+#define AssertIsEqualStr(expected, s) { if(0 != strcmp((expected), (s))) { fprintf(stderr, "***Test FAILED*** at line %d: %s\n", __LINE__, (s)); exit(1); } }
+
+// Key IDs used below (see Stats_TLV.cpp).
+#define KEY_T_C16 0
+#define KEY_H_PC 1
+#define KEY_B_MV 4
+
+// Build a frame with the given records (key ID, delta flag, value) and write it as hex with spaces and a trailing ff.
+static void frameHex(char *const hex, const uint8_t seq, const uint8_t id0, const uint8_t id1,
+                     const uint8_t nRecords, const uint8_t *const keys, const bool *const deltas, const int16_t *const values)
+  {
+  uint8_t buf[STATS_TLV_DECODE_MAX_FRAME_BYTES];
+  uint8_t n = statsTLVStartFrame(buf, sizeof(buf), seq, id0, id1);
+  AssertIsTrue(0 != n);
+  for(uint8_t i = 0; i < nRecords; ++i)
+    {
+    const uint8_t w = statsTLVPutRecord(buf + n, sizeof(buf) - n, keys[i], deltas[i], values[i]);
+    AssertIsTrue(0 != w);
+    n += w;
+    }
+  n = statsTLVFinishFrame(buf, n, sizeof(buf));
+  AssertIsTrue(0 != n);
+  char *p = hex;
+  for(uint8_t i = 0; i < n; ++i) { p += sprintf(p, "%02x ", buf[i]); }
+  strcpy(p, "ff\n");
+  }
+
+// Decode one hex line into out (emptied first), returning the objects count.
+static int decode(const char *const hex, char *const out, const size_t outSize)
+  {
+  out[0] = '\0';
+  return(statsTLVDecodeHexLine(hex, out, outSize));
+  }
+
+int main()
+  {
+  char hex[4 * STATS_TLV_DECODE_MAX_FRAME_BYTES];
+  char out[8 * STATS_TLV_DECODE_JSON_BYTES];
+  statsTLVDecodeReset();
+
+  // Absolute values decode to the same JSON as the hub emits.
+  const uint8_t k1[] = { KEY_T_C16, KEY_H_PC };
+  const bool d1[] = { false, false };
+  const int16_t v1[] = { 311, 81 };
+  frameHex(hex, 5, 0xc2, 0xe0, 2, k1, d1, v1);
+  AssertIsTrue(1 == decode(hex, out, sizeof(out)));
+  AssertIsEqualStr("{\"@\":\"c2e0\",\"T|C16\":311,\"H|%\":81}\n", out);
+  // A repeat (eg from double TX) produces nothing.
+  AssertIsTrue(0 == decode(hex, out, sizeof(out)));
+  AssertIsEqualStr("", out);
+
+  // Many senders interleaved each keep their own baseline, so all their deltas apply.
+  for(uint8_t s = 0; s < 16; ++s)
+    {
+    const uint8_t k[] = { KEY_T_C16 };
+    const bool d[] = { false };
+    const int16_t v[] = { (int16_t)(300 + s) };
+    frameHex(hex, 1, 0x10, s, 1, k, d, v);
+    AssertIsTrue(1 == decode(hex, out, sizeof(out)));
+    }
+  for(uint8_t s = 0; s < 16; ++s)
+    {
+    const uint8_t k[] = { KEY_T_C16 };
+    const bool d[] = { true };
+    const int16_t v[] = { -3 };
+    frameHex(hex, 2, 0x10, s, 1, k, d, v);
+    AssertIsTrue(1 == decode(hex, out, sizeof(out)));
+    char expected[40];
+    sprintf(expected, "{\"@\":\"10%02x\",\"T|C16\":%d}\n", s, 297 + s);
+    AssertIsEqualStr(expected, out);
+    }
+
+  // A delta after a missed frame is not applied, so nothing is emitted until the next absolute value.
+  const uint8_t k2[] = { KEY_T_C16 };
+  const bool d2[] = { true };
+  const int16_t v2[] = { 1 };
+  frameHex(hex, 7, 0xc2, 0xe0, 1, k2, d2, v2);
+  AssertIsTrue(0 == decode(hex, out, sizeof(out)));
+  const uint8_t k3[] = { KEY_T_C16, KEY_B_MV };
+  const bool d3[] = { true, false };
+  const int16_t v3[] = { 1, 2612 };
+  frameHex(hex, 8, 0xc2, 0xe0, 2, k3, d3, v3);
+  AssertIsTrue(1 == decode(hex, out, sizeof(out)));
+  AssertIsEqualStr("{\"@\":\"c2e0\",\"B|mV\":2612}\n", out);
+
+  // Values that do not all fit in one hub-sized JSON object are split over more than one.
+  const uint8_t k4[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+  const bool d4[] = { false, false, false, false, false, false, false, false, false };
+  const int16_t v4[] = { -1234, 99, 3, 1000, 3300, 100, 21, 100, 255 };
+  frameHex(hex, 0, 0x01, 0x02, 9, k4, d4, v4);
+  AssertIsTrue(3 == decode(hex, out, sizeof(out)));
+  AssertIsEqualStr("{\"@\":\"0102\",\"T|C16\":-1234,\"H|%\":99,\"O\":3,\"vac|h\":1000}\n"
+                   "{\"@\":\"0102\",\"B|mV\":3300,\"v|%\":100,\"tT|C\":21,\"vC|%\":100}\n"
+                   "{\"@\":\"0102\",\"L\":255}\n", out);
+
+  // Corrupt and malformed lines are rejected.
+  frameHex(hex, 9, 0xc2, 0xe0, 1, k2, d2, v2);
+  hex[10] = ('0' == hex[10]) ? '1' : '0'; // Flip a bit in the first record.
+  AssertIsTrue(-1 == decode(hex, out, sizeof(out)));
+  AssertIsTrue(-1 == decode("2", out, sizeof(out)));
+  AssertIsTrue(-1 == decode("zz", out, sizeof(out)));
+  AssertIsTrue(-1 == decode("7b2240223a", out, sizeof(out))); // JSON, not TLV.
+
+  puts("OK");
+  return(0);
+  }
@@ -0,0 +1,218 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): agent 2026
+*/
+
+/*
+ Host benchmark of time-proportional (TPI) against plain on/off boiler control by the hub.
+
+ A line-for-line port of javasrc/uk/org/opentrv/test/boiler/TPIBoilerSimTest.java
+ (same model, same arithmetic, same checks) so that it can be run where there is no JDK;
+ keep the two in step.
+ Prints the results for each minimum on/off time,
+ and exits with 0 if all the checks pass, else reports the first failing line and exits with 1.
+
+ Build and run on the host from this directory with eg
+   g++ -O2 -o TPIBoilerSim TPIBoilerSim.cpp && ./TPIBoilerSim
+ Define TPI_BOILER_SIM_LOGIC_ONLY to include just the boiler logic in another simulation.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define AssertIsTrue(x) { if(!(x)) { fprintf(stderr, "***Test FAILED*** at line %d\n", __LINE__); exit(1); } }
+
+static int imax(const int a, const int b) { return((a > b) ? a : b); }
+static int imin(const int a, const int b) { return((a < b) ? a : b); }
+
+// Port of the boiler decision logic in OnOffBoilerDriverLogic, fed with the latest report from each valve; also used by StaggerSim.cpp.
+struct Logic
+  {
+  int minTicks;
+  int minIndividualPC;
+  int minAggregatePC;
+  int tpiPeriodTicks;
+  int tpiFullDemandPC;
+  bool callForHeat;
+  int ticksInCurrentState;
+  int tpiTick;
+  int tpiOnTicks;
+
+  Logic(const int minTicks_, const int tpiPeriodTicks_)
+    : minTicks(minTicks_), minIndividualPC(15), minAggregatePC(34),
+      tpiPeriodTicks((0 == tpiPeriodTicks_) ? 0 : imax(tpiPeriodTicks_, 2 * minTicks_)), tpiFullDemandPC(100),
+      callForHeat(false), ticksInCurrentState(0), tpiTick(0), tpiOnTicks(0)
+    { }
+
+  void tick2s(const int percentOpen[], const int n)
+    {
+    bool atLeastOne = false;
+    int cumulativePC = 0;
+    for(int i = 0; i < n; ++i)
+      {
+      if(percentOpen[i] >= minIndividualPC) { atLeastOne = true; }
+      cumulativePC += percentOpen[i];
+      }
+    bool desired = atLeastOne && (cumulativePC >= minAggregatePC);
+    if(0 != tpiPeriodTicks)
+      {
+      if(0 == tpiTick)
+        {
+        int on = (!atLeastOne || (cumulativePC < minAggregatePC)) ? 0 :
+            ((cumulativePC >= tpiFullDemandPC) ? tpiPeriodTicks : (tpiPeriodTicks * cumulativePC) / tpiFullDemandPC);
+        if(on < minTicks) { on = (on >= minTicks/2) ? imin(minTicks, tpiPeriodTicks) : 0; }
+        if((0 != on) && (tpiPeriodTicks - on < minTicks)) { on = tpiPeriodTicks; }
+        tpiOnTicks = on;
+        }
+      if(!atLeastOne && (tpiTick < tpiOnTicks)) { tpiOnTicks = tpiTick; }
+      desired = (tpiTick < tpiOnTicks);
+      if(++tpiTick >= tpiPeriodTicks) { tpiTick = 0; }
+      }
+    if(ticksInCurrentState < 0xff) { ++ticksInCurrentState; }
+    if(desired == callForHeat) { return; }
+    if(ticksInCurrentState < minTicks) { return; }
+    callForHeat = desired;
+    ticksInCurrentState = 0;
+    }
+  };
+
+#if !defined(TPI_BOILER_SIM_LOGIC_ONLY)
+// Seconds per hub logic tick.
+static const int TICK_S = 2;
+// Ticks per day.
+static const long TICKS_PER_DAY = 24 * 3600 / TICK_S;
+// Days to simulate; the first is ignored for overshoot as the rooms warm up.
+static const int DAYS = 7;
+// Room target temperature (C).
+static const double TARGET_C = 21;
+// Number of radiators/rooms.
+#define N 3
+
+// Results of one simulation run.
+struct Result
+  {
+  double startsPerDay;
+  double maxOvershootC;
+  double meanOvershootC;
+  double meanTempC;
+  double duty;
+  void print() const
+    {
+    printf("starts/day %.1f, max overshoot %.2fC, mean overshoot %.3fC, mean temp %.2fC, duty %.2f\n",
+        startsPerDay, maxOvershootC, meanOvershootC, meanTempC, duty);
+    }
+  };
+
+// Simulate a week with the given minimum ticks in either state and TPI period (0 for on/off).
+static Result simulate(const int minTicks, const int tpiPeriodTicks)
+  {
+  Logic logic(minTicks, tpiPeriodTicks);
+  double room[N] = { 18, 18, 18 };
+  double rad[N] = { 20, 20, 20 };
+  double water = 20;
+  int pc[N] = { 0 };
+  int reported[N] = { 0 };
+  int starts = 0;
+  long onTicks = 0;
+  double maxOver = 0, sumOver = 0, sumT = 0;
+  long samples = 0;
+  bool wasOn = false;
+  const double dt = TICK_S;
+  for(long t = 0; t < DAYS * TICKS_PER_DAY; ++t)
+    {
+    const double hour = fmod((t * dt) / 3600.0, 24.0);
+    const double outC = 4 - 4*cos((hour - 3) * M_PI / 12); // 0--8C, coldest around 3am.
+    // Each valve moves once a minute in proportion to how far below its target (+0.5C) its room is,
+    // and reports its position to the hub every 2 minutes (staggered).
+    for(int i = 0; i < N; ++i)
+      {
+      if(0 == (t % 30))
+        {
+        const double e = (TARGET_C + 0.5) - room[i];
+        pc[i] = imax(0, imin(100, (int)(e*100 + 0.5)));
+        }
+      if(0 == ((t + 20*i) % 60)) { reported[i] = pc[i]; }
+      }
+    logic.tick2s(reported, N);
+    if(logic.callForHeat && !wasOn) { ++starts; }
+    wasOn = logic.callForHeat;
+    if(logic.callForHeat) { ++onTicks; }
+    // Physics: 15kW boiler into ~40kg of water;
+    // flow into each radiator (~150kJ/K) in proportion to valve opening;
+    // each radiator emits 100W/K into a room of 3MJ/K losing 80W/K to outside.
+    double qTotal = 0;
+    for(int i = 0; i < N; ++i)
+      {
+      const double q = (water > rad[i]) ? (400.0 * pc[i] / 100.0 * (water - rad[i])) : 0;
+      const double e = 100.0 * (rad[i] - room[i]);
+      qTotal += q;
+      rad[i] += dt * (q - e) / 150e3;
+      room[i] += dt * (e - 80.0*(room[i] - outC)) / 3.0e6;
+      }
+    const double boilerW = logic.callForHeat ? 15000 : 0;
+    water += dt * (boilerW - qTotal - 20*(water - outC)) / (40 * 4200.0);
+    if(water > 75) { water = 75; } // Boiler thermostat.
+    if(t > TICKS_PER_DAY)
+      {
+      for(int i = 0; i < N; ++i)
+        {
+        const double o = room[i] - TARGET_C;
+        sumT += room[i];
+        if(o > maxOver) { maxOver = o; }
+        if(o > 0) { sumOver += o; }
+        ++samples;
+        }
+      }
+    }
+  Result r;
+  r.startsPerDay = starts / (double)DAYS;
+  r.maxOvershootC = maxOver;
+  r.meanOvershootC = sumOver / samples;
+  r.meanTempC = sumT / samples;
+  r.duty = onTicks / (double)(DAYS * TICKS_PER_DAY);
+  return(r);
+  }
+
+// Compare TPI at 6 cycles per hour with on/off control at a range of minimum on/off times; as testTPIAgainstOnOff().
+int main()
+  {
+  const int tpiPeriodTicks = 3600 / TICK_S / 6;
+  static const int minTicksList[] = { 60, 150, 255 };
+  for(unsigned m = 0; m < sizeof(minTicksList)/sizeof(minTicksList[0]); ++m)
+    {
+    const int minTicks = minTicksList[m];
+    const Result onOff = simulate(minTicks, 0);
+    const Result tpi = simulate(minTicks, tpiPeriodTicks);
+    printf("min ticks %d: on/off ", minTicks); onOff.print();
+    printf("min ticks %d: TPI    ", minTicks); tpi.print();
+    // TPI can never start more often than once per period.
+    AssertIsTrue(tpi.startsPerDay <= 24 * 6);
+    // Rooms stay close to target either way.
+    AssertIsTrue(onOff.maxOvershootC < 1);
+    AssertIsTrue(tpi.maxOvershootC < 1);
+    if(150 == minTicks)
+      {
+      AssertIsTrue(tpi.startsPerDay < onOff.startsPerDay);
+      AssertIsTrue(tpi.meanOvershootC < onOff.meanOvershootC);
+      }
+    else if(60 == minTicks)
+      { AssertIsTrue(onOff.startsPerDay < tpi.startsPerDay); }
+    }
+  printf("OK\n");
+  return(0);
+  }
+#endif
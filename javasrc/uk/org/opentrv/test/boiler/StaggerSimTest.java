@@ -0,0 +1,163 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): agent 2026
+*/
+
+package uk.org.opentrv.test.boiler;
+
+import static org.junit.Assert.assertTrue;
+
+import org.junit.Test;
+
+/**Multi-node simulation of pre-warm staggering by the hub's ZoneCoordinator.
+ * Eight rooms with slightly different heat losses share one on/off boiler (TPIBoilerSimTest.Logic)
+ * and all have the same schedule: 16C overnight, an 18C setback period ahead of 21C WARM from 07:00 to 22:00.
+ * With staggering each node's setback period starts earlier by its slot times the step (Schedule.cpp);
+ * eight zones get slots 0 to 7 from the coordinator's least-used allocation.
+ * Reports the most valves opening in any one minute, the sharpest two-minute rise in aggregate demand,
+ * boiler starts per day, and mean room temperature just after the WARM start.
+ * Arduino/V0p2_Main/host/StaggerSim.cpp is a line-for-line C++ port to run without a JDK;
+ * keep the two in step.
+ */
+public final class StaggerSimTest
+    {
+    /**Seconds per hub logic tick. */
+    private static final int TICK_S = 2;
+    /**Ticks per day. */
+    private static final int TICKS_PER_DAY = 24 * 3600 / TICK_S;
+    /**Days to simulate; the first is ignored as the rooms settle. */
+    private static final int DAYS = 7;
+    /**Number of rooms/nodes. */
+    private static final int N = 8;
+    /**WARM start, and setback period before it without stagger, in minutes. */
+    private static final int WARM_START_M = 7 * 60;
+    private static final int PREPREWARM_M = 30;
+
+    /**Results of one simulation run. */
+    private static final class Result
+        {
+        int peakOpeningsPerMinute;
+        int peakRise2MinPC;
+        double startsPerDay;
+        double meanTempAtWarmC;
+        @Override public String toString()
+            {
+            return(String.format("peak openings/min %d, peak 2-minute demand rise %d%%, starts/day %.1f, mean temp 07:15 %.2fC",
+                peakOpeningsPerMinute, peakRise2MinPC, startsPerDay, meanTempAtWarmC));
+            }
+        }
+
+    /**Simulate a week with the given stagger step in minutes per slot (0 for none) and minimum boiler ticks in either state. */
+    private static Result simulate(final int stepMins, final int minTicks)
+        {
+        final TPIBoilerSimTest.Logic logic = new TPIBoilerSimTest.Logic(minTicks, 0);
+        final double room[] = new double[N];
+        final double rad[] = new double[N];
+        for(int i = 0; i < N; ++i) { room[i] = 16; rad[i] = 16; }
+        double water = 20;
+        final int pc[] = new int[N];
+        final int reported[] = new int[N];
+        final boolean wasOpen[] = new boolean[N];
+        int starts = 0;
+        boolean wasOn = false;
+        int peakOpenings = 0, peakRise = 0;
+        int aggPrev2 = 0, aggPrev1 = 0;
+        double warmSum = 0;
+        int warmN = 0;
+        final double dt = TICK_S;
+        for(long t = 0; t < (long)DAYS * TICKS_PER_DAY; ++t)
+            {
+            final double hour = ((t * dt) / 3600.0) % 24.0;
+            final double mins = ((t * dt) / 60.0) % 1440.0;
+            final double outC = 4 - 4*Math.cos((hour - 3) * Math.PI / 12); // 0--8C, coldest around 3am.
+            // Each valve moves once a minute in proportion to how far below its target (+0.5C) its room is.
+            if(0 == (t % 30))
+                {
+                int openings = 0;
+                int agg = 0;
+                for(int i = 0; i < N; ++i)
+                    {
+                    final int slot = i;
+                    final double setbackStartM = WARM_START_M - PREPREWARM_M - slot * stepMins;
+                    final double targetC = ((mins >= WARM_START_M) && (mins < 22*60)) ? 21 :
+                        (((mins >= setbackStartM) && (mins < WARM_START_M)) ? 18 : 16);
+                    final double e = (targetC + 0.5) - room[i];
+                    pc[i] = Math.max(0, Math.min(100, (int)(e*100 + 0.5)));
+                    final boolean open = (pc[i] >= logic.minIndividualPC);
+                    if(open && !wasOpen[i]) { ++openings; }
+                    wasOpen[i] = open;
+                    agg += pc[i];
+                    }
+                if(t > TICKS_PER_DAY)
+                    {
+                    peakOpenings = Math.max(peakOpenings, openings);
+                    peakRise = Math.max(peakRise, agg - aggPrev2);
+                    if((long)mins == WARM_START_M + 15) { for(int i = 0; i < N; ++i) { warmSum += room[i]; ++warmN; } }
+                    }
+                aggPrev2 = aggPrev1;
+                aggPrev1 = agg;
+                }
+            // Each valve reports its position to the hub every 2 minutes (staggered).
+            for(int i = 0; i < N; ++i) { if(0 == ((t + 7*i) % 60)) { reported[i] = pc[i]; } }
+            logic.tick2s(reported);
+            if(logic.callForHeat && !wasOn) { ++starts; }
+            wasOn = logic.callForHeat;
+            // Physics as TPIBoilerSimTest, with a 30kW boiler and ~80kg of water for the larger system,
+            // and room heat losses from 60 to 95W/K.
+            double qTotal = 0;
+            for(int i = 0; i < N; ++i)
+                {
+                final double q = (water > rad[i]) ? (400.0 * pc[i] / 100.0 * (water - rad[i])) : 0;
+                final double e = 100.0 * (rad[i] - room[i]);
+                qTotal += q;
+                rad[i] += dt * (q - e) / 150e3;
+                room[i] += dt * (e - (60 + 5*i)*(room[i] - outC)) / 3.0e6;
+                }
+            final double boilerW = logic.callForHeat ? 30000 : 0;
+            water += dt * (boilerW - qTotal - 20*(water - outC)) / (80 * 4200.0);
+            if(water > 75) { water = 75; } // Boiler thermostat.
+            }
+        final Result r = new Result();
+        r.peakOpeningsPerMinute = peakOpenings;
+        r.peakRise2MinPC = peakRise;
+        r.startsPerDay = starts / (double)DAYS;
+        r.meanTempAtWarmC = warmSum / warmN;
+        return(r);
+        }
+
+    /**Compare no stagger with the 3-minute-per-slot stagger used by the nodes.
+     * Staggering spreads the morning valve openings so that demand on the boiler ramps up
+     * rather than jumping all at once, without delaying the rooms or adding boiler starts.
+     */
+    @Test
+    public void testStaggerAgainstNone()
+        {
+        for(final int minTicks : new int[]{ 60, 150 })
+            {
+            final Result none = simulate(0, minTicks);
+            final Result stagger = simulate(3, minTicks);
+            System.out.println("min ticks " + minTicks + ": no stagger " + none);
+            System.out.println("min ticks " + minTicks + ": stagger    " + stagger);
+            // Without stagger all valves open together.
+            assertTrue(N == none.peakOpeningsPerMinute);
+            assertTrue(stagger.peakOpeningsPerMinute <= N/2);
+            assertTrue(2 * stagger.peakRise2MinPC < none.peakRise2MinPC);
+            // Rooms are no cooler at the WARM start and the boiler starts hardly more often.
+            assertTrue(stagger.meanTempAtWarmC >= none.meanTempAtWarmC);
+            assertTrue(stagger.startsPerDay <= none.startsPerDay + 1);
+            }
+        }
+    }
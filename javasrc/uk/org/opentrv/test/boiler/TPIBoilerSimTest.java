@@ -0,0 +1,212 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): agent 2026
+*/
+
+package uk.org.opentrv.test.boiler;
+
+import static org.junit.Assert.assertTrue;
+
+import org.junit.Test;
+
+/**Benchmark of time-proportional (TPI) against plain on/off boiler control by the hub.
+ * Mirrors the OnOffBoilerDriverLogic tick2s() rules (V0p2_Actuators.cpp)
+ * driving a simple lumped model of a boiler, its water and three radiators in three rooms
+ * over a week with a daily swing in outside temperature,
+ * and reports boiler starts per day and overshoot above target.
+ * Arduino/V0p2_Main/host/TPIBoilerSim.cpp is a line-for-line C++ port to run without a JDK;
+ * keep the two in step.
+ */
+public final class TPIBoilerSimTest
+    {
+    /**Seconds per hub logic tick. */
+    private static final int TICK_S = 2;
+    /**Ticks per day. */
+    private static final int TICKS_PER_DAY = 24 * 3600 / TICK_S;
+    /**Days to simulate; the first is ignored for overshoot as the rooms warm up. */
+    private static final int DAYS = 7;
+    /**Room target temperature (C). */
+    private static final double TARGET_C = 21;
+    /**Number of radiators/rooms. */
+    private static final int N = 3;
+
+    /**Port of the boiler decision logic in OnOffBoilerDriverLogic, fed with the latest report from each valve; also used by StaggerSimTest. */
+    static final class Logic
+        {
+        final int minTicks;
+        final int minIndividualPC = 15;
+        final int minAggregatePC = 34;
+        final int tpiPeriodTicks;
+        final int tpiFullDemandPC = 100;
+        boolean callForHeat;
+        int ticksInCurrentState;
+        int tpiTick;
+        int tpiOnTicks;
+
+        Logic(final int minTicks, final int tpiPeriodTicks)
+            {
+            this.minTicks = minTicks;
+            this.tpiPeriodTicks = (0 == tpiPeriodTicks) ? 0 : Math.max(tpiPeriodTicks, 2 * minTicks);
+            }
+
+        void tick2s(final int[] percentOpen)
+            {
+            boolean atLeastOne = false;
+            int cumulativePC = 0;
+            for(final int pc : percentOpen)
+                {
+                if(pc >= minIndividualPC) { atLeastOne = true; }
+                cumulativePC += pc;
+                }
+            boolean desired = atLeastOne && (cumulativePC >= minAggregatePC);
+            if(0 != tpiPeriodTicks)
+                {
+                if(0 == tpiTick)
+                    {
+                    int on = (!atLeastOne || (cumulativePC < minAggregatePC)) ? 0 :
+                        ((cumulativePC >= tpiFullDemandPC) ? tpiPeriodTicks : (tpiPeriodTicks * cumulativePC) / tpiFullDemandPC);
+                    if(on < minTicks) { on = (on >= minTicks/2) ? Math.min(minTicks, tpiPeriodTicks) : 0; }
+                    if((0 != on) && (tpiPeriodTicks - on < minTicks)) { on = tpiPeriodTicks; }
+                    tpiOnTicks = on;
+                    }
+                if(!atLeastOne && (tpiTick < tpiOnTicks)) { tpiOnTicks = tpiTick; }
+                desired = (tpiTick < tpiOnTicks);
+                if(++tpiTick >= tpiPeriodTicks) { tpiTick = 0; }
+                }
+            if(ticksInCurrentState < 0xff) { ++ticksInCurrentState; }
+            if(desired == callForHeat) { return; }
+            if(ticksInCurrentState < minTicks) { return; }
+            callForHeat = desired;
+            ticksInCurrentState = 0;
+            }
+        }
+
+    /**Results of one simulation run. */
+    private static final class Result
+        {
+        double startsPerDay;
+        double maxOvershootC;
+        double meanOvershootC;
+        double meanTempC;
+        double duty;
+        @Override public String toString()
+            {
+            return(String.format("starts/day %.1f, max overshoot %.2fC, mean overshoot %.3fC, mean temp %.2fC, duty %.2f",
+                startsPerDay, maxOvershootC, meanOvershootC, meanTempC, duty));
+            }
+        }
+
+    /**Simulate a week with the given minimum ticks in either state and TPI period (0 for on/off). */
+    private static Result simulate(final int minTicks, final int tpiPeriodTicks)
+        {
+        final Logic logic = new Logic(minTicks, tpiPeriodTicks);
+        final double room[] = { 18, 18, 18 };
+        final double rad[] = { 20, 20, 20 };
+        double water = 20;
+        final int pc[] = new int[N];
+        final int reported[] = new int[N];
+        int starts = 0;
+        long onTicks = 0;
+        double maxOver = 0, sumOver = 0, sumT = 0;
+        long samples = 0;
+        boolean wasOn = false;
+        final double dt = TICK_S;
+        for(long t = 0; t < (long)DAYS * TICKS_PER_DAY; ++t)
+            {
+            final double hour = ((t * dt) / 3600.0) % 24.0;
+            final double outC = 4 - 4*Math.cos((hour - 3) * Math.PI / 12); // 0--8C, coldest around 3am.
+            // Each valve moves once a minute in proportion to how far below its target (+0.5C) its room is,
+            // and reports its position to the hub every 2 minutes (staggered).
+            for(int i = 0; i < N; ++i)
+                {
+                if(0 == (t % 30))
+                    {
+                    final double e = (TARGET_C + 0.5) - room[i];
+                    pc[i] = Math.max(0, Math.min(100, (int)(e*100 + 0.5)));
+                    }
+                if(0 == ((t + 20*i) % 60)) { reported[i] = pc[i]; }
+                }
+            logic.tick2s(reported);
+            if(logic.callForHeat && !wasOn) { ++starts; }
+            wasOn = logic.callForHeat;
+            if(logic.callForHeat) { ++onTicks; }
+            // Physics: 15kW boiler into ~40kg of water;
+            // flow into each radiator (~150kJ/K) in proportion to valve opening;
+            // each radiator emits 100W/K into a room of 3MJ/K losing 80W/K to outside.
+            double qTotal = 0;
+            for(int i = 0; i < N; ++i)
+                {
+                final double q = (water > rad[i]) ? (400.0 * pc[i] / 100.0 * (water - rad[i])) : 0;
+                final double e = 100.0 * (rad[i] - room[i]);
+                qTotal += q;
+                rad[i] += dt * (q - e) / 150e3;
+                room[i] += dt * (e - 80.0*(room[i] - outC)) / 3.0e6;
+                }
+            final double boilerW = logic.callForHeat ? 15000 : 0;
+            water += dt * (boilerW - qTotal - 20*(water - outC)) / (40 * 4200.0);
+            if(water > 75) { water = 75; } // Boiler thermostat.
+            if(t > TICKS_PER_DAY)
+                {
+                for(int i = 0; i < N; ++i)
+                    {
+                    final double o = room[i] - TARGET_C;
+                    sumT += room[i];
+                    if(o > maxOver) { maxOver = o; }
+                    if(o > 0) { sumOver += o; }
+                    ++samples;
+                    }
+                }
+            }
+        final Result r = new Result();
+        r.startsPerDay = starts / (double)DAYS;
+        r.maxOvershootC = maxOver;
+        r.meanOvershootC = sumOver / samples;
+        r.meanTempC = sumT / samples;
+        r.duty = onTicks / (double)((long)DAYS * TICKS_PER_DAY);
+        return(r);
+        }
+
+    /**Compare TPI at 6 cycles per hour with on/off control at a range of minimum on/off times.
+     * With a 5 minute (150 tick) minimum, as for a typical gas boiler,
+     * TPI makes fewer starts per day and overshoots less on average.
+     * With a short 2 minute (60 tick) minimum on/off control makes fewer starts,
+     * so TPI is not recommended there (see BOILER_TPI_CYCLES_PER_HOUR in V0p2_Generic_Config.h).
+     */
+    @Test
+    public void testTPIAgainstOnOff()
+        {
+        final int tpiPeriodTicks = 3600 / TICK_S / 6;
+        for(final int minTicks : new int[]{ 60, 150, 255 })
+            {
+            final Result onOff = simulate(minTicks, 0);
+            final Result tpi = simulate(minTicks, tpiPeriodTicks);
+            System.out.println("min ticks " + minTicks + ": on/off " + onOff);
+            System.out.println("min ticks " + minTicks + ": TPI    " + tpi);
+            // TPI can never start more often than once per period.
+            assertTrue(tpi.startsPerDay <= 24 * 6);
+            // Rooms stay close to target either way.
+            assertTrue(onOff.maxOvershootC < 1);
+            assertTrue(tpi.maxOvershootC < 1);
+            if(150 == minTicks)
+                {
+                assertTrue(tpi.startsPerDay < onOff.startsPerDay);
+                assertTrue(tpi.meanOvershootC < onOff.meanOvershootC);
+                }
+            else if(60 == minTicks)
+                { assertTrue(onOff.startsPerDay < tpi.startsPerDay); }
+            }
+        }
+    }